@@ -0,0 +1,96 @@
+--- kv.Engine scaling.
+-- Runs a graph of independent voice chains feeding one mix node on 1 to N
+-- threads and prints blocks per second and speedup over one thread. Each
+-- voice does a fixed amount of per-sample Lua work, so the figures show
+-- scheduling overhead against useful work.
+--
+--     lua bench/engine.lua [max threads] [voices] [seconds]
+--
+package.cpath = "build/lib/lua/?.so;"..package.cpath
+package.path  = "src/?.lua;"..package.path
+
+local Engine            = require ('kv.Engine')
+local profile           = require ('kv.profile')
+
+local max_threads       = tonumber (arg and arg[1]) or 8
+local voices            = tonumber (arg and arg[2]) or 32
+local seconds           = tonumber (arg and arg[3]) or 1.0
+local nframes           = 256
+
+local voice = [[
+    local phase, inc = 0.0, %f
+    return function (_, out)
+        for f = 1, out:length() do
+            phase = phase + inc
+            if phase >= 1.0 then phase = phase - 1.0 end
+            out:set (1, f, math.sin (phase * 6.283185307) * 0.1)
+        end
+    end
+]]
+
+local filter = [[
+    local z = 0.0
+    return function (ins, out)
+        for f = 1, out:length() do
+            z = z + 0.1 * (ins:get (1, f) - z)
+            out:set (1, f, z)
+        end
+    end
+]]
+
+local mix = [[
+    return function (ins, out)
+        for f = 1, out:length() do
+            local x = 0.0
+            for c = 1, ins:channels() do x = x + ins:get (c, f) end
+            out:set (1, f, x)
+            out:set (2, f, x)
+        end
+    end
+]]
+
+local function measure (threads)
+    local engine = Engine.new (threads)
+    local master = engine:add (mix, 2)
+    for v = 1, voices do
+        local osc = engine:add (string.format (voice, v * 0.001), 1)
+        local flt = engine:add (filter, 1)
+        engine:connect (osc, flt)
+        engine:connect (flt, master)
+    end
+    engine:prepare (nframes)
+
+    for _ = 1, 10 do engine:process (nframes) end
+    local blocks, start = 0, profile.now()
+    repeat
+        for _ = 1, 10 do engine:process (nframes) end
+        blocks = blocks + 10
+    until profile.now() - start >= seconds * 1.0e6
+    return blocks / ((profile.now() - start) * 1.0e-6)
+end
+
+-- microseconds per add() from a cold pool, then after warming
+local function instantiate (warm)
+    local engine = Engine.new (1)
+    if warm then engine:warm (filter, voices) end
+    local start = profile.now()
+    for _ = 1, voices do engine:add (filter, 1) end
+    local stats = engine:poolstats()
+    return (profile.now() - start) / voices, stats.hitrate
+end
+
+for _, warm in ipairs ({ false, true }) do
+    local us, rate = instantiate (warm)
+    print (string.format ("add %-6s %10.1f us   hit rate %.2f", warm and "warm" or "cold", us, rate))
+end
+
+print (string.format ("%d voices, %d frames per block", voices, nframes))
+print (string.format ("%8s %14s %10s", "threads", "blocks/sec", "speedup"))
+local base
+local threads = 1
+while threads <= max_threads do
+    local rate = measure (threads)
+    base = base or rate
+    print (string.format ("%8d %14.1f %9.2fx", threads, rate, rate / base))
+    threads = threads * 2
+end
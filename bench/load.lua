@@ -0,0 +1,48 @@
+--- Module load cost.
+-- Prints the time taken to load the core and GUI modules and how much they
+-- add to the resident set. Each case runs in a fresh interpreter so the
+-- shared library is really opened. RSS is read from /proc and is only
+-- available on Linux.
+--
+--     lua bench/load.lua [module...]
+--
+package.cpath = "build/lib/lua/?.so;"..package.cpath
+package.path  = "src/?.lua;"..package.path
+
+local function rss_kb()
+    local f = io.open ('/proc/self/status')
+    if not f then return nil end
+    local kb
+    for line in f:lines() do
+        kb = kb or tonumber (line:match ('^VmRSS:%s*(%d+)'))
+    end
+    f:close()
+    return kb
+end
+
+-- measure a single module in this process
+if arg[1] == '--one' then
+    local rss, start = rss_kb(), os.clock()
+    require (arg[2])
+    local ms = (os.clock() - start) * 1000.0
+    local after = rss_kb()
+    print (string.format ('%-20s %10.2f ms %10s KiB', arg[2], ms,
+        (rss and after) and tostring (after - rss) or 'n/a'))
+    return
+end
+
+local modules = #arg > 0 and arg or {
+    'kv.MidiBuffer',        -- core only
+    'kv.AudioBuffer',
+    'kv.Widget'             -- GUI module
+}
+
+local lua = arg[-1] or 'lua'
+local script = arg[0]
+print (string.format ('%-20s %13s %14s', 'module', 'load (cpu)', 'rss added'))
+for _, name in ipairs (modules) do
+    local cmd = string.format ('%q %q --one %q', lua, script, name)
+    if not os.execute (cmd) then
+        print (string.format ('%-20s failed', name))
+    end
+end
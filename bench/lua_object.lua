@@ -1,7 +1,5 @@
---- Define objects with attributes.
--- @module kv.object
--- @usage
--- local Animal = object()
+-- kv.object as it was in Lua, before the module moved to C.
+-- Kept as the baseline for bench/suite/object.lua; not installed.
 local M = {}
 
 local function lookup (T, name)
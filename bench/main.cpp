@@ -0,0 +1,402 @@
+/*
+    lkv-bench: runs benchmark cases written in Lua and prints the results
+    as JSON.
+
+        lkv-bench [-t seconds] [-r reps] [-f filter] [-o file] script.lua...
+
+    Each script returns an array of cases:
+
+        return {
+            { name = 'bytes.pack', setup = function() return state end,
+              run = function (n, state) for _ = 1, n do ... end end }
+        }
+
+    `setup` is optional and its result is passed to `run`. `run` performs n
+    operations; if it returns a number, that is used as the elapsed time in
+    nanoseconds instead of the harness's own measurement. Iterations are
+    doubled until a run takes a tenth of the target time, then scaled so
+    each timed repetition lasts the target. The median repetition is
+    reported along with the fastest.
+
+    The kv modules are linked in and preloaded, so results don't depend on
+    what is installed. A `bench` module gives scripts a clock and native
+    drivers for paths that can't be reached from Lua alone.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+#include "kv/lua/object.hpp"
+
+#ifndef LKV_VERSION
+ #define LKV_VERSION "unknown"
+#endif
+
+extern "C" {
+int luaopen_kv_AudioBuffer32 (lua_State*);
+int luaopen_kv_AudioBuffer64 (lua_State*);
+int luaopen_kv_Bounds (lua_State*);
+int luaopen_kv_Desktop (lua_State*);
+int luaopen_kv_DisplayList (lua_State*);
+int luaopen_kv_DocumentWindow (lua_State*);
+int luaopen_kv_Engine (lua_State*);
+int luaopen_kv_File (lua_State*);
+int luaopen_kv_Graphics (lua_State*);
+int luaopen_kv_MidiBuffer (lua_State*);
+int luaopen_kv_MidiClockFollower (lua_State*);
+int luaopen_kv_MidiClockGenerator (lua_State*);
+int luaopen_kv_MidiMessage (lua_State*);
+int luaopen_kv_MouseEvent (lua_State*);
+int luaopen_kv_Point (lua_State*);
+int luaopen_kv_Range (lua_State*);
+int luaopen_kv_Rectangle (lua_State*);
+int luaopen_kv_Slider (lua_State*);
+int luaopen_kv_TextButton (lua_State*);
+int luaopen_kv_VoiceAllocator (lua_State*);
+int luaopen_kv_Widget (lua_State*);
+int luaopen_kv_audio (lua_State*);
+int luaopen_kv_bytes (lua_State*);
+int luaopen_kv_dsp_Convolver (lua_State*);
+int luaopen_kv_dsp_DelayLine (lua_State*);
+int luaopen_kv_dsp_EnvelopeBank (lua_State*);
+int luaopen_kv_dsp_Expression (lua_State*);
+int luaopen_kv_dsp_FFT (lua_State*);
+int luaopen_kv_dsp_LookupTable (lua_State*);
+int luaopen_kv_dsp_OscillatorBank (lua_State*);
+int luaopen_kv_dsp_Oversampler (lua_State*);
+int luaopen_kv_dsp_Resampler (lua_State*);
+int luaopen_kv_dsp_STFT (lua_State*);
+int luaopen_kv_midi (lua_State*);
+int luaopen_kv_object (lua_State*);
+int luaopen_kv_profile (lua_State*);
+int luaopen_kv_round (lua_State*);
+int luaopen_kv_rt (lua_State*);
+int luaopen_kv_vector (lua_State*);
+}
+
+namespace {
+
+const luaL_Reg kv_modules[] = {
+    { "kv.AudioBuffer32",       luaopen_kv_AudioBuffer32 },
+    { "kv.AudioBuffer64",       luaopen_kv_AudioBuffer64 },
+    { "kv.Bounds",              luaopen_kv_Bounds },
+    { "kv.Desktop",             luaopen_kv_Desktop },
+    { "kv.DisplayList",         luaopen_kv_DisplayList },
+    { "kv.DocumentWindow",      luaopen_kv_DocumentWindow },
+    { "kv.Engine",              luaopen_kv_Engine },
+    { "kv.File",                luaopen_kv_File },
+    { "kv.Graphics",            luaopen_kv_Graphics },
+    { "kv.MidiBuffer",          luaopen_kv_MidiBuffer },
+    { "kv.MidiClockFollower",   luaopen_kv_MidiClockFollower },
+    { "kv.MidiClockGenerator",  luaopen_kv_MidiClockGenerator },
+    { "kv.MidiMessage",         luaopen_kv_MidiMessage },
+    { "kv.MouseEvent",          luaopen_kv_MouseEvent },
+    { "kv.Point",               luaopen_kv_Point },
+    { "kv.Range",               luaopen_kv_Range },
+    { "kv.Rectangle",           luaopen_kv_Rectangle },
+    { "kv.Slider",              luaopen_kv_Slider },
+    { "kv.TextButton",          luaopen_kv_TextButton },
+    { "kv.VoiceAllocator",      luaopen_kv_VoiceAllocator },
+    { "kv.Widget",              luaopen_kv_Widget },
+    { "kv.audio",               luaopen_kv_audio },
+    { "kv.bytes",               luaopen_kv_bytes },
+    { "kv.dsp.Convolver",       luaopen_kv_dsp_Convolver },
+    { "kv.dsp.DelayLine",       luaopen_kv_dsp_DelayLine },
+    { "kv.dsp.EnvelopeBank",    luaopen_kv_dsp_EnvelopeBank },
+    { "kv.dsp.Expression",      luaopen_kv_dsp_Expression },
+    { "kv.dsp.FFT",             luaopen_kv_dsp_FFT },
+    { "kv.dsp.LookupTable",     luaopen_kv_dsp_LookupTable },
+    { "kv.dsp.OscillatorBank",  luaopen_kv_dsp_OscillatorBank },
+    { "kv.dsp.Oversampler",     luaopen_kv_dsp_Oversampler },
+    { "kv.dsp.Resampler",       luaopen_kv_dsp_Resampler },
+    { "kv.dsp.STFT",            luaopen_kv_dsp_STFT },
+    { "kv.midi",                luaopen_kv_midi },
+    { "kv.object",              luaopen_kv_object },
+    { "kv.profile",             luaopen_kv_profile },
+    { "kv.round",               luaopen_kv_round },
+    { "kv.rt",                  luaopen_kv_rt },
+    { "kv.vector",              luaopen_kv_vector },
+    { NULL, NULL }
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ns (Clock::time_point start) {
+    return std::chrono::duration<double, std::nano> (Clock::now() - start).count();
+}
+
+/// Monotonic time in nanoseconds.
+int bench_now (lua_State* L) {
+    lua_pushnumber (L, std::chrono::duration<double, std::nano> (Clock::now().time_since_epoch()).count());
+    return 1;
+}
+
+/// Call a widget's paint function n times into an image.
+// Returns the elapsed nanoseconds, so it can be returned from `run`.
+int bench_paint (lua_State* L) {
+    auto* widget = kv::lua::object_userdata<juce::Component> (sol::stack::get<sol::table> (L, 1));
+    if (widget == nullptr)
+        return luaL_argerror (L, 1, "expected a kv.Widget");
+    const auto width  = static_cast<int> (luaL_optinteger (L, 2, 100));
+    const auto height = static_cast<int> (luaL_optinteger (L, 3, 100));
+    const auto count  = static_cast<int> (luaL_optinteger (L, 4, 1));
+
+    widget->setSize (width, height);
+    juce::Image image (juce::Image::ARGB, width, height, true);
+    juce::Graphics g (image);
+
+    const auto start = Clock::now();
+    for (int i = 0; i < count; ++i)
+        widget->paint (g);
+    lua_pushnumber (L, elapsed_ns (start));
+    return 1;
+}
+
+int luaopen_bench (lua_State* L) {
+    const luaL_Reg functions[] = {
+        { "now",    bench_now },
+        { "paint",  bench_paint },
+        { NULL, NULL }
+    };
+    luaL_newlib (L, functions);
+    return 1;
+}
+
+struct Options {
+    double seconds { 0.2 };
+    int reps { 5 };
+    const char* filter { nullptr };
+    const char* output { nullptr };
+    std::vector<const char*> scripts;
+};
+
+struct Result {
+    std::string file, name, error;
+    lua_Integer iterations { 0 };
+    std::vector<double> ns_per_op;      // one per repetition, sorted
+};
+
+/** Run a case once with n iterations, returning nanoseconds or < 0 on error */
+double run_case (lua_State* L, int run, int state, lua_Integer n, std::string& error) {
+    lua_gc (L, LUA_GCCOLLECT, 0);
+    lua_pushvalue (L, run);
+    lua_pushinteger (L, n);
+    lua_pushvalue (L, state);
+    const auto start = Clock::now();
+    const int status = lua_pcall (L, 2, 1, 0);
+    double ns = elapsed_ns (start);
+
+    if (status != LUA_OK) {
+        error = lua_tostring (L, -1) != nullptr ? lua_tostring (L, -1) : "error";
+        lua_pop (L, 1);
+        return -1.0;
+    }
+    if (lua_type (L, -1) == LUA_TNUMBER)
+        ns = lua_tonumber (L, -1);
+    lua_pop (L, 1);
+    return ns;
+}
+
+/** Benchmark the case table on top of the stack */
+Result measure (lua_State* L, const Options& opts, const char* file) {
+    Result result;
+    result.file = file;
+    const int item = lua_gettop (L);
+    lua_getfield (L, item, "name");
+    result.name = lua_tostring (L, -1) != nullptr ? lua_tostring (L, -1) : "?";
+    lua_getfield (L, item, "run");
+    const int run = lua_gettop (L);
+
+    lua_getfield (L, item, "setup");
+    if (lua_isfunction (L, -1) && lua_pcall (L, 0, 1, 0) != LUA_OK) {
+        result.error = lua_tostring (L, -1) != nullptr ? lua_tostring (L, -1) : "error";
+        lua_settop (L, item - 1);
+        return result;
+    }
+    const int state = lua_gettop (L);
+
+    if (! lua_isfunction (L, run)) {
+        result.error = "case has no run function";
+        lua_settop (L, item - 1);
+        return result;
+    }
+
+    const double target = opts.seconds * 1.0e9;
+    lua_Integer n = 1;
+    double ns = 0.0;
+    while ((ns = run_case (L, run, state, n, result.error)) >= 0.0 && ns < target * 0.1 && n < ((lua_Integer) 1 << 40))
+        n *= 2;
+
+    if (ns >= 0.0) {
+        n = std::max<lua_Integer> (1, (lua_Integer) ((double) n * target / std::max (ns, 1.0)));
+        result.iterations = n;
+        for (int r = 0; r < opts.reps; ++r) {
+            ns = run_case (L, run, state, n, result.error);
+            if (ns < 0.0)
+                break;
+            result.ns_per_op.push_back (ns / (double) n);
+        }
+        std::sort (result.ns_per_op.begin(), result.ns_per_op.end());
+    }
+
+    lua_settop (L, item - 1);
+    return result;
+}
+
+void append_string (std::string& json, const std::string& text) {
+    json += '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            std::snprintf (code, sizeof (code), "\\u%04x", (unsigned) (unsigned char) c);
+            json += code;
+        } else {
+            json += c;
+        }
+    }
+    json += '"';
+}
+
+std::string to_json (const std::vector<Result>& results, const Options& opts) {
+    std::string json = "{\n  \"suite\": \"lua-kv\",\n  \"version\": \"" LKV_VERSION "\",\n  \"lua\": \"" LUA_RELEASE "\",\n";
+    char line[256];
+    std::snprintf (line, sizeof (line), "  \"seconds\": %g,\n  \"reps\": %d,\n  \"results\": [", opts.seconds, opts.reps);
+    json += line;
+
+    bool first = true;
+    for (const auto& r : results) {
+        json += first ? "\n    { \"name\": " : ",\n    { \"name\": ";
+        first = false;
+        append_string (json, r.name);
+        json += ", \"file\": ";
+        append_string (json, r.file);
+
+        if (r.ns_per_op.empty()) {
+            json += ", \"error\": ";
+            append_string (json, r.error);
+            json += " }";
+            continue;
+        }
+
+        const double median = r.ns_per_op[r.ns_per_op.size() / 2];
+        std::snprintf (line, sizeof (line),
+                       ", \"iterations\": %lld, \"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, \"ops_per_sec\": %.1f }",
+                       (long long) r.iterations, median, r.ns_per_op.front(), median > 0.0 ? 1.0e9 / median : 0.0);
+        json += line;
+    }
+
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+bool parse_options (int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp (argv[i], "-t") == 0 && has_value)
+            opts.seconds = std::max (0.001, std::atof (argv[++i]));
+        else if (std::strcmp (argv[i], "-r") == 0 && has_value)
+            opts.reps = std::max (1, std::atoi (argv[++i]));
+        else if (std::strcmp (argv[i], "-f") == 0 && has_value)
+            opts.filter = argv[++i];
+        else if (std::strcmp (argv[i], "-o") == 0 && has_value)
+            opts.output = argv[++i];
+        else if (argv[i][0] == '-')
+            return false;
+        else
+            opts.scripts.push_back (argv[i]);
+    }
+    return ! opts.scripts.empty();
+}
+
+}
+
+int main (int argc, char** argv) {
+    Options opts;
+    if (! parse_options (argc, argv, opts)) {
+        std::fprintf (stderr, "usage: %s [-t seconds] [-r reps] [-f filter] [-o file] script.lua...\n", argv[0]);
+        return 2;
+    }
+
+    // widgets need a message thread
+    juce::ScopedJuceInitialiser_GUI juce_init;
+
+    lua_State* L = luaL_newstate();
+    luaL_openlibs (L);
+    luaL_getsubtable (L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    for (const luaL_Reg* m = kv_modules; m->name != nullptr; ++m) {
+        lua_pushcfunction (L, m->func);
+        lua_setfield (L, -2, m->name);
+    }
+    lua_pushcfunction (L, luaopen_bench);
+    lua_setfield (L, -2, "bench");
+    lua_pop (L, 1);
+
+    // Lua modules come from the source tree
+    lua_getglobal (L, "package");
+    lua_pushliteral (L, "src/?.lua");
+    lua_setfield (L, -2, "path");
+    lua_pop (L, 1);
+
+    std::vector<Result> results;
+    int failures = 0;
+
+    for (const char* script : opts.scripts) {
+        if (luaL_dofile (L, script) != LUA_OK || ! lua_istable (L, -1)) {
+            std::fprintf (stderr, "%s: %s\n", script, lua_isstring (L, -1) ? lua_tostring (L, -1) : "did not return a table");
+            lua_settop (L, 0);
+            ++failures;
+            continue;
+        }
+
+        const int cases = lua_gettop (L);
+        const auto ncases = (lua_Integer) lua_rawlen (L, cases);
+        for (lua_Integer i = 1; i <= ncases; ++i) {
+            lua_rawgeti (L, cases, i);
+            lua_getfield (L, -1, "name");
+            const char* name = lua_tostring (L, -1);
+            const bool wanted = opts.filter == nullptr || (name != nullptr && std::strstr (name, opts.filter) != nullptr);
+            lua_pop (L, 1);
+            if (! wanted) {
+                lua_pop (L, 1);
+                continue;
+            }
+
+            results.push_back (measure (L, opts, script));
+            const auto& r = results.back();
+            if (r.ns_per_op.empty()) {
+                std::fprintf (stderr, "%-32s error: %s\n", r.name.c_str(), r.error.c_str());
+                ++failures;
+            } else {
+                std::fprintf (stderr, "%-32s %12.1f ns/op %14.0f ops/s\n", r.name.c_str(),
+                              r.ns_per_op[r.ns_per_op.size() / 2], 1.0e9 / r.ns_per_op[r.ns_per_op.size() / 2]);
+            }
+        }
+        lua_settop (L, 0);
+    }
+
+    lua_close (L);
+
+    const auto json = to_json (results, opts);
+    if (opts.output != nullptr) {
+        if (FILE* out = std::fopen (opts.output, "w")) {
+            std::fputs (json.c_str(), out);
+            std::fclose (out);
+        } else {
+            std::fprintf (stderr, "can't write %s\n", opts.output);
+            return 1;
+        }
+    } else {
+        std::fputs (json.c_str(), stdout);
+    }
+
+    return failures > 0 ? 1 : 0;
+}
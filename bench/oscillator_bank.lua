@@ -0,0 +1,49 @@
+--- Oscillator bank throughput.
+-- Prints voices x samples per second for each mode and voice count.
+-- Compare a scalar build with a vectorized one:
+--
+--     CXXFLAGS="-O3 -fno-tree-vectorize" waf configure build
+--     lua bench/oscillator_bank.lua
+--     CXXFLAGS="-O3 -march=native" waf configure build
+--     lua bench/oscillator_bank.lua
+--
+package.cpath = "build/lib/lua/?.so;"..package.cpath
+package.path  = "src/?.lua;"..package.path
+
+local AudioBuffer       = require ('kv.AudioBuffer')
+local OscillatorBank    = require ('kv.dsp.OscillatorBank')
+
+local modes = {
+    { 'sine',       OscillatorBank.SINE },
+    { 'saw',        OscillatorBank.SAW },
+    { 'square',     OscillatorBank.SQUARE },
+    { 'wavetable',  OscillatorBank.WAVETABLE }
+}
+
+local nframes   = 512
+local seconds   = tonumber (arg and arg[1]) or 0.25
+
+local function measure (bank, buf)
+    local blocks, start = 0, os.clock()
+    repeat
+        for _ = 1, 16 do bank:render (buf, 1, 1, nframes) end
+        blocks = blocks + 16
+    until os.clock() - start >= seconds
+    return blocks * nframes * bank:size() / (os.clock() - start)
+end
+
+for _, bits in ipairs ({ 32, 64 }) do
+    local buf = bits == 32 and AudioBuffer.new32 (1, nframes) or AudioBuffer.new64 (1, nframes)
+    for _, m in ipairs (modes) do
+        for _, nvoices in ipairs ({ 1, 16, 64 }) do
+            local bank = OscillatorBank.new (nvoices, 48000)
+            bank:setmode (m[2])
+            for v = 1, nvoices do
+                bank:setfrequency (v, 55.0 * v)
+                bank:setgain (v, 1.0 / nvoices)
+            end
+            print (string.format ("%-10s %2d bit %3d voices %8.1f M voice-samples/s",
+                m[1], bits, nvoices, measure (bank, buf) / 1e6))
+        end
+    end
+end
@@ -0,0 +1,47 @@
+--- Resampler throughput.
+-- Prints channel-frames per second and realtime factor for each quality
+-- and channel count, converting 44.1 kHz to 48 kHz in 512 frame blocks.
+--
+--     lua bench/resampler.lua [seconds]
+--
+package.cpath = "build/lib/lua/?.so;"..package.cpath
+package.path  = "src/?.lua;"..package.path
+
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Resampler         = require ('kv.dsp.Resampler')
+
+local qualities = {
+    { 'lagrange',   Resampler.LAGRANGE },
+    { 'sinc',       Resampler.SINC },
+    { 'sinc_best',  Resampler.SINC_BEST }
+}
+
+local nframes   = 512
+local seconds   = tonumber (arg and arg[1]) or 0.25
+
+local function measure (rs, input, output)
+    local frames, start = 0, os.clock()
+    repeat
+        for _ = 1, 16 do
+            local used = rs:process (input, output)
+            frames = frames + used
+        end
+    until os.clock() - start >= seconds
+    return frames / (os.clock() - start)
+end
+
+for _, q in ipairs (qualities) do
+    for _, nchans in ipairs ({ 2, 8, 64 }) do
+        local rs = Resampler.new (nchans, q[2])
+        rs:setrates (44100, 48000)
+        local input  = AudioBuffer.new32 (nchans, nframes)
+        local output = AudioBuffer.new32 (nchans, nframes * 2)
+        for c = 1, nchans do
+            for f = 1, nframes do input:set (c, f, math.sin (f * 0.01 * c)) end
+        end
+
+        local rate = measure (rs, input, output)
+        print (string.format ("%-10s %3d ch %8.1f M ch-frames/s %8.1fx realtime",
+            q[1], nchans, rate * nchans / 1e6, rate / 44100))
+    end
+end
@@ -0,0 +1,53 @@
+--- Audio buffer access.
+local AudioBuffer       = require ('kv.AudioBuffer')
+
+local nframes = 512
+
+local function filled (value)
+    return function()
+        local buf = AudioBuffer.new (2, nframes)
+        for c = 1, 2 do
+            for f = 1, nframes do buf:set (c, f, value) end
+        end
+        return buf
+    end
+end
+
+local buffer = filled (0.5)
+
+-- written zeros, so repeated gains never decay into denormals
+local silent = filled (0.0)
+
+return {
+    {
+        name = 'AudioBuffer.get',
+        setup = buffer,
+        run = function (n, buf)
+            local x = 0.0
+            for i = 1, n do x = x + buf:get (1, 1 + i % nframes) end
+            return nil
+        end
+    },
+    {
+        name = 'AudioBuffer.set',
+        setup = buffer,
+        run = function (n, buf)
+            for i = 1, n do buf:set (2, 1 + i % nframes, 0.25) end
+        end
+    },
+    {
+        -- per call on a 2 x 512 buffer
+        name = 'AudioBuffer.applygain',
+        setup = silent,
+        run = function (n, buf)
+            for _ = 1, n do buf:applygain (0.999) end
+        end
+    },
+    {
+        name = 'AudioBuffer.fade',
+        setup = silent,
+        run = function (n, buf)
+            for _ = 1, n do buf:fade (1.0, 0.5) end
+        end
+    }
+}
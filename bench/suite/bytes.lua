@@ -0,0 +1,13 @@
+--- Byte packing.
+local bytes             = require ('kv.bytes')
+
+return {
+    {
+        name = 'bytes.pack',
+        run = function (n)
+            for i = 1, n do
+                local _ = bytes.pack (0x90, i & 0x7f, 100)
+            end
+        end
+    }
+}
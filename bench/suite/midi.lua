@@ -0,0 +1,56 @@
+--- MIDI buffers and messages.
+local MidiBuffer        = require ('kv.MidiBuffer')
+local MidiMessage       = require ('kv.MidiMessage')
+local midi              = require ('kv.midi')
+
+local nevents = 64
+
+local function filled()
+    local buffer = MidiBuffer.new (4096)
+    for i = 1, nevents do
+        buffer:insert (midi.noteon (1, 36 + i % 64, 100), i)
+    end
+    return buffer
+end
+
+return {
+    {
+        name = 'MidiBuffer.insert',
+        setup = function() return MidiBuffer.new (4096) end,
+        run = function (n, buffer)
+            local msg = midi.noteon (1, 60, 100)
+            for i = 1, n do
+                if i % nevents == 0 then buffer:clear() end
+                buffer:insert (msg, i % 512)
+            end
+        end
+    },
+    {
+        name = 'MidiBuffer.events',
+        setup = filled,
+        run = function (n, buffer)
+            -- one operation per event visited
+            for _ = 1, math.max (1, n // nevents) do
+                for _, _, _ in buffer:events() do end
+            end
+        end
+    },
+    {
+        name = 'MidiBuffer.messages',
+        setup = filled,
+        run = function (n, buffer)
+            for _ = 1, math.max (1, n // nevents) do
+                for _, _ in buffer:messages() do end
+            end
+        end
+    },
+    {
+        name = 'MidiMessage.new',
+        run = function (n)
+            local data = midi.noteon (1, 60, 100)
+            for _ = 1, n do
+                local _ = MidiMessage.new (data)
+            end
+        end
+    }
+}
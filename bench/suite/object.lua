@@ -0,0 +1,111 @@
+--- Object construction, field access and GUI dispatch.
+-- Cases ending in `.lua` run the same work on the old pure Lua kv.object
+-- for comparison.
+local DisplayList       = require ('kv.DisplayList')
+local Widget            = require ('kv.Widget')
+local bench             = require ('bench')
+
+local impls = {
+    { suffix = '',      object = require ('kv.object') },
+    { suffix = '.lua',  object = dofile ('bench/lua_object.lua') }
+}
+
+local cases = {}
+
+for _, impl in ipairs (impls) do
+    local object = impl.object
+
+    local Plain = object ({
+        size = {
+            get = function (self) return rawget (self, '_size') or 0 end,
+            set = function (self, v) rawset (self, '_size', v) end
+        }
+    })
+
+    function Plain:area() return 1 end
+
+    local Knob = object (Widget)
+
+    function Knob:init()
+        Widget.init (self)
+    end
+
+    function Knob:paint (g)
+        g:fillall()
+    end
+
+    -- paints the same with a display list and no Lua
+    local Static = object (Widget)
+
+    local function add (name, case)
+        case.name = name .. impl.suffix
+        cases[#cases + 1] = case
+    end
+
+    add ('object.new', {
+        run = function (n)
+            for _ = 1, n do
+                local _ = object.new (Plain)
+            end
+        end
+    })
+
+    add ('object.attribute', {
+        setup = function() return object.new (Plain) end,
+        run = function (n, obj)
+            for _ = 1, n do
+                local _ = obj.size
+            end
+        end
+    })
+
+    add ('object.method', {
+        setup = function() return object.new (Plain) end,
+        run = function (n, obj)
+            for _ = 1, n do
+                local _ = obj:area()
+            end
+        end
+    })
+
+    -- a proxy around a new Widget userdata
+    add ('object.new.Widget', {
+        run = function (n)
+            for _ = 1, n do
+                local _ = object.new (Knob)
+            end
+        end
+    })
+
+    -- a userdata method through the proxy
+    add ('object.Widget.method', {
+        setup = function() return object.new (Knob) end,
+        run = function (n, knob)
+            for _ = 1, n do
+                local _ = knob:right()
+            end
+        end
+    })
+
+    add ('Widget.paint', {
+        setup = function() return object.new (Knob) end,
+        run = function (n, knob)
+            return bench.paint (knob, 64, 64, n)
+        end
+    })
+
+    add ('Widget.paint.displaylist', {
+        setup = function()
+            local list = DisplayList.new()
+            list:fillall()
+            local static = object.new (Static)
+            static.displaylist = list
+            return static
+        end,
+        run = function (n, static)
+            return bench.paint (static, 64, 64, n)
+        end
+    })
+end
+
+return cases
@@ -7,13 +7,74 @@
 namespace kv {
 namespace lua {
 
+/** Returns the metatable name used for a buffer of sample type T */
+template<typename T> inline const char* audio_buffer_metatable();
+template<> inline const char* audio_buffer_metatable<float>()       { return LKV_MT_AUDIO_BUFFER_32; }
+template<> inline const char* audio_buffer_metatable<double>()      { return LKV_MT_AUDIO_BUFFER_64; }
+
 template<typename T>
-inline juce::AudioBuffer<T>* 
+inline juce::AudioBuffer<T>*
 create_audio_buffer (lua_State* L, int nchans, int nframes) {
-    auto** userdata = lua_newuserdata (L, sizeof (juce::AudioBuffer<T>**));
+    auto** userdata = (juce::AudioBuffer<T>**) lua_newuserdata (L, sizeof (juce::AudioBuffer<T>**));
     *userdata = new juce::AudioBuffer<T> (juce::jmax (0, nchans), juce::jmax (0, nframes));
-    luaL_setmetatable (L, LKV_MT_AUDIO_BUFFER);
+    luaL_setmetatable (L, audio_buffer_metatable<T>());
     return *userdata;
 }
 
+/** Returns the buffer at `idx` if it is of sample type T, or nullptr */
+template<typename T>
+inline juce::AudioBuffer<T>* test_audio_buffer (lua_State* L, int idx) {
+    auto** userdata = (juce::AudioBuffer<T>**) luaL_testudata (L, idx, audio_buffer_metatable<T>());
+    return userdata != nullptr ? *userdata : nullptr;
+}
+
+/** Calls `fn` with the 32 or 64 bit buffer at `idx`.
+    DSP objects use this so one kernel template serves both buffer types.
+    @returns false if the value is not an audio buffer
+*/
+template<typename Fn>
+inline bool visit_audio_buffer (lua_State* L, int idx, Fn&& fn) {
+    if (auto* b32 = test_audio_buffer<float> (L, idx)) {
+        fn (*b32);
+        return true;
+    }
+    if (auto* b64 = test_audio_buffer<double> (L, idx)) {
+        fn (*b64);
+        return true;
+    }
+    return false;
+}
+
+/** Range of samples on a buffer given as Lua arguments.
+    Reads optional 1-based `channel`, `start` and `count` arguments beginning
+    at `idx` and clips them to the buffer. A channel out of range gives an
+    empty range.
+*/
+struct AudioRange {
+    int channel { 0 };
+    int start   { 0 };
+    int count   { 0 };
+
+    template<typename T>
+    static AudioRange read (lua_State* L, int idx, const juce::AudioBuffer<T>& buffer) {
+        auto r = read_frames (L, idx + 1, buffer);
+        r.channel = lua_isinteger (L, idx) ? (int) lua_tointeger (L, idx) - 1 : 0;
+        if (! juce::isPositiveAndBelow (r.channel, buffer.getNumChannels()))
+            r.count = 0;
+        return r;
+    }
+
+    /** Same as `read` without a channel argument */
+    template<typename T>
+    static AudioRange read_frames (lua_State* L, int idx, const juce::AudioBuffer<T>& buffer) {
+        AudioRange r;
+        r.start   = lua_isinteger (L, idx) ? (int) lua_tointeger (L, idx) - 1 : 0;
+        r.start   = juce::jlimit (0, buffer.getNumSamples(), r.start);
+        r.count   = lua_isinteger (L, idx + 1) ? (int) lua_tointeger (L, idx + 1)
+                                               : buffer.getNumSamples() - r.start;
+        r.count   = juce::jlimit (0, buffer.getNumSamples() - r.start, r.count);
+        return r;
+    }
+};
+
 }}
@@ -0,0 +1,445 @@
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** Uniformly partitioned overlap-save convolution.
+    Convolves blocks of `P` samples with an impulse response split into
+    partitions of `P` taps, using FFTs of size 2P and a frequency domain
+    delay line. Output of each call is the block just given, convolved.
+*/
+class PartitionedConvolution final {
+public:
+    PartitionedConvolution (int partitionSize, const float* ir, int length)
+        : fft (fft_order (partitionSize)),
+          block (fft.getSize() / 2),
+          bins (block + 1),
+          num_parts (juce::jmax (1, (length + block - 1) / block))
+    {
+        spectra.allocate ((size_t) (num_parts * bins * 2), true);
+        fdl.allocate ((size_t) (num_parts * bins * 2), true);
+        history.allocate ((size_t) block * 2, true);
+        work.allocate ((size_t) block * 4, true);
+        acc.allocate ((size_t) bins * 2, true);
+
+        for (int k = 0; k < num_parts; ++k) {
+            work.clear ((size_t) block * 4);
+            const int n = juce::jlimit (0, block, length - k * block);
+            std::copy (ir + k * block, ir + k * block + n, work.get());
+            fft.performRealOnlyForwardTransform (work.get(), true);
+            std::copy (work.get(), work.get() + bins * 2, spectra.get() + k * bins * 2);
+        }
+    }
+
+    int get_block_size() const noexcept { return block; }
+
+    void reset() noexcept {
+        fdl.clear ((size_t) (num_parts * bins * 2));
+        history.clear ((size_t) block * 2);
+        slot = 0;
+    }
+
+    /** Convolve `get_block_size()` new samples into `out` */
+    void process (const float* in, float* out) noexcept {
+        float* h = history.get();
+        std::copy (h + block, h + block * 2, h);
+        std::copy (in, in + block, h + block);
+
+        float* w = work.get();
+        std::copy (h, h + block * 2, w);
+        std::fill (w + block * 2, w + block * 4, 0.0f);
+        fft.performRealOnlyForwardTransform (w, true);
+        std::copy (w, w + bins * 2, fdl.get() + slot * bins * 2);
+
+        float* a = acc.get();
+        std::fill (a, a + bins * 2, 0.0f);
+        for (int k = 0; k < num_parts; ++k) {
+            const float* x = fdl.get() + ((slot - k + num_parts) % num_parts) * bins * 2;
+            const float* y = spectra.get() + k * bins * 2;
+            for (int b = 0; b < bins * 2; b += 2) {
+                a[b]     += x[b] * y[b] - x[b + 1] * y[b + 1];
+                a[b + 1] += x[b] * y[b + 1] + x[b + 1] * y[b];
+            }
+        }
+        slot = (slot + 1) % num_parts;
+
+        std::copy (a, a + bins * 2, w);
+        std::fill (w + bins * 2, w + block * 4, 0.0f);
+        fft.performRealOnlyInverseTransform (w);
+        std::copy (w + block, w + block * 2, out);
+    }
+
+private:
+    juce::dsp::FFT fft;
+    int block, bins, num_parts;
+
+    /** Order of an FFT twice the partition size */
+    static int fft_order (int partitionSize) noexcept {
+        int order = 1;
+        while ((1 << order) < partitionSize * 2)
+            ++order;
+        return order;
+    }
+
+    int slot { 0 };
+    juce::HeapBlock<float> spectra, fdl, history, work, acc;
+};
+
+//==============================================================================
+/** Background threads that run convolution tail partitions.
+    One set of workers is shared by every convolver alive, sized to the
+    machine, so many long impulse responses spread over all cores.
+*/
+class ConvolutionWorkers final {
+public:
+    /** A unit of tail work */
+    struct Job {
+        virtual ~Job() = default;
+        virtual void run() noexcept = 0;
+        std::atomic<bool> done { true };
+    };
+
+    ConvolutionWorkers() {
+        init_cells();
+        const int n = juce::jmax (1, (int) std::thread::hardware_concurrency() - 1);
+        for (int i = 0; i < n; ++i)
+            threads.emplace_back ([this] { thread_loop(); });
+    }
+
+    ~ConvolutionWorkers() {
+        {
+            std::lock_guard<std::mutex> sl (lock);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    /** Returns the shared workers, starting them if needed */
+    static std::shared_ptr<ConvolutionWorkers> get() {
+        static std::mutex mutex;
+        static std::weak_ptr<ConvolutionWorkers> shared;
+        std::lock_guard<std::mutex> sl (mutex);
+        auto workers = shared.lock();
+        if (workers == nullptr) {
+            workers = std::make_shared<ConvolutionWorkers>();
+            shared = workers;
+        }
+        return workers;
+    }
+
+    int get_num_threads() const noexcept { return (int) threads.size(); }
+
+    /** Queue a job. Lock free and does not allocate. If the queue is full
+        the job runs on the calling thread instead.
+    */
+    void submit (Job& job) noexcept {
+        job.done.store (false, std::memory_order_relaxed);
+        if (! push (&job)) {
+            finish (&job);
+            return;
+        }
+        // only wake a worker that is asleep
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        if (sleeping.load (std::memory_order_relaxed) > 0)
+            wake.notify_one();
+    }
+
+    /** Block until a job has finished, running queued jobs meanwhile.
+        A wake up missed by the workers then only moves the work to the
+        caller instead of stalling it.
+    */
+    void wait (Job& job) noexcept {
+        while (! job.done.load (std::memory_order_acquire)) {
+            if (Job* next = pop())
+                finish (next);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    enum { max_jobs = 1024, mask = max_jobs - 1 };
+
+    /** A bounded multi producer, multi consumer queue slot. Its sequence
+        says whether it is free for the push at that position or holds the
+        job for the pop at that position.
+    */
+    struct Cell {
+        std::atomic<juce::uint64> sequence { 0 };
+        Job* job { nullptr };
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool running { true };
+    std::atomic<int> sleeping { 0 };
+    Cell cells[max_jobs];
+    alignas (64) std::atomic<juce::uint64> push_pos { 0 };
+    alignas (64) std::atomic<juce::uint64> pop_pos { 0 };
+
+    void init_cells() noexcept {
+        for (int i = 0; i < max_jobs; ++i)
+            cells[i].sequence.store ((juce::uint64) i, std::memory_order_relaxed);
+    }
+
+    bool push (Job* job) noexcept {
+        auto pos = push_pos.load (std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells[pos & mask];
+            const auto diff = (juce::int64) (cell.sequence.load (std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (push_pos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.job = job;
+                    cell.sequence.store (pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;       // full
+            } else {
+                pos = push_pos.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Job* pop() noexcept {
+        auto pos = pop_pos.load (std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells[pos & mask];
+            const auto diff = (juce::int64) (cell.sequence.load (std::memory_order_acquire) - (pos + 1));
+            if (diff == 0) {
+                if (pop_pos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed)) {
+                    Job* job = cell.job;
+                    cell.sequence.store (pos + max_jobs, std::memory_order_release);
+                    return job;
+                }
+            } else if (diff < 0) {
+                return nullptr;     // empty
+            } else {
+                pos = pop_pos.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool has_jobs() const noexcept {
+        const auto pos = pop_pos.load (std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load (std::memory_order_acquire) == pos + 1;
+    }
+
+    static void finish (Job* job) noexcept {
+        job->run();
+        job->done.store (true, std::memory_order_release);
+    }
+
+    void thread_loop() {
+        for (;;) {
+            if (Job* job = pop()) {
+                finish (job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> sl (lock);
+            sleeping.fetch_add (1, std::memory_order_seq_cst);
+            wake.wait (sl, [this] { return ! running || has_jobs(); });
+            sleeping.fetch_sub (1, std::memory_order_relaxed);
+            if (! running)
+                return;
+        }
+    }
+};
+
+//==============================================================================
+/** Zero latency convolution of one channel with a non-uniform partition.
+
+    The first `H` taps are a direct form FIR. Taps up to `2L` use FFT
+    partitions of `H` on the calling thread, and the rest use partitions of
+    `L = 16H` on the shared workers. A tail block is handed off every `L`
+    samples and must be done `L` samples later, when its output is due.
+*/
+class ChannelConvolver final : private ConvolutionWorkers::Job {
+public:
+    ChannelConvolver (const float* ir, int length, int headSize,
+                      std::shared_ptr<ConvolutionWorkers> w)
+        : workers (std::move (w)),
+          head_size (juce::nextPowerOfTwo (juce::jmax (8, headSize))),
+          tail_size (head_size * 16)
+    {
+        head.allocate ((size_t) head_size, true);
+        const int nhead = juce::jlimit (0, head_size, length);
+        for (int i = 0; i < nhead; ++i)
+            head[head_size - 1 - i] = ir[i];   // reversed for a forward dot product
+
+        fir.allocate ((size_t) head_size * 2, true);
+        block_in.allocate ((size_t) head_size, true);
+        block_out.allocate ((size_t) head_size, true);
+
+        if (length > head_size) {
+            const int end = juce::jmin (length, tail_size * 2);
+            body.reset (new PartitionedConvolution (head_size, ir + head_size, end - head_size));
+        }
+
+        if (length > tail_size * 2) {
+            tail.reset (new PartitionedConvolution (tail_size, ir + tail_size * 2, length - tail_size * 2));
+            tail_in.allocate ((size_t) tail_size, true);
+            tail_out.allocate ((size_t) tail_size, true);
+            tail_collect.allocate ((size_t) tail_size, true);
+        }
+
+        ring_size = juce::nextPowerOfTwo (tail_size * 2);
+        ring_mask = ring_size - 1;
+        ring.allocate ((size_t) ring_size, true);
+    }
+
+    ~ChannelConvolver() {
+        workers->wait (*this);
+    }
+
+    int get_head_size() const noexcept { return head_size; }
+    int get_tail_size() const noexcept { return tail != nullptr ? tail_size : 0; }
+
+    void reset() noexcept {
+        workers->wait (*this);
+        fir.clear ((size_t) head_size * 2);
+        ring.clear ((size_t) ring_size);
+        if (body) body->reset();
+        if (tail) tail->reset();
+        head_fill = tail_fill = 0;
+        now = 0;
+        pending = false;
+    }
+
+    /** Convolve `n` samples in place */
+    template<typename T>
+    void process (T* io, int n) noexcept {
+        int done = 0;
+        while (done < n) {
+            const int chunk = juce::jmin (n - done, head_size - head_fill);
+            run_chunk (io + done, chunk);
+            done += chunk;
+        }
+    }
+
+private:
+    std::shared_ptr<ConvolutionWorkers> workers;
+    int head_size, tail_size;
+    int head_fill { 0 }, tail_fill { 0 };
+    int ring_size { 0 }, ring_mask { 0 };
+    juce::uint32 now { 0 };
+    bool pending { false };
+    juce::HeapBlock<float> head, fir, block_in, block_out, ring;
+    juce::HeapBlock<float> tail_in, tail_out, tail_collect;
+    std::unique_ptr<PartitionedConvolution> body, tail;
+
+    void run() noexcept override {
+        tail->process (tail_in.get(), tail_out.get());
+    }
+
+    void add_to_ring (const float* src, int n) noexcept {
+        for (int i = 0; i < n; ++i)
+            ring[(now + (juce::uint32) i) & (juce::uint32) ring_mask] += src[i];
+    }
+
+    template<typename T>
+    void run_chunk (T* io, int n) noexcept {
+        // direct form head over the previous H - 1 inputs and this chunk
+        float* x = fir.get() + head_size - 1;
+        for (int i = 0; i < n; ++i) {
+            x[head_fill + i] = static_cast<float> (io[i]);
+            block_in[head_fill + i] = x[head_fill + i];
+            if (tail)
+                tail_collect[tail_fill + i] = x[head_fill + i];
+        }
+
+        const float* h = head.get();
+        for (int i = 0; i < n; ++i) {
+            const float* xi = x + head_fill + i - (head_size - 1);
+            float sum = 0.0f;
+            for (int k = 0; k < head_size; ++k)
+                sum += h[k] * xi[k];
+
+            auto& r = ring[(now + (juce::uint32) i) & (juce::uint32) ring_mask];
+            io[i] = static_cast<T> (sum + r);
+            r = 0.0f;
+        }
+
+        now += (juce::uint32) n;
+        head_fill += n;
+        tail_fill += n;
+
+        if (head_fill == head_size) {
+            float* f = fir.get();
+            std::copy (f + head_size, f + head_size * 2 - 1, f);
+            if (body) {
+                body->process (block_in.get(), block_out.get());
+                add_to_ring (block_out.get(), head_size);
+            }
+            head_fill = 0;
+        }
+
+        if (tail && tail_fill == tail_size) {
+            if (pending) {
+                workers->wait (*this);
+                add_to_ring (tail_out.get(), tail_size);
+            }
+            std::copy (tail_collect.get(), tail_collect.get() + tail_size, tail_in.get());
+            workers->submit (*this);
+            pending = true;
+            tail_fill = 0;
+        }
+    }
+};
+
+//==============================================================================
+/** Multichannel zero latency convolution with an impulse response */
+class Convolver final {
+public:
+    Convolver (const juce::AudioBuffer<float>& ir, int numChannels, int headSize = 64)
+        : workers (ConvolutionWorkers::get()),
+          length (ir.getNumSamples())
+    {
+        jassert (ir.getNumChannels() > 0);
+        numChannels = juce::jmax (1, numChannels);
+        for (int c = 0; c < numChannels; ++c) {
+            const int src = juce::jmin (c, ir.getNumChannels() - 1);
+            channels.emplace_back (new ChannelConvolver (ir.getReadPointer (src), length,
+                                                         headSize, workers));
+        }
+    }
+
+    int get_num_channels() const noexcept   { return (int) channels.size(); }
+    int get_length() const noexcept         { return length; }
+    int get_head_size() const noexcept      { return channels.front()->get_head_size(); }
+    int get_tail_size() const noexcept      { return channels.front()->get_tail_size(); }
+
+    void reset() noexcept {
+        for (auto& c : channels)
+            c->reset();
+    }
+
+    /** Convolve one channel in place */
+    template<typename T>
+    void process (int channel, T* io, int n) noexcept {
+        if (juce::isPositiveAndBelow (channel, get_num_channels()))
+            channels[(size_t) channel]->process (io, n);
+    }
+
+private:
+    std::shared_ptr<ConvolutionWorkers> workers;
+    int length;
+    std::vector<std::unique_ptr<ChannelConvolver>> channels;
+};
+
+}}
@@ -0,0 +1,176 @@
+
+#pragma once
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** A multichannel circular buffer with fractional delay reads.
+
+    Capacity is rounded up to a power of two so positions wrap with a mask.
+    Reads are aligned with the most recently written block: reading frame
+    `f` with delay `d` gives the input from `d` frames before frame `f` of
+    that block, where frames are numbered as they were in the written buffer.
+*/
+class DelayLine final {
+public:
+    enum Interpolation {
+        None        = 0,
+        Linear      = 1,
+        Allpass     = 2,
+        Cubic       = 3
+    };
+
+    DelayLine (int numChannels, int maxDelay, int maxBlock = 4096)
+        : num_channels (juce::jmax (1, numChannels)),
+          max_delay (juce::jmax (1, maxDelay)),
+          max_block (juce::jmax (1, maxBlock))
+    {
+        capacity = juce::nextPowerOfTwo (max_delay + max_block + 4);
+        mask = (juce::uint32) capacity - 1;
+        data.allocate ((size_t) (capacity * num_channels), true);
+        state.allocate ((size_t) num_channels, true);
+    }
+
+    ~DelayLine() = default;
+
+    int get_num_channels() const noexcept   { return num_channels; }
+    int get_max_delay() const noexcept      { return max_delay; }
+    int get_max_block() const noexcept      { return max_block; }
+    int get_capacity() const noexcept       { return capacity; }
+
+    void set_interpolation (int mode) noexcept {
+        interpolation = juce::jlimit ((int) None, (int) Cubic, mode);
+        state.clear ((size_t) num_channels);
+    }
+
+    int get_interpolation() const noexcept { return interpolation; }
+
+    /** Zero the buffer and the interpolator state */
+    void clear() noexcept {
+        data.clear ((size_t) (capacity * num_channels));
+        state.clear ((size_t) num_channels);
+    }
+
+    /** Write `n` frames to a channel, does not advance the head.
+        At most the block size given when created is written, since a
+        longer block would overwrite the history delays read from.
+    */
+    template<typename T>
+    void write (int channel, const T* in, int n) noexcept {
+        n = juce::jmin (n, max_block);
+        double* buf = channel_data (channel);
+        for (int i = 0; i < n; ++i)
+            buf[(head + (juce::uint32) i) & mask] = static_cast<double> (in[i]);
+    }
+
+    /** Move the write head forward after writing a block to every channel.
+        @param n        Number of frames written
+        @param frame    Frame index the block started at in its buffer
+    */
+    void advance (int n, int frame = 0) noexcept {
+        block_begin = head;
+        block_frame = frame;
+        head += (juce::uint32) juce::jmin (n, max_block);
+    }
+
+    /** Read `n` frames starting at block frame `frame` with a fixed delay.
+        Allpass reads keep one filter state per channel, so make a single
+        allpass read per channel per block.
+    */
+    template<typename T>
+    LKV_TARGET_CLONES
+    void read (int channel, T* out, int frame, int n, double delay) noexcept {
+        delay = juce::jlimit (0.0, (double) max_delay, delay);
+        auto fn = [delay] (int) { return delay; };
+        switch (interpolation) {
+            case Linear:    read_block<Linear> (channel, out, frame, n, fn); break;
+            case Allpass:   read_block<Allpass> (channel, out, frame, n, fn); break;
+            case Cubic:     read_block<Cubic> (channel, out, frame, n, fn); break;
+            default:        read_block<None> (channel, out, frame, n, fn); break;
+        }
+    }
+
+    /** Read `n` frames starting at block frame `frame` with a delay per frame */
+    template<typename T, typename D>
+    LKV_TARGET_CLONES
+    void read (int channel, T* out, int frame, int n, const D* delays) noexcept {
+        const double md = (double) max_delay;
+        auto fn = [delays, md] (int k) { return juce::jlimit (0.0, md, (double) delays[k]); };
+        switch (interpolation) {
+            case Linear:    read_block<Linear> (channel, out, frame, n, fn); break;
+            case Allpass:   read_block<Allpass> (channel, out, frame, n, fn); break;
+            case Cubic:     read_block<Cubic> (channel, out, frame, n, fn); break;
+            default:        read_block<None> (channel, out, frame, n, fn); break;
+        }
+    }
+
+private:
+    int num_channels;
+    int max_delay;
+    int max_block;
+    int capacity { 0 };
+    juce::uint32 mask { 0 };
+    juce::uint32 head { 0 };
+    juce::uint32 block_begin { 0 };
+    int block_frame { 0 };
+    int interpolation { Linear };
+    juce::HeapBlock<double> data;
+    juce::HeapBlock<double> state;
+
+    double* channel_data (int channel) const noexcept {
+        return data.get() + (size_t) (juce::jlimit (0, num_channels - 1, channel) * capacity);
+    }
+
+    template<int Mode, typename T, typename Fn>
+    void read_block (int channel, T* out, int frame, int n, Fn&& delay_for) noexcept {
+        const double* buf = channel_data (channel);
+        double& v = state[juce::jlimit (0, num_channels - 1, channel)];
+        const juce::uint32 base = block_begin + (juce::uint32) (frame - block_frame);
+
+        for (int k = 0; k < n; ++k) {
+            // the cubic's newest neighbour is one frame after the read
+            // position, which isn't written yet below a delay of one
+            const double d = Mode == Cubic ? juce::jmax (1.0, delay_for (k)) : delay_for (k);
+            int di = (int) d;
+            double frac = d - (double) di;
+            const juce::uint32 pos = base + (juce::uint32) k;
+
+            if (Mode == None) {
+                out[k] = static_cast<T> (buf[(pos - (juce::uint32) juce::roundToInt (d)) & mask]);
+            } else if (Mode == Linear) {
+                const double a = buf[(pos - (juce::uint32) di) & mask];
+                const double b = buf[(pos - (juce::uint32) di - 1u) & mask];
+                out[k] = static_cast<T> (a + frac * (b - a));
+            } else if (Mode == Allpass) {
+                // keep the allpass coefficient away from the unstable region
+                if (frac < 0.618 && di >= 1) {
+                    --di;
+                    frac += 1.0;
+                }
+                const double alpha = (1.0 - frac) / (1.0 + frac);
+                const double a = buf[(pos - (juce::uint32) di) & mask];
+                const double b = buf[(pos - (juce::uint32) di - 1u) & mask];
+                v = frac == 0.0 ? a : b + alpha * (a - v);
+                out[k] = static_cast<T> (v);
+            } else {
+                // third order Lagrange through four neighbours
+                const juce::uint32 p = pos - (juce::uint32) di;
+                const double x0 = buf[(p + 1u) & mask];
+                const double x1 = buf[p & mask];
+                const double x2 = buf[(p - 1u) & mask];
+                const double x3 = buf[(p - 2u) & mask];
+                const double d1 = frac - 1.0, d2 = frac - 2.0, d0 = frac + 1.0;
+                const double c0 = -frac * d1 * d2 / 6.0;
+                const double c1 = d0 * d1 * d2 / 2.0;
+                const double c2 = -d0 * frac * d2 / 2.0;
+                const double c3 = d0 * frac * d1 / 6.0;
+                out[k] = static_cast<T> (c0 * x0 + c1 * x1 + c2 * x2 + c3 * x3);
+            }
+        }
+    }
+};
+
+}}
@@ -0,0 +1,189 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** Drawing operations recorded once and replayed into a juce::Graphics.
+
+    Shapes, paths, text, images and transforms are stored natively, so
+    replaying a list runs no Lua. Every change sends a change message,
+    which widgets showing the list use to repaint.
+*/
+class DisplayList final : public juce::ChangeBroadcaster {
+public:
+    DisplayList() = default;
+    ~DisplayList() { removeAllChangeListeners(); }
+
+    /** Replay every operation into `g`.
+
+        Saves and restores recorded in the list are matched against each
+        other only: a restore without a save is ignored and saves left open
+        are restored, so `g` ends in the state it started in.
+    */
+    void draw (juce::Graphics& g) {
+        juce::Graphics::ScopedSaveState state (g);
+        int depth = 0;
+        for (const auto& op : ops) {
+            const auto* v = op.values;
+            switch (op.kind) {
+                case Kind::save:
+                    g.saveState();
+                    ++depth;
+                    break;
+                case Kind::restore:
+                    if (depth > 0) {
+                        g.restoreState();
+                        --depth;
+                    }
+                    break;
+                case Kind::colour:          g.setColour (juce::Colour ((juce::uint32) op.index)); break;
+                case Kind::font:            g.setFont (v[0]); break;
+                case Kind::fill_all:        g.fillAll(); break;
+                case Kind::fill_colour:     g.fillAll (juce::Colour ((juce::uint32) op.index)); break;
+                case Kind::fill_rect:       g.fillRect (v[0], v[1], v[2], v[3]); break;
+                case Kind::draw_rect:       g.drawRect (v[0], v[1], v[2], v[3], v[4]); break;
+                case Kind::fill_rounded:    g.fillRoundedRectangle (v[0], v[1], v[2], v[3], v[4]); break;
+                case Kind::draw_rounded:    g.drawRoundedRectangle (v[0], v[1], v[2], v[3], v[4], v[5]); break;
+                case Kind::fill_ellipse:    g.fillEllipse (v[0], v[1], v[2], v[3]); break;
+                case Kind::draw_ellipse:    g.drawEllipse (v[0], v[1], v[2], v[3], v[4]); break;
+                case Kind::line:            g.drawLine (v[0], v[1], v[2], v[3], v[4]); break;
+                case Kind::fill_path:       g.fillPath (paths[(size_t) op.index]); break;
+                case Kind::stroke_path:
+                    g.strokePath (paths[(size_t) op.index], juce::PathStrokeType (v[0]));
+                    break;
+                case Kind::text:
+                    g.drawText (texts[op.index], juce::Rectangle<float> (v[0], v[1], v[2], v[3]),
+                                juce::Justification ((int) v[4]), true);
+                    break;
+                case Kind::image:
+                    g.drawImage (images.getReference (op.index), juce::Rectangle<float> (v[0], v[1], v[2], v[3]));
+                    break;
+                case Kind::transform:
+                    g.addTransform (juce::AffineTransform (v[0], v[1], v[2], v[3], v[4], v[5]));
+                    break;
+            }
+        }
+        for (; depth > 0; --depth)
+            g.restoreState();
+    }
+
+    /** Remove every operation. */
+    void clear() {
+        ops.clear();
+        paths.clear();
+        texts.clear();
+        images.clear();
+        path.clear();
+        changed();
+    }
+
+    /** Number of operations recorded. */
+    int size() const noexcept { return (int) ops.size(); }
+
+    void save_state()                   { add (Kind::save); }
+    void restore_state()                { add (Kind::restore); }
+    void set_colour (juce::uint32 argb) { add (Kind::colour, {}, (int) argb); }
+    void set_font (float height)        { add (Kind::font, { height }); }
+    void fill_all()                     { add (Kind::fill_all); }
+
+    void fill_all (juce::uint32 argb)   { add (Kind::fill_colour, {}, (int) argb); }
+
+    void fill_rect (float x, float y, float w, float h) {
+        add (Kind::fill_rect, { x, y, w, h });
+    }
+
+    void draw_rect (float x, float y, float w, float h, float thickness) {
+        add (Kind::draw_rect, { x, y, w, h, thickness });
+    }
+
+    void fill_rounded (float x, float y, float w, float h, float corner) {
+        add (Kind::fill_rounded, { x, y, w, h, corner });
+    }
+
+    void draw_rounded (float x, float y, float w, float h, float corner, float thickness) {
+        add (Kind::draw_rounded, { x, y, w, h, corner, thickness });
+    }
+
+    void fill_ellipse (float x, float y, float w, float h) {
+        add (Kind::fill_ellipse, { x, y, w, h });
+    }
+
+    void draw_ellipse (float x, float y, float w, float h, float thickness) {
+        add (Kind::draw_ellipse, { x, y, w, h, thickness });
+    }
+
+    void draw_line (float x1, float y1, float x2, float y2, float thickness) {
+        add (Kind::line, { x1, y1, x2, y2, thickness });
+    }
+
+    void draw_text (const juce::String& text, float x, float y, float w, float h, int justification) {
+        texts.add (text);
+        add (Kind::text, { x, y, w, h, (float) justification }, texts.size() - 1);
+    }
+
+    void draw_image (const juce::Image& image, float x, float y, float w, float h) {
+        images.add (image);
+        add (Kind::image, { x, y, w, h }, images.size() - 1);
+    }
+
+    void add_transform (const juce::AffineTransform& t) {
+        add (Kind::transform, { t.mat00, t.mat01, t.mat02, t.mat10, t.mat11, t.mat12 });
+    }
+
+    /** The path being built, used by fill_path() and stroke_path(). */
+    juce::Path& get_path() noexcept { return path; }
+
+    /** Record filling the path being built and start a new one. */
+    void fill_path()                    { add_path (Kind::fill_path, 0.f); }
+
+    /** Record stroking the path being built and start a new one. */
+    void stroke_path (float thickness)  { add_path (Kind::stroke_path, thickness); }
+
+private:
+    enum class Kind : uint8_t {
+        save, restore, colour, font, fill_all, fill_colour,
+        fill_rect, draw_rect, fill_rounded, draw_rounded,
+        fill_ellipse, draw_ellipse, line,
+        fill_path, stroke_path, text, image, transform
+    };
+
+    struct Op {
+        Kind kind;
+        int index;
+        float values[6];
+    };
+
+    std::vector<Op> ops;
+    std::vector<juce::Path> paths;
+    juce::StringArray texts;
+    juce::Array<juce::Image> images;
+    juce::Path path;
+
+    void add (Kind kind, std::initializer_list<float> values = {}, int index = 0) {
+        Op op { kind, index, {} };
+        std::copy (values.begin(), values.end(), op.values);
+        ops.push_back (op);
+        changed();
+    }
+
+    void add_path (Kind kind, float thickness) {
+        paths.push_back (path);
+        path.clear();
+        add (kind, { thickness }, (int) paths.size() - 1);
+    }
+
+    void changed() { sendChangeMessage(); }
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (DisplayList)
+};
+
+}}
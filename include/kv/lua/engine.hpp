@@ -0,0 +1,533 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/midi_buffer.hpp"
+#include "kv/lua/state_pool.hpp"
+
+extern "C" {
+#include <lualib.h>
+}
+
+namespace kv {
+namespace lua {
+
+/** Fixed size work stealing deque.
+    The owning thread pushes and pops at the bottom and any other thread
+    steals from the top (Chase and Lev, with the C11 orderings of Lê et al).
+    The capacity must cover everything pushed between two pops.
+*/
+template<typename T>
+class WorkDeque final {
+public:
+    void reset (int capacity) {
+        int n = 1;
+        while (n < capacity)
+            n <<= 1;
+        slots.reset (new std::atomic<T*>[(size_t) n]);
+        for (int i = 0; i < n; ++i)
+            slots[(size_t) i].store (nullptr, std::memory_order_relaxed);
+        mask = n - 1;
+        top.store (0, std::memory_order_relaxed);
+        bottom.store (0, std::memory_order_relaxed);
+    }
+
+    /** Add an item. Owner only */
+    void push (T* item) noexcept {
+        const int64_t b = bottom.load (std::memory_order_relaxed);
+        slots[(size_t) (b & mask)].store (item, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+        bottom.store (b + 1, std::memory_order_relaxed);
+    }
+
+    /** Take the newest item, or nullptr. Owner only */
+    T* pop() noexcept {
+        const int64_t b = bottom.load (std::memory_order_relaxed) - 1;
+        bottom.store (b, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        int64_t t = top.load (std::memory_order_relaxed);
+
+        T* item = nullptr;
+        if (t <= b) {
+            item = slots[(size_t) (b & mask)].load (std::memory_order_relaxed);
+            if (t == b) {
+                // last item, race the thieves for it
+                if (! top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed))
+                    item = nullptr;
+                bottom.store (b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            bottom.store (b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /** Take the oldest item, or nullptr if empty or another thread won */
+    T* steal() noexcept {
+        int64_t t = top.load (std::memory_order_acquire);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        const int64_t b = bottom.load (std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        T* item = slots[(size_t) (t & mask)].load (std::memory_order_relaxed);
+        if (! top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+private:
+    std::unique_ptr<std::atomic<T*>[]> slots;
+    int64_t mask { 0 };
+    alignas (64) std::atomic<int64_t> top { 0 };
+    alignas (64) std::atomic<int64_t> bottom { 0 };
+};
+
+/** Runs a graph of Lua script nodes in parallel, a block at a time.
+
+    Every node has its own Lua state with the kv libraries open, so nodes
+    that don't depend on each other run on different threads at once. A
+    node's script returns a function that is called each block as
+
+        process (audio_in, audio_out, midi_in, midi_out)
+
+    The audio arguments are kv.AudioBuffer32 views: `audio_in` refers to
+    the output channels of the nodes connected to it, in connection order,
+    and `audio_out` to the node's own output, so no samples are copied.
+    MIDI is handed over by swapping buffers when an output feeds a single
+    input, and merged otherwise.
+
+    States come from a StatePool per script, so adding a node whose script
+    was warmed, or used by a node since removed with clear(), doesn't
+    create a state or run the script.
+
+    Scheduling uses a work stealing deque per thread. The thread calling
+    process() takes part, so an engine with one thread runs everything in
+    the caller. Building the graph and prepare() allocate; process() does
+    not, apart from whatever the scripts do, as long as every node has
+    fewer than 32 input and 32 output channels. JUCE keeps the channel list
+    of a buffer with more channels on the heap, so the views of such a node
+    allocate each block.
+
+    process() returns once every helper thread has left the block, so the
+    graph may be changed and prepared again between calls.
+*/
+class Engine final {
+public:
+    enum { max_error = 256 };
+
+    /** Create an engine.
+        @param num_threads  Threads to run on including the caller, or 0
+                            for one per core.
+    */
+    explicit Engine (int num_threads = 0) {
+        if (num_threads <= 0)
+            num_threads = juce::jmax (1, (int) std::thread::hardware_concurrency());
+        num_deques = num_threads;
+        deques.reset (new WorkDeque<Node>[(size_t) num_threads]);
+        for (int i = 1; i < num_threads; ++i)
+            threads.emplace_back ([this, i] { thread_loop (i); });
+    }
+
+    ~Engine() {
+        {
+            std::lock_guard<std::mutex> sl (lock);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& t : threads)
+            t.join();
+        for (auto& node : nodes)
+            node->pool->destroy (node->L);
+    }
+
+    int get_num_threads() const noexcept { return num_deques; }
+    int get_num_nodes() const noexcept { return (int) nodes.size(); }
+
+    /** Add a node running `script`.
+        @returns the node index, or -1 with `error` set
+    */
+    int add_node (const char* script, size_t len, const char* name, int num_outputs, std::string& error) {
+        auto* pool = get_pool (script, len, name, error);
+        lua_State* L = pool != nullptr ? pool->acquire (error) : nullptr;
+        if (L == nullptr)
+            return -1;
+
+        StatePool::push_result (L);
+        if (lua_type (L, -1) != LUA_TFUNCTION) {
+            error = "script must return a function";
+            pool->destroy (L);
+            return -1;
+        }
+
+        auto node = std::make_unique<Node>();
+        node->index = (int) nodes.size();
+        node->L = L;
+        node->pool = pool;
+        node->num_outputs = juce::jmax (0, num_outputs);
+        node->process_ref = luaL_ref (L, LUA_REGISTRYINDEX);
+
+        // the views stay referenced until clear()
+        node->audio_in  = new_view (L, node->refs);
+        node->audio_out = new_view (L, node->refs);
+        node->midi_in   = new_midi (L, node->refs);
+        node->midi_out  = new_midi (L, node->refs);
+
+        nodes.push_back (std::move (node));
+        prepared = false;
+        return (int) nodes.size() - 1;
+    }
+
+    /** Remove every node.
+        Their states are reset and kept for nodes added later with the
+        same script and name.
+    */
+    void clear() {
+        wait_idle();
+        for (auto& node : nodes) {
+            luaL_unref (node->L, LUA_REGISTRYINDEX, node->process_ref);
+            for (int ref : node->refs)
+                luaL_unref (node->L, LUA_REGISTRYINDEX, ref);
+            node->pool->release (node->L);
+        }
+        nodes.clear();
+        roots.clear();
+        prepared = false;
+    }
+
+    /** Create states for `script` until `count` are waiting to be used
+        by add_node() with the same script and name.
+        @returns false with `error` set if the script failed
+    */
+    bool warm (const char* script, size_t len, const char* name, int count, std::string& error) {
+        auto* pool = get_pool (script, len, name, error);
+        return pool != nullptr && pool->warm (count, error);
+    }
+
+    /** Pool statistics summed over every script */
+    StatePool::Stats get_pool_stats() const {
+        StatePool::Stats total;
+        for (const auto& p : pools) {
+            const auto stats = p.second->get_stats();
+            total.size      += stats.size;
+            total.available += stats.available;
+            total.hits      += stats.hits;
+            total.misses    += stats.misses;
+        }
+        return total;
+    }
+
+    /** Feed the output of node `source` to node `dest`.
+        @returns false if either index is invalid, they are already
+                 connected, or the connection would make a cycle
+    */
+    bool connect (int source, int dest) {
+        if (! juce::isPositiveAndBelow (source, get_num_nodes())
+            || ! juce::isPositiveAndBelow (dest, get_num_nodes())
+            || source == dest || reaches (dest, source))
+            return false;
+        auto* src = nodes[(size_t) source].get();
+        auto* dst = nodes[(size_t) dest].get();
+        if (std::find (src->outputs.begin(), src->outputs.end(), dst) != src->outputs.end())
+            return false;
+        src->outputs.push_back (dst);
+        dst->inputs.push_back (src);
+        prepared = false;
+        return true;
+    }
+
+    /** Allocate buffers for blocks of up to `block_size` frames */
+    void prepare (int block_size) {
+        wait_idle();
+        max_frames = juce::jmax (1, block_size);
+        for (int i = 0; i < num_deques; ++i)
+            deques[(size_t) i].reset (juce::jmax (1, get_num_nodes()));
+
+        for (auto& node : nodes) {
+            node->output.setSize (juce::jmax (1, node->num_outputs), max_frames);
+            node->output.clear();
+            node->out_channels.assign ((size_t) juce::jmax (1, node->num_outputs), nullptr);
+            for (int c = 0; c < node->num_outputs; ++c)
+                node->out_channels[(size_t) c] = node->output.getWritePointer (c);
+            node->midi_out_buffer().ensureSize (midi_reserve);
+            node->midi_in_buffer().ensureSize (midi_reserve);
+        }
+
+        // input channel lists are fixed once the outputs are allocated
+        for (auto& node : nodes) {
+            node->in_channels.clear();
+            for (auto* src : node->inputs)
+                for (int c = 0; c < src->num_outputs; ++c)
+                    node->in_channels.push_back (src->out_channels[(size_t) c]);
+            node->num_inputs = (int) node->in_channels.size();
+            if (node->in_channels.empty())
+                node->in_channels.push_back (nullptr);
+        }
+
+        roots.clear();
+        for (auto& node : nodes)
+            if (node->inputs.empty())
+                roots.push_back (node.get());
+        prepared = true;
+    }
+
+    /** Run every node for `nframes` frames.
+        @returns false if not prepared or `nframes` exceeds the block size
+    */
+    bool process (int nframes) noexcept {
+        if (! prepared || nframes < 0 || nframes > max_frames)
+            return false;
+        if (nodes.empty())
+            return true;
+
+        frames = nframes;
+        for (auto& node : nodes)
+            node->pending.store ((int) node->inputs.size(), std::memory_order_relaxed);
+        remaining.store (get_num_nodes(), std::memory_order_relaxed);
+
+        // roots go on the caller's deque, the other threads steal them
+        for (auto* node : roots)
+            deques[0].push (node);
+
+        if (! threads.empty()) {
+            {
+                std::lock_guard<std::mutex> sl (lock);
+                ++epoch;
+            }
+            wake.notify_all();
+        }
+
+        work (0);
+        wait_idle();
+        return true;
+    }
+
+    /** Output of a node from the last block. Channels are `max_frames` long */
+    const juce::AudioBuffer<float>& get_output (int node) const noexcept {
+        return nodes[(size_t) node]->output;
+    }
+
+    int get_num_outputs (int node) const noexcept { return nodes[(size_t) node]->num_outputs; }
+
+    /** MIDI written by a node in the last block.
+        Empty if the node feeds a single input, which took the buffer.
+    */
+    const juce::MidiBuffer& get_midi_output (int node) const noexcept {
+        return nodes[(size_t) node]->midi_out_buffer();
+    }
+
+    /** The error that stopped a node, or nullptr if it is running.
+        A node that raises an error is skipped from then on and outputs
+        silence.
+    */
+    const char* get_error (int node) const noexcept {
+        const auto& n = *nodes[(size_t) node];
+        return n.failed.load (std::memory_order_acquire) ? n.error : nullptr;
+    }
+
+    /** Let a failed node run again */
+    void reset_error (int node) noexcept {
+        nodes[(size_t) node]->failed.store (false, std::memory_order_release);
+    }
+
+    /** The node's Lua state. Only touch it while process() isn't running */
+    lua_State* get_state (int node) const noexcept { return nodes[(size_t) node]->L; }
+
+private:
+    enum { midi_reserve = 2048 };
+
+    struct Node {
+        int index { 0 };
+        lua_State* L { nullptr };
+        StatePool* pool { nullptr };
+        int process_ref { LUA_NOREF };
+        std::vector<int> refs;
+
+        juce::AudioBuffer<float>** audio_in  { nullptr };
+        juce::AudioBuffer<float>** audio_out { nullptr };
+        MidiBufferImpl** midi_in  { nullptr };
+        MidiBufferImpl** midi_out { nullptr };
+
+        int num_inputs { 0 }, num_outputs { 0 };
+        juce::AudioBuffer<float> output;
+        std::vector<float*> in_channels, out_channels;
+        std::vector<Node*> inputs, outputs;
+
+        std::atomic<int> pending { 0 };
+        std::atomic<bool> failed { false };
+        char error[max_error] {};
+
+        juce::MidiBuffer& midi_in_buffer() const noexcept   { return (*midi_in)->buffer; }
+        juce::MidiBuffer& midi_out_buffer() const noexcept  { return (*midi_out)->buffer; }
+    };
+
+    std::map<std::string, std::unique_ptr<StatePool>> pools;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<Node*> roots;
+    std::unique_ptr<WorkDeque<Node>[]> deques;
+    int num_deques { 0 };
+    std::vector<std::thread> threads;
+    int max_frames { 0 };
+    int frames { 0 };
+    bool prepared { false };
+
+    alignas (64) std::atomic<int> remaining { 0 };
+    alignas (64) std::atomic<int> active { 0 };     // helpers inside work()
+
+    std::mutex lock;
+    std::condition_variable wake;
+    uint64_t epoch { 0 };
+    bool running { true };
+
+    static juce::AudioBuffer<float>** new_view (lua_State* L, std::vector<int>& refs) {
+        create_audio_buffer<float> (L, 0, 0);
+        auto** view = (juce::AudioBuffer<float>**) lua_touserdata (L, -1);
+        refs.push_back (luaL_ref (L, LUA_REGISTRYINDEX));
+        return view;
+    }
+
+    static MidiBufferImpl** new_midi (lua_State* L, std::vector<int>& refs) {
+        auto** impl = new_midibuffer (L);
+        refs.push_back (luaL_ref (L, LUA_REGISTRYINDEX));
+        return impl;
+    }
+
+    /** The pool for a script, compiling it the first time */
+    StatePool* get_pool (const char* script, size_t len, const char* name, std::string& error) {
+        std::string key (name != nullptr ? name : "");
+        key.push_back ('\0');
+        key.append (script, len);
+        auto it = pools.find (key);
+        if (it != pools.end())
+            return it->second.get();
+
+        auto pool = std::make_unique<StatePool>();
+        if (! pool->load (script, len, name, error))
+            return nullptr;
+        return pools.emplace (std::move (key), std::move (pool)).first->second.get();
+    }
+
+    /** True if `to` can be reached from `from` along connections */
+    bool reaches (int from, int to) const {
+        std::vector<const Node*> stack { nodes[(size_t) from].get() };
+        std::vector<bool> seen (nodes.size(), false);
+        while (! stack.empty()) {
+            const auto* node = stack.back();
+            stack.pop_back();
+            if (node->index == to)
+                return true;
+            if (seen[(size_t) node->index])
+                continue;
+            seen[(size_t) node->index] = true;
+            for (const auto* next : node->outputs)
+                stack.push_back (next);
+        }
+        return false;
+    }
+
+    void thread_loop (int index) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> sl (lock);
+                wake.wait (sl, [this, seen] { return ! running || epoch != seen; });
+                if (! running)
+                    return;
+                seen = epoch;
+                active.fetch_add (1, std::memory_order_acq_rel);
+            }
+            work (index);
+            active.fetch_sub (1, std::memory_order_release);
+        }
+    }
+
+    /** Wait for helpers still inside work(), which may touch the deques */
+    void wait_idle() const noexcept {
+        while (active.load (std::memory_order_acquire) > 0)
+            std::this_thread::yield();
+    }
+
+    /** Run nodes until the block is done */
+    void work (int index) noexcept {
+        int victim = index;
+        while (remaining.load (std::memory_order_acquire) > 0) {
+            Node* node = deques[(size_t) index].pop();
+            for (int i = 1; node == nullptr && i < num_deques; ++i) {
+                victim = (victim + 1) % num_deques;
+                if (victim != index)
+                    node = deques[(size_t) victim].steal();
+            }
+
+            if (node == nullptr) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            run (*node);
+            for (auto* next : node->outputs)
+                if (next->pending.fetch_sub (1, std::memory_order_acq_rel) == 1)
+                    deques[(size_t) index].push (next);
+            remaining.fetch_sub (1, std::memory_order_acq_rel);
+        }
+    }
+
+    void gather_midi (Node& node) noexcept {
+        auto& in = node.midi_in_buffer();
+        if (node.inputs.size() == 1 && node.inputs[0]->outputs.size() == 1) {
+            // sole consumer, take the buffer instead of copying it
+            in.clear();
+            in.swapWith (node.inputs[0]->midi_out_buffer());
+            return;
+        }
+        in.clear();
+        for (auto* src : node.inputs)
+            in.addEvents (src->midi_out_buffer(), 0, -1, 0);
+    }
+
+    void run (Node& node) noexcept {
+        gather_midi (node);
+        node.output.clear (0, frames);
+        node.midi_out_buffer().clear();
+
+        // a script may have freed its views
+        if (node.failed.load (std::memory_order_relaxed)
+            || *node.audio_in == nullptr || *node.audio_out == nullptr)
+            return;
+
+        // allocates when a view has 32 channels or more
+        (*node.audio_in)->setDataToReferTo (node.in_channels.data(), node.num_inputs, frames);
+        (*node.audio_out)->setDataToReferTo (node.out_channels.data(), node.num_outputs, frames);
+        (*node.midi_in)->reset_iter();
+        (*node.midi_out)->reset_iter();
+
+        lua_State* L = node.L;
+        lua_rawgeti (L, LUA_REGISTRYINDEX, node.process_ref);
+        for (int ref : node.refs)
+            lua_rawgeti (L, LUA_REGISTRYINDEX, ref);
+        if (lua_pcall (L, (int) node.refs.size(), 0, 0) != LUA_OK) {
+            const char* msg = lua_tostring (L, -1);
+            std::strncpy (node.error, msg != nullptr ? msg : "error", max_error - 1);
+            node.error[max_error - 1] = 0;
+            lua_pop (L, 1);
+            node.output.clear (0, frames);
+            node.midi_out_buffer().clear();
+            node.failed.store (true, std::memory_order_release);
+        }
+    }
+};
+
+}}
@@ -0,0 +1,292 @@
+
+#pragma once
+
+#include "kv/lua/voice_allocator.hpp"
+
+namespace kv {
+namespace lua {
+
+/** A bank of ADSR envelopes.
+
+    State and parameters for every envelope live in contiguous arrays.
+    Attack is linear, decay and release are exponential with times given to
+    -60 dB. Triggers and releases can be scheduled at frame offsets from a
+    MIDI buffer or a voice allocator, and are applied when the matching
+    range is rendered.
+*/
+class EnvelopeBank final {
+public:
+    enum { max_events = 1024 };
+
+    enum Stage {
+        Idle    = 0,
+        Attack  = 1,
+        Decay   = 2,
+        Sustain = 3,
+        Release = 4
+    };
+
+    explicit EnvelopeBank (int numEnvelopes, double rate = 44100.0)
+        : size (juce::jmax (1, numEnvelopes))
+    {
+        for (auto* block : { &level, &scale, &attack, &decay, &sustain, &release,
+                             &attack_inc, &decay_coef, &release_coef })
+            block->allocate ((size_t) size, true);
+        stage.allocate ((size_t) size, true);
+
+        for (int i = 0; i < size; ++i)
+            set_adsr (i, 0.01, 0.1, 1.0, 0.2);
+        set_sample_rate (rate);
+    }
+
+    ~EnvelopeBank() = default;
+
+    int get_size() const noexcept { return size; }
+
+    void set_sample_rate (double rate) noexcept {
+        sample_rate = rate > 0.0 ? rate : 44100.0;
+        for (int i = 0; i < size; ++i)
+            update_coefficients (i);
+    }
+
+    double get_sample_rate() const noexcept { return sample_rate; }
+
+    /** Set times in seconds and a sustain level 0-1 */
+    void set_adsr (int i, double a, double d, double s, double r) noexcept {
+        if (! juce::isPositiveAndBelow (i, size))
+            return;
+        attack[i]   = juce::jmax (0.0, a);
+        decay[i]    = juce::jmax (0.0, d);
+        sustain[i]  = juce::jlimit (0.0, 1.0, s);
+        release[i]  = juce::jmax (0.0, r);
+        update_coefficients (i);
+    }
+
+    void get_adsr (int i, double& a, double& d, double& s, double& r) const noexcept {
+        i = juce::jlimit (0, size - 1, i);
+        a = attack[i]; d = decay[i]; s = sustain[i]; r = release[i];
+    }
+
+    /** Start the attack from the current level */
+    void trigger (int i, double velocity = 1.0) noexcept {
+        if (! juce::isPositiveAndBelow (i, size))
+            return;
+        scale[i] = velocity;
+        stage[i] = Attack;
+    }
+
+    void release_envelope (int i) noexcept {
+        if (juce::isPositiveAndBelow (i, size) && stage[i] != Idle)
+            stage[i] = Release;
+    }
+
+    /** Silence every envelope and drop scheduled events */
+    void reset() noexcept {
+        level.clear ((size_t) size);
+        stage.clear ((size_t) size);
+        num_events = 0;
+    }
+
+    double get_level (int i) const noexcept {
+        return juce::isPositiveAndBelow (i, size) ? level[i] * scale[i] : 0.0;
+    }
+
+    int get_stage (int i) const noexcept {
+        return juce::isPositiveAndBelow (i, size) ? stage[i] : Idle;
+    }
+
+    bool is_active (int i) const noexcept { return get_stage (i) != Idle; }
+
+    int get_num_active() const noexcept {
+        int n = 0;
+        for (int i = 0; i < size; ++i)
+            if (stage[i] != Idle)
+                ++n;
+        return n;
+    }
+
+    //==========================================================================
+    /** Drop all scheduled events */
+    void clear_events() noexcept { num_events = 0; }
+    int get_num_events() const noexcept { return num_events; }
+
+    /** Schedule note on/off from a MIDI buffer, replacing pending events.
+        Envelope `n` follows MIDI note `n` on any channel.
+    */
+    void schedule (const juce::MidiBuffer& buffer) noexcept {
+        num_events = 0;
+        for (const auto meta : buffer) {
+            if (meta.numBytes < 3)
+                continue;
+            const auto* d = meta.data;
+            const int status = d[0] & 0xf0;
+            if (status == 0x90 && d[2] > 0)
+                add_event (meta.samplePosition, d[1], true, d[2] / 127.0);
+            else if (status == 0x80 || status == 0x90)
+                add_event (meta.samplePosition, d[1], false, 0.0);
+        }
+    }
+
+    /** Schedule the commands of a voice allocator, replacing pending events.
+        Envelope `v` follows voice `v`.
+    */
+    void schedule (const VoiceAllocator& alloc) noexcept {
+        num_events = 0;
+        for (const auto& cmd : alloc) {
+            if (cmd.type == VoiceAllocator::Start)
+                add_event (cmd.frame, cmd.voice, true, cmd.velocity / 127.0);
+            else if (cmd.type == VoiceAllocator::Stop)
+                add_event (cmd.frame, cmd.voice, false, 0.0);
+        }
+    }
+
+    //==========================================================================
+    /** Write `n` values of envelope `i` starting at block frame `start` */
+    template<typename T>
+    void render (int i, T* out, int start, int n) noexcept {
+        run<false> (i, out, start, n);
+    }
+
+    /** Multiply `n` samples by envelope `i` starting at block frame `start` */
+    template<typename T>
+    void apply (int i, T* out, int start, int n) noexcept {
+        run<true> (i, out, start, n);
+    }
+
+    /** Multiply several channels by envelope `i` in one pass */
+    template<typename T>
+    void apply (int i, T* const* chans, int nchans, int start, int n) noexcept {
+        double tmp [256];
+        for (int done = 0; done < n;) {
+            const int todo = juce::jmin (256, n - done);
+            run<false> (i, tmp, start + done, todo);
+            for (int c = 0; c < nchans; ++c) {
+                T* out = chans[c] + start + done;
+                for (int f = 0; f < todo; ++f)
+                    out[f] *= static_cast<T> (tmp[f]);
+            }
+            done += todo;
+        }
+    }
+
+    /** Control rate update.
+        Advances every envelope by `n` frames, applying the scheduled events
+        in the block range [0, n) and discarding them.
+    */
+    void tick (int n) noexcept {
+        for (int i = 0; i < size; ++i)
+            run<false, double> (i, nullptr, 0, n);
+        num_events = 0;
+    }
+
+private:
+    struct Event {
+        int frame;
+        int index;
+        bool on;
+        double velocity;
+    };
+
+    int size;
+    double sample_rate { 44100.0 };
+    juce::HeapBlock<double> level, scale, attack, decay, sustain, release;
+    juce::HeapBlock<double> attack_inc, decay_coef, release_coef;
+    juce::HeapBlock<int> stage;
+    Event events [max_events];
+    int num_events { 0 };
+
+    static constexpr double floor_level = 0.001;
+
+    void add_event (int frame, int index, bool on, double velocity) noexcept {
+        if (num_events < max_events && juce::isPositiveAndBelow (index, size))
+            events[num_events++] = { frame, index, on, velocity };
+    }
+
+    double coefficient (double seconds) const noexcept {
+        const double n = seconds * sample_rate;
+        return n < 1.0 ? 0.0 : std::exp (std::log (floor_level) / n);
+    }
+
+    void update_coefficients (int i) noexcept {
+        const double n = attack[i] * sample_rate;
+        attack_inc[i]   = n < 1.0 ? 1.0 : 1.0 / n;
+        decay_coef[i]   = coefficient (decay[i]);
+        release_coef[i] = coefficient (release[i]);
+    }
+
+    /** Advance envelope `i` by `n` frames from `start`, honouring events */
+    template<bool Multiply, typename T>
+    LKV_TARGET_CLONES
+    void run (int i, T* out, int start, int n) noexcept {
+        if (! juce::isPositiveAndBelow (i, size) || n <= 0)
+            return;
+
+        const int end = start + n;
+        int pos = start;
+        for (int e = 0; e < num_events; ++e) {
+            const auto& ev = events[e];
+            if (ev.index != i || ev.frame < start || ev.frame >= end)
+                continue;
+            const int frame = juce::jmax (pos, ev.frame);
+            segment<Multiply> (i, out, pos - start, frame - pos);
+            pos = frame;
+            if (ev.on)
+                trigger (i, ev.velocity);
+            else
+                release_envelope (i);
+        }
+
+        segment<Multiply> (i, out, pos - start, end - pos);
+    }
+
+    template<bool Multiply, typename T>
+    void segment (int i, T* out, int offset, int n) noexcept {
+        double lvl = level[i];
+        int st = stage[i];
+        const double g = scale[i];
+        const double inc = attack_inc[i], dc = decay_coef[i];
+        const double rc = release_coef[i], sus = sustain[i];
+
+        for (int f = 0; f < n; ++f) {
+            switch (st) {
+                case Attack:
+                    lvl += inc;
+                    // tolerate rounding from the accumulated increments
+                    if (lvl >= 1.0 - 1.0e-9) {
+                        lvl = 1.0;
+                        st = Decay;
+                    }
+                    break;
+                case Decay:
+                    // approach the sustain level, 60 dB below the start
+                    lvl = sus + (lvl - sus) * dc;
+                    if (lvl - sus <= floor_level * (1.0 - sus)) {
+                        lvl = sus;
+                        st = sus > 0.0 ? Sustain : Idle;
+                    }
+                    break;
+                case Release:
+                    lvl *= rc;
+                    if (lvl <= floor_level) {
+                        lvl = 0.0;
+                        st = Idle;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            if (out != nullptr) {
+                if (Multiply)
+                    out[offset + f] *= static_cast<T> (lvl * g);
+                else
+                    out[offset + f] = static_cast<T> (lvl * g);
+            }
+        }
+
+        level[i] = lvl;
+        stage[i] = st;
+    }
+};
+
+}}
@@ -0,0 +1,513 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** Per-sample formulas compiled to block-wise stack bytecode.
+
+    Source is a list of assignments separated by newlines or semicolons:
+
+        g = 0.5
+        y = x * g + sin (p)
+
+    A name read before it is assigned is an input, and a name that is
+    assigned is an output. Both can be bound to 32 or 64 bit arrays or to
+    a scalar. Unbound inputs read zero. Assigned names are also locals for
+    later statements.
+
+    Each instruction runs over a whole block of frames before the next one
+    is dispatched, so the loops are simple enough to vectorize. All memory
+    is allocated by compile(); binding and running do not allocate.
+*/
+class Expression final {
+public:
+    enum { block_size = 128, max_stack = 32 };
+
+    Expression() = default;
+    ~Expression() = default;
+
+    /** Parse and compile a program. Allocates.
+        @returns false and sets `error` if the source is invalid
+    */
+    bool compile (const std::string& source, std::string& error) {
+        Parser parser (*this, source);
+        code.clear();
+        vars.clear();
+        consts.clear();
+        depth = 0;
+        max_depth = 0;
+
+        if (! parser.parse_program() || max_depth > max_stack) {
+            error = parser.error.empty() ? std::string ("expression is too deeply nested") : parser.error;
+            code.clear();
+            vars.clear();
+            return false;
+        }
+
+        stack.allocate ((size_t) (juce::jmax (1, max_depth) * block_size), true);
+        const_blocks.allocate ((size_t) (juce::jmax (1, (int) consts.size()) * block_size), true);
+        for (size_t i = 0; i < consts.size(); ++i)
+            std::fill (const_block ((int) i), const_block ((int) i) + block_size, consts[i]);
+        var_blocks.allocate ((size_t) (juce::jmax (1, (int) vars.size()) * block_size * 2), true);
+        return true;
+    }
+
+    int get_num_variables() const noexcept { return (int) vars.size(); }
+    int get_num_instructions() const noexcept { return (int) code.size(); }
+    const std::string& get_name (int v) const noexcept { return vars[(size_t) v].name; }
+    bool is_input (int v) const noexcept   { return vars[(size_t) v].input; }
+    bool is_output (int v) const noexcept  { return vars[(size_t) v].output; }
+
+    int find_variable (const char* name) const noexcept {
+        for (size_t i = 0; i < vars.size(); ++i)
+            if (vars[i].name == name)
+                return (int) i;
+        return -1;
+    }
+
+    /** Read a variable as a constant */
+    void bind_scalar (int v, double value) noexcept {
+        auto& var = vars[(size_t) v];
+        var.kind = Scalar;
+        var.length = -1;
+        std::fill (input_block (v), input_block (v) + block_size, static_cast<float> (value));
+    }
+
+    void bind (int v, float* data, int length) noexcept {
+        auto& var = vars[(size_t) v];
+        var.kind = Array32;
+        var.f32 = data;
+        var.length = length;
+    }
+
+    void bind (int v, double* data, int length) noexcept {
+        auto& var = vars[(size_t) v];
+        var.kind = Array64;
+        var.f64 = data;
+        var.length = length;
+    }
+
+    void unbind (int v) noexcept {
+        vars[(size_t) v].kind = Unbound;
+        vars[(size_t) v].length = -1;
+        std::fill (input_block (v), input_block (v) + block_size, 0.0f);
+    }
+
+    /** Shortest bound array, or -1 if none are bound */
+    int get_bound_length() const noexcept {
+        int len = -1;
+        for (const auto& var : vars)
+            if (var.length >= 0)
+                len = len < 0 ? var.length : juce::jmin (len, var.length);
+        return len;
+    }
+
+    /** Evaluate `count` frames of the bound arrays beginning at `start` */
+    LKV_TARGET_CLONES
+    void run (int start, int count) noexcept {
+        if (code.empty())
+            return;
+        for (int done = 0; done < count;) {
+            const int n = juce::jmin ((int) block_size, count - done);
+            run_block (start + done, n);
+            done += n;
+        }
+    }
+
+private:
+    enum Kind { Unbound, Scalar, Array32, Array64 };
+
+    enum Op {
+        LoadVar, LoadLocal, LoadConst, Store,
+        Add, Sub, Mul, Div, Pow, Neg,
+        Sin, Cos, Tan, Exp, Log, Sqrt, Abs, Floor, Tanh,
+        Min, Max, Clamp
+    };
+
+    struct Instruction {
+        int op;
+        int arg;
+    };
+
+    struct Variable {
+        std::string name;
+        bool input  { false };
+        bool output { false };
+        bool assigned { false };    // used while parsing
+        int kind    { Unbound };
+        int length  { -1 };
+        float* f32  { nullptr };
+        double* f64 { nullptr };
+    };
+
+    std::vector<Instruction> code;
+    std::vector<Variable> vars;
+    std::vector<float> consts;
+    int depth { 0 }, max_depth { 0 };
+    juce::HeapBlock<float> stack, const_blocks, var_blocks;
+
+    float* stack_block (int i) const noexcept   { return stack.get() + (size_t) (i * block_size); }
+    float* const_block (int i) const noexcept   { return const_blocks.get() + (size_t) (i * block_size); }
+    float* input_block (int v) const noexcept   { return var_blocks.get() + (size_t) (v * 2 * block_size); }
+    float* local_block (int v) const noexcept   { return input_block (v) + block_size; }
+
+    //==========================================================================
+    void emit (int op, int arg, int effect) {
+        code.push_back ({ op, arg });
+        depth += effect;
+        max_depth = juce::jmax (max_depth, depth);
+    }
+
+    int variable_for (const std::string& name) {
+        for (size_t i = 0; i < vars.size(); ++i)
+            if (vars[i].name == name)
+                return (int) i;
+        vars.push_back ({});
+        vars.back().name = name;
+        return (int) vars.size() - 1;
+    }
+
+    int constant_for (float value) {
+        for (size_t i = 0; i < consts.size(); ++i)
+            if (consts[i] == value)
+                return (int) i;
+        consts.push_back (value);
+        return (int) consts.size() - 1;
+    }
+
+    /** Recursive descent parser emitting straight into the program */
+    struct Parser {
+        Parser (Expression& e, const std::string& s) : expr (e), src (s) {}
+
+        Expression& expr;
+        const std::string& src;
+        size_t pos { 0 };
+        int nesting { 0 };
+        std::string error;
+
+        /** Nesting limit, like LUAI_MAXCCALLS, so the C stack stays bounded */
+        enum { max_nesting = 200 };
+
+        bool enter() {
+            return ++nesting <= max_nesting ? true : fail ("expression too deeply nested");
+        }
+
+        bool fail (const std::string& message) {
+            if (error.empty())
+                error = message + " at position " + std::to_string (pos + 1);
+            return false;
+        }
+
+        /** Skip spaces, tabs and comments. Newlines are separators */
+        void skip() {
+            for (;;) {
+                while (pos < src.size() && (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\r'))
+                    ++pos;
+                if (pos + 1 < src.size() && src[pos] == '-' && src[pos + 1] == '-') {
+                    while (pos < src.size() && src[pos] != '\n')
+                        ++pos;
+                    continue;
+                }
+                break;
+            }
+        }
+
+        bool accept (char c) {
+            skip();
+            if (pos < src.size() && src[pos] == c) {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+
+        bool name (std::string& out) {
+            skip();
+            if (pos >= src.size() || ! (std::isalpha ((unsigned char) src[pos]) || src[pos] == '_'))
+                return false;
+            size_t end = pos;
+            while (end < src.size() && (std::isalnum ((unsigned char) src[end]) || src[end] == '_'))
+                ++end;
+            out = src.substr (pos, end - pos);
+            pos = end;
+            return true;
+        }
+
+        bool parse_program() {
+            for (;;) {
+                while (accept ('\n') || accept (';')) {}
+                skip();
+                if (pos >= src.size())
+                    break;
+                if (! parse_statement())
+                    return false;
+                skip();
+                if (pos < src.size() && ! (accept ('\n') || accept (';')))
+                    return fail ("expected end of statement");
+            }
+            return expr.code.empty() ? fail ("no statements") : true;
+        }
+
+        bool parse_statement() {
+            std::string target;
+            if (! name (target))
+                return fail ("expected a name");
+            if (! accept ('='))
+                return fail ("expected '='");
+            if (! parse_expression())
+                return false;
+            const int v = expr.variable_for (target);
+            expr.vars[(size_t) v].output   = true;
+            expr.vars[(size_t) v].assigned = true;
+            expr.emit (Store, v, -1);
+            return true;
+        }
+
+        bool parse_expression() {
+            if (! parse_term())
+                return false;
+            for (;;) {
+                if (accept ('+'))       { if (! parse_term()) return false; expr.emit (Add, 0, -1); }
+                else if (peek_minus())  { ++pos; if (! parse_term()) return false; expr.emit (Sub, 0, -1); }
+                else                    return true;
+            }
+        }
+
+        /** A minus that does not start a comment */
+        bool peek_minus() {
+            skip();
+            return pos < src.size() && src[pos] == '-'
+                && ! (pos + 1 < src.size() && src[pos + 1] == '-');
+        }
+
+        bool parse_term() {
+            if (! parse_unary())
+                return false;
+            for (;;) {
+                if (accept ('*'))       { if (! parse_unary()) return false; expr.emit (Mul, 0, -1); }
+                else if (accept ('/'))  { if (! parse_unary()) return false; expr.emit (Div, 0, -1); }
+                else                    return true;
+            }
+        }
+
+        bool parse_unary() {
+            if (! enter())
+                return false;
+            bool ok;
+            if (peek_minus()) {
+                ++pos;
+                ok = parse_unary();
+                if (ok)
+                    expr.emit (Neg, 0, 0);
+            } else if (accept ('+')) {
+                ok = parse_unary();
+            } else {
+                ok = parse_power();
+            }
+            --nesting;
+            return ok;
+        }
+
+        bool parse_power() {
+            if (! parse_primary())
+                return false;
+            if (accept ('^')) {
+                // right associative and binds tighter than unary minus on its left
+                if (! parse_unary())
+                    return false;
+                expr.emit (Pow, 0, -1);
+            }
+            return true;
+        }
+
+        bool parse_primary() {
+            skip();
+            if (pos >= src.size())
+                return fail ("unexpected end of source");
+
+            if (accept ('(')) {
+                if (! enter() || ! parse_expression())
+                    return false;
+                --nesting;
+                return accept (')') ? true : fail ("expected ')'");
+            }
+
+            const char c = src[pos];
+            if (std::isdigit ((unsigned char) c) || c == '.') {
+                char* end = nullptr;
+                const double value = std::strtod (src.c_str() + pos, &end);
+                if (end == src.c_str() + pos)
+                    return fail ("malformed number");
+                pos = (size_t) (end - src.c_str());
+                expr.emit (LoadConst, expr.constant_for ((float) value), 1);
+                return true;
+            }
+
+            std::string id;
+            if (! name (id))
+                return fail ("unexpected character");
+
+            if (accept ('('))
+                return parse_call (id);
+
+            if (id == "pi") {
+                expr.emit (LoadConst, expr.constant_for (juce::MathConstants<float>::pi), 1);
+                return true;
+            }
+
+            const int v = expr.variable_for (id);
+            auto& var = expr.vars[(size_t) v];
+            if (var.assigned) {
+                expr.emit (LoadLocal, v, 1);
+            } else {
+                var.input = true;
+                expr.emit (LoadVar, v, 1);
+            }
+            return true;
+        }
+
+        bool parse_call (const std::string& fn) {
+            struct Function { const char* name; int op; int nargs; };
+            static const Function functions[] = {
+                { "sin", Sin, 1 }, { "cos", Cos, 1 }, { "tan", Tan, 1 },
+                { "exp", Exp, 1 }, { "log", Log, 1 }, { "sqrt", Sqrt, 1 },
+                { "abs", Abs, 1 }, { "floor", Floor, 1 }, { "tanh", Tanh, 1 },
+                { "min", Min, 2 }, { "max", Max, 2 }, { "pow", Pow, 2 },
+                { "clamp", Clamp, 3 }
+            };
+
+            const Function* f = nullptr;
+            for (const auto& candidate : functions)
+                if (fn == candidate.name)
+                    f = &candidate;
+            if (f == nullptr)
+                return fail ("unknown function '" + fn + "'");
+
+            for (int i = 0; i < f->nargs; ++i) {
+                if (i > 0 && ! accept (','))
+                    return fail ("expected ',' in call to " + fn);
+                if (! parse_expression())
+                    return false;
+            }
+            if (! accept (')'))
+                return fail ("expected ')' after arguments to " + fn);
+            expr.emit (f->op, 0, 1 - f->nargs);
+            return true;
+        }
+    };
+
+    //==========================================================================
+    const float* load (int v, int frame, int n) noexcept {
+        const auto& var = vars[(size_t) v];
+        if (var.kind == Array32)
+            return var.f32 + frame;
+        if (var.kind == Array64) {
+            float* dst = input_block (v);
+            for (int i = 0; i < n; ++i)
+                dst[i] = static_cast<float> (var.f64[frame + i]);
+            return dst;
+        }
+        return input_block (v);
+    }
+
+    void store (int v, const float* src, int frame, int n) noexcept {
+        const auto& var = vars[(size_t) v];
+        float* local = local_block (v);
+        if (src != local)
+            std::copy (src, src + n, local);
+        if (var.kind == Array32) {
+            std::copy (src, src + n, var.f32 + frame);
+        } else if (var.kind == Array64) {
+            for (int i = 0; i < n; ++i)
+                var.f64[frame + i] = static_cast<double> (src[i]);
+        }
+    }
+
+    template<typename Fn>
+    static void unary (float* out, const float* a, int n, Fn&& fn) noexcept {
+        for (int i = 0; i < n; ++i)
+            out[i] = fn (a[i]);
+    }
+
+    template<typename Fn>
+    static void binary (float* out, const float* a, const float* b, int n, Fn&& fn) noexcept {
+        for (int i = 0; i < n; ++i)
+            out[i] = fn (a[i], b[i]);
+    }
+
+    void run_block (int frame, int n) noexcept {
+        const float* ptr[max_stack];
+        int sp = 0;
+
+        for (const auto& ins : code) {
+            switch (ins.op) {
+                case LoadVar:   ptr[sp++] = load (ins.arg, frame, n); break;
+                case LoadLocal: ptr[sp++] = local_block (ins.arg); break;
+                case LoadConst: ptr[sp++] = const_block (ins.arg); break;
+                case Store:     store (ins.arg, ptr[--sp], frame, n); break;
+
+                case Add: case Sub: case Mul: case Div: case Pow: case Min: case Max: {
+                    float* out = stack_block (sp - 2);
+                    const float* a = ptr[sp - 2];
+                    const float* b = ptr[sp - 1];
+                    switch (ins.op) {
+                        case Add: binary (out, a, b, n, [] (float x, float y) { return x + y; }); break;
+                        case Sub: binary (out, a, b, n, [] (float x, float y) { return x - y; }); break;
+                        case Mul: binary (out, a, b, n, [] (float x, float y) { return x * y; }); break;
+                        case Div: binary (out, a, b, n, [] (float x, float y) { return x / y; }); break;
+                        case Pow: binary (out, a, b, n, [] (float x, float y) { return std::pow (x, y); }); break;
+                        case Min: binary (out, a, b, n, [] (float x, float y) { return y < x ? y : x; }); break;
+                        case Max: binary (out, a, b, n, [] (float x, float y) { return x < y ? y : x; }); break;
+                    }
+                    ptr[sp - 2] = out;
+                    --sp;
+                    break;
+                }
+
+                case Clamp: {
+                    float* out = stack_block (sp - 3);
+                    const float* x  = ptr[sp - 3];
+                    const float* lo = ptr[sp - 2];
+                    const float* hi = ptr[sp - 1];
+                    for (int i = 0; i < n; ++i)
+                        out[i] = x[i] < lo[i] ? lo[i] : (hi[i] < x[i] ? hi[i] : x[i]);
+                    ptr[sp - 3] = out;
+                    sp -= 2;
+                    break;
+                }
+
+                default: {
+                    float* out = stack_block (sp - 1);
+                    const float* a = ptr[sp - 1];
+                    switch (ins.op) {
+                        case Neg:   unary (out, a, n, [] (float x) { return -x; }); break;
+                        case Sin:   unary (out, a, n, [] (float x) { return std::sin (x); }); break;
+                        case Cos:   unary (out, a, n, [] (float x) { return std::cos (x); }); break;
+                        case Tan:   unary (out, a, n, [] (float x) { return std::tan (x); }); break;
+                        case Exp:   unary (out, a, n, [] (float x) { return std::exp (x); }); break;
+                        case Log:   unary (out, a, n, [] (float x) { return std::log (x); }); break;
+                        case Sqrt:  unary (out, a, n, [] (float x) { return std::sqrt (x); }); break;
+                        case Abs:   unary (out, a, n, [] (float x) { return std::abs (x); }); break;
+                        case Floor: unary (out, a, n, [] (float x) { return std::floor (x); }); break;
+                        case Tanh:  unary (out, a, n, [] (float x) { return std::tanh (x); }); break;
+                    }
+                    ptr[sp - 1] = out;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+}}
@@ -0,0 +1,199 @@
+
+#pragma once
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+#define LKV_MT_FFT                      "kv.dsp.FFT"
+
+extern "C" int luaopen_kv_dsp_FFT (lua_State* L);
+
+namespace kv {
+namespace lua {
+
+/** Real FFT with an analysis window and preallocated work memory.
+    The last forward transform is kept as N/2 + 1 complex bins so it can be
+    inspected or modified before an inverse transform.
+*/
+class FFT final {
+public:
+    enum Window {
+        Rectangular     = 0,
+        Hann            = 1,
+        BlackmanHarris  = 2
+    };
+
+    explicit FFT (int order)
+        : fft (juce::jlimit (1, 16, order)),
+          size (fft.getSize())
+    {
+        spectrum.allocate ((size_t) size * 2, true);
+        work.allocate ((size_t) size * 2, true);
+        window.allocate ((size_t) size, false);
+        set_window (Rectangular);
+    }
+
+    ~FFT() = default;
+
+    int get_order() const noexcept      { return fft.getOrder(); }
+    int get_size() const noexcept       { return size; }
+    int get_num_bins() const noexcept   { return size / 2 + 1; }
+
+    /** Fills `out` with a periodic window of length `n`.
+        Periodic windows overlap-add to a constant at the usual hop sizes.
+    */
+    template<typename T>
+    static void fill_window (T* out, int n, int type) {
+        using Windowing = juce::dsp::WindowingFunction<T>;
+        if (n <= 0)
+            return;
+        if (type != Hann && type != BlackmanHarris) {
+            std::fill (out, out + n, static_cast<T> (1));
+            return;
+        }
+
+        juce::HeapBlock<T> table ((size_t) n + 1);
+        Windowing::fillWindowingTables (table.get(), (size_t) n + 1,
+            type == Hann ? Windowing::hann : Windowing::blackmanHarris, false);
+        std::copy (table.get(), table.get() + n, out);
+    }
+
+    /** Change the analysis window. Allocates temporary memory */
+    void set_window (int type) {
+        window_type = juce::jlimit ((int) Rectangular, (int) BlackmanHarris, type);
+        fill_window (window.get(), size, window_type);
+    }
+
+    int get_window() const noexcept             { return window_type; }
+    const float* get_window_table() const noexcept { return window.get(); }
+
+    /** Scratch memory of the FFT size, free for use between transforms */
+    float* get_scratch() noexcept               { return work.get(); }
+
+    /** Window and transform `n` samples, zero padding to the FFT size */
+    template<typename T>
+    void forward (const T* in, int n) noexcept {
+        n = juce::jlimit (0, size, n);
+        float* d = spectrum.get();
+        for (int i = 0; i < n; ++i)
+            d[i] = static_cast<float> (in[i]) * window[i];
+        std::fill (d + n, d + size * 2, 0.0f);
+        fft.performRealOnlyForwardTransform (d, true);
+    }
+
+    /** Inverse transform of the current bins, writing `n` samples */
+    template<typename T>
+    void inverse (T* out, int n) noexcept {
+        n = juce::jlimit (0, size, n);
+        float* d = work.get();
+        std::copy (spectrum.get(), spectrum.get() + size * 2, d);
+        fft.performRealOnlyInverseTransform (d);
+        for (int i = 0; i < n; ++i)
+            out[i] = static_cast<T> (d[i]);
+    }
+
+    float get_real (int bin) const noexcept  { return spectrum[(size_t) bin * 2]; }
+    float get_imag (int bin) const noexcept  { return spectrum[(size_t) bin * 2 + 1]; }
+
+    void set_bin (int bin, float re, float im) noexcept {
+        spectrum[(size_t) bin * 2]     = re;
+        spectrum[(size_t) bin * 2 + 1] = im;
+    }
+
+    float get_magnitude (int bin) const noexcept {
+        return std::hypot (get_real (bin), get_imag (bin));
+    }
+
+    float get_phase (int bin) const noexcept {
+        return std::atan2 (get_imag (bin), get_real (bin));
+    }
+
+private:
+    juce::dsp::FFT fft;
+    int size;
+    int window_type { Rectangular };
+    juce::HeapBlock<float> spectrum, work, window;
+};
+
+/** Overlap-add short time Fourier transform.
+
+    Collects input into frames of the FFT size every `hop` samples. Each
+    frame is windowed, transformed, handed to a callback, transformed back
+    and overlap-added with the same window. Output is delayed by the FFT
+    size. All memory is allocated up front.
+*/
+class STFT final {
+public:
+    STFT (FFT& f, int hopSize)
+        : fft (f), size (f.get_size()),
+          hop (juce::jlimit (1, f.get_size(), hopSize))
+    {
+        input.allocate ((size_t) size, true);
+        output.allocate ((size_t) size, true);
+        frame.allocate ((size_t) size, true);
+
+        // gain that makes window^2 overlap-add to unity
+        const float* w = fft.get_window_table();
+        double sum = 0.0;
+        for (int i = 0; i < size; ++i)
+            sum += (double) w[i] * (double) w[i];
+        gain = sum > 0.0 ? (float) ((double) hop / sum) : 1.0f;
+    }
+
+    int get_hop() const noexcept    { return hop; }
+    int get_latency() const noexcept { return size; }
+
+    void reset() noexcept {
+        input.clear ((size_t) size);
+        output.clear ((size_t) size);
+        pos = count = 0;
+    }
+
+    /** Process `n` samples in place, calling `on_frame()` for every frame */
+    template<typename T, typename Fn>
+    void process (T* io, int n, Fn&& on_frame) {
+        for (int i = 0; i < n; ++i) {
+            input[pos] = static_cast<float> (io[i]);
+            io[i] = static_cast<T> (output[pos]);
+            output[pos] = 0.0f;
+            pos = (pos + 1) % size;
+
+            if (++count >= hop) {
+                count = 0;
+                run_frame (on_frame);
+            }
+        }
+    }
+
+private:
+    FFT& fft;
+    int size, hop;
+    int pos { 0 }, count { 0 };
+    float gain { 1.0f };
+    juce::HeapBlock<float> input, output, frame;
+
+    template<typename Fn>
+    void run_frame (Fn&& on_frame) {
+        // oldest sample is at the write position
+        for (int i = 0; i < size; ++i)
+            frame[i] = input[(pos + i) % size];
+
+        fft.forward (frame.get(), size);
+        on_frame();
+        fft.inverse (frame.get(), size);
+
+        const float* w = fft.get_window_table();
+        for (int i = 0; i < size; ++i)
+            output[(pos + i) % size] += frame[i] * w[i] * gain;
+    }
+};
+
+/** Adds a new kv.dsp.FFT to the stack */
+inline FFT* new_fft (lua_State* L, int order) {
+    auto** userdata = (FFT**) lua_newuserdata (L, sizeof (FFT**));
+    *userdata = new FFT (order);
+    luaL_setmetatable (L, LKV_MT_FFT);
+    return *userdata;
+}
+
+}}
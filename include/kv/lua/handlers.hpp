@@ -0,0 +1,191 @@
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** Receives the name of a handler that raised an error and the message,
+    with a traceback. Called on the thread that ran the handler.
+*/
+using HandlerErrorReporter = void (*) (const char* name, const char* message);
+
+inline void report_handler_error_dbg (const char* name, const char* message) {
+    DBG (name << ": " << message);
+}
+
+inline HandlerErrorReporter& handler_error_reporter() noexcept {
+    static HandlerErrorReporter reporter = report_handler_error_dbg;
+    return reporter;
+}
+
+/** Change where handler errors go, or pass nullptr to drop them.
+    The default writes them with DBG, so release builds drop them too.
+*/
+inline void set_handler_error_reporter (HandlerErrorReporter reporter) noexcept {
+    handler_error_reporter() = reporter;
+}
+
+/** The handler functions of an object, looked up by name on its proxy.
+
+    Functions found are kept as registry references and looked up again
+    only after kv.object reports a function was assigned to or removed
+    from some type or from this proxy, so calling a handler is two
+    registry reads and a single protected call. Errors raised by a handler
+    get a traceback from one message handler, go to the handler error
+    reporter and make the call return false.
+
+    Calls stay protected: handlers run from JUCE callbacks, and an error
+    raised through them without a pcall would unwind the C++ frames with
+    longjmp.
+
+    @tparam N Number of handler names
+*/
+template<std::size_t N>
+class Handlers final {
+public:
+    /** Create with the name of each handler. */
+    template<typename ...Names>
+    explicit Handlers (Names... n)
+        : names {{ n... }}
+    {
+        static_assert (sizeof... (Names) == N, "need one name per handler");
+        refs.fill (LUA_NOREF);
+    }
+
+    ~Handlers() { reset(); }
+
+    Handlers (const Handlers&) = delete;
+    Handlers& operator= (const Handlers&) = delete;
+
+    /** Use the handlers of `proxy`. */
+    void bind (const sol::table& proxy) {
+        reset();
+        if (! proxy.valid())
+            return;
+        // handlers run on the main thread, whichever thread made the proxy
+        L = sol::main_thread (proxy.lua_state(), proxy.lua_state());
+        proxy.push (L);
+        own = get_own_version (L);
+        self = luaL_ref (L, LUA_REGISTRYINDEX);
+        version = get_version (L);
+        seen = *version - 1;
+    }
+
+    /** Drop the proxy and the cached functions. */
+    void reset() {
+        if (L == nullptr)
+            return;
+        unref_all();
+        luaL_unref (L, LUA_REGISTRYINDEX, self);
+        self = LUA_NOREF;
+        own = nullptr;
+        L = nullptr;
+    }
+
+    /** True if the handler at `index` is set. */
+    bool contains (std::size_t index) {
+        refresh();
+        return refs[index] != LUA_NOREF;
+    }
+
+    /** Call the handler at `index` with the proxy and `args`.
+        @returns false if it is not set or raised an error
+    */
+    template<typename ...Args>
+    bool call (std::size_t index, Args&& ...args) {
+        if (! contains (index))
+            return false;
+        const int top = lua_gettop (L);
+        lua_pushcfunction (L, traceback);
+        lua_rawgeti (L, LUA_REGISTRYINDEX, refs[index]);
+        lua_rawgeti (L, LUA_REGISTRYINDEX, self);
+        const int nargs = 1 + sol::stack::multi_push (L, std::forward<Args> (args)...);
+        const bool ok = lua_pcall (L, nargs, 0, top + 1) == LUA_OK;
+        const auto reporter = handler_error_reporter();
+        if (! ok && reporter != nullptr)
+            reporter (names[index], lua_tostring (L, -1));
+        lua_settop (L, top);
+        return ok;
+    }
+
+private:
+    std::array<const char*, N> names;
+    std::array<int, N> refs;
+    lua_State* L { nullptr };
+    int self { LUA_NOREF };
+    const lua_Integer* version { nullptr };
+    lua_Integer seen { 0 };
+    const lua_Integer* own { nullptr };
+    lua_Integer own_seen { 0 };
+
+    static const lua_Integer* get_version (lua_State* L) {
+        if (lua_getfield (L, LUA_REGISTRYINDEX, LKV_REG_OBJECT_VERSION) != LUA_TUSERDATA) {
+            lua_pop (L, 1);
+            *(lua_Integer*) lua_newuserdata (L, sizeof (lua_Integer)) = 0;
+            lua_pushvalue (L, -1);
+            lua_setfield (L, LUA_REGISTRYINDEX, LKV_REG_OBJECT_VERSION);
+        }
+        auto* v = (const lua_Integer*) lua_touserdata (L, -1);
+        lua_pop (L, 1);
+        return v;
+    }
+
+    // the version of the kv.object proxy on top of the stack if it is backed
+    // by userdata, made on first use and kept alive by its own metatable
+    static const lua_Integer* get_own_version (lua_State* L) {
+        if (! lua_getmetatable (L, -1))
+            return nullptr;
+        if (lua_getfield (L, -1, "__impl") == LUA_TNIL) {
+            lua_pop (L, 2);
+            return nullptr;
+        }
+        lua_pop (L, 1);
+        if (lua_getfield (L, -1, LKV_OBJECT_VERSION_FIELD) != LUA_TUSERDATA) {
+            lua_pop (L, 1);
+            *(lua_Integer*) lua_newuserdata (L, sizeof (lua_Integer)) = 0;
+            lua_pushvalue (L, -1);
+            lua_setfield (L, -3, LKV_OBJECT_VERSION_FIELD);
+        }
+        auto* v = (const lua_Integer*) lua_touserdata (L, -1);
+        lua_pop (L, 2);
+        return v;
+    }
+
+    static int traceback (lua_State* L) {
+        luaL_traceback (L, L, lua_tostring (L, 1), 1);
+        return 1;
+    }
+
+    void unref_all() {
+        for (auto& ref : refs) {
+            luaL_unref (L, LUA_REGISTRYINDEX, ref);
+            ref = LUA_NOREF;
+        }
+    }
+
+    void refresh() {
+        if (L == nullptr || (*version == seen && (own == nullptr || *own == own_seen)))
+            return;
+        seen = *version;
+        if (own != nullptr)
+            own_seen = *own;
+        unref_all();
+        lua_rawgeti (L, LUA_REGISTRYINDEX, self);
+        for (std::size_t i = 0; i < N; ++i) {
+            if (lua_getfield (L, -1, names[i]) == LUA_TFUNCTION)
+                refs[i] = luaL_ref (L, LUA_REGISTRYINDEX);
+            else
+                lua_pop (L, 1);
+        }
+        lua_pop (L, 1);
+    }
+};
+
+}}
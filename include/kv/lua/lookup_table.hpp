@@ -0,0 +1,139 @@
+
+#pragma once
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** A transfer curve sampled at evenly spaced points over a range.
+
+    Values are stored with one guard point before and two after the curve,
+    copies of the end points, so cubic interpolation needs no edge checks.
+    Inputs outside the range are clamped to it.
+*/
+class LookupTable final {
+public:
+    enum Interpolation {
+        Linear  = 0,
+        Cubic   = 1
+    };
+
+    LookupTable() = default;
+    ~LookupTable() = default;
+
+    int get_size() const noexcept           { return size; }
+    double get_min() const noexcept         { return range_min; }
+    double get_max() const noexcept         { return range_max; }
+    int get_interpolation() const noexcept  { return interpolation; }
+    bool is_empty() const noexcept          { return size < 2; }
+
+    void set_interpolation (int mode) noexcept {
+        interpolation = mode == Cubic ? Cubic : Linear;
+    }
+
+    /** Change the input range. Does not allocate */
+    void set_range (double lo, double hi) noexcept {
+        if (hi < lo)
+            std::swap (lo, hi);
+        range_min = lo;
+        range_max = hi > lo ? hi : lo + 1.0;
+        update_scale();
+    }
+
+    /** Copy `n` curve points. Allocates */
+    template<typename T>
+    void set_values (const T* values, int n) {
+        size = n >= 2 ? n : 0;
+        table.allocate ((size_t) (size + 3), true);
+        if (size == 0)
+            return;
+
+        float* t = table.get() + 1;
+        for (int i = 0; i < size; ++i)
+            t[i] = static_cast<float> (values[i]);
+        t[-1]       = t[0];
+        t[size]     = t[size - 1];
+        t[size + 1] = t[size - 1];
+        update_scale();
+    }
+
+    /** Set curve points from a function of the input. Allocates */
+    template<typename Fn>
+    void fill (int n, Fn&& fn) {
+        size = juce::jmax (2, n);
+        table.allocate ((size_t) (size + 3), true);
+        float* t = table.get() + 1;
+        const double step = (range_max - range_min) / (double) (size - 1);
+        for (int i = 0; i < size; ++i)
+            t[i] = static_cast<float> (fn (range_min + step * (double) i));
+        t[-1]       = t[0];
+        t[size]     = t[size - 1];
+        t[size + 1] = t[size - 1];
+        update_scale();
+    }
+
+    /** Evaluate the curve at one input */
+    float evaluate (double x) const noexcept {
+        if (is_empty())
+            return 0.0f;
+        float y = static_cast<float> (x);
+        if (interpolation == Cubic)
+            process_block<Cubic> (&y, 1);
+        else
+            process_block<Linear> (&y, 1);
+        return y;
+    }
+
+    /** Replace each of `n` samples with the curve's value */
+    template<typename T>
+    LKV_TARGET_CLONES
+    void process (T* data, int n) const noexcept {
+        if (is_empty())
+            return;
+        if (interpolation == Cubic)
+            process_block<Cubic> (data, n);
+        else
+            process_block<Linear> (data, n);
+    }
+
+private:
+    int size { 0 };
+    int interpolation { Linear };
+    double range_min { -1.0 }, range_max { 1.0 };
+    float scale { 0.0f };
+    juce::HeapBlock<float> table;
+
+    void update_scale() noexcept {
+        scale = size >= 2 ? (float) ((double) (size - 1) / (range_max - range_min)) : 0.0f;
+    }
+
+    template<int Mode, typename T>
+    void process_block (T* data, int n) const noexcept {
+        const float* t    = table.get() + 1;
+        const float lo    = (float) range_min;
+        const float hi    = (float) range_max;
+        const int last    = size - 2;
+
+        for (int i = 0; i < n; ++i) {
+            const float x   = juce::jlimit (lo, hi, static_cast<float> (data[i]));
+            const float pos = (x - lo) * scale;
+            const int k     = juce::jlimit (0, last, (int) pos);
+            const float a   = pos - (float) k;
+
+            if (Mode == Linear) {
+                data[i] = static_cast<T> (t[k] + a * (t[k + 1] - t[k]));
+            } else {
+                // Catmull-Rom through the neighbouring points
+                const float y0 = t[k - 1], y1 = t[k], y2 = t[k + 1], y3 = t[k + 2];
+                const float c1 = 0.5f * (y2 - y0);
+                const float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+                const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+                data[i] = static_cast<T> (((c3 * a + c2) * a + c1) * a + y1);
+            }
+        }
+    }
+};
+
+}}
@@ -2,6 +2,7 @@
 #pragma once
 #include "lua-kv.hpp"
 #include LKV_JUCE_HEADER
+#include "kv/lua/shared_buffer.hpp"
 
 namespace kv {
 namespace lua {
@@ -47,7 +48,7 @@ struct MidiBufferImpl final {
 inline static 
 MidiBufferImpl**
 new_midibuffer (lua_State* L) {
-    auto** impl = (MidiBufferImpl**) lua_newuserdata (L, sizeof (MidiBufferImpl**));
+    auto** impl = (MidiBufferImpl**) lua_newuserdatauv (L, sizeof (MidiBufferImpl**), shared_link_uv);
     *impl = new MidiBufferImpl (L);
     luaL_setmetatable (L, LKV_MT_MIDI_BUFFER);
     return impl;
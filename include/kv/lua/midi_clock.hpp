@@ -0,0 +1,504 @@
+
+#pragma once
+#include "kv/lua/midi_buffer.hpp"
+
+namespace kv {
+namespace lua {
+
+/** MIDI time code frame rates, numbered as in the MTC hour nibble */
+enum MidiTimecodeType {
+    MTC_24      = 0,
+    MTC_25      = 1,
+    MTC_2997    = 2,
+    MTC_30      = 3
+};
+
+/** An hh:mm:ss:ff time code value */
+struct MidiTimecode final {
+    int hours { 0 }, minutes { 0 }, seconds { 0 }, frames { 0 };
+    int type { MTC_25 };
+
+    /** Frames per second, rounded to the nominal rate */
+    static int nominal_rate (int type) noexcept {
+        static const int rates[] = { 24, 25, 30, 30 };
+        return rates [juce::jlimit (0, 3, type)];
+    }
+
+    /** Actual frames per second */
+    static double frame_rate (int type) noexcept {
+        return type == MTC_2997 ? 30000.0 / 1001.0 : (double) nominal_rate (type);
+    }
+
+    /** Returns the type for a rate in frames per second or -1 if not a
+        supported MTC rate */
+    static int type_for_rate (double fps) noexcept {
+        if (fps == 24.0)    return MTC_24;
+        if (fps == 25.0)    return MTC_25;
+        if (fps == 30.0)    return MTC_30;
+        if (std::abs (fps - 29.97) < 0.01)
+            return MTC_2997;
+        return -1;
+    }
+
+    /** Set from a count of frames since zero */
+    void set_frames (juce::int64 count, int rate_type) noexcept {
+        type = rate_type;
+        const int fps = nominal_rate (type);
+        if (type == MTC_2997) {
+            // drop frame numbers 0 and 1 every minute except each tenth
+            const juce::int64 d = count / 17982, m = count % 17982;
+            count += 18 * d + (m > 1 ? 2 * ((m - 2) / 1798) : 0);
+        }
+
+        frames  = (int) (count % fps);
+        seconds = (int) ((count / fps) % 60);
+        minutes = (int) ((count / (fps * 60)) % 60);
+        hours   = (int) ((count / (fps * 3600)) % 24);
+    }
+
+    /** Returns the count of frames since zero */
+    juce::int64 get_frames() const noexcept {
+        const int fps = nominal_rate (type);
+        const juce::int64 mins = hours * 60 + minutes;
+        juce::int64 count = (mins * 60 + seconds) * fps + frames;
+        if (type == MTC_2997)
+            count -= 2 * (mins - mins / 10);
+        return count;
+    }
+
+    /** Returns the quarter frame data nibble for a sequence piece 0-7 */
+    int piece (int seq) const noexcept {
+        switch (seq & 7) {
+            case 0: return frames & 0x0f;
+            case 1: return (frames >> 4) & 0x01;
+            case 2: return seconds & 0x0f;
+            case 3: return (seconds >> 4) & 0x03;
+            case 4: return minutes & 0x0f;
+            case 5: return (minutes >> 4) & 0x03;
+            case 6: return hours & 0x0f;
+            case 7: return ((hours >> 4) & 0x01) | (type << 1);
+        }
+        return 0;
+    }
+
+    /** Applies a received quarter frame data nibble */
+    void set_piece (int seq, int value) noexcept {
+        switch (seq & 7) {
+            case 0: frames  = (frames  & 0xf0) | value; break;
+            case 1: frames  = (frames  & 0x0f) | ((value & 0x01) << 4); break;
+            case 2: seconds = (seconds & 0xf0) | value; break;
+            case 3: seconds = (seconds & 0x0f) | ((value & 0x03) << 4); break;
+            case 4: minutes = (minutes & 0xf0) | value; break;
+            case 5: minutes = (minutes & 0x0f) | ((value & 0x03) << 4); break;
+            case 6: hours   = (hours   & 0xf0) | value; break;
+            case 7:
+                hours = (hours & 0x0f) | ((value & 0x01) << 4);
+                type  = (value >> 1) & 0x03;
+                break;
+        }
+    }
+};
+
+//==============================================================================
+/** Writes MIDI clock, transport, song position and quarter frame messages
+    into a MIDI buffer with sample accurate timing.
+
+    Nothing is allocated while processing, but the target buffer should have
+    enough space reserved to avoid JUCE growing it.
+*/
+class MidiClockGenerator final {
+public:
+    MidiClockGenerator() { update_period(); }
+    ~MidiClockGenerator() = default;
+
+    void set_sample_rate (double rate) noexcept {
+        if (rate <= 0.0 || rate == sample_rate)
+            return;
+        const double scale = rate / sample_rate;
+        sample_rate = rate;
+        clock_next *= scale;
+        qf_next *= scale;
+        update_period();
+    }
+
+    double get_sample_rate() const noexcept { return sample_rate; }
+
+    void set_tempo (double bpm) noexcept {
+        bpm = juce::jlimit (1.0, 999.0, bpm);
+        if (bpm == tempo)
+            return;
+        const double scale = tempo / bpm;
+        tempo = bpm;
+        clock_next *= scale;
+        update_period();
+    }
+
+    double get_tempo() const noexcept { return tempo; }
+
+    /** Enable time code output. A rate type < 0 disables it */
+    void set_timecode_type (int type) noexcept {
+        mtc_type = juce::jlimit (-1, 3, type);
+        update_period();
+        if (running)
+            sync_timecode (0.0);
+    }
+
+    int get_timecode_type() const noexcept { return mtc_type; }
+
+    bool is_running() const noexcept { return running; }
+
+    /** Position in quarter notes */
+    double get_position() const noexcept {
+        if (! running)
+            return (double) ticks / 24.0;
+        return juce::jmax (0.0, (double) ticks - clock_next / clock_period) / 24.0;
+    }
+
+    /** Transport commands are applied by the next call to process at `frame` */
+    void start (int frame)                  noexcept { schedule (Start, frame); }
+    void stop (int frame)                   noexcept { schedule (Stop, frame); }
+    void resume (int frame)                 noexcept { schedule (Continue, frame); }
+    void locate (double beats, int frame)   noexcept {
+        locate_ticks = juce::jmax (juce::int64(), (juce::int64) (beats * 4.0) * 6);
+        schedule (Locate, frame);
+    }
+
+    /** Write messages for one block */
+    void process (juce::MidiBuffer& buffer, int nframes) noexcept {
+        if (nframes <= 0)
+            return;
+
+        int frame = 0;
+        if (command != None) {
+            const int at = juce::jlimit (0, nframes - 1, command_frame);
+            render (buffer, frame, at);
+            apply (buffer, at);
+            frame = at;
+        }
+
+        render (buffer, frame, nframes);
+
+        if (running) {
+            clock_next -= nframes;
+            qf_next -= nframes;
+            seconds += (double) nframes / sample_rate;
+        }
+    }
+
+private:
+    enum Command { None = 0, Start, Stop, Continue, Locate };
+
+    double sample_rate      { 44100.0 };
+    double tempo            { 120.0 };
+    double clock_period     { 0.0 };
+    double clock_next       { 0.0 };
+    juce::int64 ticks       { 0 };
+    bool running            { false };
+
+    int mtc_type            { -1 };
+    double qf_period        { 0.0 };
+    double qf_next          { 0.0 };
+    int qf_seq              { 0 };
+    juce::int64 mtc_frame   { 0 };
+    MidiTimecode timecode;
+    double seconds          { 0.0 };
+
+    Command command         { None };
+    int command_frame       { 0 };
+    juce::int64 locate_ticks { 0 };
+
+    void update_period() noexcept {
+        clock_period = sample_rate * 60.0 / (tempo * 24.0);
+        if (mtc_type >= 0)
+            qf_period = sample_rate / (MidiTimecode::frame_rate (mtc_type) * 4.0);
+    }
+
+    void schedule (Command c, int frame) noexcept {
+        command = c;
+        command_frame = frame;
+    }
+
+    static void add (juce::MidiBuffer& buffer, int frame, juce::uint8 b1) noexcept {
+        buffer.addEvent (&b1, 1, frame);
+    }
+
+    static void add (juce::MidiBuffer& buffer, int frame, juce::uint8 b1,
+                     juce::uint8 b2) noexcept {
+        const juce::uint8 data[] = { b1, b2 };
+        buffer.addEvent (data, 2, frame);
+    }
+
+    /** Align quarter frames to the next even frame after `offset` samples */
+    void sync_timecode (double offset) noexcept {
+        if (mtc_type < 0)
+            return;
+        const double fps = MidiTimecode::frame_rate (mtc_type);
+        const double pos = (seconds + offset / sample_rate) * fps;
+        mtc_frame = (juce::int64) std::ceil (pos);
+        if (mtc_frame & 1)
+            ++mtc_frame;
+        qf_next = offset + ((double) mtc_frame - pos) / fps * sample_rate;
+        qf_seq = 0;
+    }
+
+    void apply (juce::MidiBuffer& buffer, int frame) noexcept {
+        const auto c = command;
+        command = None;
+
+        switch (c) {
+            case Start:
+                add (buffer, frame, 0xfa);
+                ticks = 0;
+                seconds = 0.0;
+                running = true;
+                clock_next = frame;
+                sync_timecode (frame);
+                break;
+
+            case Continue:
+                if (running)
+                    break;
+                add (buffer, frame, 0xfb);
+                running = true;
+                clock_next = frame;
+                seconds = (double) ticks / 24.0 * 60.0 / tempo - frame / sample_rate;
+                sync_timecode (frame);
+                break;
+
+            case Stop:
+                if (! running)
+                    break;
+                add (buffer, frame, 0xfc);
+                // next tick index becomes the song position
+                running = false;
+                break;
+
+            case Locate: {
+                if (running)
+                    break;
+                ticks = juce::jmin (locate_ticks, (juce::int64) 0x3fff * 6);
+                const int beats = (int) (ticks / 6);
+                const juce::uint8 data[] = { 0xf2, (juce::uint8) (beats & 0x7f),
+                                             (juce::uint8) ((beats >> 7) & 0x7f) };
+                buffer.addEvent (data, 3, frame);
+                seconds = (double) ticks / 24.0 * 60.0 / tempo;
+                break;
+            }
+
+            case None:
+                break;
+        }
+    }
+
+    void render (juce::MidiBuffer& buffer, int start, int end) noexcept {
+        if (! running)
+            return;
+
+        while (clock_next < (double) end) {
+            add (buffer, juce::jmax (start, (int) clock_next), 0xf8);
+            ++ticks;
+            clock_next += clock_period;
+        }
+
+        if (mtc_type < 0)
+            return;
+
+        while (qf_next < (double) end) {
+            if (qf_seq == 0)
+                timecode.set_frames (mtc_frame, mtc_type);
+            add (buffer, juce::jmax (start, (int) qf_next), 0xf1,
+                 (juce::uint8) ((qf_seq << 4) | timecode.piece (qf_seq)));
+            if (++qf_seq == 8) {
+                qf_seq = 0;
+                mtc_frame += 2;
+            }
+            qf_next += qf_period;
+        }
+    }
+};
+
+//==============================================================================
+/** Follows incoming MIDI clock.
+
+    Clock arrival times are smoothed with a second order delay locked loop
+    (see F. Adriaensen, "Using a DLL to filter time") giving a stable tempo
+    and a continuous song position between ticks.
+*/
+class MidiClockFollower final {
+public:
+    MidiClockFollower() = default;
+    ~MidiClockFollower() = default;
+
+    void set_sample_rate (double rate) noexcept {
+        if (rate > 0.0 && rate != sample_rate) {
+            sample_rate = rate;
+            reset();
+        }
+    }
+
+    double get_sample_rate() const noexcept { return sample_rate; }
+
+    /** Loop bandwidth relative to the tick rate. Lower is smoother but
+        slower to follow tempo changes */
+    void set_bandwidth (double bw) noexcept {
+        bandwidth = juce::jlimit (0.0001, 0.5, bw);
+        update_coefficients();
+    }
+
+    double get_bandwidth() const noexcept { return bandwidth; }
+
+    void reset() noexcept {
+        locked = false;
+        num_ticks = 0;
+        time = 0;
+    }
+
+    bool is_locked() const noexcept { return locked; }
+    bool is_running() const noexcept { return running; }
+
+    /** Estimated tempo in beats per minute, 0 if not locked */
+    double get_tempo() const noexcept {
+        return locked ? sample_rate * 60.0 / (period * 24.0) : 0.0;
+    }
+
+    /** Estimated song position in quarter notes at the end of the last
+        processed block */
+    double get_position() const noexcept {
+        if (! running || last_index < 0)
+            return (double) next_index / 24.0;
+        double phase = 0.0;
+        if (locked)
+            phase = juce::jlimit (0.0, 1.0, ((double) time - t0) / period);
+        return ((double) last_index + phase) / 24.0;
+    }
+
+    const MidiTimecode& get_timecode() const noexcept { return timecode; }
+
+    void process (const juce::MidiBuffer& buffer, int nframes) noexcept {
+        for (const auto meta : buffer) {
+            if (meta.samplePosition >= nframes)
+                break;
+            handle (meta.data, meta.numBytes, time + meta.samplePosition);
+        }
+
+        time += juce::jmax (0, nframes);
+
+        if (num_ticks > 0 && (double) (time - last_tick) > timeout) {
+            locked = false;
+            num_ticks = 0;
+        }
+    }
+
+private:
+    double sample_rate      { 44100.0 };
+    double bandwidth        { 0.05 };
+    double b                { 0.0 };
+    double c                { 0.0 };
+
+    // DLL state: filtered times of the last and next tick, and period
+    double t0               { 0.0 };
+    double t1               { 0.0 };
+    double period           { 0.0 };
+    double timeout          { 0.0 };
+
+    juce::int64 time        { 0 };
+    juce::int64 last_tick   { 0 };
+    juce::int64 num_ticks   { 0 };
+    juce::int64 last_index  { -1 };
+    juce::int64 next_index  { 0 };
+    bool locked             { false };
+    bool running            { false };
+
+    MidiTimecode timecode;
+    MidiTimecode incoming;
+    int qf_received         { 0 };
+
+    void update_coefficients() noexcept {
+        const double omega = juce::MathConstants<double>::twoPi * bandwidth;
+        b = juce::MathConstants<double>::sqrt2 * omega;
+        c = omega * omega;
+    }
+
+    void tick (juce::int64 at) noexcept {
+        if (b == 0.0)
+            update_coefficients();
+
+        if (num_ticks == 0) {
+            t0 = (double) at;
+        } else if (num_ticks == 1) {
+            period = (double) (at - last_tick);
+            t0 = (double) at;
+            t1 = t0 + period;
+            locked = period > 0.0;
+        } else {
+            const double e = (double) at - t1;
+            t0 = t1;
+            t1 += b * e + period;
+            period += c * e;
+            if (period <= 0.0) {
+                locked = false;
+                num_ticks = 0;
+                return;
+            }
+        }
+
+        last_tick = at;
+        ++num_ticks;
+        timeout = juce::jmax (4.0 * period, sample_rate * 0.25);
+
+        if (running)
+            last_index = next_index++;
+    }
+
+    void handle (const juce::uint8* data, int size, juce::int64 at) noexcept {
+        if (size <= 0)
+            return;
+
+        switch (data[0]) {
+            case 0xf8:
+                tick (at);
+                break;
+
+            case 0xfa:
+                running = true;
+                last_index = -1;
+                next_index = 0;
+                break;
+
+            case 0xfb:
+                running = true;
+                last_index = -1;
+                break;
+
+            case 0xfc:
+                if (running && last_index >= 0)
+                    next_index = last_index + 1;
+                running = false;
+                break;
+
+            case 0xf2:
+                if (size >= 3) {
+                    next_index = ((juce::int64) data[1] | ((juce::int64) data[2] << 7)) * 6;
+                    last_index = -1;
+                }
+                break;
+
+            case 0xf1:
+                if (size >= 2) {
+                    const int seq = (data[1] >> 4) & 0x07;
+                    incoming.set_piece (seq, data[1] & 0x0f);
+                    qf_received = seq == 0 ? 1 : qf_received | (1 << seq);
+                    if (seq == 7 && qf_received == 0xff) {
+                        // a full sequence spans two frames
+                        timecode.set_frames (incoming.get_frames() + 2, incoming.type);
+                    }
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+};
+
+}}
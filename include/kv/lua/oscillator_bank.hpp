@@ -0,0 +1,223 @@
+
+#pragma once
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** A bank of oscillators sharing one waveform.
+
+    Voice state is kept as structure-of-arrays and each voice renders a whole
+    block in one loop. Phase for sample `i` is computed from the block start
+    as `frac (phase + i * increment)`, so there is no loop carried dependency
+    and the inner loops auto-vectorize when built with SIMD enabled.
+*/
+class OscillatorBank final {
+public:
+    enum Mode {
+        Sine        = 0,
+        Saw         = 1,
+        Square      = 2,
+        Wavetable   = 3
+    };
+
+    explicit OscillatorBank (int numVoices, double rate = 44100.0)
+        : size (juce::jmax (1, numVoices))
+    {
+        phase.allocate ((size_t) size, true);
+        increment.allocate ((size_t) size, true);
+        frequency.allocate ((size_t) size, true);
+        gain.allocate ((size_t) size, true);
+        set_sample_rate (rate);
+        set_wavetable<double> (nullptr, 0);
+    }
+
+    ~OscillatorBank() = default;
+
+    int get_size() const noexcept { return size; }
+
+    void set_sample_rate (double rate) noexcept {
+        sample_rate = rate > 0.0 ? rate : 44100.0;
+        for (int v = 0; v < size; ++v)
+            update_increment (v);
+    }
+
+    double get_sample_rate() const noexcept { return sample_rate; }
+
+    void set_mode (int m) noexcept  { mode = juce::jlimit ((int) Sine, (int) Wavetable, m); }
+    int get_mode() const noexcept   { return mode; }
+
+    void set_frequency (int v, double hz) noexcept {
+        if (! juce::isPositiveAndBelow (v, size))
+            return;
+        frequency[v] = hz;
+        update_increment (v);
+    }
+
+    double get_frequency (int v) const noexcept {
+        return juce::isPositiveAndBelow (v, size) ? frequency[v] : 0.0;
+    }
+
+    void set_gain (int v, double g) noexcept {
+        if (juce::isPositiveAndBelow (v, size))
+            gain[v] = g;
+    }
+
+    double get_gain (int v) const noexcept {
+        return juce::isPositiveAndBelow (v, size) ? gain[v] : 0.0;
+    }
+
+    void set_phase (int v, double p) noexcept {
+        if (juce::isPositiveAndBelow (v, size))
+            phase[v] = p - std::floor (p);
+    }
+
+    double get_phase (int v) const noexcept {
+        return juce::isPositiveAndBelow (v, size) ? phase[v] : 0.0;
+    }
+
+    double* get_frequencies() noexcept  { return frequency.get(); }
+    double* get_gains() noexcept        { return gain.get(); }
+
+    /** Call after writing directly to the frequency array */
+    void update_increments() noexcept {
+        for (int v = 0; v < size; ++v)
+            update_increment (v);
+    }
+
+    /** Reset all phases to zero */
+    void reset() noexcept {
+        phase.clear ((size_t) size);
+    }
+
+    /** Replace the single cycle wavetable.
+        Allocates, do not call on the audio thread. An empty table gives a sine.
+    */
+    template<typename T>
+    void set_wavetable (const T* values, int n) {
+        if (values == nullptr || n <= 0) {
+            table_size = 2048;
+            table.allocate ((size_t) table_size + 1, false);
+            for (int i = 0; i < table_size; ++i)
+                table[i] = std::sin (juce::MathConstants<double>::twoPi * (double) i / (double) table_size);
+        } else {
+            table_size = n;
+            table.allocate ((size_t) table_size + 1, false);
+            for (int i = 0; i < n; ++i)
+                table[i] = static_cast<double> (values[i]);
+        }
+        table[table_size] = table[0];
+    }
+
+    int get_wavetable_size() const noexcept { return table_size; }
+
+    /** Adds every voice to `out` and advances the phases by `nframes` */
+    template<typename T>
+    LKV_TARGET_CLONES
+    void render (T* out, int nframes) noexcept {
+        if (out == nullptr || nframes <= 0)
+            return;
+
+        for (int v = 0; v < size; ++v) {
+            const double p0  = phase[v];
+            const double inc = increment[v];
+            const double g   = gain[v];
+
+            if (g != 0.0) {
+                switch (mode) {
+                    case Saw:       render_saw (out, nframes, p0, inc, g); break;
+                    case Square:    render_square (out, nframes, p0, inc, g); break;
+                    case Wavetable: render_table (out, nframes, p0, inc, g); break;
+                    default:        render_sine (out, nframes, p0, inc, g); break;
+                }
+            }
+
+            const double p = p0 + inc * (double) nframes;
+            phase[v] = p - std::floor (p);
+        }
+    }
+
+    /** Sine approximation, `x` in cycles. Accurate to about 1e-9 */
+    static inline double sine (double x) noexcept {
+        // fold to a quarter cycle around zero: sin(2pi x) = -sin(2pi t)
+        double t = x - std::floor (x) - 0.5;
+        const double half = std::copysign (0.5, t);
+        t = std::abs (t) > 0.25 ? half - t : t;
+
+        const double r  = t * juce::MathConstants<double>::twoPi;
+        const double r2 = r * r;
+        const double s  = r * (1.0 + r2 * (-1.0 / 6.0 + r2 * (1.0 / 120.0 + r2 * (-1.0 / 5040.0
+                          + r2 * (1.0 / 362880.0 + r2 * (-1.0 / 39916800.0 + r2 * (1.0 / 6227020800.0)))))));
+        return -s;
+    }
+
+    /** PolyBLEP residual for phase `t` and increment `dt` */
+    static inline double blep (double t, double dt) noexcept {
+        if (t < dt) {
+            t /= dt;
+            return t + t - t * t - 1.0;
+        }
+        if (t > 1.0 - dt) {
+            t = (t - 1.0) / dt;
+            return t * t + t + t + 1.0;
+        }
+        return 0.0;
+    }
+
+private:
+    int size;
+    int mode { Sine };
+    double sample_rate { 44100.0 };
+    juce::HeapBlock<double> phase, increment, frequency, gain;
+    juce::HeapBlock<double> table;
+    int table_size { 0 };
+
+    void update_increment (int v) noexcept {
+        // limited to nyquist, PolyBLEP assumes fewer than one edge per sample
+        increment[v] = juce::jlimit (0.0, 0.5, std::abs (frequency[v]) / sample_rate);
+    }
+
+    template<typename T>
+    static void render_sine (T* out, int n, double p0, double inc, double g) noexcept {
+        for (int i = 0; i < n; ++i)
+            out[i] += static_cast<T> (g * sine (p0 + inc * (double) i));
+    }
+
+    template<typename T>
+    static void render_saw (T* out, int n, double p0, double inc, double g) noexcept {
+        for (int i = 0; i < n; ++i) {
+            double t = p0 + inc * (double) i;
+            t -= std::floor (t);
+            out[i] += static_cast<T> (g * (2.0 * t - 1.0 - blep (t, inc)));
+        }
+    }
+
+    template<typename T>
+    static void render_square (T* out, int n, double p0, double inc, double g) noexcept {
+        for (int i = 0; i < n; ++i) {
+            double t = p0 + inc * (double) i;
+            t -= std::floor (t);
+            double t2 = t + 0.5;
+            t2 -= std::floor (t2);
+            const double naive = t < 0.5 ? 1.0 : -1.0;
+            out[i] += static_cast<T> (g * (naive + blep (t, inc) - blep (t2, inc)));
+        }
+    }
+
+    template<typename T>
+    void render_table (T* out, int n, double p0, double inc, double g) const noexcept {
+        const double* tbl = table.get();
+        const double scale = (double) table_size;
+        for (int i = 0; i < n; ++i) {
+            double t = p0 + inc * (double) i;
+            t = (t - std::floor (t)) * scale;
+            const int j = juce::jmin (table_size - 1, (int) t);
+            const double f = t - (double) j;
+            out[i] += static_cast<T> (g * (tbl[j] + f * (tbl[j + 1] - tbl[j])));
+        }
+    }
+};
+
+}}
@@ -0,0 +1,150 @@
+
+#pragma once
+
+#include "kv/lua/lookup_table.hpp"
+
+namespace kv {
+namespace lua {
+
+/** Runs nonlinear processing at a multiple of the sample rate.
+
+    Wraps juce::dsp::Oversampling with filter memory and a 32 bit staging
+    buffer sized for a maximum block when created. The upsampled audio is
+    exposed through a buffer that refers to the oversampling stage's own
+    memory, so scripts can process it without copies. An optional
+    waveshaper table is applied natively at the high rate.
+*/
+class Oversampler final {
+public:
+    enum Filter {
+        IIR = 0,
+        FIR = 1
+    };
+
+    enum { max_channels = 64 };
+
+    Oversampler (int numChannels, int factor, int maxBlock = 4096, int filter = IIR)
+        : num_channels (juce::jlimit (1, (int) max_channels, numChannels)),
+          max_block (juce::jmax (1, maxBlock)),
+          filter_type (filter == FIR ? FIR : IIR),
+          oversampling ((size_t) num_channels, (size_t) order_for (factor),
+                        filter_type == FIR ? juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple
+                                           : juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR,
+                        true)
+    {
+        oversampling.initProcessing ((size_t) max_block);
+        staging.setSize (num_channels, max_block);
+    }
+
+    ~Oversampler() = default;
+
+    int get_num_channels() const noexcept   { return num_channels; }
+    int get_max_block() const noexcept      { return max_block; }
+    int get_filter() const noexcept         { return filter_type; }
+    int get_factor() const noexcept         { return (int) oversampling.getOversamplingFactor(); }
+    double get_latency() const noexcept     { return (double) oversampling.getLatencyInSamples(); }
+
+    void reset() noexcept { oversampling.reset(); }
+
+    /** Use another buffer as the view of the upsampled audio.
+        The buffer must outlive this object or be replaced first.
+    */
+    void set_view (juce::AudioBuffer<float>* buffer) noexcept {
+        view = buffer != nullptr ? buffer : &own_view;
+    }
+
+    /** Buffer referring to the upsampled audio of the current chunk.
+        Only valid while processing.
+    */
+    juce::AudioBuffer<float>& get_view() noexcept { return *view; }
+
+    /** Set a transfer curve over -1 to 1, or clear it with an empty table.
+        Allocates.
+    */
+    template<typename T>
+    void set_shaper (const T* values, int n) {
+        shaper.set_values (values, n);
+    }
+
+    bool has_shaper() const noexcept { return ! shaper.is_empty(); }
+
+    /** Oversample `n` frames of each channel in place.
+        Audio is handled in chunks of the maximum block. For each chunk the
+        shaper is applied, then `on_chunk()` is called with the view set.
+    */
+    template<typename T, typename Fn>
+    void process (T* const* io, int nchans, int n, Fn&& on_chunk) {
+        nchans = juce::jmin (nchans, num_channels);
+        for (int done = 0; done < n;) {
+            const int chunk = juce::jmin (n - done, max_block);
+            float* const* chans = stage (io, nchans, done, chunk);
+
+            juce::dsp::AudioBlock<const float> input (chans, (size_t) nchans, 0, (size_t) chunk);
+            auto up = oversampling.processSamplesUp (input);
+            refer_view (up, nchans);
+            if (has_shaper())
+                apply_shaper();
+            on_chunk();
+
+            juce::dsp::AudioBlock<float> output (chans, (size_t) nchans, 0, (size_t) chunk);
+            oversampling.processSamplesDown (output);
+            unstage (io, nchans, done, chunk);
+            done += chunk;
+        }
+    }
+
+private:
+    int num_channels, max_block, filter_type;
+    juce::dsp::Oversampling<float> oversampling;
+    juce::AudioBuffer<float> staging, own_view;
+    juce::AudioBuffer<float>* view { &own_view };
+    LookupTable shaper;
+    float* pointers[max_channels] {};
+
+    static int order_for (int factor) noexcept {
+        int order = 1;
+        while ((1 << order) < factor && order < 4)
+            ++order;
+        return order;
+    }
+
+    /** 32 bit audio is processed in place, 64 bit goes through staging */
+    float* const* stage (float* const* io, int nchans, int offset, int) noexcept {
+        for (int c = 0; c < nchans; ++c)
+            pointers[c] = io[c] + offset;
+        return pointers;
+    }
+
+    float* const* stage (double* const* io, int nchans, int offset, int n) noexcept {
+        for (int c = 0; c < nchans; ++c) {
+            float* dst = staging.getWritePointer (c);
+            for (int i = 0; i < n; ++i)
+                dst[i] = static_cast<float> (io[c][offset + i]);
+        }
+        return staging.getArrayOfWritePointers();
+    }
+
+    void unstage (float* const*, int, int, int) noexcept {}
+
+    void unstage (double* const* io, int nchans, int offset, int n) noexcept {
+        for (int c = 0; c < nchans; ++c) {
+            const float* src = staging.getReadPointer (c);
+            for (int i = 0; i < n; ++i)
+                io[c][offset + i] = static_cast<double> (src[i]);
+        }
+    }
+
+    void refer_view (juce::dsp::AudioBlock<float>& up, int nchans) noexcept {
+        float* chans[max_channels];
+        for (int c = 0; c < nchans; ++c)
+            chans[c] = up.getChannelPointer ((size_t) c);
+        view->setDataToReferTo (chans, nchans, (int) up.getNumSamples());
+    }
+
+    void apply_shaper() noexcept {
+        for (int c = 0; c < view->getNumChannels(); ++c)
+            shaper.process (view->getWritePointer (c), view->getNumSamples());
+    }
+};
+
+}}
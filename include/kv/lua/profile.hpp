@@ -0,0 +1,386 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#if defined (_MSC_VER) && (defined (_M_X64) || defined (_M_IX86))
+ #include <intrin.h>
+ #define LKV_PROFILE_TSC 1
+#elif defined (__x86_64__) || defined (__i386__)
+ #include <x86intrin.h>
+ #define LKV_PROFILE_TSC 1
+#else
+ #define LKV_PROFILE_TSC 0
+#endif
+
+#include "lua-kv.hpp"
+
+namespace kv {
+namespace lua {
+
+/** Monotonic tick counter for timing zones.
+    Reads the CPU time stamp counter on x86, which is constant rate on any
+    processor from the last decade, and the steady clock in nanoseconds
+    elsewhere. Ticks are converted to time against the steady clock.
+*/
+struct ProfileClock final {
+    static uint64_t now() noexcept {
+       #if LKV_PROFILE_TSC
+        return (uint64_t) __rdtsc();
+       #else
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+       #endif
+    }
+
+    /** Start measuring the tick rate. Call once early, off the audio thread */
+    static void init() { reference(); }
+
+    /** Ticks per microsecond. May sleep briefly the first time */
+    static double ticks_per_us() {
+       #if LKV_PROFILE_TSC
+        static const double rate = [] {
+            using namespace std::chrono;
+            const auto& ref = reference();
+            auto elapsed = steady_clock::now() - ref.time;
+            if (elapsed < milliseconds (20))
+                std::this_thread::sleep_for (milliseconds (20) - elapsed);
+            const uint64_t ticks = now();
+            elapsed = steady_clock::now() - ref.time;
+            return (double) (ticks - ref.ticks) / duration<double, std::micro> (elapsed).count();
+        }();
+        return rate;
+       #else
+        return 1000.0;
+       #endif
+    }
+
+    /** Ticks at init(), the origin of trace timestamps */
+    static uint64_t origin() { return reference().ticks; }
+
+private:
+    struct Reference {
+        uint64_t ticks;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    static const Reference& reference() {
+        static const Reference ref { now(), std::chrono::steady_clock::now() };
+        return ref;
+    }
+};
+
+/** Log linear histogram of tick counts, four buckets per octave.
+    Written by one thread and read by any.
+*/
+struct ProfileHistogram final {
+    enum { num_buckets = 256 };
+
+    std::atomic<uint64_t> count { 0 }, total { 0 }, max { 0 };
+    std::atomic<uint32_t> buckets[num_buckets] {};
+
+    void add (uint64_t ticks) noexcept {
+        // single writer, so plain loads and stores are enough
+        bump (count, 1);
+        bump (total, ticks);
+        if (ticks > max.load (std::memory_order_relaxed))
+            max.store (ticks, std::memory_order_relaxed);
+        auto& b = buckets[bucket_for (ticks)];
+        b.store (b.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clear() noexcept {
+        count.store (0, std::memory_order_relaxed);
+        total.store (0, std::memory_order_relaxed);
+        max.store (0, std::memory_order_relaxed);
+        for (auto& b : buckets)
+            b.store (0, std::memory_order_relaxed);
+    }
+
+    static int bucket_for (uint64_t v) noexcept {
+        if (v < 8)
+            return (int) v;
+        const int e = highest_bit (v);
+        return 8 + (e - 3) * 4 + (int) ((v >> (e - 2)) & 3);
+    }
+
+    /** Smallest value in a bucket */
+    static uint64_t bucket_low (int b) noexcept {
+        if (b < 8)
+            return (uint64_t) b;
+        const int e = (b - 8) / 4 + 3;
+        return (uint64_t) (4 + (b - 8) % 4) << (e - 2);
+    }
+
+private:
+    static void bump (std::atomic<uint64_t>& a, uint64_t n) noexcept {
+        a.store (a.load (std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static int highest_bit (uint64_t v) noexcept {
+       #if defined (_MSC_VER)
+        int e = 0;
+        while (v >>= 1)
+            ++e;
+        return e;
+       #else
+        return 63 - __builtin_clzll (v);
+       #endif
+    }
+};
+
+/** Totals for one named zone on one thread */
+struct ProfileZone final {
+    enum { max_name = 48 };
+    char name[max_name] {};
+    ProfileHistogram histogram;
+};
+
+/** Zone timers for one thread.
+    Each thread that times zones gets its own set, so timing needs no locks
+    or atomic read-modify-write. Threads are kept in a list that is only
+    ever prepended to, and are never freed.
+*/
+class ProfileThread final {
+public:
+    enum { max_zones = 128, max_depth = 32, max_events = 8192, cache_size = 256 };
+
+    struct Event {
+        int zone;
+        uint64_t start, end;
+    };
+
+    /** The calling thread's zones. Allocates the first time on each thread */
+    static ProfileThread& current() {
+        thread_local ProfileThread* thread = nullptr;
+        if (thread == nullptr) {
+            thread = new ProfileThread();
+            thread->id = next_id().fetch_add (1) + 1;
+            auto& head = list_head();
+            thread->next = head.load (std::memory_order_relaxed);
+            while (! head.compare_exchange_weak (thread->next, thread,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {}
+        }
+        return *thread;
+    }
+
+    /** First thread in the list, or nullptr */
+    static ProfileThread* first() noexcept { return list_head().load (std::memory_order_acquire); }
+    ProfileThread* get_next() const noexcept { return next; }
+
+    /** Record begin and end of zones as trace events */
+    static std::atomic<bool>& tracing() noexcept {
+        static std::atomic<bool> enabled { false };
+        return enabled;
+    }
+
+    int get_id() const noexcept { return id; }
+    int get_num_zones() const noexcept { return num_zones.load (std::memory_order_acquire); }
+    const ProfileZone& get_zone (int i) const noexcept { return zones[i]; }
+
+    enum Result { Ok = 0, TooManyZones, TooDeep, NotStarted, Mismatched };
+
+    /** Start timing a zone */
+    Result begin (const char* name) noexcept {
+        if (depth >= max_depth)
+            return TooDeep;
+        const int z = find_zone (name);
+        if (z < 0)
+            return TooManyZones;
+        stack[depth++] = { z, ProfileClock::now() };
+        return Ok;
+    }
+
+    /** Stop timing the innermost zone. If `name` is given it must match */
+    Result finish (const char* name) noexcept {
+        const uint64_t end = ProfileClock::now();
+        if (depth <= 0)
+            return NotStarted;
+        const auto& frame = stack[depth - 1];
+        if (name != nullptr && std::strncmp (name, zones[frame.zone].name, ProfileZone::max_name - 1) != 0)
+            return Mismatched;
+        --depth;
+        zones[frame.zone].histogram.add (end - frame.start);
+
+        if (tracing().load (std::memory_order_relaxed)) {
+            const uint64_t n = num_events.load (std::memory_order_relaxed);
+            events[n % max_events] = { frame.zone, frame.start, end };
+            num_events.store (n + 1, std::memory_order_release);
+        }
+        return Ok;
+    }
+
+    /** Recorded events, oldest first. Read while the thread is quiet */
+    template<typename Fn>
+    void for_each_event (Fn&& fn) const {
+        const uint64_t n = num_events.load (std::memory_order_acquire);
+        const uint64_t first = n > max_events ? n - max_events : 0;
+        for (uint64_t i = first; i < n; ++i)
+            fn (events[i % max_events]);
+    }
+
+    /** Clear totals and events. Zone names are kept */
+    void clear() noexcept {
+        for (int i = 0; i < get_num_zones(); ++i)
+            zones[i].histogram.clear();
+        num_events.store (0, std::memory_order_relaxed);
+    }
+
+private:
+    ProfileThread() = default;
+
+    struct Frame {
+        int zone;
+        uint64_t start;
+    };
+
+    struct Slot {
+        const void* key;
+        int zone;
+    };
+
+    int id { 0 };
+    ProfileThread* next { nullptr };
+    std::atomic<int> num_zones { 0 };
+    ProfileZone zones[max_zones];
+    Slot cache[cache_size] {};
+    Frame stack[max_depth] {};
+    int depth { 0 };
+    Event events[max_events] {};
+    std::atomic<uint64_t> num_events { 0 };
+
+    static std::atomic<ProfileThread*>& list_head() noexcept {
+        static std::atomic<ProfileThread*> head { nullptr };
+        return head;
+    }
+
+    static std::atomic<int>& next_id() noexcept {
+        static std::atomic<int> counter { 0 };
+        return counter;
+    }
+
+    /** Zone for a name. Names from Lua are interned, so the pointer is
+        cached and checked against the stored name.
+    */
+    int find_zone (const char* name) noexcept {
+        auto& slot = cache[((uintptr_t) name >> 4) % cache_size];
+        if (slot.key == name && std::strncmp (zones[slot.zone].name, name, ProfileZone::max_name - 1) == 0)
+            return slot.zone;
+
+        const int n = num_zones.load (std::memory_order_relaxed);
+        int z = 0;
+        while (z < n && std::strncmp (zones[z].name, name, ProfileZone::max_name - 1) != 0)
+            ++z;
+
+        if (z == n) {
+            if (n >= max_zones)
+                return -1;
+            std::strncpy (zones[n].name, name, ProfileZone::max_name - 1);
+            num_zones.store (n + 1, std::memory_order_release);
+        }
+
+        slot = { name, z };
+        return z;
+    }
+};
+
+/** Counts where a Lua state spends its time by sampling it from a count
+    hook. Samples are keyed by source and line in a fixed table that is
+    allocated up front.
+*/
+class ProfileSampler final {
+public:
+    enum { capacity = 4096, max_name = 48 };
+
+    struct Entry {
+        const void* source;
+        int line;
+        uint64_t count;
+        char where[LUA_IDSIZE];
+        char name[max_name];
+    };
+
+    ProfileSampler() : entries (new Entry[capacity]) { clear(); }
+    ~ProfileSampler() = default;
+
+    bool is_running() const noexcept { return running; }
+    uint64_t get_total() const noexcept { return total; }
+    uint64_t get_dropped() const noexcept { return dropped; }
+
+    void start (lua_State* L, int period) noexcept {
+        running = true;
+        lua_sethook (L, hook, LUA_MASKCOUNT, std::max (1, period));
+    }
+
+    void stop (lua_State* L) noexcept {
+        running = false;
+        lua_sethook (L, nullptr, 0, 0);
+    }
+
+    void clear() noexcept {
+        for (int i = 0; i < capacity; ++i)
+            entries[i].count = 0;
+        total = dropped = 0;
+    }
+
+    template<typename Fn>
+    void for_each (Fn&& fn) const {
+        for (int i = 0; i < capacity; ++i)
+            if (entries[i].count > 0)
+                fn (entries[i]);
+    }
+
+    /** Registry key of the sampler the hook records into */
+    static const void* registry_key() noexcept {
+        static const char key = 0;
+        return &key;
+    }
+
+private:
+    std::unique_ptr<Entry[]> entries;
+    uint64_t total { 0 }, dropped { 0 };
+    bool running { false };
+
+    static void hook (lua_State* L, lua_Debug* ar) {
+        lua_rawgetp (L, LUA_REGISTRYINDEX, registry_key());
+        auto** sampler = (ProfileSampler**) lua_touserdata (L, -1);
+        lua_pop (L, 1);
+        if (sampler != nullptr && *sampler != nullptr && lua_getinfo (L, "Sl", ar) != 0)
+            (*sampler)->record (L, ar);
+    }
+
+    void record (lua_State* L, lua_Debug* ar) noexcept {
+        ++total;
+        const auto h = ((uintptr_t) ar->source >> 3) * 31u + (uintptr_t) ar->currentline;
+        for (int probe = 0; probe < 16; ++probe) {
+            auto& e = entries[(h + (uintptr_t) probe) % capacity];
+            if (e.count == 0) {
+                e.source = ar->source;
+                e.line   = ar->currentline;
+                std::memcpy (e.where, ar->short_src, sizeof (e.where));
+                e.name[0] = 0;
+                if (lua_getinfo (L, "n", ar) != 0 && ar->name != nullptr) {
+                    std::strncpy (e.name, ar->name, max_name - 1);
+                    e.name[max_name - 1] = 0;
+                }
+                e.count = 1;
+                return;
+            }
+            if (e.source == ar->source && e.line == ar->currentline
+                && std::strncmp (e.where, ar->short_src, LUA_IDSIZE) == 0) {
+                ++e.count;
+                return;
+            }
+        }
+        ++dropped;
+    }
+};
+
+}}
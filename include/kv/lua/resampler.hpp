@@ -0,0 +1,207 @@
+
+#pragma once
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+namespace kv {
+namespace lua {
+
+/** Streaming multichannel sample rate converter.
+
+    Input frames are pushed into a per-channel history as the read position
+    advances, so blocks of any size can be given and state carries over to
+    the next call. Each output frame computes its kernel once and applies it
+    to every channel.
+
+    The sinc modes use a Kaiser windowed polyphase table with linear
+    interpolation between phases. When downsampling the cutoff follows the
+    output rate. Lagrange is a four point cubic without band limiting.
+*/
+class Resampler final {
+public:
+    enum Quality {
+        Lagrange    = 0,
+        Sinc        = 1,
+        SincBest    = 2
+    };
+
+    enum { num_phases = 256, max_channels = 256 };
+
+    explicit Resampler (int numChannels, int q = Sinc)
+        : num_channels (juce::jlimit (1, (int) max_channels, numChannels))
+    {
+        set_quality (q);
+    }
+
+    ~Resampler() = default;
+
+    int get_num_channels() const noexcept   { return num_channels; }
+    int get_quality() const noexcept        { return quality; }
+    int get_num_taps() const noexcept       { return num_taps; }
+
+    /** Delay in input frames */
+    int get_latency() const noexcept        { return num_taps / 2; }
+
+    /** Output rate divided by input rate */
+    double get_ratio() const noexcept       { return 1.0 / step; }
+
+    /** Change the quality. Allocates and resets */
+    void set_quality (int q) {
+        quality  = juce::jlimit ((int) Lagrange, (int) SincBest, q);
+        num_taps = quality == Lagrange ? 4 : (quality == Sinc ? 32 : 64);
+        history.allocate ((size_t) (num_taps * 2 * num_channels), true);
+        coefs.allocate ((size_t) num_taps, true);
+        if (quality != Lagrange)
+            table.allocate ((size_t) (num_taps * (num_phases + 1)), true);
+        cutoff = 0.0;
+        build_table();
+        reset();
+    }
+
+    /** Change the ratio between blocks.
+        Rebuilds the kernel when the downsampling cutoff changes, which
+        does not allocate but is not free either.
+    */
+    void set_ratio (double ratio) noexcept {
+        ratio = juce::jlimit (1.0 / 256.0, 256.0, ratio);
+        step = 1.0 / ratio;
+        build_table();
+    }
+
+    void reset() noexcept {
+        history.clear ((size_t) (num_taps * 2 * num_channels));
+        write = 0;
+        frac = 1.0;
+    }
+
+    /** Convert up to `nin` frames into up to `nout` frames.
+        Stops when either side runs out.
+        @returns consumed input frames and produced output frames
+    */
+    template<typename TI, typename TO>
+    LKV_TARGET_CLONES
+    std::pair<int, int> process (const TI* const* in, int nin, TO* const* out, int nout, int nchans) noexcept {
+        nchans = juce::jmin (nchans, num_channels);
+        int consumed = 0, produced = 0;
+
+        while (produced < nout) {
+            while (frac >= 1.0) {
+                if (consumed == nin)
+                    return { consumed, produced };
+                for (int c = 0; c < nchans; ++c)
+                    push (c, static_cast<float> (in[c][consumed]));
+                write = (write + 1) % num_taps;
+                ++consumed;
+                frac -= 1.0;
+            }
+
+            compute_coefficients();
+            for (int c = 0; c < nchans; ++c)
+                out[c][produced] = static_cast<TO> (dot (channel_history (c) + write));
+
+            ++produced;
+            frac += step;
+        }
+
+        return { consumed, produced };
+    }
+
+private:
+    int num_channels;
+    int quality { Sinc };
+    int num_taps { 32 };
+    int write { 0 };
+    double step { 1.0 };
+    double frac { 1.0 };
+    double cutoff { 0.0 };
+    juce::HeapBlock<float> history, coefs, table;
+
+    /** History is stored twice so the newest `num_taps` are contiguous */
+    float* channel_history (int c) const noexcept {
+        return history.get() + (size_t) (c * num_taps * 2);
+    }
+
+    void push (int c, float x) noexcept {
+        float* h = channel_history (c);
+        h[write] = x;
+        h[write + num_taps] = x;
+    }
+
+    /** Kernel times history. Four partial sums let the loop vectorize
+        without relaxed floating point; tap counts are multiples of four.
+    */
+    float dot (const float* x) const noexcept {
+        const float* h = coefs.get();
+        float s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int k = 0; k < num_taps; k += 4)
+            for (int j = 0; j < 4; ++j)
+                s[j] += h[k + j] * x[k + j];
+        return (s[0] + s[1]) + (s[2] + s[3]);
+    }
+
+    void compute_coefficients() noexcept {
+        const float t = static_cast<float> (frac);
+        if (quality == Lagrange) {
+            // output lies between coefs[1] and coefs[2]
+            const float d1 = t - 1.0f, d2 = t - 2.0f, d0 = t + 1.0f;
+            coefs[0] = -t * d1 * d2 / 6.0f;
+            coefs[1] = d0 * d1 * d2 / 2.0f;
+            coefs[2] = -d0 * t * d2 / 2.0f;
+            coefs[3] = d0 * t * d1 / 6.0f;
+            return;
+        }
+
+        const float pos = t * (float) num_phases;
+        const int p = juce::jlimit (0, num_phases - 1, (int) pos);
+        const float a = pos - (float) p;
+        const float* r0 = table.get() + (size_t) (p * num_taps);
+        const float* r1 = r0 + num_taps;
+        for (int k = 0; k < num_taps; ++k)
+            coefs[k] = r0[k] + a * (r1[k] - r0[k]);
+    }
+
+    static double bessel_i0 (double x) noexcept {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    void build_table() noexcept {
+        if (quality == Lagrange)
+            return;
+
+        // leave a little room below Nyquist for the transition band
+        const double fc = juce::jmin (1.0, 1.0 / step) * (quality == SincBest ? 0.95 : 0.9);
+        if (fc == cutoff)
+            return;
+        cutoff = fc;
+
+        const double beta   = quality == SincBest ? 9.0 : 7.0;
+        const double half   = num_taps / 2.0;
+        const double center = half - 1.0;
+        const double norm   = bessel_i0 (beta);
+
+        for (int p = 0; p <= num_phases; ++p) {
+            float* row = table.get() + (size_t) (p * num_taps);
+            const double offset = center + (double) p / (double) num_phases;
+            double sum = 0.0;
+            for (int k = 0; k < num_taps; ++k) {
+                const double x = (double) k - offset;
+                const double r = x / half;
+                const double w = r * r < 1.0 ? bessel_i0 (beta * std::sqrt (1.0 - r * r)) / norm : 0.0;
+                const double s = x == 0.0 ? 1.0 : std::sin (juce::MathConstants<double>::pi * fc * x)
+                                                    / (juce::MathConstants<double>::pi * fc * x);
+                row[k] = (float) (s * w);
+                sum += row[k];
+            }
+            for (int k = 0; k < num_taps; ++k)
+                row[k] = (float) (row[k] / sum);
+        }
+    }
+};
+
+}}
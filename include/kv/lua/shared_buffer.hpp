@@ -0,0 +1,248 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+#include "lua-kv.hpp"
+#include LKV_JUCE_HEADER
+
+#define LKV_MT_SHARED_LINK          "kv.SharedLink"
+#define LKV_MT_SHARED_HANDLE        "kv.SharedHandle"
+
+namespace kv {
+namespace lua {
+
+inline void swap_contents (juce::MidiBuffer& a, juce::MidiBuffer& b) noexcept { a.swapWith (b); }
+template<typename T>
+inline void swap_contents (juce::AudioBuffer<T>& a, juce::AudioBuffer<T>& b) noexcept { std::swap (a, b); }
+
+inline void copy_contents (juce::MidiBuffer& dst, const juce::MidiBuffer& src) { dst = src; }
+template<typename T>
+inline void copy_contents (juce::AudioBuffer<T>& dst, const juce::AudioBuffer<T>& src) { dst.makeCopyOf (src); }
+
+/** Reference counted storage behind a shared buffer */
+class SharedStorage {
+public:
+    virtual ~SharedStorage() = default;
+
+    /** Metatable name of the buffers that can use this storage */
+    const char* get_type() const noexcept { return type; }
+
+    void retain() noexcept { refs.fetch_add (1, std::memory_order_relaxed); }
+
+    /** Drop a reference, deleting the storage on the last one.
+        The last reference may be dropped on any thread.
+    */
+    void release() noexcept {
+        if (refs.fetch_sub (1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+protected:
+    explicit SharedStorage (const char* t) : type (t) {}
+
+private:
+    const char* type;
+    std::atomic<int> refs { 1 };
+};
+
+/** Lock free triple buffer joining two buffers in different Lua states.
+
+    Each end keeps its own buffer object and owns one of three slots. An
+    end publishes by trading its contents for the slot in the middle, and
+    takes the newest contents by trading back, so only buffer internals
+    change hands: no samples or events are copied and nothing allocates.
+    Intended for one end writing and the other reading. A reader never
+    sees a buffer the writer is still filling, and the writer always gets
+    back a buffer the reader has let go of.
+*/
+template<typename Buffer>
+class SharedBuffer final : public SharedStorage {
+public:
+    /** Share `buffer`. The other two slots start as copies of it */
+    SharedBuffer (const char* type, const Buffer& buffer)
+        : SharedStorage (type)
+    {
+        copy_contents (slots[1], buffer);
+        copy_contents (slots[2], buffer);
+    }
+
+    /** Hand the contents of `buffer` to the other end.
+        `buffer` gets back older contents to fill next.
+    */
+    void publish (Buffer& buffer, int& own) noexcept {
+        swap_contents (buffer, slots[own]);
+        own = middle.exchange (own | fresh, std::memory_order_acq_rel) & index_mask;
+        swap_contents (buffer, slots[own]);
+    }
+
+    /** Take the newest contents published by the other end.
+        @returns false if nothing was published since the last fetch
+    */
+    bool fetch (Buffer& buffer, int& own) noexcept {
+        if ((middle.load (std::memory_order_acquire) & fresh) == 0)
+            return false;
+        swap_contents (buffer, slots[own]);
+        own = middle.exchange (own, std::memory_order_acq_rel) & index_mask;
+        swap_contents (buffer, slots[own]);
+        return true;
+    }
+
+    /** Give the second end its first contents.
+        @returns false if there already is a second end
+    */
+    bool attach (Buffer& buffer) noexcept {
+        if (attached.exchange (true, std::memory_order_acq_rel))
+            return false;
+        swap_contents (buffer, slots[2]);
+        return true;
+    }
+
+private:
+    enum : int { index_mask = 3, fresh = 4 };
+    Buffer slots[3];
+    std::atomic<int> middle { 1 };
+    std::atomic<bool> attached { false };
+};
+
+/** User value of a buffer userdata that holds its SharedLink.
+    Buffers are shareable only when created with this many user values,
+    so views, which keep their owner in user value 1, can't be shared.
+*/
+enum : int { shared_link_uv = 2 };
+
+/** One end of a shared buffer, kept as a user value of its userdata */
+struct SharedLink {
+    SharedStorage* storage { nullptr };
+    int own { 0 };
+};
+
+/** A reference to shared storage not yet imported */
+struct SharedHandle {
+    SharedStorage* storage { nullptr };
+};
+
+inline int shared_link_gc (lua_State* L) {
+    auto* link = (SharedLink*) lua_touserdata (L, 1);
+    if (link->storage != nullptr) {
+        link->storage->release();
+        link->storage = nullptr;
+    }
+    return 0;
+}
+
+inline int shared_handle_gc (lua_State* L) {
+    auto* handle = (SharedHandle*) lua_touserdata (L, 1);
+    if (handle->storage != nullptr) {
+        handle->storage->release();
+        handle->storage = nullptr;
+    }
+    return 0;
+}
+
+/** The link of the buffer userdata at `idx`, or nullptr if not shared */
+inline SharedLink* get_shared_link (lua_State* L, int idx) {
+    lua_getiuservalue (L, idx, shared_link_uv);
+    auto* link = (SharedLink*) luaL_testudata (L, -1, LKV_MT_SHARED_LINK);
+    lua_pop (L, 1);
+    return link;
+}
+
+/** True if the buffer userdata at `idx` has room for a link */
+inline bool can_share (lua_State* L, int idx) {
+    const bool room = lua_getiuservalue (L, idx, shared_link_uv) != LUA_TNONE;
+    lua_pop (L, 1);
+    return room;
+}
+
+inline void set_shared_link (lua_State* L, int idx, SharedStorage* storage, int own) {
+    idx = lua_absindex (L, idx);
+    auto* link = (SharedLink*) lua_newuserdatauv (L, sizeof (SharedLink), 0);
+    link->storage = storage;
+    link->own = own;
+    if (luaL_newmetatable (L, LKV_MT_SHARED_LINK)) {
+        lua_pushcfunction (L, shared_link_gc);
+        lua_setfield (L, -2, "__gc");
+    }
+    lua_setmetatable (L, -2);
+    lua_setiuservalue (L, idx, shared_link_uv);
+}
+
+/** Push a handle holding a reference to `storage` */
+inline void push_shared_handle (lua_State* L, SharedStorage* storage) {
+    auto* handle = (SharedHandle*) lua_newuserdatauv (L, sizeof (SharedHandle), 0);
+    handle->storage = nullptr;
+    if (luaL_newmetatable (L, LKV_MT_SHARED_HANDLE)) {
+        lua_pushcfunction (L, shared_handle_gc);
+        lua_setfield (L, -2, "__gc");
+    }
+    lua_setmetatable (L, -2);
+    handle->storage = storage;
+}
+
+/** Move the handle at `idx` of `from` to a new handle pushed on `to`.
+    Lets a host pass a handle to the Lua state that imports it. The old
+    handle is left empty.
+    @returns false, pushing nothing, if there is no handle to move
+*/
+inline bool move_shared_handle (lua_State* from, int idx, lua_State* to) {
+    auto* handle = (SharedHandle*) luaL_testudata (from, idx, LKV_MT_SHARED_HANDLE);
+    if (handle == nullptr || handle->storage == nullptr)
+        return false;
+    push_shared_handle (to, handle->storage);
+    handle->storage = nullptr;
+    return true;
+}
+
+/** Share the buffer userdata at `idx` and push a handle for import_buffer().
+    Raises an error if the buffer is already shared or can't be.
+*/
+template<typename Buffer>
+inline int share_buffer (lua_State* L, int idx, const char* type, Buffer& buffer) {
+    if (! can_share (L, idx))
+        return luaL_error (L, "buffer can't be shared");
+    if (get_shared_link (L, idx) != nullptr)
+        return luaL_error (L, "buffer is already shared");
+    auto* shared = new SharedBuffer<Buffer> (type, buffer);
+    set_shared_link (L, idx, shared, 0);
+    // the handle holds a reference until it is imported or collected
+    shared->retain();
+    push_shared_handle (L, shared);
+    return 1;
+}
+
+/** Make the buffer userdata at `idx` the second end of the handle at `arg`.
+    Raises an error if the handle is for another type of buffer or was
+    imported before. The handle's reference passes to the buffer and the
+    handle is left empty.
+*/
+template<typename Buffer>
+inline void import_buffer (lua_State* L, int idx, int arg, const char* type, Buffer& buffer) {
+    auto* handle = (SharedHandle*) luaL_checkudata (L, arg, LKV_MT_SHARED_HANDLE);
+    auto* storage = handle->storage;
+    luaL_argcheck (L, storage != nullptr, arg, "handle already imported");
+    luaL_argcheck (L, std::strcmp (storage->get_type(), type) == 0, arg, "handle is for another buffer type");
+    luaL_argcheck (L, static_cast<SharedBuffer<Buffer>*> (storage)->attach (buffer), arg, "handle already imported");
+    handle->storage = nullptr;
+    set_shared_link (L, idx, storage, 2);
+}
+
+/** publish() or fetch() the shared buffer userdata at `idx`.
+    @returns false if not shared or, when fetching, nothing was new
+*/
+template<typename Buffer>
+inline bool exchange_buffer (lua_State* L, int idx, Buffer& buffer, bool publish) {
+    auto* link = get_shared_link (L, idx);
+    if (link == nullptr || link->storage == nullptr)
+        return false;
+    auto* shared = static_cast<SharedBuffer<Buffer>*> (link->storage);
+    if (publish) {
+        shared->publish (buffer, link->own);
+        return true;
+    }
+    return shared->fetch (buffer, link->own);
+}
+
+}}
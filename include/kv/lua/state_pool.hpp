@@ -0,0 +1,251 @@
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "lua-kv.hpp"
+
+extern "C" {
+#include <lualib.h>
+}
+
+namespace kv {
+namespace lua {
+
+/** Ready to use Lua states that have all run the same script.
+
+    The script is compiled once and each state is created with the
+    standard and kv libraries open and the script already run, so handing
+    one out is a pop from a list. States given back are reset and run the
+    script again, which moves that cost from acquire() to release().
+
+    Reset puts back the globals and `package.loaded` entries as they were
+    before the script ran, drops everything else the script added, and
+    collects garbage. Changes made inside library tables, and registry
+    references the caller created, are not undone.
+
+    Every method may allocate and takes a lock, so use the pool off the
+    audio thread.
+*/
+class StatePool final {
+public:
+    struct Stats {
+        int size { 0 };             ///< States created and not closed
+        int available { 0 };        ///< States waiting in the pool
+        uint64_t hits { 0 };        ///< acquire() calls served from the pool
+        uint64_t misses { 0 };      ///< acquire() calls that made a state
+    };
+
+    StatePool() = default;
+
+    ~StatePool() {
+        for (auto* L : available)
+            lua_close (L);
+    }
+
+    /** Compile the script every state runs.
+        Call once, before any other method.
+        @returns false with `error` set if it doesn't compile
+    */
+    bool load (const char* source, size_t len, const char* name, std::string& error) {
+        lua_State* L = luaL_newstate();
+        if (L == nullptr) {
+            error = "not enough memory";
+            return false;
+        }
+        bool ok = luaL_loadbuffer (L, source, len, name) == LUA_OK;
+        if (ok) {
+            lua_dump (L, write_chunk, &bytecode, 0);
+            chunk_name = name != nullptr ? name : "=pool";
+        } else {
+            error = lua_tostring (L, -1);
+        }
+        lua_close (L);
+        return ok;
+    }
+
+    /** Create states until `count` are waiting.
+        @returns false with `error` set if the script failed
+    */
+    bool warm (int count, std::string& error) {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> sl (lock);
+                if ((int) available.size() >= count)
+                    return true;
+            }
+            auto* L = create (error);
+            if (L == nullptr)
+                return false;
+            std::lock_guard<std::mutex> sl (lock);
+            available.push_back (L);
+        }
+    }
+
+    /** Take a state. Creates one if none are waiting.
+        The script's first return value can be pushed with push_result().
+        @returns the state, or nullptr with `error` set if the script failed
+    */
+    lua_State* acquire (std::string& error) {
+        {
+            std::lock_guard<std::mutex> sl (lock);
+            if (! available.empty()) {
+                auto* L = available.back();
+                available.pop_back();
+                ++hits;
+                return L;
+            }
+            ++misses;
+        }
+        return create (error);
+    }
+
+    /** Reset a state from acquire() and keep it for later.
+        If the script fails when run again the state is closed.
+    */
+    void release (lua_State* L) {
+        if (L == nullptr)
+            return;
+        reset (L);
+        if (! run (L)) {
+            destroy (L);
+            return;
+        }
+        std::lock_guard<std::mutex> sl (lock);
+        available.push_back (L);
+    }
+
+    /** Close a state from acquire() instead of keeping it */
+    void destroy (lua_State* L) {
+        if (L == nullptr)
+            return;
+        lua_close (L);
+        std::lock_guard<std::mutex> sl (lock);
+        --size;
+    }
+
+    Stats get_stats() const {
+        std::lock_guard<std::mutex> sl (lock);
+        Stats stats;
+        stats.size      = size;
+        stats.available = (int) available.size();
+        stats.hits      = hits;
+        stats.misses    = misses;
+        return stats;
+    }
+
+    /** Push the first value returned by the script in a pooled state */
+    static void push_result (lua_State* L) {
+        lua_rawgetp (L, LUA_REGISTRYINDEX, result_key());
+    }
+
+private:
+    mutable std::mutex lock;
+    std::string bytecode, chunk_name;
+    std::vector<lua_State*> available;
+    int size { 0 };
+    uint64_t hits { 0 }, misses { 0 };
+
+    static const void* globals_key() noexcept { static const char key = 0; return &key; }
+    static const void* loaded_key() noexcept  { static const char key = 0; return &key; }
+    static const void* result_key() noexcept  { static const char key = 0; return &key; }
+
+    static int write_chunk (lua_State*, const void* data, size_t len, void* user) {
+        static_cast<std::string*> (user)->append (static_cast<const char*> (data), len);
+        return 0;
+    }
+
+    lua_State* create (std::string& error) {
+        lua_State* L = luaL_newstate();
+        if (L == nullptr) {
+            error = "not enough memory";
+            return nullptr;
+        }
+        luaL_openlibs (L);
+        kv_openlibs (L, 0);
+
+        lua_pushglobaltable (L);
+        snapshot (L, globals_key());
+        lua_getfield (L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+        snapshot (L, loaded_key());
+
+        if (! run (L, &error)) {
+            lua_close (L);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> sl (lock);
+        ++size;
+        return L;
+    }
+
+    /** Store a shallow copy of the table on top of the stack and pop it */
+    static void snapshot (lua_State* L, const void* key) {
+        lua_newtable (L);
+        lua_pushnil (L);
+        while (lua_next (L, -3) != 0) {
+            lua_pushvalue (L, -2);
+            lua_insert (L, -2);
+            lua_rawset (L, -4);
+        }
+        lua_rawsetp (L, LUA_REGISTRYINDEX, key);
+        lua_pop (L, 1);
+    }
+
+    /** Make the table on top of the stack match its snapshot and pop it */
+    static void restore (lua_State* L, const void* key) {
+        const int table = lua_gettop (L);
+        lua_rawgetp (L, LUA_REGISTRYINDEX, key);
+        const int saved = table + 1;
+
+        // clearing fields while traversing is allowed
+        lua_pushnil (L);
+        while (lua_next (L, table) != 0) {
+            lua_pop (L, 1);
+            lua_pushvalue (L, -1);
+            if (lua_rawget (L, saved) == LUA_TNIL) {
+                lua_pushvalue (L, -2);
+                lua_pushnil (L);
+                lua_rawset (L, table);
+            }
+            lua_pop (L, 1);
+        }
+
+        lua_pushnil (L);
+        while (lua_next (L, saved) != 0) {
+            lua_pushvalue (L, -2);
+            lua_insert (L, -2);
+            lua_rawset (L, table);
+        }
+        lua_pop (L, 2);
+    }
+
+    static void reset (lua_State* L) {
+        lua_settop (L, 0);
+        lua_sethook (L, nullptr, 0, 0);
+        lua_pushglobaltable (L);
+        restore (L, globals_key());
+        lua_getfield (L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+        restore (L, loaded_key());
+        lua_pushnil (L);
+        lua_rawsetp (L, LUA_REGISTRYINDEX, result_key());
+        lua_gc (L, LUA_GCCOLLECT, 0);
+    }
+
+    /** Run the compiled script and keep its result */
+    bool run (lua_State* L, std::string* error = nullptr) const {
+        if (luaL_loadbufferx (L, bytecode.data(), bytecode.size(), chunk_name.c_str(), "b") != LUA_OK
+            || lua_pcall (L, 0, 1, 0) != LUA_OK) {
+            if (error != nullptr)
+                *error = lua_tostring (L, -1) != nullptr ? lua_tostring (L, -1) : "error";
+            lua_pop (L, 1);
+            return false;
+        }
+        lua_rawsetp (L, LUA_REGISTRYINDEX, result_key());
+        return true;
+    }
+};
+
+}}
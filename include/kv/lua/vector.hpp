@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include "lua-kv.h"
+
+namespace kv {
+namespace lua {
+
+/** Copies values from a `kv.vector`, a Lua array or a single number.
+    At most `max` values are written to `dst`. Tables are read with raw
+    access, and nothing is allocated.
+    @returns the number of values copied
+*/
+template<typename T>
+inline int read_values (lua_State* L, int idx, T* dst, int max) {
+    if (auto* vec = (kv_vector_t*) luaL_testudata (L, idx, LKV_MT_VECTOR)) {
+        const int n = (int) kv_vector_size (vec) < max ? (int) kv_vector_size (vec) : max;
+        const kv_sample_t* src = kv_vector_values (vec);
+        for (int i = 0; i < n; ++i)
+            dst[i] = static_cast<T> (src[i]);
+        return n;
+    }
+
+    if (lua_istable (L, idx)) {
+        const int len = (int) lua_rawlen (L, idx);
+        const int n = len < max ? len : max;
+        for (int i = 0; i < n; ++i) {
+            lua_rawgeti (L, idx, i + 1);
+            dst[i] = static_cast<T> (lua_tonumber (L, -1));
+            lua_pop (L, 1);
+        }
+        return n;
+    }
+
+    if (lua_isnumber (L, idx) && max > 0) {
+        dst[0] = static_cast<T> (lua_tonumber (L, idx));
+        return 1;
+    }
+
+    return 0;
+}
+
+}}
@@ -0,0 +1,303 @@
+
+#pragma once
+#include "kv/lua/midi_buffer.hpp"
+
+#define LKV_MT_VOICE_ALLOCATOR          "kv.VoiceAllocator"
+
+namespace kv {
+namespace lua {
+
+/** Assigns incoming notes to a fixed number of voices.
+
+    Reads note and pedal messages from a MIDI buffer and produces a compact
+    list of start, stop and steal commands with frame offsets. All storage is
+    fixed size, so processing never allocates.
+*/
+class VoiceAllocator final {
+public:
+    enum { max_voices = 128, max_commands = 1024 };
+
+    enum CommandType {
+        Start   = 1,    ///< Start a note on a voice
+        Stop    = 2,    ///< Release the note playing on a voice
+        Steal   = 3     ///< Cut the voice quickly, a Start for it follows
+    };
+
+    enum Policy {
+        Oldest      = 0,
+        Quietest    = 1,
+        Lowest      = 2,
+        Highest     = 3
+    };
+
+    struct Command {
+        int type;
+        int voice;
+        int note;
+        int velocity;
+        int channel;
+        int frame;
+    };
+
+    VoiceAllocator() { reset(); }
+    ~VoiceAllocator() = default;
+
+    void set_polyphony (int n) noexcept {
+        n = juce::jlimit (1, (int) max_voices, n);
+        for (int i = n; i < polyphony; ++i)
+            voices[i] = Voice();
+        polyphony = n;
+    }
+
+    int get_polyphony() const noexcept { return polyphony; }
+
+    void set_policy (int p) noexcept { policy = juce::jlimit ((int) Oldest, (int) Highest, p); }
+    int get_policy() const noexcept { return policy; }
+
+    /** Forget all voices and pedal states without emitting commands */
+    void reset() noexcept {
+        for (auto& v : voices)
+            v = Voice();
+        for (auto& p : pedals)
+            p = Pedals();
+        num_commands = 0;
+        counter = 0;
+    }
+
+    /** Reads a block of MIDI. Commands from the previous block are cleared */
+    void process (const juce::MidiBuffer& buffer) noexcept {
+        num_commands = 0;
+        for (const auto meta : buffer)
+            handle (meta.data, meta.numBytes, meta.samplePosition);
+    }
+
+    /** Release all sounding voices at `frame` */
+    void release_all (int frame) noexcept {
+        for (int i = 0; i < polyphony; ++i)
+            if (voices[i].sounding())
+                stop (i, frame);
+    }
+
+    int size() const noexcept                       { return num_commands; }
+    const Command& get_command (int i) const noexcept { return commands[i]; }
+    const Command* begin() const noexcept           { return commands; }
+    const Command* end() const noexcept             { return commands + num_commands; }
+
+    /** Note playing on a voice or -1 if the voice is idle */
+    int get_note (int voice) const noexcept {
+        return juce::isPositiveAndBelow (voice, polyphony) && voices[voice].state != Idle
+            ? voices[voice].note : -1;
+    }
+
+    /** True if a voice is held by a key or pedal */
+    bool is_sounding (int voice) const noexcept {
+        return juce::isPositiveAndBelow (voice, polyphony) && voices[voice].sounding();
+    }
+
+    int get_num_sounding() const noexcept {
+        int n = 0;
+        for (int i = 0; i < polyphony; ++i)
+            if (voices[i].sounding())
+                ++n;
+        return n;
+    }
+
+private:
+    enum State { Idle = 0, Held, Sustained, Released };
+
+    struct Voice {
+        int state       { Idle };
+        int note        { -1 };
+        int channel     { 0 };
+        int velocity    { 0 };
+        bool sostenuto  { false };
+        juce::uint32 age { 0 };
+        bool sounding() const noexcept { return state == Held || state == Sustained; }
+    };
+
+    struct Pedals {
+        bool sustain    { false };
+        bool sostenuto  { false };
+    };
+
+    Voice voices [max_voices];
+    Pedals pedals [16];
+    Command commands [max_commands];
+    int num_commands    { 0 };
+    int polyphony       { 16 };
+    int policy          { Oldest };
+    juce::uint32 counter { 0 };
+
+    void emit (int type, int voice, int frame) noexcept {
+        if (num_commands >= max_commands)
+            return;
+        const auto& v = voices[voice];
+        commands[num_commands++] = { type, voice, v.note, v.velocity, v.channel, frame };
+    }
+
+    void stop (int voice, int frame) noexcept {
+        emit (Stop, voice, frame);
+        voices[voice].state = Released;
+        voices[voice].sostenuto = false;
+    }
+
+    /** Lower is a better candidate for stealing */
+    juce::int64 steal_rank (const Voice& v) const noexcept {
+        switch (policy) {
+            case Quietest:  return ((juce::int64) v.velocity << 32) | v.age;
+            case Lowest:    return ((juce::int64) v.note << 32) | v.age;
+            case Highest:   return ((juce::int64) (127 - v.note) << 32) | v.age;
+            default:        break;
+        }
+        return v.age;
+    }
+
+    int find_voice() const noexcept {
+        // idle first, then the longest released, then steal
+        int best = -1;
+        for (int i = 0; i < polyphony; ++i) {
+            const auto& v = voices[i];
+            if (v.state == Idle)
+                return i;
+            if (v.state == Released && (best < 0 || v.age < voices[best].age))
+                best = i;
+        }
+
+        if (best >= 0)
+            return best;
+
+        // pedal-sustained voices are stolen before keys that are held down
+        for (int pass = Sustained; pass >= Held && best < 0; --pass) {
+            for (int i = 0; i < polyphony; ++i) {
+                const auto& v = voices[i];
+                if (v.state == pass && (best < 0 || steal_rank (v) < steal_rank (voices[best])))
+                    best = i;
+            }
+        }
+
+        return best;
+    }
+
+    void note_on (int channel, int note, int velocity, int frame) noexcept {
+        int voice = -1;
+        for (int i = 0; i < polyphony; ++i) {
+            if (voices[i].sounding() && voices[i].note == note && voices[i].channel == channel) {
+                voice = i;
+                break;
+            }
+        }
+
+        if (voice < 0)
+            voice = find_voice();
+        if (voice < 0)
+            return;
+
+        auto& v = voices[voice];
+        if (v.sounding())
+            emit (Steal, voice, frame);
+
+        v.state     = Held;
+        v.note      = note;
+        v.channel   = channel;
+        v.velocity  = velocity;
+        v.sostenuto = false;
+        v.age       = ++counter;
+        emit (Start, voice, frame);
+    }
+
+    void note_off (int channel, int note, int frame) noexcept {
+        const auto& p = pedals[channel];
+        for (int i = 0; i < polyphony; ++i) {
+            auto& v = voices[i];
+            if (v.state != Held || v.note != note || v.channel != channel)
+                continue;
+            if (p.sustain || v.sostenuto)
+                v.state = Sustained;
+            else
+                stop (i, frame);
+        }
+    }
+
+    void release_sustained (int channel, int frame) noexcept {
+        const auto& p = pedals[channel];
+        for (int i = 0; i < polyphony; ++i) {
+            auto& v = voices[i];
+            if (v.channel != channel || v.state != Sustained)
+                continue;
+            if (! p.sustain && ! v.sostenuto)
+                stop (i, frame);
+        }
+    }
+
+    void controller (int channel, int number, int value, int frame) noexcept {
+        auto& p = pedals[channel];
+        switch (number) {
+            case 64: {
+                const bool down = value >= 64;
+                if (p.sustain == down)
+                    break;
+                p.sustain = down;
+                if (! down)
+                    release_sustained (channel, frame);
+                break;
+            }
+
+            case 66: {
+                const bool down = value >= 64;
+                if (p.sostenuto == down)
+                    break;
+                p.sostenuto = down;
+                for (int i = 0; i < polyphony; ++i) {
+                    auto& v = voices[i];
+                    if (v.channel != channel)
+                        continue;
+                    if (down && v.state == Held)
+                        v.sostenuto = true;
+                    else if (! down)
+                        v.sostenuto = false;
+                }
+                if (! down)
+                    release_sustained (channel, frame);
+                break;
+            }
+
+            case 120:
+            case 123:
+                for (int i = 0; i < polyphony; ++i)
+                    if (voices[i].channel == channel && voices[i].sounding())
+                        stop (i, frame);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void handle (const juce::uint8* data, int size, int frame) noexcept {
+        if (size < 3)
+            return;
+
+        const int channel = data[0] & 0x0f;
+        switch (data[0] & 0xf0) {
+            case 0x90:
+                if (data[2] > 0) {
+                    note_on (channel, data[1], data[2], frame);
+                    break;
+                }
+                // note on with zero velocity is a note off
+                [[fallthrough]];
+            case 0x80:
+                note_off (channel, data[1], frame);
+                break;
+
+            case 0xb0:
+                controller (channel, data[1], data[2], frame);
+                break;
+
+            default:
+                break;
+        }
+    }
+};
+
+}}
@@ -5,6 +5,7 @@
 
 #include "lua-kv.hpp"
 #include LKV_JUCE_HEADER
+#include "kv/lua/shared_buffer.hpp"
 
 #ifndef LKV_AUDIO_BUFFER_32
  #define LKV_AUDIO_BUFFER_32 0
@@ -269,6 +270,39 @@ static int audio_free (lua_State* L) {
     return 0;
 }
 
+/// Share this buffer with another Lua state.
+// Returns a handle to pass to `import` in the other state, once. The two
+// buffers then trade contents with @{AudioBuffer:publish} and
+// @{AudioBuffer:fetch}: one end writes and publishes, the other fetches
+// and reads, and neither locks, allocates or copies samples. A handle
+// collected without being imported releases the shared storage. Views of
+// other buffers can't be shared.
+// @function AudioBuffer:share
+// @treturn userdata Handle for `import`
+static int audio_share (lua_State* L) {
+    auto* buf = toclassref (L, 1);
+    return kv::lua::share_buffer (L, 1, LKV_MT_AUDIO_BUFFER_IMPL, *buf);
+}
+
+/// Hand the contents to the other end of a shared buffer.
+// Afterwards this buffer holds older audio of the same size to overwrite.
+// Does nothing if the buffer isn't shared.
+// @function AudioBuffer:publish
+static int audio_publish (lua_State* L) {
+    auto* buf = toclassref (L, 1);
+    kv::lua::exchange_buffer (L, 1, *buf, true);
+    return 0;
+}
+
+/// Take the newest contents published by the other end.
+// @function AudioBuffer:fetch
+// @treturn boolean False if nothing was published since the last fetch
+static int audio_fetch (lua_State* L) {
+    auto* buf = toclassref (L, 1);
+    lua_pushboolean (L, kv::lua::exchange_buffer (L, 1, *buf, false));
+    return 1;
+}
+
 static int audio_tostring (lua_State* L) {
     auto* buf = toclassref (L, 1);
     const auto str = kv::lua::to_string (*buf, "AudioBuffer");
@@ -295,7 +329,7 @@ static int audio_tostring (lua_State* L) {
 // local buf = AudioBuffer.new (2, 2048)
 // -- do someting with `buf`
 static int audio_new (lua_State* L) {
-    auto** buf = (Buffer**) lua_newuserdata (L, sizeof (Buffer**));
+    auto** buf = (Buffer**) lua_newuserdatauv (L, sizeof (Buffer**), kv::lua::shared_link_uv);
     
     int nchans = 0, nframes = 0;
     if (lua_gettop(L) >= 2 && lua_isinteger (L, 1) && lua_isinteger (L, 2)) {
@@ -308,6 +342,22 @@ static int audio_new (lua_State* L) {
     return 1;
 }
 
+/// Create the other end of a shared buffer.
+// The new buffer starts with the contents the shared buffer had when
+// @{AudioBuffer:share} was called.
+// @function AudioBuffer.import
+// @tparam userdata handle From @{AudioBuffer:share} on a buffer of the
+// same sample type
+// @return The new buffer
+// @within Constructors
+static int audio_import (lua_State* L) {
+    auto** buf = (Buffer**) lua_newuserdatauv (L, sizeof (Buffer**), kv::lua::shared_link_uv);
+    *buf = new Buffer();
+    luaL_setmetatable (L, LKV_MT_AUDIO_BUFFER_IMPL);
+    kv::lua::import_buffer (L, -1, 1, LKV_MT_AUDIO_BUFFER_IMPL, **buf);
+    return 1;
+}
+
 //==============================================================================
 static const luaL_Reg buffer_methods[] = {
     { "__gc",           audio_free },
@@ -323,6 +373,9 @@ static const luaL_Reg buffer_methods[] = {
     { "set",            audio_set },
     { "applygain",      audio_applygain },
     { "fade",           audio_fade },
+    { "share",          audio_share },
+    { "publish",        audio_publish },
+    { "fetch",          audio_fetch },
     { NULL, NULL }
 };
 
@@ -349,6 +402,8 @@ int luaopen_kv_AudioBuffer64 (lua_State* L) {
     luaL_setmetatable (L, LKV_MT_AUDIO_BUFFER_TYPE);
     lua_pushcfunction (L, audio_new);
     lua_setfield (L, -2, "new");
+    lua_pushcfunction (L, audio_import);
+    lua_setfield (L, -2, "import");
     return 1;
 }
 
@@ -0,0 +1,282 @@
+/// Drawing operations recorded once and replayed natively.
+// Build a list once, then show it with `Widget.displaylist` or replay it
+// with @{kv.Graphics:draw}. Replaying runs no Lua, so a widget showing a
+// list doesn't need a `paint` handler at all. Any change repaints the
+// widgets showing it.
+// @classmod kv.DisplayList
+// @pragma nostrip
+// @usage
+// local list = DisplayList.new()
+// list:setcolor (0xff202020)
+// list:fillall()
+// list:setcolor (0xffffffff)
+// list:drawtext ("Gain", 0, 0, 100, 20)
+// widget.displaylist = list
+
+#include "kv/lua/display_list.hpp"
+
+#define LKV_TYPE_NAME_DISPLAY_LIST "DisplayList"
+
+using namespace juce;
+using kv::lua::DisplayList;
+
+LKV_EXPORT
+int luaopen_kv_DisplayList (lua_State* L) {
+    sol::state_view lua (L);
+    auto M = lua.create_table();
+    M.new_usertype<DisplayList> (LKV_TYPE_NAME_DISPLAY_LIST, sol::no_constructor,
+        /// Create an empty list.
+        // @function DisplayList.new
+        // @treturn kv.DisplayList
+        "new", sol::factories ([]() { return std::make_unique<DisplayList>(); }),
+
+        sol::meta_method::to_string, [](DisplayList& self) {
+            return kv::lua::to_string (self, LKV_TYPE_NAME_DISPLAY_LIST);
+        },
+
+        /// Number of operations recorded.
+        // @function DisplayList:__len
+        sol::meta_method::length, &DisplayList::size,
+
+        /// Methods.
+        // @section methods
+
+        /// Remove every operation.
+        // @function DisplayList:clear
+        "clear", &DisplayList::clear,
+
+        /// Save the drawing state.
+        // @function DisplayList:savestate
+        "savestate", &DisplayList::save_state,
+
+        /// Restore the last saved drawing state.
+        // Only restores states saved in this list, extra restores are
+        // ignored when drawn.
+        // @function DisplayList:restorestate
+        "restorestate", &DisplayList::restore_state,
+
+        /// Change the color.
+        // @function DisplayList:setcolor
+        // @int color ARGB color as integer. e.g.`0xAARRGGBB`
+        "setcolor", [](DisplayList& self, lua_Integer color) {
+            self.set_colour ((uint32) color);
+        },
+
+        /// Change the font height.
+        // @function DisplayList:setfont
+        // @number height Font height in pixels
+        "setfont", &DisplayList::set_font,
+
+        /// Fill the entire drawing area.
+        // @function DisplayList:fillall
+        // @int[opt] color ARGB color, the current color if missing
+        "fillall", sol::overload (
+            [](DisplayList& self) { self.fill_all(); },
+            [](DisplayList& self, lua_Integer color) { self.fill_all ((uint32) color); }
+        ),
+
+        /// Fill a rectangle.
+        // @function DisplayList:fillrect
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+
+        /// Fill a rectangle.
+        // @function DisplayList:fillrect
+        // @tparam kv.Rectangle r
+        "fillrect", sol::overload (
+            &DisplayList::fill_rect,
+            [](DisplayList& self, const Rectangle<float>& r) {
+                self.fill_rect (r.getX(), r.getY(), r.getWidth(), r.getHeight());
+            }
+        ),
+
+        /// Outline a rectangle.
+        // @function DisplayList:drawrect
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        // @number[opt] thickness Line thickness (default 1)
+        "drawrect", [](DisplayList& self, float x, float y, float w, float h, sol::optional<float> t) {
+            self.draw_rect (x, y, w, h, t.value_or (1.f));
+        },
+
+        /// Fill a rectangle with rounded corners.
+        // @function DisplayList:fillroundedrect
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        // @number corner Corner size
+        "fillroundedrect", &DisplayList::fill_rounded,
+
+        /// Outline a rectangle with rounded corners.
+        // @function DisplayList:drawroundedrect
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        // @number corner Corner size
+        // @number[opt] thickness Line thickness (default 1)
+        "drawroundedrect", [](DisplayList& self, float x, float y, float w, float h, float corner, sol::optional<float> t) {
+            self.draw_rounded (x, y, w, h, corner, t.value_or (1.f));
+        },
+
+        /// Fill an ellipse inside a rectangle.
+        // @function DisplayList:fillellipse
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        "fillellipse", &DisplayList::fill_ellipse,
+
+        /// Outline an ellipse inside a rectangle.
+        // @function DisplayList:drawellipse
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        // @number[opt] thickness Line thickness (default 1)
+        "drawellipse", [](DisplayList& self, float x, float y, float w, float h, sol::optional<float> t) {
+            self.draw_ellipse (x, y, w, h, t.value_or (1.f));
+        },
+
+        /// Draw a line.
+        // @function DisplayList:drawline
+        // @number x1
+        // @number y1
+        // @number x2
+        // @number y2
+        // @number[opt] thickness Line thickness (default 1)
+        "drawline", [](DisplayList& self, float x1, float y1, float x2, float y2, sol::optional<float> t) {
+            self.draw_line (x1, y1, x2, y2, t.value_or (1.f));
+        },
+
+        /// Draw some text.
+        // @function DisplayList:drawtext
+        // @string text Text to draw
+        // @number x
+        // @number y
+        // @number w
+        // @number h
+        // @int[opt] justification JUCE Justification flags (default centred)
+
+        /// Draw some text.
+        // @function DisplayList:drawtext
+        // @string text Text to draw
+        // @tparam kv.Rectangle r
+        // @int[opt] justification JUCE Justification flags (default centred)
+        "drawtext", sol::overload (
+            [](DisplayList& self, const char* text, float x, float y, float w, float h, sol::optional<int> j) {
+                self.draw_text (String::fromUTF8 (text), x, y, w, h, j.value_or (Justification::centred));
+            },
+            [](DisplayList& self, const char* text, const Rectangle<float>& r, sol::optional<int> j) {
+                self.draw_text (String::fromUTF8 (text), r.getX(), r.getY(), r.getWidth(), r.getHeight(),
+                                j.value_or (Justification::centred));
+            }
+        ),
+
+        /// Draw an image file.
+        // The image is loaded when recorded.
+        // @function DisplayList:drawimage
+        // @tparam kv.File|string file Image file
+        // @number x
+        // @number y
+        // @number[opt] w Width, the image's if missing
+        // @number[opt] h Height, the image's if missing
+        // @treturn bool False if the image could not be loaded
+        "drawimage", [](DisplayList& self, const sol::object& src, float x, float y,
+                        sol::optional<float> w, sol::optional<float> h) {
+            File file;
+            if (src.is<File>())
+                file = src.as<File>();
+            else if (src.get_type() == sol::type::string)
+                file = File::getCurrentWorkingDirectory().getChildFile (String::fromUTF8 (src.as<const char*>()));
+            auto image = ImageCache::getFromFile (file);
+            if (! image.isValid())
+                return false;
+            self.draw_image (image, x, y, w.value_or ((float) image.getWidth()),
+                                          h.value_or ((float) image.getHeight()));
+            return true;
+        },
+
+        /// Start a new sub-path of the path being built.
+        // @function DisplayList:moveto
+        // @number x
+        // @number y
+        "moveto", [](DisplayList& self, float x, float y) { self.get_path().startNewSubPath (x, y); },
+
+        /// Add a line to the path being built.
+        // @function DisplayList:lineto
+        // @number x
+        // @number y
+        "lineto", [](DisplayList& self, float x, float y) { self.get_path().lineTo (x, y); },
+
+        /// Add a quadratic curve to the path being built.
+        // @function DisplayList:quadto
+        // @number cx Control point x
+        // @number cy Control point y
+        // @number x
+        // @number y
+        "quadto", [](DisplayList& self, float cx, float cy, float x, float y) {
+            self.get_path().quadraticTo (cx, cy, x, y);
+        },
+
+        /// Add a cubic curve to the path being built.
+        // @function DisplayList:cubicto
+        // @number c1x First control point x
+        // @number c1y First control point y
+        // @number c2x Second control point x
+        // @number c2y Second control point y
+        // @number x
+        // @number y
+        "cubicto", [](DisplayList& self, float c1x, float c1y, float c2x, float c2y, float x, float y) {
+            self.get_path().cubicTo (c1x, c1y, c2x, c2y, x, y);
+        },
+
+        /// Close the current sub-path of the path being built.
+        // @function DisplayList:closepath
+        "closepath", [](DisplayList& self) { self.get_path().closeSubPath(); },
+
+        /// Fill the path being built, then start a new one.
+        // @function DisplayList:fillpath
+        "fillpath", &DisplayList::fill_path,
+
+        /// Stroke the path being built, then start a new one.
+        // @function DisplayList:strokepath
+        // @number[opt] thickness Line thickness (default 1)
+        "strokepath", [](DisplayList& self, sol::optional<float> t) {
+            self.stroke_path (t.value_or (1.f));
+        },
+
+        /// Move what is drawn after this.
+        // @function DisplayList:translate
+        // @number x
+        // @number y
+        "translate", [](DisplayList& self, float x, float y) {
+            self.add_transform (AffineTransform::translation (x, y));
+        },
+
+        /// Scale what is drawn after this.
+        // @function DisplayList:scale
+        // @number sx Horizontal factor
+        // @number[opt] sy Vertical factor, same as sx if missing
+        "scale", [](DisplayList& self, float sx, sol::optional<float> sy) {
+            self.add_transform (AffineTransform::scale (sx, sy.value_or (sx)));
+        },
+
+        /// Rotate what is drawn after this.
+        // @function DisplayList:rotate
+        // @number radians Clockwise angle
+        // @number[opt] cx Pivot x (default 0)
+        // @number[opt] cy Pivot y (default 0)
+        "rotate", [](DisplayList& self, float radians, sol::optional<float> cx, sol::optional<float> cy) {
+            self.add_transform (AffineTransform::rotation (radians, cx.value_or (0.f), cy.value_or (0.f)));
+        }
+    );
+
+    sol::stack::push (L, kv::lua::remove_and_clear (M, LKV_TYPE_NAME_DISPLAY_LIST));
+    return 1;
+}
@@ -4,6 +4,7 @@
 // @classmod kv.DocumentWindow
 // @pragma nostrip
 
+#include "kv/lua/handlers.hpp"
 #include "kv/lua/object.hpp"
 #include "kv/lua/widget.hpp"
 #include "lua-kv.hpp"
@@ -25,12 +26,14 @@ public:
 
     ~DocumentWindow() override
     {
+        handlers.reset();
         widget = sol::lua_nil;
     }
 
     static void init (const sol::table& proxy) {
         if (auto* const impl = object_userdata<DocumentWindow> (proxy)) {
             impl->widget = proxy;
+            impl->handlers.bind (proxy);
             impl->setUsingNativeTitleBar (true);
             impl->setResizable (true, false);
         }
@@ -47,8 +50,7 @@ public:
     // @within Handlers
     void closeButtonPressed() override
     {
-        if (sol::safe_function f = widget ["closepressed"])
-            f (widget);
+        handlers.call (ClosePressed);
     }
 
     void setContent (const sol::object& child)
@@ -86,6 +88,8 @@ public:
 private:
     sol::table widget;
     sol::table content;
+    enum { ClosePressed };
+    Handlers<1> handlers { "closepressed" };
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DocumentWindow)
 };
 
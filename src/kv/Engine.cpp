@@ -0,0 +1,294 @@
+/// Runs Lua script nodes in parallel.
+// Each node is a script in its own Lua state with the kv libraries open.
+// The script returns a function, called once per block with four buffers:
+//
+//     return function (audio_in, audio_out, midi_in, midi_out)
+//         for c = 1, audio_out:channels() do ... end
+//     end
+//
+// `audio_in` holds the output channels of every node connected to this one,
+// in the order they were connected, and `audio_out` the node's own outputs.
+// Both are views of the engine's buffers, so nothing is copied between
+// nodes. Outputs start each block silent. Nodes only see their own state;
+// share data through the connections.
+//
+// process() runs nodes whose inputs are ready on a pool of threads that
+// steal work from each other, and returns when every node is done. A node
+// that raises an error outputs silence from then on, see @{Engine:error}.
+// @classmod kv.Engine
+// @pragma nostrip
+
+#include "kv/lua/engine.hpp"
+
+#define LKV_MT_ENGINE                   "kv.Engine"
+#define LKV_MT_ENGINE_TYPE              "kv.EngineClass"
+
+using Engine = kv::lua::Engine;
+
+#define toengine(L, n) (*(Engine**) lua_touserdata (L, n))
+
+/// Create an engine.
+// @function Engine.new
+// @int[opt] threads Threads including the caller's (default one per core)
+// @treturn kv.Engine
+// @within Constructors
+static int engine_new (lua_State* L) {
+    const auto threads = static_cast<int> (luaL_optinteger (L, 1, 0));
+    auto** userdata = (Engine**) lua_newuserdata (L, sizeof (Engine**));
+    *userdata = new Engine (threads);
+    luaL_setmetatable (L, LKV_MT_ENGINE);
+    return 1;
+}
+
+static int engine_free (lua_State* L) {
+    auto** engine = (Engine**) lua_touserdata (L, 1);
+    if (nullptr != *engine) {
+        delete (*engine);
+        *engine = nullptr;
+    }
+    return 0;
+}
+
+static int check_node (lua_State* L, Engine* engine, int arg) {
+    const auto node = static_cast<int> (luaL_checkinteger (L, arg)) - 1;
+    luaL_argcheck (L, juce::isPositiveAndBelow (node, engine->get_num_nodes()), arg, "invalid node");
+    return node;
+}
+
+static int engine_add (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    size_t len = 0;
+    const char* src = luaL_checklstring (L, 2, &len);
+    const auto outputs = static_cast<int> (luaL_optinteger (L, 3, 2));
+    const char* name = luaL_optstring (L, 4, "=node");
+    std::string error;
+    const int node = engine->add_node (src, len, name, outputs, error);
+    if (node < 0)
+        return luaL_error (L, "engine: %s", error.c_str());
+    lua_pushinteger (L, node + 1);
+    return 1;
+}
+
+static int engine_warm (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    size_t len = 0;
+    const char* src = luaL_checklstring (L, 2, &len);
+    const auto count = static_cast<int> (luaL_checkinteger (L, 3));
+    const char* name = luaL_optstring (L, 4, "=node");
+    std::string error;
+    if (! engine->warm (src, len, name, count, error))
+        return luaL_error (L, "engine: %s", error.c_str());
+    return 0;
+}
+
+static int engine_clear (lua_State* L) {
+    toengine (L, 1)->clear();
+    return 0;
+}
+
+static int engine_connect (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    const int source = check_node (L, engine, 2);
+    const int dest   = check_node (L, engine, 3);
+    lua_pushboolean (L, engine->connect (source, dest));
+    return 1;
+}
+
+static int engine_prepare (lua_State* L) {
+    toengine (L, 1)->prepare (static_cast<int> (luaL_checkinteger (L, 2)));
+    return 0;
+}
+
+static int engine_process (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    const auto nframes = static_cast<int> (luaL_checkinteger (L, 2));
+    if (! engine->process (nframes))
+        return luaL_error (L, "engine: not prepared for %d frames", nframes);
+    return 0;
+}
+
+static int engine_output (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    const int node = check_node (L, engine, 2);
+    const auto& output = engine->get_output (node);
+    const int nchans = engine->get_num_outputs (node);
+    const bool ok = kv::lua::visit_audio_buffer (L, 3, [&] (auto& buffer) {
+        const int n = juce::jmin (buffer.getNumSamples(), output.getNumSamples());
+        for (int c = 0; c < juce::jmin (nchans, buffer.getNumChannels()); ++c) {
+            auto* dst = buffer.getWritePointer (c);
+            const auto* src = output.getReadPointer (c);
+            for (int i = 0; i < n; ++i)
+                dst[i] = static_cast<typename std::decay<decltype (*dst)>::type> (src[i]);
+        }
+    });
+    if (! ok)
+        return luaL_typeerror (L, 3, "kv.AudioBuffer");
+    return 0;
+}
+
+static int engine_midi (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    const int node = check_node (L, engine, 2);
+    auto* impl = *(kv::lua::MidiBufferImpl**) luaL_checkudata (L, 3, LKV_MT_MIDI_BUFFER);
+    impl->buffer.addEvents (engine->get_midi_output (node), 0, -1, 0);
+    return 0;
+}
+
+static int engine_error (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    const int node = check_node (L, engine, 2);
+    if (const char* error = engine->get_error (node))
+        lua_pushstring (L, error);
+    else
+        lua_pushnil (L);
+    return 1;
+}
+
+static int engine_clearerror (lua_State* L) {
+    auto* engine = toengine (L, 1);
+    engine->reset_error (check_node (L, engine, 2));
+    return 0;
+}
+
+static int engine_threads (lua_State* L) {
+    lua_pushinteger (L, toengine (L, 1)->get_num_threads());
+    return 1;
+}
+
+static int engine_nodes (lua_State* L) {
+    lua_pushinteger (L, toengine (L, 1)->get_num_nodes());
+    return 1;
+}
+
+static int engine_poolstats (lua_State* L) {
+    const auto stats = toengine (L, 1)->get_pool_stats();
+    const auto total = stats.hits + stats.misses;
+    lua_createtable (L, 0, 5);
+    lua_pushinteger (L, stats.size);
+    lua_setfield (L, -2, "size");
+    lua_pushinteger (L, stats.available);
+    lua_setfield (L, -2, "available");
+    lua_pushinteger (L, static_cast<lua_Integer> (stats.hits));
+    lua_setfield (L, -2, "hits");
+    lua_pushinteger (L, static_cast<lua_Integer> (stats.misses));
+    lua_setfield (L, -2, "misses");
+    lua_pushnumber (L, total > 0 ? static_cast<lua_Number> (stats.hits) / static_cast<lua_Number> (total) : 0.0);
+    lua_setfield (L, -2, "hitrate");
+    return 1;
+}
+
+static const luaL_Reg engine_methods[] = {
+    { "__gc",           engine_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Add a node.
+    // Takes a state that has run the script from the script's pool, making
+    // one if none are waiting, and keeps the function it returns.
+    // Raises an error if the script fails or doesn't return a function.
+    // @function Engine:add
+    // @string source Lua source of the node
+    // @int[opt] outputs Number of output channels (default 2)
+    // @string[opt] name Chunk name used in error messages
+    // @treturn int The node's index
+    { "add",            engine_add },
+
+    /// Make states ready for nodes running a script.
+    // Nodes added later with the same source and name start without
+    // creating a state or running the script.
+    // @function Engine:warm
+    // @string source Lua source of the node
+    // @int count Number of states to keep waiting
+    // @string[opt] name Chunk name, as passed to @{Engine:add}
+    { "warm",           engine_warm },
+
+    /// Remove every node.
+    // Their states are reset, run their script again and wait for nodes
+    // added later. Prepare again before processing.
+    // @function Engine:clear
+    { "clear",          engine_clear },
+
+    /// Feed one node's output to another.
+    // @function Engine:connect
+    // @int source Node index
+    // @int dest Node index
+    // @treturn boolean False if already connected or it would make a cycle
+    { "connect",        engine_connect },
+
+    /// Allocate buffers.
+    // Call after changing the graph and before processing.
+    // @function Engine:prepare
+    // @int blocksize Largest number of frames per block
+    { "prepare",        engine_prepare },
+
+    /// Run every node for one block.
+    // @function Engine:process
+    // @int nframes Frames in the block, at most the prepared size
+    { "process",        engine_process },
+
+    /// Copy a node's output from the last block.
+    // @function Engine:output
+    // @int node Node index
+    // @tparam kv.AudioBuffer buffer Destination
+    { "output",         engine_output },
+
+    /// Add a node's MIDI output from the last block to a buffer.
+    // A node connected to exactly one other hands its MIDI over instead of
+    // copying it, so only nodes with no or several consumers keep theirs.
+    // @function Engine:midi
+    // @int node Node index
+    // @tparam kv.MidiBuffer buffer Destination
+    { "midi",           engine_midi },
+
+    /// Error raised by a node.
+    // @function Engine:error
+    // @int node Node index
+    // @treturn string|nil The message, nil if the node is running
+    { "error",          engine_error },
+
+    /// Run a failed node again from the next block.
+    // @function Engine:clearerror
+    // @int node Node index
+    { "clearerror",     engine_clearerror },
+
+    /// Number of threads including the caller's.
+    // @function Engine:threads
+    // @treturn int
+    { "threads",        engine_threads },
+
+    /// Number of nodes.
+    // @function Engine:nodes
+    // @treturn int
+    { "nodes",          engine_nodes },
+
+    /// State pool statistics, summed over every script.
+    // Fields are `size` (states alive), `available` (states waiting),
+    // `hits` and `misses` (@{Engine:add} calls that did or didn't find a
+    // waiting state) and `hitrate` (hits over adds, 0 before the first).
+    // @function Engine:poolstats
+    // @treturn table
+    { "poolstats",      engine_poolstats },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_Engine (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_ENGINE)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, engine_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_ENGINE_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_ENGINE_TYPE);
+    lua_pushcfunction (L, engine_new);
+    lua_setfield (L, -2, "new");
+    return 1;
+}
@@ -2,20 +2,74 @@
 // @classmod kv.Graphics
 // @pragma nostrip
 
-#include "lua-kv.hpp"
-#include LKV_JUCE_HEADER
+#include "kv/lua/display_list.hpp"
+#include "kv/lua/object.hpp"
 
 using namespace juce;
 
+namespace {
+
+struct ImageHolder {
+    explicit ImageHolder (int width, int height)
+        : image (Image::ARGB, jmax (1, width), jmax (1, height), true) {}
+    Image image;
+};
+
+/** A drawing context which draws into its own image. */
+class ImageGraphics final : private ImageHolder,
+                            public Graphics {
+public:
+    ImageGraphics (int width, int height)
+        : ImageHolder (width, height),
+          Graphics (image) {}
+
+    lua_Integer pixel (int x, int y) const {
+        return (lua_Integer) image.getPixelAt (x, y).getARGB();
+    }
+};
+
+}
+
 LKV_EXPORT
 int luaopen_kv_Graphics (lua_State* L) {
     sol::state_view lua (L);
 
     auto M = lua.create_table();
+    M.new_usertype<ImageGraphics> ("ImageGraphics", sol::no_constructor,
+        "pixel", &ImageGraphics::pixel,
+        "paintwidget", [](ImageGraphics& g, const sol::table& widget) {
+            if (auto* impl = kv::lua::object_userdata<Component> (widget))
+                impl->paintEntireComponent (g, true);
+        },
+        sol::base_classes, sol::bases<Graphics>()
+    );
+
     M.new_usertype<Graphics> ("Graphics", sol::no_constructor,
+        /// Create a context which draws into a new, transparent image.
+        // Useful to render offscreen and to test painting code.
+        // @function Graphics.image
+        // @int width Image width
+        // @int height Image height
+        // @treturn kv.Graphics
+        "image", sol::factories ([](int width, int height) {
+            return std::make_unique<ImageGraphics> (width, height);
+        }),
+
         /// Methods.
         // @section methods
 
+        /// ARGB color of an image pixel.
+        // Only contexts made with @{Graphics.image} have pixels to read.
+        // @function Graphics:pixel
+        // @int x
+        // @int y
+        // @treturn int ARGB color as integer
+
+        /// Paint a widget and its children.
+        // Only contexts made with @{Graphics.image} can paint widgets.
+        // @function Graphics:paintwidget
+        // @tparam kv.Widget widget Widget to paint
+
         /// Save the current state.
         // @function Graphics:savestate
         "savestate", &Graphics::saveState,
@@ -56,7 +110,14 @@ int luaopen_kv_Graphics (lua_State* L) {
         "fillall", sol::overload (
             [](Graphics& g)                 { g.fillAll(); },
             [](Graphics& g, int color)      { g.fillAll (Colour (color)); }
-        )
+        ),
+
+        /// Replay a display list.
+        // Draws everything recorded in one call, leaving this context's
+        // state as it was.
+        // @function Graphics:draw
+        // @tparam kv.DisplayList list The list to draw
+        "draw", [](Graphics& g, kv::lua::DisplayList& list) { list.draw (g); }
     );
     sol::stack::push (L, kv::lua::remove_and_clear (M, "Graphics"));
     return 1;
@@ -5,6 +5,7 @@
 // @pragma nostrip
 
 #include "kv/lua/midi_buffer.hpp"
+#include "kv/lua/shared_buffer.hpp"
 #include "bytes.h"
 #include "packed.h"
 #define LKV_MT_MIDI_BUFFER_TYPE "kv.MidiBufferClass"
@@ -199,6 +200,44 @@ static int midibuffer_insert (lua_State* L) {
     return 0;
 }
 
+//==============================================================================
+static int midibuffer_share (lua_State* L) {
+    auto* impl = *(Impl**) lua_touserdata (L, 1);
+    return kv::lua::share_buffer (L, 1, LKV_MT_MIDI_BUFFER, impl->buffer);
+}
+
+static bool midibuffer_exchange (lua_State* L, bool publish) {
+    auto* impl = *(Impl**) lua_touserdata (L, 1);
+    const bool changed = kv::lua::exchange_buffer (L, 1, impl->buffer, publish);
+    // the iterator pointed into the old contents
+    if (changed)
+        impl->iter = impl->buffer.end();
+    return changed;
+}
+
+static int midibuffer_publish (lua_State* L) {
+    midibuffer_exchange (L, true);
+    return 0;
+}
+
+static int midibuffer_fetch (lua_State* L) {
+    lua_pushboolean (L, midibuffer_exchange (L, false));
+    return 1;
+}
+
+/// Create the other end of a shared buffer.
+// The new buffer starts with the events the shared buffer had when
+// @{MidiBuffer:share} was called.
+// @function MidiBuffer.import
+// @tparam userdata handle From @{MidiBuffer:share}
+// @return A new MIDI Buffer
+// @within Constructors
+static int midibuffer_import (lua_State* L) {
+    auto** impl = kv::lua::new_midibuffer (L);
+    kv::lua::import_buffer (L, -1, 1, LKV_MT_MIDI_BUFFER, (**impl).buffer);
+    return 1;
+}
+
 //==============================================================================
 
 /// Methods.
@@ -295,6 +334,25 @@ static const luaL_Reg buffer_methods[] = {
     // @tparam kv.MidiBuffer buf Buffer to copy from
     { "addbuffer",         midibuffer_addbuffer },
 
+    /// Share this buffer with another Lua state.
+    // Returns a handle to pass to `MidiBuffer.import` in the other state,
+    // once. One end then inserts and publishes while the other fetches and
+    // reads, without locking, allocating or copying events.
+    // @function MidiBuffer:share
+    // @treturn userdata Handle for `MidiBuffer.import`
+    { "share",             midibuffer_share },
+
+    /// Hand the events to the other end of a shared buffer.
+    // Afterwards this buffer holds older events; clear it before reuse.
+    // Does nothing if the buffer isn't shared.
+    // @function MidiBuffer:publish
+    { "publish",           midibuffer_publish },
+
+    /// Take the newest events published by the other end.
+    // @function MidiBuffer:fetch
+    // @treturn boolean False if nothing was published since the last fetch
+    { "fetch",             midibuffer_fetch },
+
     { NULL, NULL }
 };
 
@@ -316,5 +374,7 @@ int luaopen_kv_MidiBuffer (lua_State* L) {
     luaL_setmetatable (L, LKV_MT_MIDI_BUFFER_TYPE);
     lua_pushcfunction (L, midibuffer_new);
     lua_setfield (L, -2, "new");
+    lua_pushcfunction (L, midibuffer_import);
+    lua_setfield (L, -2, "import");
     return 1;
 }
@@ -0,0 +1,191 @@
+/// MIDI clock follower.
+// Estimates tempo and song position from incoming MIDI clock, start, stop,
+// continue and song position messages found in a @{kv.MidiBuffer}. Tick times
+// are smoothed with a delay locked loop, so the position advances continuously
+// between clock ticks. MTC quarter frames are decoded as well.
+// @classmod kv.MidiClockFollower
+// @pragma nostrip
+
+#include "kv/lua/midi_clock.hpp"
+#define LKV_MT_MIDI_CLOCK_FOLLOWER          "kv.MidiClockFollower"
+#define LKV_MT_MIDI_CLOCK_FOLLOWER_TYPE     "kv.MidiClockFollowerClass"
+
+using Follower      = kv::lua::MidiClockFollower;
+using Impl          = kv::lua::MidiBufferImpl;
+
+#define tofollower(L, n) (*(Follower**) lua_touserdata (L, n))
+
+/// Create a new follower.
+// @function MidiClockFollower.new
+// @number[opt] rate Sample rate (default 44100)
+// @treturn kv.MidiClockFollower
+// @within Constructors
+static int follower_new (lua_State* L) {
+    auto** f = (Follower**) lua_newuserdata (L, sizeof (Follower**));
+    *f = new Follower();
+    luaL_setmetatable (L, LKV_MT_MIDI_CLOCK_FOLLOWER);
+    if (lua_isnumber (L, 1))
+        (**f).set_sample_rate (lua_tonumber (L, 1));
+    return 1;
+}
+
+static int follower_free (lua_State* L) {
+    auto** f = (Follower**) lua_touserdata (L, 1);
+    if (nullptr != *f) {
+        delete (*f);
+        *f = nullptr;
+    }
+    return 0;
+}
+
+static int follower_samplerate (lua_State* L) {
+    lua_pushnumber (L, tofollower (L, 1)->get_sample_rate());
+    return 1;
+}
+
+static int follower_setsamplerate (lua_State* L) {
+    tofollower (L, 1)->set_sample_rate (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int follower_bandwidth (lua_State* L) {
+    lua_pushnumber (L, tofollower (L, 1)->get_bandwidth());
+    return 1;
+}
+
+static int follower_setbandwidth (lua_State* L) {
+    tofollower (L, 1)->set_bandwidth (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int follower_reset (lua_State* L) {
+    tofollower (L, 1)->reset();
+    return 0;
+}
+
+static int follower_locked (lua_State* L) {
+    lua_pushboolean (L, tofollower (L, 1)->is_locked());
+    return 1;
+}
+
+static int follower_running (lua_State* L) {
+    lua_pushboolean (L, tofollower (L, 1)->is_running());
+    return 1;
+}
+
+static int follower_tempo (lua_State* L) {
+    lua_pushnumber (L, tofollower (L, 1)->get_tempo());
+    return 1;
+}
+
+static int follower_position (lua_State* L) {
+    lua_pushnumber (L, tofollower (L, 1)->get_position());
+    return 1;
+}
+
+static int follower_timecode (lua_State* L) {
+    const auto& tc = tofollower (L, 1)->get_timecode();
+    lua_pushinteger (L, tc.hours);
+    lua_pushinteger (L, tc.minutes);
+    lua_pushinteger (L, tc.seconds);
+    lua_pushinteger (L, tc.frames);
+    lua_pushinteger (L, tc.type);
+    return 5;
+}
+
+static int follower_process (lua_State* L) {
+    auto* impl = *(Impl**) lua_touserdata (L, 2);
+    tofollower (L, 1)->process (impl->buffer, static_cast<int> (lua_tointeger (L, 3)));
+    return 0;
+}
+
+static const luaL_Reg follower_methods[] = {
+    { "__gc",           follower_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Sample rate.
+    // @function MidiClockFollower:samplerate
+    // @treturn number
+    { "samplerate",     follower_samplerate },
+
+    /// Change the sample rate.
+    // Resets the follower.
+    // @function MidiClockFollower:setsamplerate
+    // @number rate New sample rate
+    { "setsamplerate",  follower_setsamplerate },
+
+    /// Loop bandwidth.
+    // @function MidiClockFollower:bandwidth
+    // @treturn number
+    { "bandwidth",      follower_bandwidth },
+
+    /// Change the loop bandwidth.
+    // Relative to the clock tick rate. Lower values give a smoother tempo
+    // but follow changes more slowly.
+    // @function MidiClockFollower:setbandwidth
+    // @number bw Bandwidth (default 0.05)
+    { "setbandwidth",   follower_setbandwidth },
+
+    /// Forget the current tempo estimate.
+    // @function MidiClockFollower:reset
+    { "reset",          follower_reset },
+
+    /// Returns true if locked to incoming clock.
+    // @function MidiClockFollower:locked
+    // @treturn bool
+    { "locked",         follower_locked },
+
+    /// Returns true if the remote transport is running.
+    // @function MidiClockFollower:running
+    // @treturn bool
+    { "running",        follower_running },
+
+    /// Estimated tempo.
+    // @function MidiClockFollower:tempo
+    // @treturn number Beats per minute or 0 if not locked
+    { "tempo",          follower_tempo },
+
+    /// Estimated song position.
+    // @function MidiClockFollower:position
+    // @treturn number Position in quarter notes at the end of the last block
+    { "position",       follower_position },
+
+    /// Last complete time code received.
+    // @function MidiClockFollower:timecode
+    // @treturn int hours
+    // @treturn int minutes
+    // @treturn int seconds
+    // @treturn int frames
+    // @treturn int rate type (0 = 24, 1 = 25, 2 = 29.97 drop, 3 = 30)
+    { "timecode",       follower_timecode },
+
+    /// Read messages for one block.
+    // @function MidiClockFollower:process
+    // @tparam kv.MidiBuffer buffer Incoming MIDI
+    // @int nframes Block size in samples
+    { "process",        follower_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_MidiClockFollower (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_MIDI_CLOCK_FOLLOWER)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, follower_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_MIDI_CLOCK_FOLLOWER_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_MIDI_CLOCK_FOLLOWER_TYPE);
+    lua_pushcfunction (L, follower_new);
+    lua_setfield (L, -2, "new");
+    return 1;
+}
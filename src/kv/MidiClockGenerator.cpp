@@ -0,0 +1,213 @@
+/// MIDI clock and time code generator.
+// Writes clock, transport, song position and MTC quarter frame messages into
+// a @{kv.MidiBuffer} with sample accurate timing. Does not allocate memory
+// while processing, and like @{kv.MidiBuffer} does virtually no type checking
+// in method calls.
+// @classmod kv.MidiClockGenerator
+// @pragma nostrip
+
+#include "kv/lua/midi_clock.hpp"
+#define LKV_MT_MIDI_CLOCK_GENERATOR         "kv.MidiClockGenerator"
+#define LKV_MT_MIDI_CLOCK_GENERATOR_TYPE    "kv.MidiClockGeneratorClass"
+
+using Generator     = kv::lua::MidiClockGenerator;
+using Timecode      = kv::lua::MidiTimecode;
+using Impl          = kv::lua::MidiBufferImpl;
+
+#define togenerator(L, n) (*(Generator**) lua_touserdata (L, n))
+
+/// Create a new generator.
+// @function MidiClockGenerator.new
+// @number[opt] rate Sample rate (default 44100)
+// @treturn kv.MidiClockGenerator
+// @within Constructors
+static int generator_new (lua_State* L) {
+    auto** gen = (Generator**) lua_newuserdata (L, sizeof (Generator**));
+    *gen = new Generator();
+    luaL_setmetatable (L, LKV_MT_MIDI_CLOCK_GENERATOR);
+    if (lua_isnumber (L, 1))
+        (**gen).set_sample_rate (lua_tonumber (L, 1));
+    return 1;
+}
+
+static int generator_free (lua_State* L) {
+    auto** gen = (Generator**) lua_touserdata (L, 1);
+    if (nullptr != *gen) {
+        delete (*gen);
+        *gen = nullptr;
+    }
+    return 0;
+}
+
+static int generator_samplerate (lua_State* L) {
+    lua_pushnumber (L, togenerator (L, 1)->get_sample_rate());
+    return 1;
+}
+
+static int generator_setsamplerate (lua_State* L) {
+    togenerator (L, 1)->set_sample_rate (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int generator_tempo (lua_State* L) {
+    lua_pushnumber (L, togenerator (L, 1)->get_tempo());
+    return 1;
+}
+
+static int generator_settempo (lua_State* L) {
+    togenerator (L, 1)->set_tempo (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int generator_mtc (lua_State* L) {
+    const int type = togenerator (L, 1)->get_timecode_type();
+    lua_pushnumber (L, type < 0 ? 0.0 : Timecode::frame_rate (type));
+    return 1;
+}
+
+static int generator_setmtc (lua_State* L) {
+    togenerator (L, 1)->set_timecode_type (
+        lua_isnumber (L, 2) ? Timecode::type_for_rate (lua_tonumber (L, 2)) : -1);
+    return 0;
+}
+
+static int generator_running (lua_State* L) {
+    lua_pushboolean (L, togenerator (L, 1)->is_running());
+    return 1;
+}
+
+static int generator_position (lua_State* L) {
+    lua_pushnumber (L, togenerator (L, 1)->get_position());
+    return 1;
+}
+
+static int frame_arg (lua_State* L, int idx) {
+    return lua_isinteger (L, idx) ? static_cast<int> (lua_tointeger (L, idx) - 1) : 0;
+}
+
+static int generator_start (lua_State* L) {
+    togenerator (L, 1)->start (frame_arg (L, 2));
+    return 0;
+}
+
+static int generator_stop (lua_State* L) {
+    togenerator (L, 1)->stop (frame_arg (L, 2));
+    return 0;
+}
+
+static int generator_continue (lua_State* L) {
+    togenerator (L, 1)->resume (frame_arg (L, 2));
+    return 0;
+}
+
+static int generator_locate (lua_State* L) {
+    togenerator (L, 1)->locate (lua_tonumber (L, 2), frame_arg (L, 3));
+    return 0;
+}
+
+static int generator_process (lua_State* L) {
+    auto* impl = *(Impl**) lua_touserdata (L, 2);
+    togenerator (L, 1)->process (impl->buffer, static_cast<int> (lua_tointeger (L, 3)));
+    return 0;
+}
+
+static const luaL_Reg generator_methods[] = {
+    { "__gc",           generator_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Sample rate.
+    // @function MidiClockGenerator:samplerate
+    // @treturn number
+    { "samplerate",     generator_samplerate },
+
+    /// Change the sample rate.
+    // @function MidiClockGenerator:setsamplerate
+    // @number rate New sample rate
+    { "setsamplerate",  generator_setsamplerate },
+
+    /// Tempo in beats per minute.
+    // @function MidiClockGenerator:tempo
+    // @treturn number
+    { "tempo",          generator_tempo },
+
+    /// Change the tempo.
+    // Takes effect from the next clock tick.
+    // @function MidiClockGenerator:settempo
+    // @number bpm Beats per minute
+    { "settempo",       generator_settempo },
+
+    /// Time code rate.
+    // @function MidiClockGenerator:mtc
+    // @treturn number Frames per second or 0 when disabled
+    { "mtc",            generator_mtc },
+
+    /// Enable or disable MTC quarter frames.
+    // @function MidiClockGenerator:setmtc
+    // @number fps One of 24, 25, 29.97 or 30. nil disables time code
+    { "setmtc",         generator_setmtc },
+
+    /// Returns true if the transport is running.
+    // @function MidiClockGenerator:running
+    // @treturn bool
+    { "running",        generator_running },
+
+    /// Song position in quarter notes.
+    // @function MidiClockGenerator:position
+    // @treturn number
+    { "position",       generator_position },
+
+    /// Send start on the next block.
+    // Resets the song position to zero.
+    // @function MidiClockGenerator:start
+    // @int[opt] frame Frame index in the next block (default 1)
+    { "start",          generator_start },
+
+    /// Send stop on the next block.
+    // @function MidiClockGenerator:stop
+    // @int[opt] frame Frame index in the next block (default 1)
+    { "stop",           generator_stop },
+
+    /// Send continue on the next block.
+    // @function MidiClockGenerator:continue
+    // @int[opt] frame Frame index in the next block (default 1)
+    { "continue",       generator_continue },
+
+    /// Send a song position pointer on the next block.
+    // Only valid while stopped. Positions are truncated to sixteenth notes.
+    // @function MidiClockGenerator:locate
+    // @number beats Position in quarter notes
+    // @int[opt] frame Frame index in the next block (default 1)
+    { "locate",         generator_locate },
+
+    /// Write messages for one block.
+    // @function MidiClockGenerator:process
+    // @tparam kv.MidiBuffer buffer Buffer to add messages to
+    // @int nframes Block size in samples
+    // @usage
+    // clock:process (midi, nframes)
+    { "process",        generator_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_MidiClockGenerator (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_MIDI_CLOCK_GENERATOR)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, generator_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_MIDI_CLOCK_GENERATOR_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_MIDI_CLOCK_GENERATOR_TYPE);
+    lua_pushcfunction (L, generator_new);
+    lua_setfield (L, -2, "new");
+    return 1;
+}
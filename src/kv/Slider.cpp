@@ -3,6 +3,7 @@
 // @classmod kv.Slider
 // @pragma nostrip
 
+#include "kv/lua/handlers.hpp"
 #include "kv/lua/object.hpp"
 #include "kv/lua/widget.hpp"
 
@@ -16,13 +17,14 @@ class Slider : public juce::Slider
 public:
     Slider (const sol::table&)
         : juce::Slider() {}
-    ~Slider() {}
+    ~Slider() { handlers.reset(); }
 
     static void init (const sol::table& proxy)
     {
         if (auto* impl = object_userdata<Slider> (proxy))
         {
             impl->proxy = proxy;
+            impl->handlers.bind (proxy);
             impl->initialize();
         }
     }
@@ -34,38 +36,21 @@ public:
 
         /// Value changed.
         // @tfield function Slider.valuechanged
-        onValueChange = [this]()
-        {
-            if (sol::function f = proxy ["valuechanged"])
-            {
-                auto r = f (proxy);
-                if (! r.valid())
-                {
-                    sol::error e = r;
-                    DBG(e.what());
-                }
-            }
-        };
+        onValueChange = [this]() { handlers.call (ValueChanged); };
 
         /// Started to drag.
         // @tfield function Slider.dragstart
-        onDragStart = [this]() {
-            if (sol::function f = proxy ["dragstart"]) {
-                f (proxy);
-            }
-        };
+        onDragStart = [this]() { handlers.call (DragStart); };
 
         /// Stopped dragging.
         // @tfield function Slider.dragend
-        onDragEnd = [this]() {
-            if (sol::function f = proxy ["dragend"]) {
-                f (proxy);
-            }
-        };
+        onDragEnd = [this]() { handlers.call (DragEnd); };
     }
 
 private:
     sol::table proxy;
+    enum { ValueChanged, DragStart, DragEnd };
+    Handlers<3> handlers { "valuechanged", "dragstart", "dragend" };
 };
 
 }}
@@ -3,6 +3,7 @@
 // @classmod kv.TextButton
 // @pragma nostrip
 
+#include "kv/lua/handlers.hpp"
 #include "kv/lua/object.hpp"
 #include "kv/lua/widget.hpp"
 #define LKV_TYPE_NAME_TEXT_BUTTON     "TextButton"
@@ -20,12 +21,15 @@ public:
         addListener (this);
     }
     ~TextButton() {
+        handlers.reset();
         removeListener (this);
     }
 
     static void init (const sol::table& proxy) {
-        if (auto* const impl = object_userdata<TextButton> (proxy))
+        if (auto* const impl = object_userdata<TextButton> (proxy)) {
             impl->widget = proxy;
+            impl->handlers.bind (proxy);
+        }
     }
 
     /// Handlers.
@@ -36,17 +40,14 @@ public:
     // @function TextButton:clicked
     // @tparam kv.TextButton self The reference to the clicked button
     void buttonClicked (Button*) override {
-        try {
-            if (sol::protected_function f = widget ["clicked"])
-                f (widget);
-        } catch (const sol::error& e) {
-            std::cerr << e.what() << std::endl;
-        }
+        handlers.call (Clicked);
     }
 
 private:
     TextButton() = delete;
     sol::table widget;
+    enum { Clicked };
+    Handlers<1> handlers { "clicked" };
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TextButton)
 };
 
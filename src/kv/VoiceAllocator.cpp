@@ -0,0 +1,294 @@
+/// Polyphonic voice allocator.
+// Reads note on/off, sustain (CC 64), sostenuto (CC 66) and all notes/sound
+// off messages from a @{kv.MidiBuffer} and produces a compact list of voice
+// commands for the block. Storage is fixed size, so nothing is allocated
+// while processing.
+// @classmod kv.VoiceAllocator
+// @pragma nostrip
+
+#include "kv/lua/voice_allocator.hpp"
+#define LKV_MT_VOICE_ALLOCATOR_TYPE     "kv.VoiceAllocatorClass"
+
+using Allocator     = kv::lua::VoiceAllocator;
+using Impl          = kv::lua::MidiBufferImpl;
+
+#define toallocator(L, n) (*(Allocator**) lua_touserdata (L, n))
+
+/// Create a new voice allocator.
+// @function VoiceAllocator.new
+// @int[opt] polyphony Number of voices (default 16, max 128)
+// @int[opt] policy Stealing policy (default `VoiceAllocator.OLDEST`)
+// @treturn kv.VoiceAllocator
+// @within Constructors
+static int allocator_new (lua_State* L) {
+    auto** alloc = (Allocator**) lua_newuserdata (L, sizeof (Allocator**));
+    *alloc = new Allocator();
+    luaL_setmetatable (L, LKV_MT_VOICE_ALLOCATOR);
+    if (lua_isinteger (L, 1))
+        (**alloc).set_polyphony (static_cast<int> (lua_tointeger (L, 1)));
+    if (lua_isinteger (L, 2))
+        (**alloc).set_policy (static_cast<int> (lua_tointeger (L, 2)));
+    return 1;
+}
+
+static int allocator_free (lua_State* L) {
+    auto** alloc = (Allocator**) lua_touserdata (L, 1);
+    if (nullptr != *alloc) {
+        delete (*alloc);
+        *alloc = nullptr;
+    }
+    return 0;
+}
+
+static int allocator_polyphony (lua_State* L) {
+    lua_pushinteger (L, toallocator (L, 1)->get_polyphony());
+    return 1;
+}
+
+static int allocator_setpolyphony (lua_State* L) {
+    toallocator (L, 1)->set_polyphony (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int allocator_policy (lua_State* L) {
+    lua_pushinteger (L, toallocator (L, 1)->get_policy());
+    return 1;
+}
+
+static int allocator_setpolicy (lua_State* L) {
+    toallocator (L, 1)->set_policy (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int allocator_reset (lua_State* L) {
+    toallocator (L, 1)->reset();
+    return 0;
+}
+
+static int allocator_releaseall (lua_State* L) {
+    toallocator (L, 1)->release_all (
+        lua_isinteger (L, 2) ? static_cast<int> (lua_tointeger (L, 2) - 1) : 0);
+    return 0;
+}
+
+static int allocator_process (lua_State* L) {
+    auto* alloc = toallocator (L, 1);
+    auto* impl  = *(Impl**) lua_touserdata (L, 2);
+    alloc->process (impl->buffer);
+    lua_pushinteger (L, alloc->size());
+    return 1;
+}
+
+static int allocator_size (lua_State* L) {
+    lua_pushinteger (L, toallocator (L, 1)->size());
+    return 1;
+}
+
+static int push_command (lua_State* L, const Allocator::Command& c) {
+    lua_pushinteger (L, c.type);
+    lua_pushinteger (L, c.voice + 1);
+    lua_pushinteger (L, c.note);
+    lua_pushinteger (L, c.velocity);
+    lua_pushinteger (L, c.frame + 1);
+    lua_pushinteger (L, c.channel + 1);
+    return 6;
+}
+
+static int allocator_command (lua_State* L) {
+    auto* alloc = toallocator (L, 1);
+    const auto i = static_cast<int> (lua_tointeger (L, 2) - 1);
+    if (i < 0 || i >= alloc->size()) {
+        lua_pushnil (L);
+        return 1;
+    }
+    return push_command (L, alloc->get_command (i));
+}
+
+static int allocator_commands_next (lua_State* L) {
+    auto* alloc = toallocator (L, 1);
+    const auto i = static_cast<int> (lua_tointeger (L, 2));
+    if (i >= alloc->size()) {
+        lua_pushnil (L);
+        return 1;
+    }
+    lua_pushinteger (L, i + 1);
+    return 1 + push_command (L, alloc->get_command (i));
+}
+
+static int allocator_commands (lua_State* L) {
+    lua_pushcfunction (L, allocator_commands_next);
+    lua_pushvalue (L, 1);
+    lua_pushinteger (L, 0);
+    return 3;
+}
+
+static int allocator_note (lua_State* L) {
+    const int note = toallocator (L, 1)->get_note (static_cast<int> (lua_tointeger (L, 2) - 1));
+    if (note < 0)
+        lua_pushnil (L);
+    else
+        lua_pushinteger (L, note);
+    return 1;
+}
+
+static int allocator_sounding (lua_State* L) {
+    auto* alloc = toallocator (L, 1);
+    if (lua_isinteger (L, 2))
+        lua_pushboolean (L, alloc->is_sounding (static_cast<int> (lua_tointeger (L, 2) - 1)));
+    else
+        lua_pushinteger (L, alloc->get_num_sounding());
+    return 1;
+}
+
+static const luaL_Reg allocator_methods[] = {
+    { "__gc",           allocator_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of voices.
+    // @function VoiceAllocator:polyphony
+    // @treturn int
+    { "polyphony",      allocator_polyphony },
+
+    /// Change the number of voices.
+    // Voices above the new count are dropped without commands.
+    // @function VoiceAllocator:setpolyphony
+    // @int n Number of voices 1-128
+    { "setpolyphony",   allocator_setpolyphony },
+
+    /// Stealing policy.
+    // @function VoiceAllocator:policy
+    // @treturn int
+    { "policy",         allocator_policy },
+
+    /// Change the stealing policy.
+    // @function VoiceAllocator:setpolicy
+    // @int policy One of the policy constants
+    { "setpolicy",      allocator_setpolicy },
+
+    /// Forget all voices and pedals.
+    // No commands are produced.
+    // @function VoiceAllocator:reset
+    { "reset",          allocator_reset },
+
+    /// Release every sounding voice.
+    // Adds stop commands to the current list.
+    // @function VoiceAllocator:releaseall
+    // @int[opt] frame Frame index (default 1)
+    { "releaseall",     allocator_releaseall },
+
+    /// Read a block of MIDI.
+    // Replaces the command list with commands for this block.
+    // @function VoiceAllocator:process
+    // @tparam kv.MidiBuffer buffer Incoming MIDI
+    // @treturn int Number of commands
+    { "process",        allocator_process },
+
+    /// Number of commands in the current list.
+    // @function VoiceAllocator:size
+    // @treturn int
+    { "size",           allocator_size },
+
+    /// Get a single command.
+    // @function VoiceAllocator:command
+    // @int index Command index
+    // @treturn int Command type
+    // @treturn int Voice index
+    // @treturn int Note number
+    // @treturn int Velocity
+    // @treturn int Frame index
+    // @treturn int MIDI channel
+    { "command",        allocator_command },
+
+    /// Iterate the current commands.
+    // Does not create a closure.
+    // @function VoiceAllocator:commands
+    // @return command iterator
+    // @usage
+    // alloc:process (midi)
+    // for _, cmd, voice, note, velocity, frame in alloc:commands() do
+    //     if cmd == VoiceAllocator.START then
+    //         -- start `note` on `voice` at `frame`
+    //     end
+    // end
+    { "commands",       allocator_commands },
+
+    /// Note assigned to a voice.
+    // @function VoiceAllocator:note
+    // @int voice Voice index
+    // @treturn int Note number or nil if the voice never played
+    { "note",           allocator_note },
+
+    /// Sounding voices.
+    // With a voice index returns true if held by a key or pedal, otherwise
+    // returns the number of sounding voices.
+    // @function VoiceAllocator:sounding
+    // @int[opt] voice Voice index
+    { "sounding",       allocator_sounding },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_VoiceAllocator (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_VOICE_ALLOCATOR)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, allocator_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_VOICE_ALLOCATOR_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_VOICE_ALLOCATOR_TYPE);
+    lua_pushcfunction (L, allocator_new);
+    lua_setfield (L, -2, "new");
+
+    /// Commands.
+    // @section commands
+
+    /// Start a note on a voice.
+    // @tfield int VoiceAllocator.START
+    lua_pushinteger (L, Allocator::Start);
+    lua_setfield (L, -2, "START");
+
+    /// Release the note on a voice.
+    // @tfield int VoiceAllocator.STOP
+    lua_pushinteger (L, Allocator::Stop);
+    lua_setfield (L, -2, "STOP");
+
+    /// Cut a voice quickly.
+    // Always followed by a START for the same voice and frame.
+    // @tfield int VoiceAllocator.STEAL
+    lua_pushinteger (L, Allocator::Steal);
+    lua_setfield (L, -2, "STEAL");
+
+    /// Policies.
+    // @section policies
+
+    /// Steal the oldest note.
+    // @tfield int VoiceAllocator.OLDEST
+    lua_pushinteger (L, Allocator::Oldest);
+    lua_setfield (L, -2, "OLDEST");
+
+    /// Steal the lowest velocity note.
+    // @tfield int VoiceAllocator.QUIETEST
+    lua_pushinteger (L, Allocator::Quietest);
+    lua_setfield (L, -2, "QUIETEST");
+
+    /// Steal the lowest note.
+    // @tfield int VoiceAllocator.LOWEST
+    lua_pushinteger (L, Allocator::Lowest);
+    lua_setfield (L, -2, "LOWEST");
+
+    /// Steal the highest note.
+    // @tfield int VoiceAllocator.HIGHEST
+    lua_pushinteger (L, Allocator::Highest);
+    lua_setfield (L, -2, "HIGHEST");
+
+    return 1;
+}
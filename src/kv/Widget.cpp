@@ -3,20 +3,28 @@
 // @classmod kv.Widget
 // @pragma nostrip
 
+#include "kv/lua/display_list.hpp"
+#include "kv/lua/handlers.hpp"
 #include "kv/lua/object.hpp"
 #include "kv/lua/widget.hpp"
 #define LKV_TYPE_NAME_WIDGET     "Widget"
 
+extern "C" int luaopen_kv_DisplayList (lua_State* L);
+
 using namespace juce;
 
 namespace kv {
 namespace lua {
 
-class Widget : public juce::Component
+class Widget : public juce::Component,
+               private juce::ChangeListener
 {
 public:
     ~Widget()
     {
+        if (auto* list = displayList.get())
+            list->removeChangeListener (this);
+        handlers.reset();
         widget = sol::lua_nil;
     }
 
@@ -27,33 +35,29 @@ public:
 
     void resized() override
     {
-        if (sol::safe_function f = widget ["resized"])
-            f (widget);
+        handlers.call (Resized);
     }
 
     void paint (Graphics& g) override
     {
-        if (sol::safe_function f = widget ["paint"]) {
-            f (widget, std::ref<Graphics> (g));
-        }
+        if (auto* list = displayList.get())
+            list->draw (g);
+        handlers.call (Paint, std::ref<Graphics> (g));
     }
 
     void mouseDrag (const MouseEvent& ev) override
     {
-        if (sol::safe_function f = widget ["mousedrag"])
-            f (widget, ev);
+        handlers.call (MouseDrag, ev);
     }
 
     void mouseDown (const MouseEvent& ev) override
     {
-        if (sol::safe_function f = widget ["mousedown"])
-            f (widget, ev);
+        handlers.call (MouseDown, ev);
     }
 
     void mouseUp (const MouseEvent& ev) override
     {
-        if (sol::safe_function f = widget ["mouseup"])
-            f (widget, ev);
+        handlers.call (MouseUp, ev);
     }
 
     sol::table addWithZ (const sol::object& child, int zorder)
@@ -75,9 +79,24 @@ public:
     static void init (const sol::table& proxy) {
         if (auto* const impl = object_userdata<Widget> (proxy)) {
             impl->widget = proxy;
+            impl->handlers.bind (proxy);
         }
     }
 
+    sol::object getDisplayList() const { return displayListObject; }
+
+    void setDisplayList (const sol::object& obj)
+    {
+        if (auto* list = displayList.get())
+            list->removeChangeListener (this);
+        auto* list = obj.is<DisplayList>() ? obj.as<DisplayList*>() : nullptr;
+        displayList = list;
+        displayListObject = list != nullptr ? obj : sol::object (sol::lua_nil);
+        if (list != nullptr)
+            list->addChangeListener (this);
+        repaint();
+    }
+
     sol::table getBoundsTable()
     {
         sol::state_view L (widget.lua_state());
@@ -93,6 +112,13 @@ public:
 private:
     Widget() = delete;
     sol::table widget;
+    WeakReference<DisplayList> displayList;
+    sol::object displayListObject;
+    enum { Resized, Paint, MouseDrag, MouseDown, MouseUp };
+    Handlers<5> handlers { "resized", "paint", "mousedrag", "mousedown", "mouseup" };
+
+    void changeListenerCallback (ChangeBroadcaster*) override { repaint(); }
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Widget)
 };
 
@@ -112,6 +138,13 @@ int luaopen_kv_Widget (lua_State* L) {
         // @int[opt] zorder Z-order
         // @within Methods
         "add", sol::overload (&Widget::add, &Widget::addWithZ),
+
+        /// Display list drawn before `paint` (kv.DisplayList).
+        // Drawn without running any Lua, and repainted when the list
+        // changes. Set nil to remove.
+        // @field Widget.displaylist
+        // @within Attributes
+        "displaylist", sol::property (&Widget::getDisplayList, &Widget::setDisplayList),
         "addtodesktop", sol::overload (
             [](Widget& self, int flags) { 
                 self.addToDesktop(flags, nullptr); 
@@ -127,6 +160,11 @@ int luaopen_kv_Widget (lua_State* L) {
     T_mt["__methods"].get_or_create<sol::table>().add (
         "add"
     );
+    T_mt["__props"].get_or_create<sol::table>().add (
+        "displaylist"
+    );
+    luaL_requiref (L, "kv.DisplayList", luaopen_kv_DisplayList, 0);
+    lua_pop (L, 1);
 
     sol::stack::push (L, T);
 
@@ -0,0 +1,22 @@
+--- Native signal processing helpers.
+-- @module kv.dsp
+-- @pragma nostrip
+
+local Expression = require ('kv.dsp.Expression')
+
+local M = {}
+
+--- Compile a per-sample expression.
+-- @string source Program text
+-- @treturn kv.dsp.Expression
+-- @see kv.dsp.Expression
+-- @usage
+-- local dsp = require ('kv.dsp')
+-- local drive = dsp.compile ("y = tanh (x * gain)")
+function M.compile (source)
+    return Expression.compile (source)
+end
+
+M.Expression = Expression
+
+return M
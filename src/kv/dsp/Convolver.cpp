@@ -0,0 +1,162 @@
+/// Zero latency convolution with an impulse response.
+// Uses a non-uniform partition: a short direct form head, FFT partitions
+// the size of the head on the audio thread, and long FFT partitions for the
+// tail on background threads. The tail threads are shared by every
+// convolver, so several long impulse responses use every core.
+// @classmod kv.dsp.Convolver
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/convolver.hpp"
+
+#define LKV_MT_CONVOLVER                "kv.dsp.Convolver"
+#define LKV_MT_CONVOLVER_TYPE           "kv.dsp.ConvolverClass"
+
+using Convolver = kv::lua::Convolver;
+
+#define toconvolver(L, n) (*(Convolver**) lua_touserdata (L, n))
+
+/// Create a new convolver.
+// Copies the impulse response, which can then be discarded. Channels past
+// the last channel of the impulse response use its last channel, so a mono
+// response can process a stereo buffer.
+// @function Convolver.new
+// @tparam kv.AudioBuffer ir Impulse response
+// @int[opt] nchannels Channels to process (default channels in the response)
+// @int[opt] headsize Direct form head size, rounded to a power of two (default 64)
+// @treturn kv.dsp.Convolver
+// @within Constructors
+// @usage
+// local cab = Convolver.new (ir, 2)
+static int convolver_new (lua_State* L) {
+    juce::AudioBuffer<float> ir;
+    if (! kv::lua::visit_audio_buffer (L, 1, [&ir] (auto& buffer) {
+        ir.setSize (buffer.getNumChannels(), buffer.getNumSamples());
+        for (int c = 0; c < buffer.getNumChannels(); ++c)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                ir.setSample (c, i, static_cast<float> (buffer.getSample (c, i)));
+    })) {
+        return luaL_typeerror (L, 1, "kv.AudioBuffer");
+    }
+
+    if (ir.getNumChannels() <= 0)
+        return luaL_argerror (L, 1, "impulse response has no channels");
+
+    const auto nchans   = static_cast<int> (luaL_optinteger (L, 2, ir.getNumChannels()));
+    const auto headsize = static_cast<int> (luaL_optinteger (L, 3, 64));
+    auto** conv = (Convolver**) lua_newuserdata (L, sizeof (Convolver**));
+    *conv = new Convolver (ir, nchans, headsize);
+    luaL_setmetatable (L, LKV_MT_CONVOLVER);
+    return 1;
+}
+
+static int convolver_free (lua_State* L) {
+    auto** conv = (Convolver**) lua_touserdata (L, 1);
+    if (nullptr != *conv) {
+        delete (*conv);
+        *conv = nullptr;
+    }
+    return 0;
+}
+
+static int convolver_channels (lua_State* L) {
+    lua_pushinteger (L, toconvolver (L, 1)->get_num_channels());
+    return 1;
+}
+
+static int convolver_length (lua_State* L) {
+    lua_pushinteger (L, toconvolver (L, 1)->get_length());
+    return 1;
+}
+
+static int convolver_headsize (lua_State* L) {
+    lua_pushinteger (L, toconvolver (L, 1)->get_head_size());
+    return 1;
+}
+
+static int convolver_tailsize (lua_State* L) {
+    lua_pushinteger (L, toconvolver (L, 1)->get_tail_size());
+    return 1;
+}
+
+static int convolver_reset (lua_State* L) {
+    toconvolver (L, 1)->reset();
+    return 0;
+}
+
+static int convolver_process (lua_State* L) {
+    auto* conv = toconvolver (L, 1);
+    kv::lua::visit_audio_buffer (L, 2, [L, conv] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read_frames (L, 3, buffer);
+        const int nchans = juce::jmin (buffer.getNumChannels(), conv->get_num_channels());
+        for (int c = 0; c < nchans; ++c)
+            conv->process (c, buffer.getWritePointer (c, r.start), r.count);
+    });
+    return 0;
+}
+
+static const luaL_Reg convolver_methods[] = {
+    { "__gc",           convolver_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of channels processed.
+    // @function Convolver:channels
+    // @treturn int
+    { "channels",       convolver_channels },
+
+    /// Impulse response length in frames.
+    // @function Convolver:length
+    // @treturn int
+    { "length",         convolver_length },
+
+    /// Direct form head size in frames.
+    // Also the partition size used on the audio thread.
+    // @function Convolver:headsize
+    // @treturn int
+    { "headsize",       convolver_headsize },
+
+    /// Partition size used on the background threads.
+    // Zero when the response is short enough to run on the audio thread.
+    // @function Convolver:tailsize
+    // @treturn int
+    { "tailsize",       convolver_tailsize },
+
+    /// Clear all convolution history.
+    // Waits for background work in progress.
+    // @function Convolver:reset
+    { "reset",          convolver_reset },
+
+    /// Convolve a block in place.
+    // Any block size works and there is no latency. Tail work is handed to
+    // the background threads every `tailsize` frames and collected one
+    // period later; if a thread is late the call waits for it.
+    // @function Convolver:process
+    // @tparam kv.AudioBuffer buffer Audio to process
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    { "process",        convolver_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_Convolver (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_CONVOLVER)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, convolver_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_CONVOLVER_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_CONVOLVER_TYPE);
+    lua_pushcfunction (L, convolver_new);
+    lua_setfield (L, -2, "new");
+    return 1;
+}
@@ -0,0 +1,218 @@
+/// A multichannel delay line.
+// Circular buffer with power of two masking and fractional delay reads.
+// Blocks are written from and read back into a @{kv.AudioBuffer}, with a
+// fixed delay or a @{kv.vector} of per-frame delays for modulated effects
+// like chorus and flanger.
+// @classmod kv.dsp.DelayLine
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/delay_line.hpp"
+
+#define LKV_MT_DELAY_LINE               "kv.dsp.DelayLine"
+#define LKV_MT_DELAY_LINE_TYPE          "kv.dsp.DelayLineClass"
+
+using Delay = kv::lua::DelayLine;
+
+#define todelay(L, n) (*(Delay**) lua_touserdata (L, n))
+
+/// Create a new delay line.
+// Allocates room for the maximum delay plus one block.
+// @function DelayLine.new
+// @int nchannels Number of channels
+// @int maxdelay Longest delay in frames
+// @int[opt] maxblock Largest block size (default 4096)
+// @treturn kv.dsp.DelayLine
+// @within Constructors
+static int delay_new (lua_State* L) {
+    const auto nchans   = static_cast<int> (luaL_optinteger (L, 1, 1));
+    const auto maxdelay = static_cast<int> (luaL_optinteger (L, 2, 1));
+    const auto maxblock = static_cast<int> (luaL_optinteger (L, 3, 4096));
+    auto** delay = (Delay**) lua_newuserdata (L, sizeof (Delay**));
+    *delay = new Delay (nchans, maxdelay, maxblock);
+    luaL_setmetatable (L, LKV_MT_DELAY_LINE);
+    return 1;
+}
+
+static int delay_free (lua_State* L) {
+    auto** delay = (Delay**) lua_touserdata (L, 1);
+    if (nullptr != *delay) {
+        delete (*delay);
+        *delay = nullptr;
+    }
+    return 0;
+}
+
+static int delay_channels (lua_State* L) {
+    lua_pushinteger (L, todelay (L, 1)->get_num_channels());
+    return 1;
+}
+
+static int delay_maxdelay (lua_State* L) {
+    lua_pushinteger (L, todelay (L, 1)->get_max_delay());
+    return 1;
+}
+
+static int delay_interpolation (lua_State* L) {
+    lua_pushinteger (L, todelay (L, 1)->get_interpolation());
+    return 1;
+}
+
+static int delay_setinterpolation (lua_State* L) {
+    todelay (L, 1)->set_interpolation (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int delay_clear (lua_State* L) {
+    todelay (L, 1)->clear();
+    return 0;
+}
+
+static int delay_write (lua_State* L) {
+    auto* delay = todelay (L, 1);
+    bool fits = true;
+    kv::lua::visit_audio_buffer (L, 2, [L, delay, &fits] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read_frames (L, 3, buffer);
+        fits = r.count <= delay->get_max_block();
+        if (! fits)
+            return;
+        const int nchans = juce::jmin (buffer.getNumChannels(), delay->get_num_channels());
+        for (int c = 0; c < nchans; ++c)
+            delay->write (c, buffer.getReadPointer (c, r.start), r.count);
+        delay->advance (r.count, r.start);
+    });
+    if (! fits)
+        return luaL_error (L, "block is longer than maxblock (%d)", delay->get_max_block());
+    return 0;
+}
+
+static int delay_read (lua_State* L) {
+    auto* delay = todelay (L, 1);
+    auto* vec   = (kv_vector_t*) luaL_testudata (L, 3, LKV_MT_VECTOR);
+    const double fixed = vec == nullptr ? lua_tonumber (L, 3) : 0.0;
+
+    kv::lua::visit_audio_buffer (L, 2, [L, delay, vec, fixed] (auto& buffer) {
+        auto r = kv::lua::AudioRange::read_frames (L, 4, buffer);
+        const int nchans = juce::jmin (buffer.getNumChannels(), delay->get_num_channels());
+        if (vec != nullptr) {
+            r.count = juce::jmin (r.count, (int) kv_vector_size (vec));
+            for (int c = 0; c < nchans; ++c)
+                delay->read (c, buffer.getWritePointer (c, r.start), r.start, r.count,
+                             kv_vector_values (vec));
+        } else {
+            for (int c = 0; c < nchans; ++c)
+                delay->read (c, buffer.getWritePointer (c, r.start), r.start, r.count, fixed);
+        }
+    });
+    return 0;
+}
+
+static const luaL_Reg delay_methods[] = {
+    { "__gc",               delay_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of channels.
+    // @function DelayLine:channels
+    // @treturn int
+    { "channels",           delay_channels },
+
+    /// Longest delay in frames.
+    // @function DelayLine:maxdelay
+    // @treturn int
+    { "maxdelay",           delay_maxdelay },
+
+    /// Interpolation used for fractional delays.
+    // @function DelayLine:interpolation
+    // @treturn int
+    { "interpolation",      delay_interpolation },
+
+    /// Change the interpolation.
+    // ALLPASS keeps one filter state per channel, so use one allpass read
+    // per channel. CUBIC delays shorter than one frame read as one frame.
+    // @function DelayLine:setinterpolation
+    // @int mode One of the interpolation constants
+    { "setinterpolation",   delay_setinterpolation },
+
+    /// Zero the delay memory.
+    // @function DelayLine:clear
+    { "clear",              delay_clear },
+
+    /// Write a block and advance the write head.
+    // Writes as many channels as the buffer and delay line have in common.
+    // Raises an error if the range is longer than `maxblock`.
+    // @function DelayLine:write
+    // @tparam kv.AudioBuffer buffer Input audio
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    { "write",              delay_write },
+
+    /// Read a delayed block.
+    // Reads are aligned with the most recent write: frame N of the output is
+    // the input from `delay` frames before frame N of the last written block.
+    // Output overwrites the buffer range.
+    //
+    // With ALLPASS interpolation make one read per channel per block. The
+    // filter state is kept per channel, so several taps on one channel, like
+    // the voices of a chorus, would feed each other's state. Use LINEAR or
+    // CUBIC for multiple taps.
+    // @function DelayLine:read
+    // @tparam kv.AudioBuffer buffer Output audio
+    // @tparam number|kv.vector delay Delay in frames, or one delay per frame
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @usage
+    // -- 100 ms echo at 44.1 kHz
+    // delay:write (input)
+    // delay:read (wet, 4410)
+    { "read",               delay_read },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_DelayLine (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_DELAY_LINE)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, delay_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_DELAY_LINE_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_DELAY_LINE_TYPE);
+    lua_pushcfunction (L, delay_new);
+    lua_setfield (L, -2, "new");
+
+    /// Interpolation.
+    // @section interpolation
+
+    /// Round to the nearest frame.
+    // @tfield int DelayLine.NONE
+    lua_pushinteger (L, Delay::None);
+    lua_setfield (L, -2, "NONE");
+
+    /// Linear interpolation (default).
+    // @tfield int DelayLine.LINEAR
+    lua_pushinteger (L, Delay::Linear);
+    lua_setfield (L, -2, "LINEAR");
+
+    /// First order allpass.
+    // Flat magnitude response, best for fixed delays in feedback loops.
+    // @tfield int DelayLine.ALLPASS
+    lua_pushinteger (L, Delay::Allpass);
+    lua_setfield (L, -2, "ALLPASS");
+
+    /// Third order Lagrange.
+    // Delays are at least one frame.
+    // @tfield int DelayLine.CUBIC
+    lua_pushinteger (L, Delay::Cubic);
+    lua_setfield (L, -2, "CUBIC");
+
+    return 1;
+}
@@ -0,0 +1,366 @@
+/// A bank of ADSR envelopes.
+// Holds the state of many envelopes in contiguous arrays. Envelopes can be
+// rendered into or multiplied with a @{kv.AudioBuffer} at audio rate, or
+// advanced per block and read back at control rate. Triggers and releases
+// can be scheduled with sample accuracy from a @{kv.MidiBuffer} or a
+// @{kv.VoiceAllocator}.
+// @classmod kv.dsp.EnvelopeBank
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/envelope_bank.hpp"
+
+#define LKV_MT_ENVELOPE_BANK            "kv.dsp.EnvelopeBank"
+#define LKV_MT_ENVELOPE_BANK_TYPE       "kv.dsp.EnvelopeBankClass"
+
+using Bank          = kv::lua::EnvelopeBank;
+using Allocator     = kv::lua::VoiceAllocator;
+using Impl          = kv::lua::MidiBufferImpl;
+
+#define tobank(L, n) (*(Bank**) lua_touserdata (L, n))
+
+static int index_arg (lua_State* L, int idx) {
+    return static_cast<int> (lua_tointeger (L, idx) - 1);
+}
+
+/// Create a new envelope bank.
+// Every envelope starts with attack 0.01, decay 0.1, sustain 1 and
+// release 0.2.
+// @function EnvelopeBank.new
+// @int size Number of envelopes
+// @number[opt] rate Sample rate (default 44100)
+// @treturn kv.dsp.EnvelopeBank
+// @within Constructors
+static int bank_new (lua_State* L) {
+    const auto size = static_cast<int> (luaL_optinteger (L, 1, 1));
+    const auto rate = luaL_optnumber (L, 2, 44100.0);
+    auto** bank = (Bank**) lua_newuserdata (L, sizeof (Bank**));
+    *bank = new Bank (size, rate);
+    luaL_setmetatable (L, LKV_MT_ENVELOPE_BANK);
+    return 1;
+}
+
+static int bank_free (lua_State* L) {
+    auto** bank = (Bank**) lua_touserdata (L, 1);
+    if (nullptr != *bank) {
+        delete (*bank);
+        *bank = nullptr;
+    }
+    return 0;
+}
+
+static int bank_size (lua_State* L) {
+    lua_pushinteger (L, tobank (L, 1)->get_size());
+    return 1;
+}
+
+static int bank_samplerate (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_sample_rate());
+    return 1;
+}
+
+static int bank_setsamplerate (lua_State* L) {
+    tobank (L, 1)->set_sample_rate (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int bank_adsr (lua_State* L) {
+    double a, d, s, r;
+    tobank (L, 1)->get_adsr (index_arg (L, 2), a, d, s, r);
+    lua_pushnumber (L, a);
+    lua_pushnumber (L, d);
+    lua_pushnumber (L, s);
+    lua_pushnumber (L, r);
+    return 4;
+}
+
+static int bank_setadsr (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (lua_gettop (L) >= 6) {
+        bank->set_adsr (index_arg (L, 2), lua_tonumber (L, 3), lua_tonumber (L, 4),
+                        lua_tonumber (L, 5), lua_tonumber (L, 6));
+    } else {
+        for (int i = 0; i < bank->get_size(); ++i)
+            bank->set_adsr (i, lua_tonumber (L, 2), lua_tonumber (L, 3),
+                            lua_tonumber (L, 4), lua_tonumber (L, 5));
+    }
+    return 0;
+}
+
+static int bank_trigger (lua_State* L) {
+    tobank (L, 1)->trigger (index_arg (L, 2), luaL_optnumber (L, 3, 1.0));
+    return 0;
+}
+
+static int bank_release (lua_State* L) {
+    tobank (L, 1)->release_envelope (index_arg (L, 2));
+    return 0;
+}
+
+static int bank_reset (lua_State* L) {
+    tobank (L, 1)->reset();
+    return 0;
+}
+
+static int bank_level (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_level (index_arg (L, 2)));
+    return 1;
+}
+
+static int bank_levels (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    auto* vec  = (kv_vector_t*) luaL_checkudata (L, 2, LKV_MT_VECTOR);
+    kv_vector_resize (vec, bank->get_size());
+    auto* values = kv_vector_values (vec);
+    for (int i = 0; i < bank->get_size(); ++i)
+        values[i] = static_cast<kv_sample_t> (bank->get_level (i));
+    return 0;
+}
+
+static int bank_stage (lua_State* L) {
+    lua_pushinteger (L, tobank (L, 1)->get_stage (index_arg (L, 2)));
+    return 1;
+}
+
+static int bank_active (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (lua_isinteger (L, 2))
+        lua_pushboolean (L, bank->is_active (index_arg (L, 2)));
+    else
+        lua_pushinteger (L, bank->get_num_active());
+    return 1;
+}
+
+static int bank_schedule (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (auto** alloc = (Allocator**) luaL_testudata (L, 2, LKV_MT_VOICE_ALLOCATOR))
+        bank->schedule (**alloc);
+    else if (auto** impl = (Impl**) luaL_testudata (L, 2, LKV_MT_MIDI_BUFFER))
+        bank->schedule ((**impl).buffer);
+    else
+        bank->clear_events();
+    lua_pushinteger (L, bank->get_num_events());
+    return 1;
+}
+
+static int bank_clearevents (lua_State* L) {
+    tobank (L, 1)->clear_events();
+    return 0;
+}
+
+static int bank_render (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    const int i = index_arg (L, 2);
+    kv::lua::visit_audio_buffer (L, 3, [L, bank, i] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read (L, 4, buffer);
+        if (r.count > 0)
+            bank->render (i, buffer.getWritePointer (r.channel, r.start), r.start, r.count);
+    });
+    return 0;
+}
+
+static int bank_apply (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    const int i = index_arg (L, 2);
+    kv::lua::visit_audio_buffer (L, 3, [L, bank, i] (auto& buffer) {
+        if (lua_tointeger (L, 4) == 0) {
+            const auto r = kv::lua::AudioRange::read_frames (L, 5, buffer);
+            if (r.count > 0)
+                bank->apply (i, buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                             r.start, r.count);
+            return;
+        }
+
+        const auto r = kv::lua::AudioRange::read (L, 4, buffer);
+        if (r.count > 0)
+            bank->apply (i, buffer.getWritePointer (r.channel, r.start), r.start, r.count);
+    });
+    return 0;
+}
+
+static int bank_tick (lua_State* L) {
+    tobank (L, 1)->tick (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static const luaL_Reg bank_methods[] = {
+    { "__gc",           bank_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of envelopes.
+    // @function EnvelopeBank:size
+    // @treturn int
+    { "size",           bank_size },
+
+    /// Sample rate.
+    // @function EnvelopeBank:samplerate
+    // @treturn number
+    { "samplerate",     bank_samplerate },
+
+    /// Change the sample rate.
+    // @function EnvelopeBank:setsamplerate
+    // @number rate New sample rate
+    { "setsamplerate",  bank_setsamplerate },
+
+    /// Parameters of an envelope.
+    // @function EnvelopeBank:adsr
+    // @int index Envelope index
+    // @treturn number Attack in seconds
+    // @treturn number Decay in seconds to -60 dB
+    // @treturn number Sustain level 0-1
+    // @treturn number Release in seconds to -60 dB
+    { "adsr",           bank_adsr },
+
+    /// Set parameters of every envelope.
+    // @function EnvelopeBank:setadsr
+    // @number a Attack
+    // @number d Decay
+    // @number s Sustain
+    // @number r Release
+
+    /// Set parameters of one envelope.
+    // @function EnvelopeBank:setadsr
+    // @int index Envelope index
+    // @number a Attack
+    // @number d Decay
+    // @number s Sustain
+    // @number r Release
+    { "setadsr",        bank_setadsr },
+
+    /// Start the attack stage.
+    // Starts from the current level, so retriggering does not click.
+    // @function EnvelopeBank:trigger
+    // @int index Envelope index
+    // @number[opt] velocity Peak level (default 1)
+    { "trigger",        bank_trigger },
+
+    /// Start the release stage.
+    // @function EnvelopeBank:release
+    // @int index Envelope index
+    { "release",        bank_release },
+
+    /// Silence every envelope and drop scheduled events.
+    // @function EnvelopeBank:reset
+    { "reset",          bank_reset },
+
+    /// Current output of an envelope.
+    // @function EnvelopeBank:level
+    // @int index Envelope index
+    // @treturn number
+    { "level",          bank_level },
+
+    /// Copy every current output to a vector.
+    // The vector is resized to the number of envelopes.
+    // @function EnvelopeBank:levels
+    // @tparam kv.vector out Vector to write to
+    { "levels",         bank_levels },
+
+    /// Current stage of an envelope.
+    // @function EnvelopeBank:stage
+    // @int index Envelope index
+    // @treturn int One of the stage constants
+    { "stage",          bank_stage },
+
+    /// Active envelopes.
+    // With an index returns true if the envelope is not idle, otherwise
+    // returns the number of active envelopes.
+    // @function EnvelopeBank:active
+    // @int[opt] index Envelope index
+    { "active",         bank_active },
+
+    /// Schedule triggers and releases for the next block.
+    // Replaces pending events. With a @{kv.VoiceAllocator}, envelope N
+    // follows voice N. With a @{kv.MidiBuffer}, envelope N + 1 follows MIDI
+    // note N on every channel. Events are applied when their frame is
+    // rendered.
+    // @function EnvelopeBank:schedule
+    // @tparam kv.VoiceAllocator|kv.MidiBuffer source Event source
+    // @treturn int Number of events scheduled
+    // @usage
+    // alloc:process (midi)
+    // envs:schedule (alloc)
+    // for v = 1, envs:size() do
+    //     envs:apply (v, voicebuffers[v])
+    // end
+    { "schedule",       bank_schedule },
+
+    /// Drop scheduled events.
+    // @function EnvelopeBank:clearevents
+    { "clearevents",    bank_clearevents },
+
+    /// Write an envelope to a buffer.
+    // Overwrites the range. The frame index is also the frame used for
+    // scheduled events.
+    // @function EnvelopeBank:render
+    // @int index Envelope index
+    // @tparam kv.AudioBuffer buffer Buffer to write to
+    // @int[opt] channel Channel index (default 1)
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    { "render",         bank_render },
+
+    /// Multiply a buffer by an envelope.
+    // @function EnvelopeBank:apply
+    // @int index Envelope index
+    // @tparam kv.AudioBuffer buffer Buffer to process
+    // @int[opt] channel Channel index. nil or 0 applies to every channel
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    { "apply",          bank_apply },
+
+    /// Advance every envelope at control rate.
+    // Applies events scheduled in the first `nframes` frames, then drops
+    // all pending events.
+    // @function EnvelopeBank:tick
+    // @int nframes Block size
+    { "tick",           bank_tick },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_EnvelopeBank (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_ENVELOPE_BANK)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, bank_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_ENVELOPE_BANK_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_ENVELOPE_BANK_TYPE);
+    lua_pushcfunction (L, bank_new);
+    lua_setfield (L, -2, "new");
+
+    /// Stages.
+    // @section stages
+
+    /// Not running, output is zero.
+    // @tfield int EnvelopeBank.IDLE
+    lua_pushinteger (L, Bank::Idle);
+    lua_setfield (L, -2, "IDLE");
+
+    /// @tfield int EnvelopeBank.ATTACK
+    lua_pushinteger (L, Bank::Attack);
+    lua_setfield (L, -2, "ATTACK");
+
+    /// @tfield int EnvelopeBank.DECAY
+    lua_pushinteger (L, Bank::Decay);
+    lua_setfield (L, -2, "DECAY");
+
+    /// @tfield int EnvelopeBank.SUSTAIN
+    lua_pushinteger (L, Bank::Sustain);
+    lua_setfield (L, -2, "SUSTAIN");
+
+    /// @tfield int EnvelopeBank.RELEASE
+    lua_pushinteger (L, Bank::Release);
+    lua_setfield (L, -2, "RELEASE");
+
+    return 1;
+}
@@ -0,0 +1,194 @@
+/// Per-sample formulas compiled to native bytecode.
+// Compiles a small arithmetic language once, then evaluates it over
+// @{kv.AudioBuffer} channels and @{kv.vector}s a block at a time. Each
+// operation runs across a whole block before the next is dispatched, so a
+// formula costs a handful of native loops instead of a Lua call per sample.
+// Running does not allocate.
+//
+// Programs are assignments separated by newlines or semicolons. Operators
+// are `+ - * / ^` and parentheses, `pi` is a constant, and the functions
+// are sin, cos, tan, exp, log, sqrt, abs, floor, tanh, min, max, pow and
+// clamp. A name read before it is assigned is an input; an assigned name is
+// an output and can be read by later statements. `--` starts a comment.
+// Evaluation is 32 bit and each statement covers a whole block, so a
+// statement can't refer to its own previous sample.
+// @classmod kv.dsp.Expression
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/expression.hpp"
+
+#include <memory>
+
+#define LKV_MT_EXPRESSION               "kv.dsp.Expression"
+#define LKV_MT_EXPRESSION_TYPE          "kv.dsp.ExpressionClass"
+
+using Expression = kv::lua::Expression;
+
+#define toexpression(L, n) (*(Expression**) lua_touserdata (L, n))
+
+/// Compile an expression.
+// Raises an error describing the problem if the source is invalid.
+// @function Expression.compile
+// @string source Program text
+// @treturn kv.dsp.Expression
+// @within Constructors
+// @usage
+// local gain = Expression.compile ("y = x * g")
+// gain:bind ("x", buffer, 1)
+// gain:bind ("y", buffer, 1)
+// gain:bind ("g", 0.5)
+// gain:run()
+static int expression_compile (lua_State* L) {
+    size_t len = 0;
+    const char* src = luaL_checklstring (L, 1, &len);
+    auto expr = std::make_unique<Expression>();
+    std::string error;
+    if (! expr->compile (std::string (src, len), error))
+        return luaL_error (L, "expression: %s", error.c_str());
+
+    auto** userdata = (Expression**) lua_newuserdatauv (L, sizeof (Expression**), 1);
+    *userdata = expr.release();
+    luaL_setmetatable (L, LKV_MT_EXPRESSION);
+
+    // bound objects are kept here so they outlive their bindings
+    lua_newtable (L);
+    lua_setiuservalue (L, -2, 1);
+    return 1;
+}
+
+static int expression_free (lua_State* L) {
+    auto** expr = (Expression**) lua_touserdata (L, 1);
+    if (nullptr != *expr) {
+        delete (*expr);
+        *expr = nullptr;
+    }
+    return 0;
+}
+
+static void push_names (lua_State* L, Expression* expr, bool inputs) {
+    lua_newtable (L);
+    int index = 0;
+    for (int v = 0; v < expr->get_num_variables(); ++v) {
+        if (inputs ? ! expr->is_input (v) : ! expr->is_output (v))
+            continue;
+        lua_pushstring (L, expr->get_name (v).c_str());
+        lua_rawseti (L, -2, ++index);
+    }
+}
+
+static int expression_inputs (lua_State* L) {
+    push_names (L, toexpression (L, 1), true);
+    return 1;
+}
+
+static int expression_outputs (lua_State* L) {
+    push_names (L, toexpression (L, 1), false);
+    return 1;
+}
+
+static int expression_bind (lua_State* L) {
+    auto* expr = toexpression (L, 1);
+    const char* name = luaL_checkstring (L, 2);
+    const int v = expr->find_variable (name);
+    if (v < 0)
+        return luaL_error (L, "expression has no variable '%s'", name);
+
+    if (lua_isnoneornil (L, 3)) {
+        expr->unbind (v);
+    } else if (lua_type (L, 3) == LUA_TNUMBER) {
+        expr->bind_scalar (v, lua_tonumber (L, 3));
+    } else if (auto* vec = (kv_vector_t*) luaL_testudata (L, 3, LKV_MT_VECTOR)) {
+        expr->bind (v, kv_vector_values (vec), (int) kv_vector_size (vec));
+    } else {
+        bool valid_channel = true;
+        const bool ok = kv::lua::visit_audio_buffer (L, 3, [L, expr, v, &valid_channel] (auto& buffer) {
+            const auto channel = static_cast<int> (luaL_optinteger (L, 4, 1)) - 1;
+            valid_channel = juce::isPositiveAndBelow (channel, buffer.getNumChannels());
+            if (valid_channel)
+                expr->bind (v, buffer.getWritePointer (channel), buffer.getNumSamples());
+        });
+        if (! ok)
+            return luaL_typeerror (L, 3, "number, kv.vector or kv.AudioBuffer");
+        if (! valid_channel)
+            return luaL_argerror (L, 4, "invalid channel");
+    }
+
+    lua_getiuservalue (L, 1, 1);
+    lua_pushvalue (L, 3);
+    lua_setfield (L, -2, name);
+    lua_pop (L, 1);
+    return 0;
+}
+
+static int expression_run (lua_State* L) {
+    auto* expr = toexpression (L, 1);
+    const int length = expr->get_bound_length();
+    const int start  = static_cast<int> (luaL_optinteger (L, 2, 1)) - 1;
+    const int avail  = juce::jmax (0, length - start);
+    int count = static_cast<int> (luaL_optinteger (L, 3, avail));
+    if (start < 0 || (length >= 0 && count > avail))
+        return luaL_error (L, "expression range %d to %d exceeds bound length %d",
+                           start + 1, start + count, length);
+    count = juce::jmax (0, count);
+    expr->run (start, count);
+    lua_pushinteger (L, count);
+    return 1;
+}
+
+static const luaL_Reg expression_methods[] = {
+    { "__gc",           expression_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Names read before they are assigned.
+    // @function Expression:inputs
+    // @treturn table Array of names
+    { "inputs",         expression_inputs },
+
+    /// Names assigned by the program.
+    // @function Expression:outputs
+    // @treturn table Array of names
+    { "outputs",        expression_outputs },
+
+    /// Bind a variable.
+    // Inputs read the bound value and outputs write to it. An unbound input
+    // reads zero, and a number reads the same value every frame. Arrays are
+    // referred to, not copied, so bind again after resizing one.
+    // @function Expression:bind
+    // @string name Variable name
+    // @tparam[opt] number|kv.AudioBuffer|kv.vector value Source or destination, nil to unbind
+    // @int[opt] channel Buffer channel (default 1)
+    { "bind",           expression_bind },
+
+    /// Evaluate the program.
+    // Frames index every bound buffer and vector alike.
+    // @function Expression:run
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to the end of the shortest binding)
+    // @treturn int Number of frames processed
+    { "run",            expression_run },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_Expression (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_EXPRESSION)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, expression_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_EXPRESSION_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_EXPRESSION_TYPE);
+    lua_pushcfunction (L, expression_compile);
+    lua_setfield (L, -2, "compile");
+    return 1;
+}
@@ -0,0 +1,298 @@
+/// A real valued Fast Fourier Transform.
+// Transforms a channel of a @{kv.AudioBuffer} or a @{kv.vector} into
+// N/2 + 1 complex bins and back. The analysis window is applied on the
+// forward transform. All memory is allocated when the object is created,
+// so transforms are safe to run in the audio thread.
+// @classmod kv.dsp.FFT
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/fft.hpp"
+#include "kv/lua/vector.hpp"
+
+#define LKV_MT_FFT_TYPE                 "kv.dsp.FFTClass"
+
+using FFT = kv::lua::FFT;
+
+#define tofft(L, n) (*(FFT**) lua_touserdata (L, n))
+
+/// Create a new FFT.
+// @function FFT.new
+// @int order Transform size as a power of two, 1 to 16 (size = 2^order)
+// @int[opt] window Analysis window (default RECTANGULAR)
+// @treturn kv.dsp.FFT
+// @within Constructors
+// @usage
+// local fft = FFT.new (10)    -- 1024 points
+static int fft_new (lua_State* L) {
+    const auto order  = static_cast<int> (luaL_checkinteger (L, 1));
+    const auto window = static_cast<int> (luaL_optinteger (L, 2, FFT::Rectangular));
+    kv::lua::new_fft (L, order)->set_window (window);
+    return 1;
+}
+
+static int fft_call (lua_State* L) {
+    lua_remove (L, 1); // class table
+    return fft_new (L);
+}
+
+static int fft_free (lua_State* L) {
+    auto** fft = (FFT**) lua_touserdata (L, 1);
+    if (nullptr != *fft) {
+        delete (*fft);
+        *fft = nullptr;
+    }
+    return 0;
+}
+
+static int fft_order (lua_State* L) {
+    lua_pushinteger (L, tofft (L, 1)->get_order());
+    return 1;
+}
+
+static int fft_size (lua_State* L) {
+    lua_pushinteger (L, tofft (L, 1)->get_size());
+    return 1;
+}
+
+static int fft_bins (lua_State* L) {
+    lua_pushinteger (L, tofft (L, 1)->get_num_bins());
+    return 1;
+}
+
+static int fft_window (lua_State* L) {
+    lua_pushinteger (L, tofft (L, 1)->get_window());
+    return 1;
+}
+
+static int fft_setwindow (lua_State* L) {
+    tofft (L, 1)->set_window (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int fft_forward (lua_State* L) {
+    auto* fft = tofft (L, 1);
+    if (kv::lua::visit_audio_buffer (L, 2, [L, fft] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read (L, 3, buffer);
+        fft->forward (buffer.getReadPointer (r.channel, r.start), r.count);
+    })) {
+        return 0;
+    }
+
+    if (auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR)) {
+        fft->forward (kv_vector_values (vec), (int) kv_vector_size (vec));
+    } else {
+        auto* scratch = fft->get_scratch();
+        fft->forward (scratch, kv::lua::read_values (L, 2, scratch, fft->get_size()));
+    }
+
+    return 0;
+}
+
+static int fft_inverse (lua_State* L) {
+    auto* fft = tofft (L, 1);
+    if (kv::lua::visit_audio_buffer (L, 2, [L, fft] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read (L, 3, buffer);
+        fft->inverse (buffer.getWritePointer (r.channel, r.start), r.count);
+    })) {
+        return 0;
+    }
+
+    auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR);
+    if (vec == nullptr) {
+        vec = kv_vector_new (L, fft->get_size());
+    } else {
+        kv_vector_resize (vec, fft->get_size());
+        lua_pushvalue (L, 2);
+    }
+
+    fft->inverse (kv_vector_values (vec), fft->get_size());
+    return 1;
+}
+
+static int fft_bin (lua_State* L) {
+    auto* fft = tofft (L, 1);
+    const auto k = static_cast<int> (luaL_checkinteger (L, 2)) - 1;
+    if (! juce::isPositiveAndBelow (k, fft->get_num_bins()))
+        return 0;
+    lua_pushnumber (L, fft->get_real (k));
+    lua_pushnumber (L, fft->get_imag (k));
+    return 2;
+}
+
+static int fft_setbin (lua_State* L) {
+    auto* fft = tofft (L, 1);
+    const auto k = static_cast<int> (luaL_checkinteger (L, 2)) - 1;
+    if (juce::isPositiveAndBelow (k, fft->get_num_bins()))
+        fft->set_bin (k, (float) lua_tonumber (L, 3), (float) lua_tonumber (L, 4));
+    return 0;
+}
+
+template<typename Fn>
+static int fft_fill_bins (lua_State* L, Fn&& value_for) {
+    auto* fft = tofft (L, 1);
+    const int nbins = fft->get_num_bins();
+    auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR);
+    if (vec == nullptr) {
+        vec = kv_vector_new (L, nbins);
+    } else {
+        kv_vector_resize (vec, nbins);
+        lua_pushvalue (L, 2);
+    }
+
+    auto* values = kv_vector_values (vec);
+    for (int k = 0; k < nbins; ++k)
+        values[k] = static_cast<kv_sample_t> (value_for (*fft, k));
+    return 1;
+}
+
+static int fft_magnitudes (lua_State* L) {
+    return fft_fill_bins (L, [] (const FFT& f, int k) { return f.get_magnitude (k); });
+}
+
+static int fft_phases (lua_State* L) {
+    return fft_fill_bins (L, [] (const FFT& f, int k) { return f.get_phase (k); });
+}
+
+static int fft_fillwindow (lua_State* L) {
+    auto* vec = (kv_vector_t*) luaL_checkudata (L, 1, LKV_MT_VECTOR);
+    FFT::fill_window (kv_vector_values (vec), (int) kv_vector_size (vec),
+                      static_cast<int> (luaL_optinteger (L, 2, FFT::Hann)));
+    lua_settop (L, 1);
+    return 1;
+}
+
+static const luaL_Reg fft_methods[] = {
+    { "__gc",           fft_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Transform order.
+    // @function FFT:order
+    // @treturn int
+    { "order",          fft_order },
+
+    /// Transform size in samples.
+    // @function FFT:size
+    // @treturn int
+    { "size",           fft_size },
+
+    /// Number of complex bins, size / 2 + 1.
+    // @function FFT:bins
+    // @treturn int
+    { "bins",           fft_bins },
+
+    /// Analysis window.
+    // @function FFT:window
+    // @treturn int
+    { "window",         fft_window },
+
+    /// Change the analysis window.
+    // Builds a new window table, so avoid calling in the audio thread.
+    // @function FFT:setwindow
+    // @int window One of the window constants
+    { "setwindow",      fft_setwindow },
+
+    /// Forward transform.
+    // Windows the input and zero pads it to the transform size. The result
+    // is kept in the object until the next forward transform.
+    // @function FFT:forward
+    // @tparam kv.AudioBuffer|kv.vector|table source Input samples
+    // @int[opt] channel Channel to read when the source is a buffer (default 1)
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @usage
+    // fft:forward (buffer, 1)
+    // local mags = fft:magnitudes (mags)
+    { "forward",        fft_forward },
+
+    /// Inverse transform of the current bins.
+    // The bins are left untouched, so a spectrum can be inverted more than
+    // once. Writing to a vector resizes it to the transform size.
+    // @function FFT:inverse
+    // @tparam[opt] kv.AudioBuffer|kv.vector dest Output, a new vector if nil
+    // @int[opt] channel Channel to write when the dest is a buffer (default 1)
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @treturn kv.vector The output vector, nothing for buffers
+    { "inverse",        fft_inverse },
+
+    /// Get a bin.
+    // @function FFT:bin
+    // @int k Bin index, 1 is DC and `bins()` is Nyquist
+    // @treturn number real part
+    // @treturn number imaginary part
+    { "bin",            fft_bin },
+
+    /// Set a bin.
+    // @function FFT:setbin
+    // @int k Bin index
+    // @number re Real part
+    // @number im Imaginary part
+    { "setbin",         fft_setbin },
+
+    /// Magnitude of every bin.
+    // @function FFT:magnitudes
+    // @tparam[opt] kv.vector dest Vector to fill, a new one if nil
+    // @treturn kv.vector
+    { "magnitudes",     fft_magnitudes },
+
+    /// Phase of every bin in radians.
+    // @function FFT:phases
+    // @tparam[opt] kv.vector dest Vector to fill, a new one if nil
+    // @treturn kv.vector
+    { "phases",         fft_phases },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_FFT (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_FFT)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, fft_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_FFT_TYPE)) {
+        lua_pushcfunction (L, fft_call);
+        lua_setfield (L, -2, "__call");
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_FFT_TYPE);
+    lua_pushcfunction (L, fft_new);
+    lua_setfield (L, -2, "new");
+
+    /// Fill a vector with a window.
+    // Windows are periodic, so they overlap-add evenly.
+    // @function FFT.fillwindow
+    // @tparam kv.vector vec Vector to fill, its size is the window length
+    // @int[opt] window Window type (default HANN)
+    // @treturn kv.vector
+    lua_pushcfunction (L, fft_fillwindow);
+    lua_setfield (L, -2, "fillwindow");
+
+    /// Windows.
+    // @section windows
+
+    /// No window (default).
+    // @tfield int FFT.RECTANGULAR
+    lua_pushinteger (L, FFT::Rectangular);
+    lua_setfield (L, -2, "RECTANGULAR");
+
+    /// Hann window.
+    // @tfield int FFT.HANN
+    lua_pushinteger (L, FFT::Hann);
+    lua_setfield (L, -2, "HANN");
+
+    /// Four term Blackman-Harris window, for low sidelobes.
+    // @tfield int FFT.BLACKMAN_HARRIS
+    lua_pushinteger (L, FFT::BlackmanHarris);
+    lua_setfield (L, -2, "BLACKMAN_HARRIS");
+
+    return 1;
+}
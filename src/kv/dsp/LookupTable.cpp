@@ -0,0 +1,215 @@
+/// A transfer curve evaluated natively.
+// Samples a Lua function once, or takes measured points from a
+// @{kv.vector}, then applies the curve with interpolation to audio. Use it
+// for waveshapers, gain curves and other per-sample mappings that would
+// be too slow in a script.
+// @classmod kv.dsp.LookupTable
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/lookup_table.hpp"
+#include "kv/lua/vector.hpp"
+
+#define LKV_MT_LOOKUP_TABLE             "kv.dsp.LookupTable"
+#define LKV_MT_LOOKUP_TABLE_TYPE        "kv.dsp.LookupTableClass"
+
+using LookupTable = kv::lua::LookupTable;
+
+#define totable(L, n) (*(LookupTable**) lua_touserdata (L, n))
+
+/// Create a new lookup table.
+// A function is called once per point with the input value and should
+// return the output. Vectors and tables give the points directly, spread
+// evenly over the range.
+// @function LookupTable.new
+// @tparam function|kv.vector|table source Curve to sample
+// @number[opt] min Lowest input (default -1)
+// @number[opt] max Highest input (default 1)
+// @int[opt] size Points to sample from a function (default 1024)
+// @treturn kv.dsp.LookupTable
+// @within Constructors
+// @usage
+// local drive = LookupTable.new (function (x) return x / (1 + math.abs (4 * x)) end)
+static int table_new (lua_State* L) {
+    const auto lo   = luaL_optnumber (L, 2, -1.0);
+    const auto hi   = luaL_optnumber (L, 3, 1.0);
+    const auto size = static_cast<int> (luaL_optinteger (L, 4, 1024));
+
+    auto** table = (LookupTable**) lua_newuserdata (L, sizeof (LookupTable**));
+    *table = new LookupTable();
+    luaL_setmetatable (L, LKV_MT_LOOKUP_TABLE);
+    auto* lut = *table;
+    lut->set_range (lo, hi);
+
+    if (lua_isfunction (L, 1)) {
+        lut->fill (size, [L] (double x) {
+            lua_pushvalue (L, 1);
+            lua_pushnumber (L, x);
+            lua_call (L, 1, 1);
+            const auto y = lua_tonumber (L, -1);
+            lua_pop (L, 1);
+            return y;
+        });
+    } else if (auto* vec = (kv_vector_t*) luaL_testudata (L, 1, LKV_MT_VECTOR)) {
+        lut->set_values (kv_vector_values (vec), (int) kv_vector_size (vec));
+    } else if (lua_istable (L, 1)) {
+        const int n = (int) lua_rawlen (L, 1);
+        juce::HeapBlock<double> values ((size_t) juce::jmax (1, n));
+        lut->set_values (values.get(), kv::lua::read_values (L, 1, values.get(), n));
+    }
+
+    return 1;
+}
+
+static int table_free (lua_State* L) {
+    auto** table = (LookupTable**) lua_touserdata (L, 1);
+    if (nullptr != *table) {
+        delete (*table);
+        *table = nullptr;
+    }
+    return 0;
+}
+
+static int table_size (lua_State* L) {
+    lua_pushinteger (L, totable (L, 1)->get_size());
+    return 1;
+}
+
+static int table_range (lua_State* L) {
+    auto* lut = totable (L, 1);
+    lua_pushnumber (L, lut->get_min());
+    lua_pushnumber (L, lut->get_max());
+    return 2;
+}
+
+static int table_setrange (lua_State* L) {
+    totable (L, 1)->set_range (luaL_checknumber (L, 2), luaL_checknumber (L, 3));
+    return 0;
+}
+
+static int table_interpolation (lua_State* L) {
+    lua_pushinteger (L, totable (L, 1)->get_interpolation());
+    return 1;
+}
+
+static int table_setinterpolation (lua_State* L) {
+    totable (L, 1)->set_interpolation (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int table_eval (lua_State* L) {
+    lua_pushnumber (L, totable (L, 1)->evaluate (lua_tonumber (L, 2)));
+    return 1;
+}
+
+static int table_apply (lua_State* L) {
+    auto* lut = totable (L, 1);
+    if (auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR)) {
+        lut->process (kv_vector_values (vec), (int) kv_vector_size (vec));
+        return 0;
+    }
+
+    kv::lua::visit_audio_buffer (L, 2, [L, lut] (auto& buffer) {
+        if (lua_tointeger (L, 3) == 0) {
+            const auto r = kv::lua::AudioRange::read_frames (L, 4, buffer);
+            for (int c = 0; c < buffer.getNumChannels(); ++c)
+                lut->process (buffer.getWritePointer (c, r.start), r.count);
+            return;
+        }
+
+        const auto r = kv::lua::AudioRange::read (L, 3, buffer);
+        if (r.count > 0)
+            lut->process (buffer.getWritePointer (r.channel, r.start), r.count);
+    });
+    return 0;
+}
+
+static const luaL_Reg table_methods[] = {
+    { "__gc",               table_free },
+    { "__call",             table_eval },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of points.
+    // @function LookupTable:size
+    // @treturn int
+    { "size",               table_size },
+
+    /// Input range.
+    // @function LookupTable:range
+    // @treturn number min
+    // @treturn number max
+    { "range",              table_range },
+
+    /// Change the input range.
+    // The points are kept and spread over the new range; a function is not
+    // sampled again.
+    // @function LookupTable:setrange
+    // @number min Lowest input
+    // @number max Highest input
+    { "setrange",           table_setrange },
+
+    /// Interpolation between points.
+    // @function LookupTable:interpolation
+    // @treturn int
+    { "interpolation",      table_interpolation },
+
+    /// Change the interpolation.
+    // @function LookupTable:setinterpolation
+    // @int mode LINEAR or CUBIC
+    { "setinterpolation",   table_setinterpolation },
+
+    /// Evaluate the curve at one input.
+    // The table can also be called like a function.
+    // @function LookupTable:eval
+    // @number x Input value, clamped to the range
+    // @treturn number
+    // @usage
+    // local y = drive (0.5)
+    { "eval",               table_eval },
+
+    /// Apply the curve in place.
+    // @function LookupTable:apply
+    // @tparam kv.AudioBuffer|kv.vector target Audio or values to map
+    // @int[opt] channel Channel index. nil or 0 applies to every channel
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    { "apply",              table_apply },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_LookupTable (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_LOOKUP_TABLE)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, table_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_LOOKUP_TABLE_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_LOOKUP_TABLE_TYPE);
+    lua_pushcfunction (L, table_new);
+    lua_setfield (L, -2, "new");
+
+    /// Interpolation.
+    // @section interpolation
+
+    /// Straight lines between points (default).
+    // @tfield int LookupTable.LINEAR
+    lua_pushinteger (L, LookupTable::Linear);
+    lua_setfield (L, -2, "LINEAR");
+
+    /// Catmull-Rom spline through the points.
+    // @tfield int LookupTable.CUBIC
+    lua_pushinteger (L, LookupTable::Cubic);
+    lua_setfield (L, -2, "CUBIC");
+
+    return 1;
+}
@@ -0,0 +1,294 @@
+/// A bank of oscillators rendering into audio buffers.
+// Renders any number of sine, wavetable or PolyBLEP band limited saw and
+// square voices into a channel of a @{kv.AudioBuffer} in one call. Works
+// with both 32 and 64 bit buffers. Like @{kv.MidiBuffer}, methods do
+// virtually no type checking.
+// @classmod kv.dsp.OscillatorBank
+// @pragma nostrip
+
+#include <vector>
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/oscillator_bank.hpp"
+#include "kv/lua/vector.hpp"
+
+#define LKV_MT_OSCILLATOR_BANK          "kv.dsp.OscillatorBank"
+#define LKV_MT_OSCILLATOR_BANK_TYPE     "kv.dsp.OscillatorBankClass"
+
+using Bank = kv::lua::OscillatorBank;
+
+#define tobank(L, n) (*(Bank**) lua_touserdata (L, n))
+
+static int voice_arg (lua_State* L, int idx) {
+    return static_cast<int> (lua_tointeger (L, idx) - 1);
+}
+
+/// Create a new oscillator bank.
+// @function OscillatorBank.new
+// @int nvoices Number of voices
+// @number[opt] rate Sample rate (default 44100)
+// @treturn kv.dsp.OscillatorBank
+// @within Constructors
+// @usage
+// local bank = OscillatorBank.new (16, 48000)
+// bank:setmode (OscillatorBank.SAW)
+static int bank_new (lua_State* L) {
+    const auto nvoices = static_cast<int> (luaL_optinteger (L, 1, 1));
+    const auto rate    = luaL_optnumber (L, 2, 44100.0);
+    auto** bank = (Bank**) lua_newuserdata (L, sizeof (Bank**));
+    *bank = new Bank (nvoices, rate);
+    luaL_setmetatable (L, LKV_MT_OSCILLATOR_BANK);
+    return 1;
+}
+
+static int bank_free (lua_State* L) {
+    auto** bank = (Bank**) lua_touserdata (L, 1);
+    if (nullptr != *bank) {
+        delete (*bank);
+        *bank = nullptr;
+    }
+    return 0;
+}
+
+static int bank_size (lua_State* L) {
+    lua_pushinteger (L, tobank (L, 1)->get_size());
+    return 1;
+}
+
+static int bank_samplerate (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_sample_rate());
+    return 1;
+}
+
+static int bank_setsamplerate (lua_State* L) {
+    tobank (L, 1)->set_sample_rate (lua_tonumber (L, 2));
+    return 0;
+}
+
+static int bank_mode (lua_State* L) {
+    lua_pushinteger (L, tobank (L, 1)->get_mode());
+    return 1;
+}
+
+static int bank_setmode (lua_State* L) {
+    tobank (L, 1)->set_mode (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int bank_frequency (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_frequency (voice_arg (L, 2)));
+    return 1;
+}
+
+static int bank_setfrequency (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (lua_isinteger (L, 2) && lua_isnumber (L, 3)) {
+        bank->set_frequency (voice_arg (L, 2), lua_tonumber (L, 3));
+    } else {
+        kv::lua::read_values (L, 2, bank->get_frequencies(), bank->get_size());
+        bank->update_increments();
+    }
+    return 0;
+}
+
+static int bank_gain (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_gain (voice_arg (L, 2)));
+    return 1;
+}
+
+static int bank_setgain (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (lua_isinteger (L, 2) && lua_isnumber (L, 3))
+        bank->set_gain (voice_arg (L, 2), lua_tonumber (L, 3));
+    else
+        kv::lua::read_values (L, 2, bank->get_gains(), bank->get_size());
+    return 0;
+}
+
+static int bank_phase (lua_State* L) {
+    lua_pushnumber (L, tobank (L, 1)->get_phase (voice_arg (L, 2)));
+    return 1;
+}
+
+static int bank_setphase (lua_State* L) {
+    tobank (L, 1)->set_phase (voice_arg (L, 2), lua_tonumber (L, 3));
+    return 0;
+}
+
+static int bank_reset (lua_State* L) {
+    tobank (L, 1)->reset();
+    return 0;
+}
+
+static int bank_setwavetable (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    if (auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR)) {
+        bank->set_wavetable (kv_vector_values (vec), (int) kv_vector_size (vec));
+    } else if (lua_istable (L, 2)) {
+        std::vector<double> values ((size_t) lua_rawlen (L, 2));
+        kv::lua::read_values (L, 2, values.data(), (int) values.size());
+        bank->set_wavetable (values.data(), (int) values.size());
+    } else {
+        bank->set_wavetable<double> (nullptr, 0);
+    }
+    return 0;
+}
+
+static int bank_render (lua_State* L) {
+    auto* bank = tobank (L, 1);
+    kv::lua::visit_audio_buffer (L, 2, [L, bank] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read (L, 3, buffer);
+        if (r.count > 0)
+            bank->render (buffer.getWritePointer (r.channel, r.start), r.count);
+    });
+    return 0;
+}
+
+static const luaL_Reg bank_methods[] = {
+    { "__gc",           bank_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of voices.
+    // @function OscillatorBank:size
+    // @treturn int
+    { "size",           bank_size },
+
+    /// Sample rate.
+    // @function OscillatorBank:samplerate
+    // @treturn number
+    { "samplerate",     bank_samplerate },
+
+    /// Change the sample rate.
+    // @function OscillatorBank:setsamplerate
+    // @number rate New sample rate
+    { "setsamplerate",  bank_setsamplerate },
+
+    /// Waveform used by all voices.
+    // @function OscillatorBank:mode
+    // @treturn int
+    { "mode",           bank_mode },
+
+    /// Change the waveform.
+    // @function OscillatorBank:setmode
+    // @int mode One of the mode constants
+    { "setmode",        bank_setmode },
+
+    /// Frequency of a voice.
+    // @function OscillatorBank:frequency
+    // @int voice Voice index
+    // @treturn number Frequency in Hz
+    { "frequency",      bank_frequency },
+
+    /// Set the frequency of one voice.
+    // @function OscillatorBank:setfrequency
+    // @int voice Voice index
+    // @number hz Frequency in Hz
+
+    /// Set the frequency of every voice.
+    // Values beyond the number of voices are ignored.
+    // @function OscillatorBank:setfrequency
+    // @tparam kv.vector|table hz Frequencies in Hz
+    // @usage
+    // midi.tohertz (notes, freqs)
+    // bank:setfrequency (freqs)
+    { "setfrequency",   bank_setfrequency },
+
+    /// Gain of a voice.
+    // @function OscillatorBank:gain
+    // @int voice Voice index
+    // @treturn number
+    { "gain",           bank_gain },
+
+    /// Set the gain of one voice.
+    // Voices with zero gain are skipped when rendering, but keep running.
+    // @function OscillatorBank:setgain
+    // @int voice Voice index
+    // @number gain Linear gain
+
+    /// Set the gain of every voice.
+    // @function OscillatorBank:setgain
+    // @tparam kv.vector|table gains Linear gains
+    { "setgain",        bank_setgain },
+
+    /// Phase of a voice.
+    // @function OscillatorBank:phase
+    // @int voice Voice index
+    // @treturn number Phase in cycles 0-1
+    { "phase",          bank_phase },
+
+    /// Set the phase of a voice.
+    // @function OscillatorBank:setphase
+    // @int voice Voice index
+    // @number phase Phase in cycles
+    { "setphase",       bank_setphase },
+
+    /// Reset all phases to zero.
+    // @function OscillatorBank:reset
+    { "reset",          bank_reset },
+
+    /// Replace the wavetable.
+    // The table holds one cycle and is read with linear interpolation. This
+    // allocates memory, so don't call it while processing.
+    // @function OscillatorBank:setwavetable
+    // @tparam[opt] kv.vector|table values One cycle of samples. nil restores a sine
+    { "setwavetable",   bank_setwavetable },
+
+    /// Add all voices to a buffer.
+    // Output is mixed with the existing content of the channel.
+    // @function OscillatorBank:render
+    // @tparam kv.AudioBuffer buffer Buffer to render in to
+    // @int[opt] channel Channel index (default 1)
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @usage
+    // audio:clear()
+    // bank:render (audio, 1)
+    { "render",         bank_render },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_OscillatorBank (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_OSCILLATOR_BANK)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, bank_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_OSCILLATOR_BANK_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_OSCILLATOR_BANK_TYPE);
+    lua_pushcfunction (L, bank_new);
+    lua_setfield (L, -2, "new");
+
+    /// Modes.
+    // @section modes
+
+    /// Sine wave.
+    // @tfield int OscillatorBank.SINE
+    lua_pushinteger (L, Bank::Sine);
+    lua_setfield (L, -2, "SINE");
+
+    /// Band limited sawtooth.
+    // @tfield int OscillatorBank.SAW
+    lua_pushinteger (L, Bank::Saw);
+    lua_setfield (L, -2, "SAW");
+
+    /// Band limited square.
+    // @tfield int OscillatorBank.SQUARE
+    lua_pushinteger (L, Bank::Square);
+    lua_setfield (L, -2, "SQUARE");
+
+    /// Wavetable.
+    // @tfield int OscillatorBank.WAVETABLE
+    lua_pushinteger (L, Bank::Wavetable);
+    lua_setfield (L, -2, "WAVETABLE");
+
+    return 1;
+}
@@ -0,0 +1,250 @@
+/// Oversampling for nonlinear processing.
+// Upsamples a range of a @{kv.AudioBuffer}, runs a native waveshaper
+// and/or a Lua function on the upsampled audio, then filters and
+// downsamples back in place. Built on juce::dsp::Oversampling with all
+// filter memory allocated for a maximum block size when created.
+// @classmod kv.dsp.Oversampler
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/oversampler.hpp"
+#include "kv/lua/vector.hpp"
+
+#define LKV_MT_OVERSAMPLER              "kv.dsp.Oversampler"
+#define LKV_MT_OVERSAMPLER_TYPE         "kv.dsp.OversamplerClass"
+
+extern "C" int luaopen_kv_AudioBuffer32 (lua_State* L);
+
+using Oversampler = kv::lua::Oversampler;
+
+#define tooversampler(L, n) (*(Oversampler**) lua_touserdata (L, n))
+
+/// Create a new oversampler.
+// @function Oversampler.new
+// @int nchannels Number of channels, up to 64
+// @int factor Oversampling factor: 2, 4, 8 or 16
+// @int[opt] maxblock Largest block processed at once (default 4096)
+// @int[opt] filter IIR or FIR (default IIR)
+// @treturn kv.dsp.Oversampler
+// @within Constructors
+static int oversampler_new (lua_State* L) {
+    const auto nchans   = static_cast<int> (luaL_optinteger (L, 1, 2));
+    const auto factor   = static_cast<int> (luaL_optinteger (L, 2, 2));
+    const auto maxblock = static_cast<int> (luaL_optinteger (L, 3, 4096));
+    const auto filter   = static_cast<int> (luaL_optinteger (L, 4, Oversampler::IIR));
+
+    auto** os = (Oversampler**) lua_newuserdatauv (L, sizeof (Oversampler**), 1);
+    *os = new Oversampler (nchans, factor, maxblock, filter);
+    luaL_setmetatable (L, LKV_MT_OVERSAMPLER);
+
+    // the view and the oversampler keep each other alive
+    auto* view = kv::lua::create_audio_buffer<float> (L, 0, 0);
+    (*os)->set_view (view);
+    lua_pushvalue (L, -2);
+    lua_setiuservalue (L, -2, 1);
+    lua_setiuservalue (L, -2, 1);
+    return 1;
+}
+
+static int oversampler_free (lua_State* L) {
+    auto** os = (Oversampler**) lua_touserdata (L, 1);
+    if (nullptr != *os) {
+        delete (*os);
+        *os = nullptr;
+    }
+    return 0;
+}
+
+static int oversampler_channels (lua_State* L) {
+    lua_pushinteger (L, tooversampler (L, 1)->get_num_channels());
+    return 1;
+}
+
+static int oversampler_factor (lua_State* L) {
+    lua_pushinteger (L, tooversampler (L, 1)->get_factor());
+    return 1;
+}
+
+static int oversampler_maxblock (lua_State* L) {
+    lua_pushinteger (L, tooversampler (L, 1)->get_max_block());
+    return 1;
+}
+
+static int oversampler_filter (lua_State* L) {
+    lua_pushinteger (L, tooversampler (L, 1)->get_filter());
+    return 1;
+}
+
+static int oversampler_latency (lua_State* L) {
+    lua_pushnumber (L, tooversampler (L, 1)->get_latency());
+    return 1;
+}
+
+static int oversampler_reset (lua_State* L) {
+    tooversampler (L, 1)->reset();
+    return 0;
+}
+
+static int oversampler_view (lua_State* L) {
+    lua_getiuservalue (L, 1, 1);
+    return 1;
+}
+
+static int oversampler_setshaper (lua_State* L) {
+    auto* os = tooversampler (L, 1);
+    if (auto* vec = (kv_vector_t*) luaL_testudata (L, 2, LKV_MT_VECTOR)) {
+        os->set_shaper (kv_vector_values (vec), (int) kv_vector_size (vec));
+    } else if (lua_istable (L, 2)) {
+        const int n = (int) lua_rawlen (L, 2);
+        juce::HeapBlock<float> values ((size_t) juce::jmax (1, n));
+        kv::lua::read_values (L, 2, values.get(), n);
+        os->set_shaper (values.get(), n);
+    } else {
+        os->set_shaper<float> (nullptr, 0);
+    }
+    return 0;
+}
+
+static int oversampler_process (lua_State* L) {
+    auto* os = tooversampler (L, 1);
+    const int top = lua_gettop (L);
+    const int fn = top > 2 && lua_isfunction (L, top) ? top : 0;
+    if (fn != 0)
+        lua_getiuservalue (L, 1, 1);
+    const int view = lua_gettop (L);
+
+    kv::lua::visit_audio_buffer (L, 2, [L, os, fn, view] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read_frames (L, 3, buffer);
+        auto* const* chans = buffer.getArrayOfWritePointers();
+        using T = typename std::decay<decltype (*chans[0])>::type;
+        T* io[Oversampler::max_channels];
+        const int nchans = juce::jmin (buffer.getNumChannels(), os->get_num_channels());
+        for (int c = 0; c < nchans; ++c)
+            io[c] = chans[c] + r.start;
+
+        os->process (io, nchans, r.count, [L, fn, view]() {
+            if (fn == 0)
+                return;
+            lua_pushvalue (L, fn);
+            lua_pushvalue (L, view);
+            lua_call (L, 1, 0);
+        });
+    });
+
+    return 0;
+}
+
+static const luaL_Reg oversampler_methods[] = {
+    { "__gc",           oversampler_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of channels.
+    // @function Oversampler:channels
+    // @treturn int
+    { "channels",       oversampler_channels },
+
+    /// Oversampling factor.
+    // @function Oversampler:factor
+    // @treturn int
+    { "factor",         oversampler_factor },
+
+    /// Largest block processed in one pass.
+    // @function Oversampler:maxblock
+    // @treturn int
+    { "maxblock",       oversampler_maxblock },
+
+    /// Filter type.
+    // @function Oversampler:filter
+    // @treturn int
+    { "filter",         oversampler_filter },
+
+    /// Delay added by the filters, in frames at the base rate.
+    // @function Oversampler:latency
+    // @treturn number
+    { "latency",        oversampler_latency },
+
+    /// Clear the filter state.
+    // @function Oversampler:reset
+    { "reset",          oversampler_reset },
+
+    /// Buffer viewing the upsampled audio.
+    // Refers to the oversampler's own memory and is only valid while a
+    // process function runs. The same buffer is passed to that function.
+    // Don't resize or free it.
+    // @function Oversampler:view
+    // @treturn kv.AudioBuffer 32 bit buffer
+    { "view",           oversampler_view },
+
+    /// Set a waveshaper transfer curve.
+    // Values map inputs spread evenly over -1 to 1, with linear
+    // interpolation and clipping outside that range. The curve runs
+    // natively at the high rate, before any process function. Copies the
+    // values, so avoid calling in the audio thread.
+    // @function Oversampler:setshaper
+    // @tparam[opt] kv.vector|table curve At least two values, nil to remove
+    // @usage
+    // local curve = {}
+    // for i = 0, 1024 do local x = 3 * (i / 512 - 1); curve[i + 1] = x / (1 + math.abs (x)) end
+    // os:setshaper (curve)
+    { "setshaper",      oversampler_setshaper },
+
+    /// Oversample a block in place.
+    // Blocks longer than `maxblock` are processed in several passes, and the
+    // function is called once per pass.
+    // @function Oversampler:process
+    // @tparam kv.AudioBuffer buffer Audio to process
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @tparam[opt] function fn Called as `fn (view)` with the upsampled audio
+    // @usage
+    // os:process (buffer, function (view)
+    //     for c = 1, view:channels() do
+    //         for f = 1, view:length() do
+    //             local x = 2 * view:get (c, f)
+    //             view:set (c, f, x / (1 + math.abs (x)))
+    //         end
+    //     end
+    // end)
+    { "process",        oversampler_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_Oversampler (lua_State* L) {
+    luaL_requiref (L, "kv.AudioBuffer32", luaopen_kv_AudioBuffer32, 0);
+    lua_pop (L, 1);
+
+    if (luaL_newmetatable (L, LKV_MT_OVERSAMPLER)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, oversampler_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_OVERSAMPLER_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_OVERSAMPLER_TYPE);
+    lua_pushcfunction (L, oversampler_new);
+    lua_setfield (L, -2, "new");
+
+    /// Filters.
+    // @section filters
+
+    /// Polyphase IIR half band filters. Low latency, nonlinear phase (default).
+    // @tfield int Oversampler.IIR
+    lua_pushinteger (L, Oversampler::IIR);
+    lua_setfield (L, -2, "IIR");
+
+    /// Equiripple FIR half band filters. Linear phase, more latency.
+    // @tfield int Oversampler.FIR
+    lua_pushinteger (L, Oversampler::FIR);
+    lua_setfield (L, -2, "FIR");
+
+    return 1;
+}
@@ -0,0 +1,225 @@
+/// Streaming sample rate conversion.
+// Converts between rates like 44.1, 48 and 96 kHz with a polyphase
+// windowed sinc kernel or a cheap Lagrange interpolator. State carries
+// across blocks so a stream can be converted in blocks of any size, and
+// the ratio can change between blocks.
+// @classmod kv.dsp.Resampler
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/resampler.hpp"
+
+#define LKV_MT_RESAMPLER                "kv.dsp.Resampler"
+#define LKV_MT_RESAMPLER_TYPE           "kv.dsp.ResamplerClass"
+
+using Resampler = kv::lua::Resampler;
+
+#define toresampler(L, n) (*(Resampler**) lua_touserdata (L, n))
+
+/// Create a new resampler.
+// The ratio starts at 1.
+// @function Resampler.new
+// @int nchannels Number of channels, up to 256
+// @int[opt] quality One of the quality constants (default SINC)
+// @treturn kv.dsp.Resampler
+// @within Constructors
+static int resampler_new (lua_State* L) {
+    const auto nchans  = static_cast<int> (luaL_optinteger (L, 1, 2));
+    const auto quality = static_cast<int> (luaL_optinteger (L, 2, Resampler::Sinc));
+    auto** rs = (Resampler**) lua_newuserdata (L, sizeof (Resampler**));
+    *rs = new Resampler (nchans, quality);
+    luaL_setmetatable (L, LKV_MT_RESAMPLER);
+    return 1;
+}
+
+static int resampler_free (lua_State* L) {
+    auto** rs = (Resampler**) lua_touserdata (L, 1);
+    if (nullptr != *rs) {
+        delete (*rs);
+        *rs = nullptr;
+    }
+    return 0;
+}
+
+static int resampler_channels (lua_State* L) {
+    lua_pushinteger (L, toresampler (L, 1)->get_num_channels());
+    return 1;
+}
+
+static int resampler_quality (lua_State* L) {
+    lua_pushinteger (L, toresampler (L, 1)->get_quality());
+    return 1;
+}
+
+static int resampler_setquality (lua_State* L) {
+    toresampler (L, 1)->set_quality (static_cast<int> (lua_tointeger (L, 2)));
+    return 0;
+}
+
+static int resampler_ratio (lua_State* L) {
+    lua_pushnumber (L, toresampler (L, 1)->get_ratio());
+    return 1;
+}
+
+static int resampler_setratio (lua_State* L) {
+    toresampler (L, 1)->set_ratio (luaL_checknumber (L, 2));
+    return 0;
+}
+
+static int resampler_setrates (lua_State* L) {
+    const auto inrate  = luaL_checknumber (L, 2);
+    const auto outrate = luaL_checknumber (L, 3);
+    luaL_argcheck (L, inrate > 0.0, 2, "rate must be positive");
+    luaL_argcheck (L, outrate > 0.0, 3, "rate must be positive");
+    toresampler (L, 1)->set_ratio (outrate / inrate);
+    return 0;
+}
+
+static int resampler_latency (lua_State* L) {
+    lua_pushinteger (L, toresampler (L, 1)->get_latency());
+    return 1;
+}
+
+static int resampler_reset (lua_State* L) {
+    toresampler (L, 1)->reset();
+    return 0;
+}
+
+static int resampler_process (lua_State* L) {
+    auto* rs = toresampler (L, 1);
+    std::pair<int, int> result { 0, 0 };
+
+    kv::lua::visit_audio_buffer (L, 2, [L, rs, &result] (auto& src) {
+        kv::lua::visit_audio_buffer (L, 3, [L, rs, &result, &src] (auto& dst) {
+            const auto ri = kv::lua::AudioRange::read_frames (L, 4, src);
+            const auto ro = kv::lua::AudioRange::read_frames (L, 6, dst);
+            using TI = typename std::decay<decltype (*src.getReadPointer (0))>::type;
+            using TO = typename std::decay<decltype (*dst.getWritePointer (0))>::type;
+
+            const int n = juce::jmin (juce::jmin (src.getNumChannels(), dst.getNumChannels()),
+                                      rs->get_num_channels());
+            const TI* ins[Resampler::max_channels];
+            TO* outs[Resampler::max_channels];
+            for (int c = 0; c < n; ++c) {
+                ins[c]  = src.getReadPointer (c, ri.start);
+                outs[c] = dst.getWritePointer (c, ro.start);
+            }
+
+            result = rs->process (ins, ri.count, outs, ro.count, n);
+        });
+    });
+
+    lua_pushinteger (L, result.first);
+    lua_pushinteger (L, result.second);
+    return 2;
+}
+
+static const luaL_Reg resampler_methods[] = {
+    { "__gc",           resampler_free },
+
+    /// Methods.
+    // @section methods
+
+    /// Number of channels.
+    // @function Resampler:channels
+    // @treturn int
+    { "channels",       resampler_channels },
+
+    /// Quality.
+    // @function Resampler:quality
+    // @treturn int
+    { "quality",        resampler_quality },
+
+    /// Change the quality.
+    // Allocates and resets the stream, so avoid in the audio thread.
+    // @function Resampler:setquality
+    // @int quality One of the quality constants
+    { "setquality",     resampler_setquality },
+
+    /// Output rate divided by input rate.
+    // @function Resampler:ratio
+    // @treturn number
+    { "ratio",          resampler_ratio },
+
+    /// Change the ratio.
+    // Takes effect on the next block. The sinc kernel is rebuilt when the
+    // downsampling cutoff changes, which does not allocate.
+    // @function Resampler:setratio
+    // @number ratio Output rate divided by input rate
+    { "setratio",       resampler_setratio },
+
+    /// Set the ratio from two sample rates.
+    // @function Resampler:setrates
+    // @number inrate Input sample rate
+    // @number outrate Output sample rate
+    // @usage
+    // rs:setrates (44100, 48000)
+    { "setrates",       resampler_setrates },
+
+    /// Delay in input frames.
+    // @function Resampler:latency
+    // @treturn int
+    { "latency",        resampler_latency },
+
+    /// Clear the stream history.
+    // @function Resampler:reset
+    { "reset",          resampler_reset },
+
+    /// Convert a block.
+    // Reads input until the output range is full or the input runs out,
+    // whichever comes first. Unconsumed input should be given again on the
+    // next call. Input and output buffers may differ in precision.
+    // @function Resampler:process
+    // @tparam kv.AudioBuffer input Source audio
+    // @tparam kv.AudioBuffer output Destination audio
+    // @int[opt] instart First input frame (default 1)
+    // @int[opt] incount Input frames available (default to end of buffer)
+    // @int[opt] outstart First output frame (default 1)
+    // @int[opt] outcount Output frames wanted (default to end of buffer)
+    // @treturn int frames consumed
+    // @treturn int frames produced
+    // @usage
+    // local used, made = rs:process (input, output)
+    { "process",        resampler_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_Resampler (lua_State* L) {
+    if (luaL_newmetatable (L, LKV_MT_RESAMPLER)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, resampler_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_RESAMPLER_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_RESAMPLER_TYPE);
+    lua_pushcfunction (L, resampler_new);
+    lua_setfield (L, -2, "new");
+
+    /// Quality.
+    // @section quality
+
+    /// Four point Lagrange interpolation. Cheapest, no anti-aliasing.
+    // @tfield int Resampler.LAGRANGE
+    lua_pushinteger (L, Resampler::Lagrange);
+    lua_setfield (L, -2, "LAGRANGE");
+
+    /// 32 tap windowed sinc (default).
+    // @tfield int Resampler.SINC
+    lua_pushinteger (L, Resampler::Sinc);
+    lua_setfield (L, -2, "SINC");
+
+    /// 64 tap windowed sinc with a sharper cutoff.
+    // @tfield int Resampler.SINC_BEST
+    lua_pushinteger (L, Resampler::SincBest);
+    lua_setfield (L, -2, "SINC_BEST");
+
+    return 1;
+}
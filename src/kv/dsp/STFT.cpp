@@ -0,0 +1,160 @@
+/// Overlap-add short time Fourier transform.
+// Cuts a stream of audio into windowed frames every `hop` samples, hands
+// each frame's spectrum to a Lua function through a @{kv.dsp.FFT}, then
+// resynthesizes with the same window. State is kept between blocks so
+// audio can be processed in blocks of any size. Output is delayed by the
+// transform size. One STFT processes one channel.
+// @classmod kv.dsp.STFT
+// @pragma nostrip
+
+#include "kv/lua/audio_buffer.hpp"
+#include "kv/lua/fft.hpp"
+
+#define LKV_MT_STFT                     "kv.dsp.STFT"
+#define LKV_MT_STFT_TYPE                "kv.dsp.STFTClass"
+
+using STFT = kv::lua::STFT;
+
+#define tostft(L, n) (*(STFT**) lua_touserdata (L, n))
+
+/// Create a new STFT.
+// The FFT window is used for both analysis and synthesis.
+// @function STFT.new
+// @int order Transform size as a power of two
+// @int[opt] hop Hop size in samples (default a quarter of the transform)
+// @int[opt] window FFT window (default HANN)
+// @treturn kv.dsp.STFT
+// @within Constructors
+static int stft_new (lua_State* L) {
+    const auto order  = static_cast<int> (luaL_checkinteger (L, 1));
+    const auto window = static_cast<int> (luaL_optinteger (L, 3, kv::lua::FFT::Hann));
+
+    auto* fft = kv::lua::new_fft (L, order);
+    fft->set_window (window);
+    const auto hop = static_cast<int> (luaL_optinteger (L, 2, fft->get_size() / 4));
+
+    auto** stft = (STFT**) lua_newuserdatauv (L, sizeof (STFT**), 1);
+    *stft = new STFT (*fft, hop);
+    luaL_setmetatable (L, LKV_MT_STFT);
+    lua_rotate (L, -2, 1);
+    lua_setiuservalue (L, -2, 1); /* keep the FFT alive */
+    return 1;
+}
+
+static int stft_free (lua_State* L) {
+    auto** stft = (STFT**) lua_touserdata (L, 1);
+    if (nullptr != *stft) {
+        delete (*stft);
+        *stft = nullptr;
+    }
+    return 0;
+}
+
+static int stft_fft (lua_State* L) {
+    lua_getiuservalue (L, 1, 1);
+    return 1;
+}
+
+static int stft_hop (lua_State* L) {
+    lua_pushinteger (L, tostft (L, 1)->get_hop());
+    return 1;
+}
+
+static int stft_latency (lua_State* L) {
+    lua_pushinteger (L, tostft (L, 1)->get_latency());
+    return 1;
+}
+
+static int stft_reset (lua_State* L) {
+    tostft (L, 1)->reset();
+    return 0;
+}
+
+static int stft_process (lua_State* L) {
+    auto* stft = tostft (L, 1);
+    const int top = lua_gettop (L);
+    const int fn = top > 2 && lua_isfunction (L, top) ? top : 0;
+    if (fn != 0)
+        lua_getiuservalue (L, 1, 1);
+    const int fftidx = lua_gettop (L);
+
+    kv::lua::visit_audio_buffer (L, 2, [L, stft, fn, fftidx] (auto& buffer) {
+        const auto r = kv::lua::AudioRange::read (L, 3, buffer);
+        stft->process (buffer.getWritePointer (r.channel, r.start), r.count, [L, fn, fftidx]() {
+            if (fn == 0)
+                return;
+            lua_pushvalue (L, fn);
+            lua_pushvalue (L, fftidx);
+            lua_call (L, 1, 0);
+        });
+    });
+
+    return 0;
+}
+
+static const luaL_Reg stft_methods[] = {
+    { "__gc",           stft_free },
+
+    /// Methods.
+    // @section methods
+
+    /// The FFT used for each frame.
+    // @function STFT:fft
+    // @treturn kv.dsp.FFT
+    { "fft",            stft_fft },
+
+    /// Hop size in samples.
+    // @function STFT:hop
+    // @treturn int
+    { "hop",            stft_hop },
+
+    /// Output delay in samples.
+    // @function STFT:latency
+    // @treturn int
+    { "latency",        stft_latency },
+
+    /// Clear the input and overlap-add history.
+    // @function STFT:reset
+    { "reset",          stft_reset },
+
+    /// Process one channel in place.
+    // The function is called once per hop with the FFT holding the frame's
+    // spectrum. Change bins with @{kv.dsp.FFT:setbin} to filter. Without a
+    // function the audio passes through unchanged, only delayed.
+    // @function STFT:process
+    // @tparam kv.AudioBuffer buffer Audio to process
+    // @int[opt] channel Channel index (default 1)
+    // @int[opt] start Frame index to start at (default 1)
+    // @int[opt] count Number of frames (default to end of buffer)
+    // @tparam[opt] function fn Called as `fn (fft)` for each frame
+    // @usage
+    // stft:process (buffer, 1, function (fft)
+    //     for k = 64, fft:bins() do fft:setbin (k, 0, 0) end
+    // end)
+    { "process",        stft_process },
+
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_dsp_STFT (lua_State* L) {
+    luaL_requiref (L, "kv.dsp.FFT", luaopen_kv_dsp_FFT, 0);
+    lua_pop (L, 1);
+
+    if (luaL_newmetatable (L, LKV_MT_STFT)) {
+        lua_pushvalue (L, -1);               /* duplicate the metatable */
+        lua_setfield (L, -2, "__index");     /* mt.__index = mt */
+        luaL_setfuncs (L, stft_methods, 0);
+        lua_pop (L, 1);
+    }
+
+    if (luaL_newmetatable (L, LKV_MT_STFT_TYPE)) {
+        lua_pop (L, 1);
+    }
+
+    lua_newtable (L);
+    luaL_setmetatable (L, LKV_MT_STFT_TYPE);
+    lua_pushcfunction (L, stft_new);
+    lua_setfield (L, -2, "new");
+    return 1;
+}
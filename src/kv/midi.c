@@ -20,6 +20,7 @@
 
 #include "lua-kv.h"
 #include <lualib.h>
+#include <math.h>
 
 typedef union _PackedMessage {
     int64_t packed;
@@ -86,16 +87,219 @@ static int f_noteoff (lua_State* L) {
     return f_msg3bytes (L, 0x80);
 }
 
+/// Conversion
+// @section conversion
+
+#define MIDI_NUM_NOTES          128
+#define MIDI_FINE_STEPS         64
+#define MIDI_BEND_CENTER        8192.0
+#define MIDI_DEFAULT_BEND_RANGE 2.0
+
+typedef struct _Tuning {
+    lua_Number reference;
+    lua_Number table [MIDI_NUM_NOTES];
+    lua_Number fine [MIDI_FINE_STEPS + 1];
+} Tuning;
+
+static void tuning_init (Tuning* t, lua_Number reference, const lua_Number* cents) {
+    t->reference = reference;
+    for (int i = 0; i < MIDI_NUM_NOTES; ++i) {
+        lua_Number offset = cents != NULL ? cents [i % 12] * 0.01 : 0.0;
+        t->table[i] = reference * pow (2.0, ((lua_Number)(i - 69) + offset) / 12.0);
+    }
+    for (int i = 0; i <= MIDI_FINE_STEPS; ++i) {
+        t->fine[i] = pow (2.0, (lua_Number) i / (lua_Number) MIDI_FINE_STEPS / 12.0);
+    }
+}
+
+static inline lua_Number tuning_hertz (const Tuning* t, lua_Number note) {
+    if (! (note > 0.0))
+        return t->table [0];
+    if (note >= (lua_Number)(MIDI_NUM_NOTES - 1))
+        return t->table [MIDI_NUM_NOTES - 1];
+
+    int i = (int) note;
+    lua_Number f = (note - (lua_Number) i) * (lua_Number) MIDI_FINE_STEPS;
+    int j = (int) f;
+    f -= (lua_Number) j;
+    return t->table[i] * (t->fine[j] + (t->fine[j + 1] - t->fine[j]) * f);
+}
+
+static inline lua_Number bend_semitones (lua_State* L, int idx) {
+    if (lua_isnoneornil (L, idx))
+        return 0.0;
+    lua_Number range = luaL_optnumber (L, idx + 1, MIDI_DEFAULT_BEND_RANGE);
+    return (lua_tonumber (L, idx) - MIDI_BEND_CENTER) / MIDI_BEND_CENTER * range;
+}
+
+#define totuning(L) ((Tuning*) lua_touserdata (L, lua_upvalueindex (1)))
+
+static int tohertz_vector (lua_State* L, kv_vector_t* notes) {
+    const Tuning* t = totuning (L);
+    kv_vector_t* out = luaL_checkudata (L, 2, LKV_MT_VECTOR);
+    const lua_Number bend = bend_semitones (L, 3);
+    const int n = (int) kv_vector_size (notes);
+
+    kv_vector_resize (out, n);
+    const kv_sample_t* src = kv_vector_values (notes);
+    kv_sample_t* dst = kv_vector_values (out);
+    for (int i = 0; i < n; ++i)
+        dst[i] = (kv_sample_t) tuning_hertz (t, (lua_Number) src[i] + bend);
+
+    lua_settop (L, 2);
+    return 1;
+}
+
+static int tohertz_table (lua_State* L) {
+    const Tuning* t = totuning (L);
+    luaL_checktype (L, 2, LUA_TTABLE);
+    const lua_Number bend = bend_semitones (L, 3);
+    const lua_Integer n = (lua_Integer) lua_rawlen (L, 1);
+
+    for (lua_Integer i = 1; i <= n; ++i) {
+        lua_rawgeti (L, 1, i);
+        lua_Number hz = tuning_hertz (t, lua_tonumber (L, -1) + bend);
+        lua_pop (L, 1);
+        lua_pushnumber (L, hz);
+        lua_rawseti (L, 2, i);
+    }
+
+    lua_settop (L, 2);
+    return 1;
+}
+
+/// Convert a note to hertz.
+// Uses the current tuning table. Fractional notes are supported.
+// @function tohertz
+// @number note Note number 0-127
+// @int[opt] bend 14bit pitch wheel value (8192 is center)
+// @number[opt] range Pitch bend range in semitones (default 2)
+// @treturn number Frequency in hertz
+// @within Conversion
+
+/// Convert many notes to hertz.
+// Writes the frequencies of `notes` to `out`. Both must be the same type:
+// `kv.vector`s or plain Lua arrays. An output vector is resized to match the
+// input, which only allocates if its capacity is too small.
+// @function tohertz
+// @param notes Input note numbers
+// @param out Output frequencies
+// @int[opt] bend 14bit pitch wheel value (8192 is center)
+// @number[opt] range Pitch bend range in semitones (default 2)
+// @return `out`
+// @within Conversion
+// @usage
+// midi.tohertz (notes, freqs, pitch, 12)
 static int f_tohertz (lua_State* L) {
-    lua_pushinteger (L, 0);
-    return 0;
+    switch (lua_type (L, 1)) {
+        case LUA_TUSERDATA: {
+            kv_vector_t* notes = luaL_checkudata (L, 1, LKV_MT_VECTOR);
+            return tohertz_vector (L, notes);
+        }
+
+        case LUA_TTABLE:
+            return tohertz_table (L);
+
+        default:
+            break;
+    }
+
+    lua_pushnumber (L, tuning_hertz (totuning (L),
+        luaL_checknumber (L, 1) + bend_semitones (L, 2)));
+    return 1;
 }
 
+/// Convert hertz to a note.
+// The inverse of `tohertz` in equal temperament.
+// @function tonote
+// @number hz Frequency in hertz
+// @treturn number Fractional note number
+// @within Conversion
+static int f_tonote (lua_State* L) {
+    const Tuning* t = totuning (L);
+    lua_Number hz = luaL_checknumber (L, 1);
+    lua_pushnumber (L, hz > 0.0 ? 69.0 + 12.0 * log2 (hz / t->reference) : 0.0);
+    return 1;
+}
+
+/// Clamp a value to the range 0-127.
+// @function clamp
+// @int value Value to clamp
+// @treturn int Clamped value
+// @within Conversion
 static int f_clamp (lua_State* L) {
     lua_Integer value = lua_tointeger (L, 1);
     if (value < 0) value = 0;
     else if (value > 127) value = 127;
     lua_pushinteger (L, value);
+    return 1;
+}
+
+/// Change the tuning table.
+// Pass 12 offsets in cents, one per pitch class starting at C, to
+// retune relative to equal temperament. Pass 128 frequencies in hertz to
+// replace the whole table. Pass nil to reset to equal temperament.
+// @function settuning
+// @tparam table tuning Cents offsets or frequencies
+// @number[opt] reference Frequency of A4 (default current reference)
+// @within Conversion
+// @usage
+// -- quarter comma meantone
+// midi.settuning ({ 10.3, -13.7, 3.4, 20.5, -3.4, 13.7, -10.3, 6.8, -17.1, 0.0, 17.1, -6.8 })
+static int f_settuning (lua_State* L) {
+    Tuning* t = totuning (L);
+    lua_Number reference = luaL_optnumber (L, 2, t->reference);
+    luaL_argcheck (L, reference > 0.0, 2, "reference must be positive");
+
+    if (lua_isnoneornil (L, 1)) {
+        tuning_init (t, reference, NULL);
+        return 0;
+    }
+
+    luaL_checktype (L, 1, LUA_TTABLE);
+    const lua_Integer n = (lua_Integer) lua_rawlen (L, 1);
+    luaL_argcheck (L, n == 12 || n == MIDI_NUM_NOTES, 1, "expected 12 or 128 values");
+
+    if (n == 12) {
+        lua_Number cents [12];
+        for (int i = 0; i < 12; ++i) {
+            lua_rawgeti (L, 1, i + 1);
+            cents[i] = lua_tonumber (L, -1);
+            lua_pop (L, 1);
+        }
+        tuning_init (t, reference, cents);
+    } else {
+        tuning_init (t, reference, NULL);
+        for (int i = 0; i < MIDI_NUM_NOTES; ++i) {
+            lua_rawgeti (L, 1, i + 1);
+            lua_Number hz = lua_tonumber (L, -1);
+            lua_pop (L, 1);
+            if (hz > 0.0)
+                t->table[i] = hz;
+        }
+    }
+
+    return 0;
+}
+
+/// Frequency of A4.
+// @function reference
+// @treturn number Reference frequency in hertz
+// @within Conversion
+static int f_reference (lua_State* L) {
+    lua_pushnumber (L, totuning (L)->reference);
+    return 1;
+}
+
+/// Change the frequency of A4.
+// Resets the tuning to equal temperament.
+// @function setreference
+// @number hz Reference frequency in hertz (default 440)
+// @within Conversion
+static int f_setreference (lua_State* L) {
+    lua_Number hz = luaL_optnumber (L, 1, 440.0);
+    luaL_argcheck (L, hz > 0.0, 1, "reference must be positive");
+    tuning_init (totuning (L), hz, NULL);
     return 0;
 }
 
@@ -104,12 +308,19 @@ static const luaL_Reg midi_f[] = {
     { "noteon",         f_noteon },
     { "noteoff",        f_noteoff },
     { "tohertz",        f_tohertz },
+    { "tonote",         f_tonote },
     { "clamp",          f_clamp },
+    { "settuning",      f_settuning },
+    { "reference",      f_reference },
+    { "setreference",   f_setreference },
     { NULL, NULL }
 };
 
 LKV_EXPORT
 int luaopen_kv_midi (lua_State* L) {
-    luaL_newlib (L, midi_f);
+    luaL_newlibtable (L, midi_f);
+    Tuning* tuning = lua_newuserdata (L, sizeof (Tuning));
+    tuning_init (tuning, 440.0, NULL);
+    luaL_setfuncs (L, midi_f, 1);
     return 1;
 }
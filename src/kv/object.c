@@ -0,0 +1,834 @@
+/// Define objects with attributes.
+// A type is a table made by `define`. Instances are proxy tables: plain
+// types share one metatable between all their instances, and types backed
+// by userdata give each instance a small metatable holding the userdata
+// (`__impl`) and the type's shared functions.
+//
+// What a type exposes, its attributes, its fields and the properties and
+// methods of its userdata, is flattened into one table when the type is
+// finalized, at the latest by its first instance. Instances then resolve
+// any name with a single lookup, however deep the type's hierarchy. Fields
+// set on the type later update that table, so methods can still be added
+// at any time. See `finalize` for changing attributes.
+//
+// Functions set on an instance backed by userdata are kept in its
+// metatable rather than the proxy, so replacing or removing one is seen
+// too, letting C++ cache the handlers of a widget.
+// @module kv.object
+// @usage
+// local Animal = object()
+
+#include "lua-kv.h"
+#include <lualib.h>
+
+/* registry keys of the weak tables caching per type functions */
+static const char types_key = 0;
+static const char refs_key  = 0;
+
+/* dispatch tags for keys that are not plain values */
+static const char attribute_tag = 0;
+static const char property_tag  = 0;
+
+/* entry fields, see new_entry() */
+enum {
+    ENTRY_NEW = 1,      /* __newuserdata function, true for refs or false for plain types */
+    ENTRY_META,         /* the shared metatable of plain types */
+    ENTRY_INDEX,        /* __index */
+    ENTRY_NEWINDEX,     /* __newindex */
+    ENTRY_DISPATCH,     /* flattened reads: name -> value or tag */
+    ENTRY_GETTERS,      /* name -> getter of attributes */
+    ENTRY_WRITES,       /* name -> attribute, or true for properties */
+    ENTRY_PROPS,        /* userdata property names */
+    ENTRY_EXPORTS,      /* userdata method closures */
+    ENTRY_FIELDS,       /* fields of the type when flattened, else nil */
+    ENTRY_UTYPE         /* the type making the userdata */
+};
+
+/* increments the handler version, see LKV_REG_OBJECT_VERSION */
+static void bump_handlers (lua_State* L) {
+    lua_getfield (L, LUA_REGISTRYINDEX, LKV_REG_OBJECT_VERSION);
+    lua_Integer* version = (lua_Integer*) lua_touserdata (L, -1);
+    if (version != NULL)
+        ++(*version);
+    lua_pop (L, 1);
+}
+
+/* returns the handler version of the userdata proxy at 1, or NULL if no
+   handlers watch it, see LKV_OBJECT_VERSION_FIELD */
+static lua_Integer* own_version (lua_State* L) {
+    lua_Integer* version = NULL;
+    if (lua_getmetatable (L, 1)) {
+        if (lua_getfield (L, -1, LKV_OBJECT_VERSION_FIELD) == LUA_TUSERDATA)
+            version = (lua_Integer*) lua_touserdata (L, -1);
+        lua_pop (L, 2);
+    }
+    return version;
+}
+
+/* true if the value at `value` or t[key] is a function */
+static int is_handler_change (lua_State* L, int t, int key, int value) {
+    int changed = lua_type (L, value) == LUA_TFUNCTION;
+    if (! changed) {
+        lua_pushvalue (L, key);
+        changed = lua_rawget (L, t) == LUA_TFUNCTION;
+        lua_pop (L, 1);
+    }
+    return changed;
+}
+
+/* bumps the handler version if the value at `value` or t[key] is a function */
+static void touch_handlers (lua_State* L, int t, int key, int value) {
+    if (is_handler_change (L, t, key, value))
+        bump_handlers (L);
+}
+
+/* Calls impl[name] (impl, ...) with the userdata behind the proxy `self` */
+static int object_export (lua_State* L) {
+    const int nargs = lua_gettop (L);
+    if (nargs < 1 || ! lua_getmetatable (L, 1))
+        return luaL_error (L, "%s: expected an object", lua_tostring (L, lua_upvalueindex (1)));
+    lua_getfield (L, -1, "__impl");
+    lua_replace (L, 1);
+    lua_pop (L, 1);
+    lua_pushvalue (L, lua_upvalueindex (1));
+    lua_gettable (L, 1);
+    lua_insert (L, 1);
+    lua_call (L, nargs, LUA_MULTRET);
+    return lua_gettop (L);
+}
+
+/* pushes the userdata behind the proxy at 1 */
+static void push_impl (lua_State* L) {
+    if (lua_getmetatable (L, 1))
+        lua_getfield (L, -1, "__impl");
+    else
+        lua_pushnil (L);
+}
+
+/* returns the tag of the value on top of the stack, if any */
+static const void* totag (lua_State* L) {
+    return lua_islightuserdata (L, -1) ? lua_touserdata (L, -1) : NULL;
+}
+
+/* calls the getter of attribute 2 with the proxy at 1 */
+static int call_getter (lua_State* L, int getters) {
+    lua_pushvalue (L, 2);
+    lua_rawget (L, getters);
+    lua_pushvalue (L, 1);
+    lua_call (L, 1, 1);
+    return 1;
+}
+
+/* userdata proxy __index. upvalues: dispatch, getters, unflattened type or nil */
+static int userdata_index (lua_State* L) {
+    lua_settop (L, 2);
+    lua_pushvalue (L, 2);
+    lua_rawget (L, lua_upvalueindex (1));
+    const void* tag = totag (L);
+    if (tag == &attribute_tag)
+        return call_getter (L, lua_upvalueindex (2));
+    if (tag == &property_tag) {
+        push_impl (L);
+        lua_pushvalue (L, 2);
+        lua_gettable (L, -2);
+        return 1;
+    }
+
+    /* fields of a derived type come before the userdata's methods */
+    if (! lua_isnil (L, lua_upvalueindex (3))) {
+        lua_pushvalue (L, 2);
+        lua_gettable (L, lua_upvalueindex (3));
+        if (lua_toboolean (L, -1))
+            return 1;
+        lua_pop (L, 1);
+    }
+
+    return 1;
+}
+
+/* __index of a userdata proxy holding functions of its own.
+   upvalues: the functions, the type's __index */
+static int own_index (lua_State* L) {
+    lua_settop (L, 2);
+    lua_pushvalue (L, 2);
+    if (lua_rawget (L, lua_upvalueindex (1)) != LUA_TNIL)
+        return 1;
+    lua_pop (L, 1);
+    lua_pushvalue (L, lua_upvalueindex (2));
+    lua_insert (L, 1);
+    lua_call (L, 2, 1);
+    return 1;
+}
+
+/* pushes the functions the userdata proxy at 1 holds itself, or nil. The
+   first one creating them puts own_index in front of the type's __index */
+static int push_own (lua_State* L, int create) {
+    lua_getmetatable (L, 1);
+    const int mt = lua_gettop (L);
+    if (lua_getfield (L, mt, "__own") == LUA_TTABLE || ! create) {
+        lua_remove (L, mt);
+        return lua_type (L, -1);
+    }
+    lua_pop (L, 1);
+    lua_newtable (L);
+    lua_pushvalue (L, -1);
+    lua_setfield (L, mt, "__own");
+    lua_pushvalue (L, -1);
+    lua_getfield (L, mt, "__index");
+    lua_pushcclosure (L, own_index, 2);
+    lua_setfield (L, mt, "__index");
+    lua_remove (L, mt);
+    return LUA_TTABLE;
+}
+
+/* userdata proxy __newindex. upvalue: writes */
+static int userdata_newindex (lua_State* L) {
+    lua_settop (L, 3);
+    lua_pushvalue (L, 2);
+    switch (lua_rawget (L, lua_upvalueindex (1))) {
+        case LUA_TTABLE:
+            if (lua_getfield (L, 4, "set") == LUA_TNIL)
+                return luaL_error (L, "cannot modify readonly attribute");
+            lua_pushvalue (L, 1);
+            lua_pushvalue (L, 3);
+            lua_call (L, 2, 0);
+            return 0;
+
+        case LUA_TBOOLEAN:
+            push_impl (L);
+            lua_pushvalue (L, 2);
+            lua_pushvalue (L, 3);
+            lua_settable (L, -3);
+            return 0;
+
+        default:
+            break;
+    }
+
+    /* functions, and every value of a proxy with handlers, are kept
+       aside, so that each later assignment comes back here and bumps
+       the proxy's handler version */
+    lua_settop (L, 3);
+    lua_Integer* version = own_version (L);
+    const int aside = version != NULL || lua_type (L, 3) == LUA_TFUNCTION;
+    if (push_own (L, aside) == LUA_TTABLE) {
+        lua_pushvalue (L, 2);
+        if (aside || lua_rawget (L, 4) != LUA_TNIL) {
+            lua_settop (L, 4);
+            if (version != NULL && is_handler_change (L, 4, 2, 3))
+                ++(*version);
+            lua_pushvalue (L, 2);
+            lua_pushvalue (L, 3);
+            lua_rawset (L, 4);
+            return 0;
+        }
+    }
+
+    lua_settop (L, 3);
+    lua_rawset (L, 1);
+    return 0;
+}
+
+/* plain proxy __index. upvalues: dispatch, getters, unflattened type or nil */
+static int table_index (lua_State* L) {
+    lua_settop (L, 2);
+    lua_pushvalue (L, 2);
+    lua_rawget (L, lua_upvalueindex (1));
+    if (totag (L) == &attribute_tag)
+        return call_getter (L, lua_upvalueindex (2));
+    if (! lua_isnil (L, lua_upvalueindex (3))) {
+        lua_pushvalue (L, 2);
+        lua_gettable (L, lua_upvalueindex (3));
+    }
+    return 1;
+}
+
+/* plain proxy __newindex. upvalue: attributes with a setter */
+static int table_newindex (lua_State* L) {
+    lua_settop (L, 3);
+    lua_pushvalue (L, 2);
+    if (lua_rawget (L, lua_upvalueindex (1)) != LUA_TNIL) {
+        lua_getfield (L, 4, "set");
+        lua_pushvalue (L, 1);
+        lua_pushvalue (L, 3);
+        lua_call (L, 2, 0);
+        return 0;
+    }
+    lua_settop (L, 3);
+    lua_rawset (L, 1);
+    return 0;
+}
+
+/* raw copies every field of the table at `src` to the table at `dst` */
+static void copy_fields (lua_State* L, int src, int dst) {
+    if (lua_type (L, src) != LUA_TTABLE)
+        return;
+    lua_pushnil (L);
+    while (lua_next (L, src) != 0) {
+        lua_pushvalue (L, -2);
+        lua_insert (L, -2);
+        lua_rawset (L, dst);
+    }
+}
+
+/* removes every field of the table at `t` */
+static void clear_fields (lua_State* L, int t) {
+    lua_pushnil (L);
+    while (lua_next (L, t) != 0) {
+        lua_pop (L, 1);
+        lua_pushvalue (L, -1);
+        lua_pushnil (L);
+        lua_rawset (L, t);
+    }
+}
+
+/* pushes getmetatable(t)[field], or nil */
+static int push_metafield (lua_State* L, int t, const char* field) {
+    if (lua_type (L, t) != LUA_TTABLE || ! lua_getmetatable (L, t)) {
+        lua_pushnil (L);
+        return LUA_TNIL;
+    }
+    const int type = lua_getfield (L, -1, field);
+    lua_remove (L, -2);
+    return type;
+}
+
+/* for each attribute in the table at `atts` with a field named `accessor`,
+   sets dst[name] = attribute. Every attribute if accessor is NULL */
+static void add_attributes (lua_State* L, int atts, int dst, const char* accessor) {
+    if (lua_type (L, atts) != LUA_TTABLE)
+        return;
+    lua_pushnil (L);
+    while (lua_next (L, atts) != 0) {
+        if (lua_type (L, -1) == LUA_TTABLE) {
+            int keep = accessor == NULL;
+            if (! keep) {
+                keep = lua_getfield (L, -1, accessor) != LUA_TNIL && lua_toboolean (L, -1);
+                lua_pop (L, 1);
+            }
+            if (keep) {
+                lua_pushvalue (L, -2);
+                lua_insert (L, -2);
+                lua_rawset (L, dst);
+                continue;
+            }
+        }
+        lua_pop (L, 1);
+    }
+}
+
+/* sets dst[name] = attribute.get for each attribute with a getter */
+static void add_getters (lua_State* L, int atts, int dst) {
+    if (lua_type (L, atts) != LUA_TTABLE)
+        return;
+    lua_pushnil (L);
+    while (lua_next (L, atts) != 0) {
+        if (lua_type (L, -1) == LUA_TTABLE) {
+            lua_getfield (L, -1, "get");
+            if (lua_toboolean (L, -1)) {
+                lua_pushvalue (L, -3);
+                lua_insert (L, -2);
+                lua_rawset (L, dst);
+            } else {
+                lua_pop (L, 1);
+            }
+        }
+        lua_pop (L, 1);
+    }
+}
+
+/* sets dst[name] = value for each name in the array getmetatable(U)[field] */
+static void add_names (lua_State* L, int U, const char* field, int dst, int value) {
+    if (push_metafield (L, U, field) == LUA_TTABLE) {
+        const lua_Integer n = luaL_len (L, -1);
+        for (lua_Integer i = 1; i <= n; ++i) {
+            if (lua_geti (L, -1, i) == LUA_TNIL) {
+                lua_pop (L, 1);
+                break;
+            }
+            if (value == 0) {
+                /* a method, exported through a closure named after it */
+                lua_pushvalue (L, -1);
+                lua_pushcclosure (L, object_export, 1);
+            } else {
+                lua_pushboolean (L, 1);
+            }
+            lua_rawset (L, dst);
+        }
+    }
+    lua_pop (L, 1);
+}
+
+/* pushes entry[field][key], returning its type */
+static int entry_get (lua_State* L, int entry, int field, int key) {
+    if (lua_rawgeti (L, entry, field) != LUA_TTABLE) {
+        lua_pop (L, 1);
+        lua_pushnil (L);
+        return LUA_TNIL;
+    }
+    lua_pushvalue (L, key);
+    const int type = lua_rawget (L, -2);
+    lua_remove (L, -2);
+    return type;
+}
+
+static int is_plain_entry (lua_State* L, int entry) {
+    lua_rawgeti (L, entry, ENTRY_NEW);
+    const int plain = lua_isboolean (L, -1) && ! lua_toboolean (L, -1);
+    lua_pop (L, 1);
+    return plain;
+}
+
+/* resolves what instances read at `key` and stores it in the dispatch table.
+   attributes come first, then properties, then fields of the type and last
+   the userdata's methods */
+static void update_dispatch (lua_State* L, int entry, int key) {
+    const int top = lua_gettop (L);
+    const int plain = is_plain_entry (L, entry);
+    lua_rawgeti (L, entry, ENTRY_DISPATCH);
+    lua_pushvalue (L, key);
+
+    const int getter = entry_get (L, entry, ENTRY_GETTERS, key) != LUA_TNIL;
+    lua_pop (L, 1);
+    if (getter) {
+        lua_pushlightuserdata (L, (void*) &attribute_tag);
+    } else if (plain) {
+        entry_get (L, entry, ENTRY_FIELDS, key);
+    } else if (entry_get (L, entry, ENTRY_PROPS, key) != LUA_TNIL) {
+        lua_pop (L, 1);
+        lua_pushlightuserdata (L, (void*) &property_tag);
+    } else {
+        lua_pop (L, 1);
+        entry_get (L, entry, ENTRY_FIELDS, key);
+        if (! lua_toboolean (L, -1)) {
+            lua_pop (L, 1);
+            entry_get (L, entry, ENTRY_EXPORTS, key);
+        }
+    }
+
+    lua_rawset (L, top + 1);
+    lua_settop (L, top);
+}
+
+/* calls update_dispatch for every key of entry[field] */
+static void update_dispatch_keys (lua_State* L, int entry, int field) {
+    if (lua_rawgeti (L, entry, field) == LUA_TTABLE) {
+        const int t = lua_gettop (L);
+        lua_pushnil (L);
+        while (lua_next (L, t) != 0) {
+            lua_pop (L, 1);
+            update_dispatch (L, entry, lua_gettop (L));
+        }
+    }
+    lua_pop (L, 1);
+}
+
+static int empty_table (lua_State* L, int t) {
+    lua_pushnil (L);
+    if (lua_next (L, t) == 0)
+        return 1;
+    lua_pop (L, 2);
+    return 0;
+}
+
+/* (re)reads the attributes of type T and the names exported by its userdata
+   into the entry at `entry`, then flattens them into its dispatch table */
+static void fill_entry (lua_State* L, int entry, int T) {
+    const int top = lua_gettop (L);
+    const int plain = is_plain_entry (L, entry);
+    for (int field = ENTRY_DISPATCH; field <= ENTRY_EXPORTS; ++field) {
+        if (lua_rawgeti (L, entry, field) == LUA_TTABLE)
+            clear_fields (L, lua_gettop (L));
+    }
+    const int getters = top + 2, writes = top + 3;
+    const int props = top + 4, exports = top + 5;
+    push_metafield (L, T, "__atts");
+    const int atts = top + 6;
+
+    add_getters (L, atts, getters);
+    if (plain) {
+        add_attributes (L, atts, writes, "set");
+    } else {
+        lua_rawgeti (L, entry, ENTRY_UTYPE);
+        const int U = lua_gettop (L);
+        add_names (L, U, "__methods", exports, 0);
+        add_names (L, U, "__props", props, 1);
+        add_names (L, U, "__props", writes, 1);
+        add_attributes (L, atts, writes, NULL);
+    }
+
+    update_dispatch_keys (L, entry, ENTRY_EXPORTS);
+    update_dispatch_keys (L, entry, ENTRY_PROPS);
+    update_dispatch_keys (L, entry, ENTRY_FIELDS);
+    update_dispatch_keys (L, entry, ENTRY_GETTERS);
+
+    if (plain) {
+        /* without getters, instances read straight from the type's fields */
+        lua_rawgeti (L, entry, ENTRY_META);
+        const int mt = lua_gettop (L);
+        if (! empty_table (L, getters))
+            lua_rawgeti (L, entry, ENTRY_INDEX);
+        else if (lua_rawgeti (L, entry, ENTRY_FIELDS) == LUA_TNIL) {
+            lua_pop (L, 1);
+            lua_pushvalue (L, T);
+        }
+        lua_setfield (L, mt, "__index");
+        if (lua_toboolean (L, atts))
+            lua_rawgeti (L, entry, ENTRY_NEWINDEX);
+        else
+            lua_pushvalue (L, T);
+        lua_setfield (L, mt, "__newindex");
+    }
+
+    lua_settop (L, top);
+}
+
+/* pushes a new entry for type T. `newuserdata` is the __newuserdata
+   function, true for refs or false for plain types, and U the type that
+   declares it */
+static void new_entry (lua_State* L, int T, int U, int newuserdata) {
+    const int top = lua_gettop (L);
+    const int plain = lua_isboolean (L, newuserdata) && ! lua_toboolean (L, newuserdata);
+    lua_createtable (L, ENTRY_UTYPE, 0);
+    const int entry = top + 1;
+    lua_pushvalue (L, newuserdata);
+    lua_rawseti (L, entry, ENTRY_NEW);
+    if (! plain) {
+        lua_pushvalue (L, U);
+        lua_rawseti (L, entry, ENTRY_UTYPE);
+    }
+    for (int field = ENTRY_DISPATCH; field <= ENTRY_EXPORTS; ++field) {
+        lua_newtable (L);
+        lua_rawseti (L, entry, field);
+    }
+
+    /* a defined type's fields are flattened. when T is the userdata's own
+       type they are not exposed at all */
+    int flat = 0;
+    if (plain || ! lua_rawequal (L, T, U)) {
+        if (push_metafield (L, T, "__fields") == LUA_TTABLE) {
+            lua_rawseti (L, entry, ENTRY_FIELDS);
+            flat = 1;
+        } else {
+            lua_pop (L, 1);
+        }
+    }
+
+    lua_rawgeti (L, entry, ENTRY_DISPATCH);
+    lua_rawgeti (L, entry, ENTRY_GETTERS);
+    if (flat || (! plain && lua_rawequal (L, T, U)))
+        lua_pushnil (L);
+    else
+        lua_pushvalue (L, T);
+    lua_pushcclosure (L, plain ? table_index : userdata_index, 3);
+    lua_rawseti (L, entry, ENTRY_INDEX);
+    lua_rawgeti (L, entry, ENTRY_WRITES);
+    lua_pushcclosure (L, plain ? table_newindex : userdata_newindex, 1);
+    lua_rawseti (L, entry, ENTRY_NEWINDEX);
+    if (plain) {
+        lua_createtable (L, 0, 2);
+        lua_rawseti (L, entry, ENTRY_META);
+    }
+
+    fill_entry (L, entry, T);
+    lua_settop (L, entry);
+}
+
+/* pushes the cached entry for type T, creating it if needed */
+static int type_entry (lua_State* L, int T, const void* key) {
+    lua_rawgetp (L, LUA_REGISTRYINDEX, key);
+    lua_pushvalue (L, T);
+    if (lua_rawget (L, -2) == LUA_TTABLE) {
+        lua_remove (L, -2);
+        return lua_gettop (L);
+    }
+    lua_pop (L, 1);
+
+    if (key == &refs_key) {
+        lua_pushboolean (L, 1);
+        new_entry (L, T, T, lua_gettop (L));
+        lua_remove (L, -2);
+    } else {
+        /* find the first type in the chain that makes userdata */
+        int found = 0;
+        lua_pushvalue (L, T);
+        while (lua_type (L, -1) == LUA_TTABLE && lua_getmetatable (L, -1)) {
+            if (lua_getfield (L, -1, "__newuserdata") == LUA_TFUNCTION) {
+                const int newuserdata = lua_gettop (L);
+                new_entry (L, T, newuserdata - 2, newuserdata);
+                lua_replace (L, newuserdata - 2);
+                lua_settop (L, newuserdata - 2);
+                found = 1;
+                break;
+            }
+            lua_pop (L, 1);
+            lua_getfield (L, -1, "__base");
+            lua_replace (L, -3);
+            lua_pop (L, 1);
+        }
+        if (! found) {
+            lua_pop (L, 1);
+            lua_pushboolean (L, 0);
+            new_entry (L, T, 0, lua_gettop (L));
+            lua_remove (L, -2);
+        }
+    }
+
+    lua_pushvalue (L, T);
+    lua_pushvalue (L, -2);
+    lua_rawset (L, -4);
+    lua_remove (L, -2);
+    return lua_gettop (L);
+}
+
+/* pushes a proxy for the userdata at `impl` */
+static void push_userdata_proxy (lua_State* L, int entry, int impl) {
+    if (lua_type (L, impl) != LUA_TUSERDATA)
+        luaL_error (L, "not userdata");
+    lua_newtable (L);
+    lua_createtable (L, 0, 3);
+    lua_pushvalue (L, impl);
+    lua_setfield (L, -2, "__impl");
+    lua_rawgeti (L, entry, ENTRY_INDEX);
+    lua_setfield (L, -2, "__index");
+    lua_rawgeti (L, entry, ENTRY_NEWINDEX);
+    lua_setfield (L, -2, "__newindex");
+    lua_setmetatable (L, -2);
+}
+
+/* defined type __newindex: stores the field and updates what instances
+   already made read at that key */
+static int type_newindex (lua_State* L) {
+    lua_settop (L, 3);
+    lua_getmetatable (L, 1);
+    lua_getfield (L, 4, "__fields");
+    touch_handlers (L, 5, 2, 3);
+    lua_pushvalue (L, 2);
+    lua_pushvalue (L, 3);
+    lua_rawset (L, 5);
+
+    const void* keys[] = { &types_key, &refs_key };
+    for (int i = 0; i < 2; ++i) {
+        lua_rawgetp (L, LUA_REGISTRYINDEX, keys[i]);
+        lua_pushvalue (L, 1);
+        if (lua_rawget (L, -2) == LUA_TTABLE)
+            update_dispatch (L, lua_gettop (L), 2);
+        lua_settop (L, 5);
+    }
+    return 0;
+}
+
+static int fields_next (lua_State* L) {
+    lua_settop (L, 2);
+    if (lua_next (L, 1) != 0)
+        return 2;
+    lua_pushnil (L);
+    return 1;
+}
+
+/* defined type __pairs */
+static int type_pairs (lua_State* L) {
+    lua_pushcfunction (L, fields_next);
+    push_metafield (L, 1, "__fields");
+    lua_pushnil (L);
+    return 3;
+}
+
+//=============================================================================
+/// Define a new object type.
+// Call when you need to define a custom object. You can also invoke the module
+// directly, which is an alias to `define`.
+// @class function
+// @name object.define
+// @param base
+// @treturn table The new object type table
+// @usage
+// local object = require ('kv.object')
+// -- Verbose method
+// local Animal = object.define()
+// -- Calling the module
+// local Cat = object (Animal)
+static int object_define (lua_State* L) {
+    const int nargs = lua_gettop (L);
+    int B = 0, atts = 0;
+
+    if (nargs == 1 && lua_type (L, 1) == LUA_TTABLE && ! lua_getmetatable (L, 1)) {
+        /* the attributes themselves */
+        lua_newtable (L);
+        B = lua_gettop (L);
+        atts = 1;
+    } else if (nargs >= 1 && lua_type (L, 1) == LUA_TTABLE) {
+        if (nargs == 1)
+            lua_pop (L, 1);
+        B = 1;
+        lua_newtable (L);
+        atts = lua_gettop (L);
+        push_metafield (L, B, "__atts");
+        copy_fields (L, lua_gettop (L), atts);
+        lua_pop (L, 1);
+        if (nargs > 1) {
+            luaL_checktype (L, 2, LUA_TTABLE);
+            copy_fields (L, 2, atts);
+        }
+    } else if (nargs > 1) {
+        luaL_checktype (L, 1, LUA_TTABLE);
+    } else {
+        lua_newtable (L);
+        B = lua_gettop (L);
+        lua_newtable (L);
+        atts = lua_gettop (L);
+    }
+
+    /* the new type's fields start as a copy of its base's. they live in
+       the metatable so that changing them can update existing instances */
+    lua_newtable (L);
+    const int D = lua_gettop (L);
+    lua_newtable (L);
+    const int fields = D + 1;
+    if (push_metafield (L, B, "__fields") == LUA_TTABLE)
+        copy_fields (L, fields + 1, fields);
+    else
+        copy_fields (L, B, fields);
+    lua_pop (L, 1);
+
+    lua_createtable (L, 0, 6);
+    lua_pushvalue (L, atts);
+    lua_setfield (L, -2, "__atts");
+    lua_pushvalue (L, B);
+    lua_setfield (L, -2, "__base");
+    lua_pushvalue (L, fields);
+    lua_setfield (L, -2, "__fields");
+    lua_pushvalue (L, fields);
+    lua_setfield (L, -2, "__index");
+    lua_pushcfunction (L, type_newindex);
+    lua_setfield (L, -2, "__newindex");
+    lua_pushcfunction (L, type_pairs);
+    lua_setfield (L, -2, "__pairs");
+    lua_setmetatable (L, D);
+    lua_settop (L, D);
+    return 1;
+}
+
+/// Finalize type `T`.
+// Flattens the type's attributes, fields and the methods and properties of
+// its userdata into one table, so that instances resolve any name with a
+// single lookup. Happens by itself when the first instance is created, and
+// setting a field on the type keeps it up to date. Call again after
+// changing the type's attributes, or its userdata's `__methods` and
+// `__props`, to update the type and every existing instance.
+// @function object.finalize
+// @tparam table T The object type
+// @treturn table T
+static int object_finalize (lua_State* L) {
+    luaL_checktype (L, 1, LUA_TTABLE);
+    lua_settop (L, 1);
+    lua_rawgetp (L, LUA_REGISTRYINDEX, &refs_key);
+    lua_pushvalue (L, 1);
+    if (lua_rawget (L, 2) == LUA_TTABLE)
+        fill_entry (L, 3, 1);
+    lua_settop (L, 1);
+
+    lua_rawgetp (L, LUA_REGISTRYINDEX, &types_key);
+    lua_pushvalue (L, 1);
+    if (lua_rawget (L, 2) == LUA_TTABLE)
+        fill_entry (L, 3, 1);
+    else
+        type_entry (L, 1, &types_key);
+    lua_settop (L, 1);
+    bump_handlers (L);
+    return 1;
+}
+
+/// Create a new instance of type `T`.
+// @function object.new
+// @tparam table T The object type to create
+// @tparam any ... Arguments passed to `T:init`
+// @treturn table The newly created object
+static int object_new (lua_State* L) {
+    luaL_checktype (L, 1, LUA_TTABLE);
+    const int nargs = lua_gettop (L);
+    const int entry = type_entry (L, 1, &types_key);
+
+    if (lua_rawgeti (L, entry, ENTRY_NEW) == LUA_TFUNCTION) {
+        lua_call (L, 0, 1);
+        push_userdata_proxy (L, entry, entry + 1);
+    } else {
+        lua_pop (L, 1);
+        lua_newtable (L);
+        lua_rawgeti (L, entry, ENTRY_META);
+        lua_setmetatable (L, -2);
+    }
+    const int proxy = lua_gettop (L);
+
+    if (lua_getfield (L, 1, "init") == LUA_TFUNCTION) {
+        lua_pushvalue (L, proxy);
+        for (int i = 2; i <= nargs; ++i)
+            lua_pushvalue (L, i);
+        lua_call (L, nargs, 0);
+    } else {
+        lua_pop (L, 1);
+    }
+
+    return 1;
+}
+
+/// Reference some userdata.
+// Only call this on userdata allocated outside of lua.
+// @function object.ref
+// @tparam table T The type of userdata
+// @tparam userdata obj Instance allocated in C/C++
+// @bool init Set false to skip calling T.init (default true)
+// @return table Proxy object for `obj`
+static int object_ref (lua_State* L) {
+    if (lua_type (L, 1) != LUA_TTABLE)
+        return luaL_error (L, "param #1 is not a table");
+    if (lua_type (L, 2) != LUA_TUSERDATA)
+        return luaL_error (L, "param #2 is not userdata");
+    const int entry = type_entry (L, 1, &refs_key);
+    push_userdata_proxy (L, entry, 2);
+    return 1;
+}
+
+static int object_call (lua_State* L) {
+    lua_remove (L, 1);
+    return object_define (L);
+}
+
+static const luaL_Reg object_f[] = {
+    { "define",     object_define },
+    { "finalize",   object_finalize },
+    { "new",        object_new },
+    { "ref",        object_ref },
+    { NULL, NULL }
+};
+
+static void new_cache (lua_State* L, const void* key) {
+    if (lua_rawgetp (L, LUA_REGISTRYINDEX, key) == LUA_TTABLE) {
+        lua_pop (L, 1);
+        return;
+    }
+    lua_pop (L, 1);
+    lua_newtable (L);
+    lua_createtable (L, 0, 1);
+    lua_pushliteral (L, "k");
+    lua_setfield (L, -2, "__mode");
+    lua_setmetatable (L, -2);
+    lua_rawsetp (L, LUA_REGISTRYINDEX, key);
+}
+
+LKV_EXPORT
+int luaopen_kv_object (lua_State* L) {
+    new_cache (L, &types_key);
+    new_cache (L, &refs_key);
+    if (lua_getfield (L, LUA_REGISTRYINDEX, LKV_REG_OBJECT_VERSION) != LUA_TUSERDATA) {
+        *(lua_Integer*) lua_newuserdata (L, sizeof (lua_Integer)) = 0;
+        lua_setfield (L, LUA_REGISTRYINDEX, LKV_REG_OBJECT_VERSION);
+    }
+    lua_pop (L, 1);
+    luaL_newlib (L, object_f);
+    lua_createtable (L, 0, 1);
+    lua_pushcfunction (L, object_call);
+    lua_setfield (L, -2, "__call");
+    lua_setmetatable (L, -2);
+    return 1;
+}
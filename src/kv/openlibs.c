@@ -0,0 +1,91 @@
+/*
+Copyright 2019-2020 Michael Fisher <mfisher@kushview.net>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <string.h>
+#include "lua-kv.h"
+
+int luaopen_kv_AudioBuffer32 (lua_State*);
+int luaopen_kv_AudioBuffer64 (lua_State*);
+int luaopen_kv_Engine (lua_State*);
+int luaopen_kv_File (lua_State*);
+int luaopen_kv_MidiBuffer (lua_State*);
+int luaopen_kv_MidiClockFollower (lua_State*);
+int luaopen_kv_MidiClockGenerator (lua_State*);
+int luaopen_kv_MidiMessage (lua_State*);
+int luaopen_kv_VoiceAllocator (lua_State*);
+int luaopen_kv_audio (lua_State*);
+int luaopen_kv_bytes (lua_State*);
+int luaopen_kv_dsp_Convolver (lua_State*);
+int luaopen_kv_dsp_DelayLine (lua_State*);
+int luaopen_kv_dsp_EnvelopeBank (lua_State*);
+int luaopen_kv_dsp_Expression (lua_State*);
+int luaopen_kv_dsp_FFT (lua_State*);
+int luaopen_kv_dsp_LookupTable (lua_State*);
+int luaopen_kv_dsp_OscillatorBank (lua_State*);
+int luaopen_kv_dsp_Oversampler (lua_State*);
+int luaopen_kv_dsp_Resampler (lua_State*);
+int luaopen_kv_dsp_STFT (lua_State*);
+int luaopen_kv_midi (lua_State*);
+int luaopen_kv_object (lua_State*);
+int luaopen_kv_profile (lua_State*);
+int luaopen_kv_round (lua_State*);
+int luaopen_kv_rt (lua_State*);
+int luaopen_kv_vector (lua_State*);
+
+/* the core libraries. The GUI classes live in their own module */
+static const luaL_Reg kv_libs[] = {
+    { "kv.AudioBuffer32",       luaopen_kv_AudioBuffer32 },
+    { "kv.AudioBuffer64",       luaopen_kv_AudioBuffer64 },
+    { "kv.Engine",              luaopen_kv_Engine },
+    { "kv.File",                luaopen_kv_File },
+    { "kv.MidiBuffer",          luaopen_kv_MidiBuffer },
+    { "kv.MidiClockFollower",   luaopen_kv_MidiClockFollower },
+    { "kv.MidiClockGenerator",  luaopen_kv_MidiClockGenerator },
+    { "kv.MidiMessage",         luaopen_kv_MidiMessage },
+    { "kv.VoiceAllocator",      luaopen_kv_VoiceAllocator },
+    { "kv.audio",               luaopen_kv_audio },
+    { "kv.bytes",               luaopen_kv_bytes },
+    { "kv.dsp.Convolver",       luaopen_kv_dsp_Convolver },
+    { "kv.dsp.DelayLine",       luaopen_kv_dsp_DelayLine },
+    { "kv.dsp.EnvelopeBank",    luaopen_kv_dsp_EnvelopeBank },
+    { "kv.dsp.Expression",      luaopen_kv_dsp_Expression },
+    { "kv.dsp.FFT",             luaopen_kv_dsp_FFT },
+    { "kv.dsp.LookupTable",     luaopen_kv_dsp_LookupTable },
+    { "kv.dsp.OscillatorBank",  luaopen_kv_dsp_OscillatorBank },
+    { "kv.dsp.Oversampler",     luaopen_kv_dsp_Oversampler },
+    { "kv.dsp.Resampler",       luaopen_kv_dsp_Resampler },
+    { "kv.dsp.STFT",            luaopen_kv_dsp_STFT },
+    { "kv.midi",                luaopen_kv_midi },
+    { "kv.object",              luaopen_kv_object },
+    { "kv.profile",             luaopen_kv_profile },
+    { "kv.round",               luaopen_kv_round },
+    { "kv.rt",                  luaopen_kv_rt },
+    { "kv.vector",              luaopen_kv_vector },
+    { NULL, NULL }
+};
+
+void kv_openlibs (lua_State* L, int glb) {
+    for (const luaL_Reg* lib = kv_libs; lib->func != NULL; ++lib) {
+        luaL_requiref (L, lib->name, lib->func, 0);
+        if (glb) {
+            /* global named by the last part, e.g. MidiBuffer or FFT */
+            const char* name = strrchr (lib->name, '.');
+            lua_setglobal (L, name != NULL ? name + 1 : lib->name);
+        } else {
+            lua_pop (L, 1);
+        }
+    }
+}
@@ -0,0 +1,354 @@
+/// Profiling for scripts.
+// Two tools for finding where time goes in a process function. Zone timers
+// measure named sections with @{begin} and @{finish}; each thread keeps its
+// own totals, so timing takes no locks and doesn't allocate after a zone's
+// first use. The sampler counts which source lines run most by interrupting
+// the state every thousand or so instructions, and costs nothing while
+// stopped.
+//
+// @{report} summarizes both, and @{dump} writes recorded zones as a Chrome
+// trace to view in chrome://tracing or Perfetto.
+// @module kv.profile
+// @pragma nostrip
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "kv/lua/profile.hpp"
+#include LKV_JUCE_HEADER
+
+using kv::lua::ProfileClock;
+using kv::lua::ProfileHistogram;
+using kv::lua::ProfileSampler;
+using kv::lua::ProfileThread;
+
+#define LKV_MT_PROFILE_SAMPLER "kv.ProfileSampler"
+
+#define tosampler(L) (*(ProfileSampler**) lua_touserdata (L, lua_upvalueindex (1)))
+
+namespace {
+
+/** Totals for a zone across all threads */
+struct ZoneSummary {
+    uint64_t count { 0 }, total { 0 }, max { 0 };
+    uint64_t buckets[ProfileHistogram::num_buckets] {};
+
+    void add (const ProfileHistogram& h) {
+        count += h.count.load (std::memory_order_relaxed);
+        total += h.total.load (std::memory_order_relaxed);
+        max = std::max (max, h.max.load (std::memory_order_relaxed));
+        for (int i = 0; i < ProfileHistogram::num_buckets; ++i)
+            buckets[i] += h.buckets[i].load (std::memory_order_relaxed);
+    }
+
+    /** Value below which a fraction `q` of the timings fall, in ticks */
+    double percentile (double q) const {
+        const auto target = (uint64_t) std::ceil (q * (double) count);
+        uint64_t seen = 0;
+        for (int b = 0; b < ProfileHistogram::num_buckets; ++b) {
+            seen += buckets[b];
+            if (seen >= target && buckets[b] > 0) {
+                const double lo = (double) ProfileHistogram::bucket_low (b);
+                const double hi = b + 1 < ProfileHistogram::num_buckets
+                    ? (double) ProfileHistogram::bucket_low (b + 1) : lo;
+                return std::min ((double) max, 0.5 * (lo + hi));
+            }
+        }
+        return (double) max;
+    }
+};
+
+std::map<std::string, ZoneSummary> summarize_zones() {
+    std::map<std::string, ZoneSummary> zones;
+    for (auto* t = ProfileThread::first(); t != nullptr; t = t->get_next())
+        for (int z = 0; z < t->get_num_zones(); ++z)
+            zones[t->get_zone (z).name].add (t->get_zone (z).histogram);
+    return zones;
+}
+
+void append_escaped (std::string& out, const char* text) {
+    for (const char* c = text; *c != 0; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+            out += *c;
+        } else if ((unsigned char) *c < 0x20) {
+            char code[8];
+            std::snprintf (code, sizeof (code), "\\u%04x", (unsigned) (unsigned char) *c);
+            out += code;
+        } else {
+            out += *c;
+        }
+    }
+}
+
+std::string chrome_trace() {
+    const double tpu = ProfileClock::ticks_per_us();
+    const uint64_t origin = ProfileClock::origin();
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+
+    for (auto* t = ProfileThread::first(); t != nullptr; t = t->get_next()) {
+        t->for_each_event ([&] (const ProfileThread::Event& e) {
+            char timing[96];
+            std::snprintf (timing, sizeof (timing), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                           (double) (e.start - origin) / tpu, (double) (e.end - e.start) / tpu, t->get_id());
+            json += first ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+            append_escaped (json, t->get_zone (e.zone).name);
+            json += timing;
+            first = false;
+        });
+    }
+
+    json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return json;
+}
+
+int check_result (lua_State* L, ProfileThread::Result result, const char* name) {
+    switch (result) {
+        case ProfileThread::TooManyZones:
+            return luaL_error (L, "profile: too many zones, can't add '%s'", name);
+        case ProfileThread::TooDeep:
+            return luaL_error (L, "profile: zones nested too deeply at '%s'", name);
+        case ProfileThread::NotStarted:
+            return luaL_error (L, "profile: finish without begin");
+        case ProfileThread::Mismatched:
+            return luaL_error (L, "profile: finish '%s' doesn't match the open zone", name);
+        default:
+            break;
+    }
+    return 0;
+}
+
+}
+
+/// Zones.
+// @section zones
+
+/// Start timing a zone.
+// Zones nest, and the first use of a name on a thread registers it.
+// @function begin
+// @string name Zone name
+// @within Zones
+// @usage
+// profile.begin ("render")
+// render (audio)
+// profile.finish ("render")
+static int f_begin (lua_State* L) {
+    const char* name = luaL_checkstring (L, 1);
+    return check_result (L, ProfileThread::current().begin (name), name);
+}
+
+/// Stop timing the innermost zone.
+// @function finish
+// @string[opt] name Zone name, checked against the open zone if given
+// @within Zones
+static int f_finish (lua_State* L) {
+    const char* name = lua_tostring (L, 1);
+    return check_result (L, ProfileThread::current().finish (name), name);
+}
+
+/// Record zones as trace events for @{dump}.
+// Each thread keeps its most recent 8192 events.
+// @function trace
+// @bool enabled Start or stop recording
+// @treturn bool Whether recording was enabled
+// @within Zones
+static int f_trace (lua_State* L) {
+    lua_pushboolean (L, ProfileThread::tracing().exchange (lua_toboolean (L, 1) != 0));
+    return 1;
+}
+
+/// Monotonic time in microseconds.
+// Uses the same clock as the zones.
+// @function now
+// @treturn number
+// @within Zones
+static int f_now (lua_State* L) {
+    lua_pushnumber (L, (double) (ProfileClock::now() - ProfileClock::origin()) / ProfileClock::ticks_per_us());
+    return 1;
+}
+
+/// Sampling.
+// @section sampling
+
+/// Start sampling this state.
+// Installs a count hook, replacing any other hook. Only the calling
+// thread is sampled, not other coroutines.
+// @function start
+// @int[opt] period Instructions between samples (default 1000)
+// @within Sampling
+static int f_start (lua_State* L) {
+    tosampler (L)->start (L, static_cast<int> (luaL_optinteger (L, 1, 1000)));
+    return 0;
+}
+
+/// Stop sampling and remove the hook.
+// @function stop
+// @within Sampling
+static int f_stop (lua_State* L) {
+    tosampler (L)->stop (L);
+    return 0;
+}
+
+/// Reports.
+// @section reports
+
+/// Summarize zones and samples.
+// Zones are merged across threads and sorted by total time. Each has
+// `name`, `count`, and `total`, `mean`, `p50`, `p99` and `max` in
+// microseconds. Percentiles are accurate to about ten percent.
+// Samples are sorted by count, each with `source`, `line`, `name` and
+// `count`. Allocates, so call it outside the audio thread.
+// @function report
+// @treturn table With `zones`, `samples`, `nsamples` and `dropped`
+// @within Reports
+// @usage
+// for _, z in ipairs (profile.report().zones) do
+//     print (z.name, z.count, z.p50, z.p99, z.max)
+// end
+static int f_report (lua_State* L) {
+    const double tpu = ProfileClock::ticks_per_us();
+    auto zones = summarize_zones();
+    std::vector<std::pair<std::string, ZoneSummary*>> sorted;
+    for (auto& z : zones)
+        if (z.second.count > 0)
+            sorted.push_back ({ z.first, &z.second });
+    std::sort (sorted.begin(), sorted.end(), [] (const auto& a, const auto& b) {
+        return a.second->total > b.second->total;
+    });
+
+    lua_createtable (L, 0, 4);
+    lua_createtable (L, (int) sorted.size(), 0);
+    int index = 0;
+    for (const auto& z : sorted) {
+        const auto& s = *z.second;
+        lua_createtable (L, 0, 7);
+        lua_pushstring (L, z.first.c_str());                        lua_setfield (L, -2, "name");
+        lua_pushinteger (L, (lua_Integer) s.count);                 lua_setfield (L, -2, "count");
+        lua_pushnumber (L, (double) s.total / tpu);                 lua_setfield (L, -2, "total");
+        lua_pushnumber (L, (double) s.total / tpu / (double) s.count); lua_setfield (L, -2, "mean");
+        lua_pushnumber (L, s.percentile (0.5) / tpu);               lua_setfield (L, -2, "p50");
+        lua_pushnumber (L, s.percentile (0.99) / tpu);              lua_setfield (L, -2, "p99");
+        lua_pushnumber (L, (double) s.max / tpu);                   lua_setfield (L, -2, "max");
+        lua_rawseti (L, -2, ++index);
+    }
+    lua_setfield (L, -2, "zones");
+
+    auto* sampler = tosampler (L);
+    std::vector<const ProfileSampler::Entry*> samples;
+    sampler->for_each ([&samples] (const ProfileSampler::Entry& e) { samples.push_back (&e); });
+    std::sort (samples.begin(), samples.end(), [] (const auto* a, const auto* b) {
+        return a->count > b->count;
+    });
+
+    lua_createtable (L, (int) samples.size(), 0);
+    index = 0;
+    for (const auto* e : samples) {
+        lua_createtable (L, 0, 4);
+        lua_pushstring (L, e->where);                   lua_setfield (L, -2, "source");
+        lua_pushinteger (L, e->line);                   lua_setfield (L, -2, "line");
+        lua_pushstring (L, e->name);                    lua_setfield (L, -2, "name");
+        lua_pushinteger (L, (lua_Integer) e->count);    lua_setfield (L, -2, "count");
+        lua_rawseti (L, -2, ++index);
+    }
+    lua_setfield (L, -2, "samples");
+
+    lua_pushinteger (L, (lua_Integer) sampler->get_total());
+    lua_setfield (L, -2, "nsamples");
+    lua_pushinteger (L, (lua_Integer) sampler->get_dropped());
+    lua_setfield (L, -2, "dropped");
+    return 1;
+}
+
+/// Clear zone totals, trace events and samples.
+// Zone totals on other threads are cleared too; do it while they are idle.
+// @function reset
+// @within Reports
+static int f_reset (lua_State* L) {
+    for (auto* t = ProfileThread::first(); t != nullptr; t = t->get_next())
+        t->clear();
+    tosampler (L)->clear();
+    return 0;
+}
+
+/// Recorded trace events as Chrome trace JSON.
+// @function tojson
+// @treturn string
+// @within Reports
+static int f_tojson (lua_State* L) {
+    const auto json = chrome_trace();
+    lua_pushlstring (L, json.data(), json.size());
+    return 1;
+}
+
+/// Write recorded trace events to a file as Chrome trace JSON.
+// @function dump
+// @tparam kv.File|string file Destination, replaced if it exists
+// @treturn bool True if written
+// @within Reports
+// @usage
+// profile.trace (true)
+// -- run some blocks
+// profile.dump (kv.File ("/tmp/trace.json"))
+static int f_dump (lua_State* L) {
+    juce::File file;
+    if (lua_type (L, 1) == LUA_TSTRING)
+        file = juce::File (juce::String::fromUTF8 (lua_tostring (L, 1)));
+    else if (sol::stack::check<juce::File> (L, 1))
+        file = sol::stack::get<juce::File> (L, 1);
+    else
+        return luaL_typeerror (L, 1, "kv.File or string");
+
+    lua_pushboolean (L, file.replaceWithText (juce::String (chrome_trace())));
+    return 1;
+}
+
+static int sampler_free (lua_State* L) {
+    auto** sampler = (ProfileSampler**) lua_touserdata (L, 1);
+    if (nullptr != *sampler) {
+        delete (*sampler);
+        *sampler = nullptr;
+    }
+    return 0;
+}
+
+static const luaL_Reg profile_f[] = {
+    { "begin",          f_begin },
+    { "finish",         f_finish },
+    { "trace",          f_trace },
+    { "now",            f_now },
+    { "start",          f_start },
+    { "stop",           f_stop },
+    { "report",         f_report },
+    { "reset",          f_reset },
+    { "tojson",         f_tojson },
+    { "dump",           f_dump },
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_profile (lua_State* L) {
+    ProfileClock::init();
+
+    // one sampler per state, found by the hook through the registry
+    if (lua_rawgetp (L, LUA_REGISTRYINDEX, ProfileSampler::registry_key()) == LUA_TNIL) {
+        lua_pop (L, 1);
+        auto** sampler = (ProfileSampler**) lua_newuserdatauv (L, sizeof (ProfileSampler**), 0);
+        *sampler = new ProfileSampler();
+        if (luaL_newmetatable (L, LKV_MT_PROFILE_SAMPLER)) {
+            lua_pushcfunction (L, sampler_free);
+            lua_setfield (L, -2, "__gc");
+        }
+        lua_setmetatable (L, -2);
+        lua_pushvalue (L, -1);
+        lua_rawsetp (L, LUA_REGISTRYINDEX, ProfileSampler::registry_key());
+    }
+
+    luaL_newlibtable (L, profile_f);
+    lua_insert (L, -2);
+    luaL_setfuncs (L, profile_f, 1);
+    return 1;
+}
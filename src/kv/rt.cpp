@@ -0,0 +1,619 @@
+/// Real time helpers.
+// Controls when the garbage collector runs so it doesn't fire in the middle
+// of an audio callback. Switch the state to manual collection, then give the
+// collector a time budget in the slack after each block with @{idle}, or
+// wrap the process function with @{wrap} to do it automatically.
+//
+// In manual mode nothing is collected unless @{idle} runs, so call it for
+// every block.
+//
+// The guard catches code that isn't safe for the audio thread. A function
+// wrapped with @{guard} counts allocations, calls into blocking functions
+// and deadline overruns on every call. Native hosts can receive each
+// result with `kv_rt_set_guard_callback`.
+// @module kv.rt
+// @pragma nostrip
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "lua-kv.hpp"
+
+namespace {
+
+enum GCMode {
+    Incremental = 0,
+    Generational,
+    Manual
+};
+
+const char* const mode_names[] = { "incremental", "generational", "manual", nullptr };
+
+struct GCState {
+    int mode { Incremental };
+    int stepkb { 0 };
+
+    lua_Number time { 0.0 };            // last block, microseconds
+    lua_Integer reclaimed { 0 };        // last block, bytes
+    lua_Integer steps { 0 };            // last block
+    lua_Number total_time { 0.0 };
+    lua_Integer total_reclaimed { 0 };
+    lua_Integer cycles { 0 };
+    lua_Integer blocks { 0 };
+};
+
+#define togcstate(L) ((GCState*) lua_touserdata (L, lua_upvalueindex (1)))
+
+lua_Integer memory_bytes (lua_State* L) {
+    return (lua_Integer) lua_gc (L, LUA_GCCOUNT, 0) * 1024
+         + (lua_Integer) lua_gc (L, LUA_GCCOUNTB, 0);
+}
+
+/** Step the collector until the budget runs out or a cycle completes */
+void collect (lua_State* L, GCState* state, lua_Number budget, int stepkb) {
+    using clock = std::chrono::steady_clock;
+    state->time = 0.0;
+    state->reclaimed = 0;
+    state->steps = 0;
+    ++state->blocks;
+    if (budget <= 0.0)
+        return;
+
+    const auto before = memory_bytes (L);
+    const auto start  = clock::now();
+    bool finished = false;
+
+    do {
+        finished = lua_gc (L, LUA_GCSTEP, stepkb) != 0;
+        ++state->steps;
+        state->time = std::chrono::duration<lua_Number, std::micro> (clock::now() - start).count();
+    } while (! finished && state->time < budget);
+
+    if (finished)
+        ++state->cycles;
+    const auto after = memory_bytes (L);
+    state->reclaimed = before > after ? before - after : 0;
+    state->total_time += state->time;
+    state->total_reclaimed += state->reclaimed;
+}
+
+/** Counts heap allocations made by this library while a guard is active.
+    Only on Linux builds with LKV_RT_GUARD_HEAP, where the linker routes
+    this library's malloc and operator new calls, including JUCE's,
+    through the wrappers below.
+*/
+thread_local bool heap_guarded = false;
+thread_local int heap_allocs = 0;
+
+struct GuardState {
+    lua_Alloc alloc { nullptr };        // the state's allocator while guarding
+    void* alloc_ud { nullptr };
+    lua_Hook hook { nullptr };          // hook that was set before guarding
+    int hook_mask { 0 }, hook_count { 0 };
+    bool active { false };
+
+    kv_rt_guard_report_t block {};      // current or last call
+    char blocking_name[64] {};
+
+    lua_Integer blocks { 0 }, allocs { 0 }, heap { 0 }, blocking { 0 }, overruns { 0 };
+    lua_Number max_time { 0.0 };
+    char first_blocking[64] {};
+
+    kv_rt_guard_callback_t callback { nullptr };
+    void* user { nullptr };
+};
+
+#define toguard(L) ((GuardState*) lua_touserdata (L, lua_upvalueindex (2)))
+
+const char guard_key = 0;
+
+/** Default modules with functions that block or touch the GUI */
+const char* const blocking_modules[] = {
+    "kv.File", "kv.Desktop", "kv.DocumentWindow", "kv.Graphics",
+    "kv.Slider", "kv.TextButton", "kv.Widget", "io", nullptr
+};
+
+/** Blocking functions from the standard library's base and os tables */
+const char* const blocking_globals[] = {
+    "print", "require", "dofile", "loadfile", nullptr
+};
+
+const char* const blocking_os[] = {
+    "execute", "exit", "getenv", "remove", "rename", "tmpname", nullptr
+};
+
+void* guard_alloc (void* ud, void* ptr, size_t osize, size_t nsize) {
+    auto* guard = (GuardState*) ud;
+    if (nsize > 0 && (ptr == nullptr || nsize > osize))
+        ++guard->block.allocs;
+    return guard->alloc (guard->alloc_ud, ptr, osize, nsize);
+}
+
+void guard_hook (lua_State* L, lua_Debug* ar) {
+    lua_rawgetp (L, LUA_REGISTRYINDEX, &guard_key);
+    auto* guard = (GuardState*) lua_touserdata (L, -1);
+    if (guard == nullptr) {
+        lua_pop (L, 1);
+        return;
+    }
+
+    if (ar->event == LUA_HOOKCALL || ar->event == LUA_HOOKTAILCALL) {
+        lua_getiuservalue (L, -1, 1);
+        lua_getinfo (L, "f", ar);
+        if (lua_iscfunction (L, -1) && lua_rawget (L, -2) == LUA_TSTRING) {
+            if (guard->block.blocking++ == 0) {
+                std::strncpy (guard->blocking_name, lua_tostring (L, -1), sizeof (guard->blocking_name) - 1);
+                guard->block.blocking_name = guard->blocking_name;
+            }
+        }
+        lua_pop (L, 2);
+    }
+    lua_pop (L, 1);
+
+    // pass events on to a hook that was already set
+    const int mask = ar->event == LUA_HOOKTAILCALL ? LUA_MASKCALL : (1 << ar->event);
+    if (guard->hook != nullptr && (guard->hook_mask & mask) != 0)
+        guard->hook (L, ar);
+}
+
+/** Add a function, or every function in a table and its metatable */
+void add_blocking (lua_State* L, int set, int value, const char* label) {
+    value = lua_absindex (L, value);
+    if (lua_iscfunction (L, value)) {
+        lua_pushvalue (L, value);
+        lua_pushstring (L, label);
+        lua_rawset (L, set);
+        return;
+    }
+    if (! lua_istable (L, value))
+        return;
+
+    lua_pushnil (L);
+    while (lua_next (L, value) != 0) {
+        if (lua_iscfunction (L, -1) && lua_type (L, -2) == LUA_TSTRING) {
+            lua_pushvalue (L, -1);
+            lua_pushfstring (L, "%s.%s", label, lua_tostring (L, -3));
+            lua_rawset (L, set);
+        }
+        lua_pop (L, 1);
+    }
+
+    if (lua_getmetatable (L, value)) {
+        if (lua_getfield (L, -1, "__call") != LUA_TNIL)
+            add_blocking (L, set, -1, label);
+        lua_pop (L, 2);
+    }
+}
+
+/** Add the default blocking modules that are loaded */
+void add_default_blocking (lua_State* L, int set) {
+    lua_getfield (L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    for (const char* const* name = blocking_modules; *name != nullptr; ++name) {
+        lua_getfield (L, -1, *name);
+        add_blocking (L, set, -1, *name);
+        lua_pop (L, 1);
+    }
+
+    lua_getfield (L, -1, "os");
+    if (lua_istable (L, -1)) {
+        for (const char* const* name = blocking_os; *name != nullptr; ++name) {
+            lua_getfield (L, -1, *name);
+            lua_pushfstring (L, "os.%s", *name);
+            add_blocking (L, set, -2, lua_tostring (L, -1));
+            lua_pop (L, 2);
+        }
+    }
+    lua_pop (L, 2);
+
+    lua_pushglobaltable (L);
+    for (const char* const* name = blocking_globals; *name != nullptr; ++name) {
+        lua_getfield (L, -1, *name);
+        add_blocking (L, set, -1, *name);
+        lua_pop (L, 1);
+    }
+    lua_pop (L, 1);
+}
+
+void guard_begin (lua_State* L, GuardState* guard) {
+    guard->block = {};
+    guard->blocking_name[0] = 0;
+    guard->alloc = lua_getallocf (L, &guard->alloc_ud);
+    lua_setallocf (L, guard_alloc, guard);
+    guard->hook = lua_gethook (L);
+    guard->hook_mask = lua_gethookmask (L);
+    guard->hook_count = lua_gethookcount (L);
+    lua_sethook (L, guard_hook, guard->hook_mask | LUA_MASKCALL, guard->hook_count);
+    heap_allocs = 0;
+    heap_guarded = true;
+    guard->active = true;
+}
+
+void guard_end (lua_State* L, GuardState* guard, lua_Number time, lua_Number budget) {
+    heap_guarded = false;
+    lua_sethook (L, guard->hook, guard->hook_mask, guard->hook_count);
+    lua_setallocf (L, guard->alloc, guard->alloc_ud);
+    guard->active = false;
+
+    auto& block = guard->block;
+    block.heap_allocs = heap_allocs;
+    block.time_us = time;
+    block.budget_us = budget;
+    block.overrun = time > budget;
+
+    ++guard->blocks;
+    guard->allocs   += block.allocs;
+    guard->heap     += block.heap_allocs;
+    guard->blocking += block.blocking;
+    if (block.overrun)
+        ++guard->overruns;
+    if (time > guard->max_time)
+        guard->max_time = time;
+    if (block.blocking > 0 && guard->first_blocking[0] == 0)
+        std::memcpy (guard->first_blocking, guard->blocking_name, sizeof (guard->first_blocking));
+
+    if (guard->callback != nullptr)
+        guard->callback (guard->user, &block);
+}
+
+}
+
+#if LKV_RT_GUARD_HEAP && defined (__linux__)
+// the build links with --wrap so this library's malloc calls and
+// operator new calls land here, leaving the rest of the process alone
+extern "C" {
+void* __real_malloc (size_t);
+void* __real_calloc (size_t, size_t);
+void* __real_realloc (void*, size_t);
+void* __real__Znwm (size_t);
+void* __real__Znam (size_t);
+
+void* __wrap_malloc (size_t size) {
+    if (heap_guarded)
+        ++heap_allocs;
+    return __real_malloc (size);
+}
+
+void* __wrap_calloc (size_t count, size_t size) {
+    if (heap_guarded)
+        ++heap_allocs;
+    return __real_calloc (count, size);
+}
+
+void* __wrap_realloc (void* ptr, size_t size) {
+    if (heap_guarded)
+        ++heap_allocs;
+    return __real_realloc (ptr, size);
+}
+
+// operator new (size_t) and operator new[] (size_t)
+void* __wrap__Znwm (size_t size) {
+    if (heap_guarded)
+        ++heap_allocs;
+    return __real__Znwm (size);
+}
+
+void* __wrap__Znam (size_t size) {
+    if (heap_guarded)
+        ++heap_allocs;
+    return __real__Znam (size);
+}
+}
+#endif
+
+/// Garbage collection.
+// @section gc
+
+/// Change how the collector runs.
+// "manual" stops automatic collection; memory is only reclaimed by
+// @{idle}. "generational" and "incremental" restart automatic collection
+// with the given tuning. @{idle} works in every mode.
+// @function setgc
+// @string mode "manual", "generational" or "incremental"
+// @int[opt] a Step size in KB for manual mode (default 0, one basic step),
+// minor multiplier for generational, pause for incremental. 0 keeps the
+// current setting.
+// @int[opt] b Major multiplier for generational, step multiplier for
+// incremental. 0 keeps the current setting.
+// @treturn string The previous mode
+// @within GC
+// @usage
+// rt.setgc ("manual")
+static int f_setgc (lua_State* L) {
+    auto* state = togcstate (L);
+    const int mode = luaL_checkoption (L, 1, nullptr, mode_names);
+    const int a = static_cast<int> (luaL_optinteger (L, 2, 0));
+    const int b = static_cast<int> (luaL_optinteger (L, 3, 0));
+    lua_pushstring (L, mode_names[state->mode]);
+
+    switch (mode) {
+        case Manual:
+            lua_gc (L, LUA_GCSTOP, 0);
+            state->stepkb = a > 0 ? a : 0;
+            break;
+        case Generational:
+            lua_gc (L, LUA_GCGEN, a, b);
+            lua_gc (L, LUA_GCRESTART, 0);
+            break;
+        case Incremental:
+            lua_gc (L, LUA_GCINC, a, b, 0);
+            lua_gc (L, LUA_GCRESTART, 0);
+            break;
+    }
+
+    state->mode = mode;
+    return 1;
+}
+
+/// Current collector mode.
+// @function gcmode
+// @treturn string "manual", "generational" or "incremental"
+// @within GC
+static int f_gcmode (lua_State* L) {
+    lua_pushstring (L, mode_names[togcstate (L)->mode]);
+    return 1;
+}
+
+/// Run the collector within a time budget.
+// Performs steps until `budget` microseconds have passed or a cycle
+// completes. A step can't be interrupted, so the last one may overrun a
+// little; smaller steps overrun less.
+// @function idle
+// @number budget Time allowed in microseconds
+// @int[opt] stepkb Work per step in KB (default from @{setgc})
+// @treturn number Microseconds spent
+// @treturn int Bytes reclaimed
+// @within GC
+// @usage
+// function process (audio, midi)
+//     render (audio, midi)
+//     rt.idle (200)
+// end
+static int f_idle (lua_State* L) {
+    auto* state = togcstate (L);
+    const auto budget = luaL_checknumber (L, 1);
+    const auto stepkb = static_cast<int> (luaL_optinteger (L, 2, state->stepkb));
+    collect (L, state, budget, stepkb);
+    lua_pushnumber (L, state->time);
+    lua_pushinteger (L, state->reclaimed);
+    return 2;
+}
+
+static int wrapped_call (lua_State* L) {
+    auto* state = togcstate (L);
+    const int nargs = lua_gettop (L);
+    lua_pushvalue (L, lua_upvalueindex (2));
+    lua_insert (L, 1);
+    lua_call (L, nargs, LUA_MULTRET);
+    collect (L, state, lua_tonumber (L, lua_upvalueindex (3)),
+             static_cast<int> (lua_tointeger (L, lua_upvalueindex (4))));
+    return lua_gettop (L);
+}
+
+/// Wrap a function to collect garbage after each call.
+// The returned function passes its arguments and results through, then
+// runs @{idle} with the budget.
+// @function wrap
+// @func fn Function to wrap, usually a process callback
+// @number budget Time allowed per call in microseconds
+// @int[opt] stepkb Work per step in KB (default from @{setgc})
+// @treturn function
+// @within GC
+// @usage
+// process = rt.wrap (process, 200)
+static int f_wrap (lua_State* L) {
+    auto* state = togcstate (L);
+    luaL_checktype (L, 1, LUA_TFUNCTION);
+    const auto budget = luaL_checknumber (L, 2);
+    const auto stepkb = luaL_optinteger (L, 3, state->stepkb);
+    lua_pushvalue (L, lua_upvalueindex (1));
+    lua_pushvalue (L, 1);
+    lua_pushnumber (L, budget);
+    lua_pushinteger (L, stepkb);
+    lua_pushcclosure (L, wrapped_call, 4);
+    return 1;
+}
+
+/// Collector statistics.
+// Fields `time`, `reclaimed` and `steps` describe the last @{idle} call;
+// `totaltime`, `totalreclaimed`, `cycles` and `blocks` accumulate since the
+// last @{resetstats}. Times are in microseconds and sizes in bytes.
+// @function stats
+// @tparam[opt] table t Table to fill instead of making a new one
+// @treturn table
+// @within GC
+static int f_stats (lua_State* L) {
+    auto* state = togcstate (L);
+    if (lua_istable (L, 1))
+        lua_settop (L, 1);
+    else
+        lua_createtable (L, 0, 7);
+
+    lua_pushnumber (L, state->time);                lua_setfield (L, -2, "time");
+    lua_pushinteger (L, state->reclaimed);          lua_setfield (L, -2, "reclaimed");
+    lua_pushinteger (L, state->steps);              lua_setfield (L, -2, "steps");
+    lua_pushnumber (L, state->total_time);          lua_setfield (L, -2, "totaltime");
+    lua_pushinteger (L, state->total_reclaimed);    lua_setfield (L, -2, "totalreclaimed");
+    lua_pushinteger (L, state->cycles);             lua_setfield (L, -2, "cycles");
+    lua_pushinteger (L, state->blocks);             lua_setfield (L, -2, "blocks");
+    return 1;
+}
+
+/// Clear the collector statistics.
+// @function resetstats
+// @within GC
+static int f_resetstats (lua_State* L) {
+    auto* state = togcstate (L);
+    const auto mode = state->mode;
+    const auto stepkb = state->stepkb;
+    *state = GCState();
+    state->mode = mode;
+    state->stepkb = stepkb;
+    return 0;
+}
+
+/// Guard.
+// @section guard
+
+static int guarded_call (lua_State* L) {
+    auto* guard = toguard (L);
+    const int nargs = lua_gettop (L);
+    lua_pushvalue (L, lua_upvalueindex (3));
+    lua_insert (L, 1);
+    if (guard->active) {
+        lua_call (L, nargs, LUA_MULTRET);
+        return lua_gettop (L);
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto budget = lua_tonumber (L, lua_upvalueindex (4));
+    guard_begin (L, guard);
+    const auto start = clock::now();
+    const int status = lua_pcall (L, nargs, LUA_MULTRET, 0);
+    const auto time = std::chrono::duration<lua_Number, std::micro> (clock::now() - start).count();
+    guard_end (L, guard, time, budget);
+
+    if (status != LUA_OK)
+        return lua_error (L);
+    return lua_gettop (L);
+}
+
+/// Wrap a function to check it is safe for the audio thread.
+// Each call of the returned function counts Lua allocations, C++ heap
+// allocations and calls into blocking functions, and checks the call time
+// against the budget. Arguments and results pass through.
+//
+// Blocking functions are those of kv.File, the GUI modules, io, print,
+// require and the os functions that touch the system, as loaded when the
+// guard is made. Add others with @{block}. Heap allocations are only
+// counted in Linux builds configured with `--rt-guard-heap`.
+//
+// Guarding adds overhead to every call it makes, so use it while testing.
+// @function guard
+// @func fn Function to guard, usually a process callback
+// @number budget Deadline per call in microseconds
+// @treturn function
+// @within Guard
+// @usage
+// process = rt.guard (process, 1000000 * blocksize / samplerate)
+static int f_guard (lua_State* L) {
+    luaL_checktype (L, 1, LUA_TFUNCTION);
+    const auto budget = luaL_checknumber (L, 2);
+    lua_getiuservalue (L, lua_upvalueindex (2), 1);
+    add_default_blocking (L, lua_gettop (L));
+    lua_pop (L, 1);
+
+    lua_pushvalue (L, lua_upvalueindex (1));
+    lua_pushvalue (L, lua_upvalueindex (2));
+    lua_pushvalue (L, 1);
+    lua_pushnumber (L, budget);
+    lua_pushcclosure (L, guarded_call, 4);
+    return 1;
+}
+
+/// Treat functions as blocking in guarded calls.
+// @function block
+// @tparam function|table value A C function, or a table of them such as a module
+// @string name Name to report
+// @within Guard
+// @usage
+// rt.block (require ('socket'), 'socket')
+static int f_block (lua_State* L) {
+    const char* name = luaL_checkstring (L, 2);
+    lua_getiuservalue (L, lua_upvalueindex (2), 1);
+    add_blocking (L, lua_gettop (L), 1, name);
+    return 0;
+}
+
+/// Guard statistics.
+// `blocks` counts guarded calls. `allocs`, `heapallocs`, `blocking` and
+// `overruns` are totals over those calls, and `maxtime` is the longest in
+// microseconds. `blockingname` is the first blocking function seen. The
+// `last` fields describe the most recent call.
+// @function guardstats
+// @tparam[opt] table t Table to fill instead of making a new one
+// @treturn table
+// @within Guard
+static int f_guardstats (lua_State* L) {
+    auto* guard = toguard (L);
+    if (lua_istable (L, 1))
+        lua_settop (L, 1);
+    else
+        lua_createtable (L, 0, 12);
+
+    lua_pushinteger (L, guard->blocks);                 lua_setfield (L, -2, "blocks");
+    lua_pushinteger (L, guard->allocs);                 lua_setfield (L, -2, "allocs");
+    lua_pushinteger (L, guard->heap);                   lua_setfield (L, -2, "heapallocs");
+    lua_pushinteger (L, guard->blocking);               lua_setfield (L, -2, "blocking");
+    lua_pushinteger (L, guard->overruns);               lua_setfield (L, -2, "overruns");
+    lua_pushnumber (L, guard->max_time);                lua_setfield (L, -2, "maxtime");
+    if (guard->first_blocking[0] != 0)
+        lua_pushstring (L, guard->first_blocking);
+    else
+        lua_pushnil (L);
+    lua_setfield (L, -2, "blockingname");
+
+    const auto& last = guard->block;
+    lua_pushinteger (L, last.allocs);                   lua_setfield (L, -2, "lastallocs");
+    lua_pushinteger (L, last.heap_allocs);              lua_setfield (L, -2, "lastheapallocs");
+    lua_pushinteger (L, last.blocking);                 lua_setfield (L, -2, "lastblocking");
+    lua_pushnumber (L, last.time_us);                   lua_setfield (L, -2, "lasttime");
+    lua_pushboolean (L, last.overrun);                  lua_setfield (L, -2, "lastoverrun");
+    return 1;
+}
+
+/// Clear the guard statistics.
+// @function resetguard
+// @within Guard
+static int f_resetguard (lua_State* L) {
+    auto* guard = toguard (L);
+    guard->block = {};
+    guard->blocks = guard->allocs = guard->heap = guard->blocking = guard->overruns = 0;
+    guard->max_time = 0.0;
+    guard->first_blocking[0] = 0;
+    return 0;
+}
+
+static GuardState* push_guard_state (lua_State* L) {
+    if (lua_rawgetp (L, LUA_REGISTRYINDEX, &guard_key) == LUA_TUSERDATA)
+        return (GuardState*) lua_touserdata (L, -1);
+    lua_pop (L, 1);
+
+    auto* guard = (GuardState*) lua_newuserdatauv (L, sizeof (GuardState), 1);
+    new (guard) GuardState();
+    lua_newtable (L);
+    lua_setiuservalue (L, -2, 1);
+    lua_pushvalue (L, -1);
+    lua_rawsetp (L, LUA_REGISTRYINDEX, &guard_key);
+    return guard;
+}
+
+void kv_rt_set_guard_callback (lua_State* L, kv_rt_guard_callback_t callback, void* user) {
+    auto* guard = push_guard_state (L);
+    guard->callback = callback;
+    guard->user = user;
+    lua_pop (L, 1);
+}
+
+static const luaL_Reg rt_f[] = {
+    { "setgc",          f_setgc },
+    { "gcmode",         f_gcmode },
+    { "idle",           f_idle },
+    { "wrap",           f_wrap },
+    { "stats",          f_stats },
+    { "resetstats",     f_resetstats },
+    { "guard",          f_guard },
+    { "block",          f_block },
+    { "guardstats",     f_guardstats },
+    { "resetguard",     f_resetguard },
+    { NULL, NULL }
+};
+
+LKV_EXPORT
+int luaopen_kv_rt (lua_State* L) {
+    luaL_newlibtable (L, rt_f);
+    auto* state = (GCState*) lua_newuserdatauv (L, sizeof (GCState), 0);
+    new (state) GCState();
+    push_guard_state (L);
+    luaL_setfuncs (L, rt_f, 2);
+    return 1;
+}
@@ -14,14 +14,11 @@ OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 PERFORMANCE OF THIS SOFTWARE.
 */
 
-#if 0
-
 /// A vector of `kv_sample_t`'s suitable for realtime
 // @module kv.vector
 #include <stdlib.h>
 #include <string.h>
-#include "luainc.h"
-#include "vector.h"
+#include <lauxlib.h>
 #include "util.h"
 #include "lua-kv.h"
 
@@ -89,8 +86,10 @@ void kv_vector_resize (kv_vector_t* vec, int size) {
     if (size <= vec->size) {
         vec->used = size;
     } else {
+        lua_Integer old = vec->size;
         vec->used = vec->size = size;
         vec->values = realloc (vec->values, sizeof(kv_sample_t) * vec->size);
+        memset (vec->values + old, 0, sizeof(kv_sample_t) * (size - old));
     }
 }
 
@@ -101,7 +100,7 @@ static int vector_gc (lua_State* L) {
 
 static int vector_len (lua_State* L) {
     Vector* vec = lua_touserdata (L, 1);
-    lua_pushinteger (L, vec->size);
+    lua_pushinteger (L, vec->used);
     return 1;
 }
 
@@ -128,7 +127,7 @@ static int vector_newindex (lua_State* L) {
 
 static int vector_tostring (lua_State* L) {
     Vector* vec = lua_touserdata (L, 1);
-    lua_pushfstring (L, "Vector: size=%d capacity=%d", vec->used, vec->size);
+    lua_pushfstring (L, "Vector: size=%I capacity=%I", vec->used, vec->size);
     return 1;
 }
 
@@ -176,6 +175,13 @@ static int f_clear (lua_State* L) {
 // @param size Number of elements to allocate memory for
 // @function reserve
 static int f_reserve (lua_State* L) {
+    kv_vector_t* vec = luaL_checkudata (L, 1, LKV_MT_VECTOR);
+    lua_Integer size = luaL_checkinteger (L, 2);
+    if (size > vec->size) {
+        vec->values = realloc (vec->values, sizeof(kv_sample_t) * size);
+        memset (vec->values + vec->size, 0, sizeof(kv_sample_t) * (size - vec->size));
+        vec->size = size;
+    }
     return 0;
 }
 
@@ -184,14 +190,36 @@ static int f_reserve (lua_State* L) {
 // @param size The new number of elements to allocate
 // @function resize
 static int f_resize (lua_State* L) {
+    kv_vector_t* vec = luaL_checkudata (L, 1, LKV_MT_VECTOR);
+    kv_vector_resize (vec, (int) luaL_checkinteger (L, 2));
     return 0;
 }
 
+/// Number of elements in use
+// @param vec The vector
+// @function size
+static int f_size (lua_State* L) {
+    kv_vector_t* vec = luaL_checkudata (L, 1, LKV_MT_VECTOR);
+    lua_pushinteger (L, vec->used);
+    return 1;
+}
+
+/// Number of elements allocated
+// @param vec The vector
+// @function capacity
+static int f_capacity (lua_State* L) {
+    kv_vector_t* vec = luaL_checkudata (L, 1, LKV_MT_VECTOR);
+    lua_pushinteger (L, vec->size);
+    return 1;
+}
+
 static const luaL_Reg vector_f[] = {
     { "new",        f_new },
     { "clear",      f_clear },
     { "reserve",    f_reserve },
     { "resize",     f_resize },
+    { "size",       f_size },
+    { "capacity",   f_capacity },
     { NULL, NULL }
 };
 
@@ -199,6 +227,7 @@ void kv_vector_metatable (lua_State* L) {
     if (0 != luaL_newmetatable (L, LKV_MT_VECTOR)) {
         luaL_setfuncs (L, vector_m, 0);
     }
+    lua_pop (L, 1);
 }
 
 LKV_EXPORT 
@@ -207,5 +236,3 @@ int luaopen_kv_vector (lua_State* L) {
     luaL_newlib (L, vector_f);
     return 1;
 }
-
-#endif
@@ -62,6 +62,17 @@ extern "C" {
 #define LKV_MT_MIDI_PIPE                    "kv.MidiPipe"
 #define LKV_MT_VECTOR                       "kv.Vector"
 
+/** Registry field holding the handler version of kv.object: a userdata
+    with one lua_Integer, incremented whenever a function is assigned to
+    or removed from an object type */
+#define LKV_REG_OBJECT_VERSION              "kv.object.version"
+
+/** Metatable field of a proxy backed by userdata whose handlers are cached: a
+    userdata with one lua_Integer, incremented whenever a function is
+    assigned to or removed from that instance. A proxy with this field
+    keeps every field it is given aside, so each assignment is seen */
+#define LKV_OBJECT_VERSION_FIELD            "__version"
+
 #if LKV_FORCE_FLOAT32
 typedef float                               kv_sample_t;
 #else
@@ -238,6 +249,29 @@ void kv_midi_pipe_resize (lua_State* L, kv_midi_pipe_t*, int);
 /** Returns a buffer from the list */
 kv_midi_buffer_t* kv_midi_pipe_get (kv_midi_pipe_t*, int);
 
+//=============================================================================
+/** Result of one call made by a function from `kv.rt.guard` */
+typedef struct {
+    int         allocs;         /**< Lua allocations, including growth */
+    int         heap_allocs;    /**< Heap allocations in this library. Needs LKV_RT_GUARD_HEAP on Linux */
+    int         blocking;       /**< Calls into blocking functions */
+    const char* blocking_name;  /**< First blocking function called, or NULL */
+    double      time_us;        /**< Duration of the call in microseconds */
+    double      budget_us;      /**< Deadline of the call in microseconds */
+    bool        overrun;        /**< True if the deadline was missed */
+} kv_rt_guard_report_t;
+
+typedef void (*kv_rt_guard_callback_t) (void* user, const kv_rt_guard_report_t* report);
+
+/** Set a function called after every guarded call in this state.
+    It is called on the thread that made the call, usually the audio
+    thread, and the report is only valid during the callback.
+    @param L        The lua state
+    @param callback Function to call, or NULL to remove
+    @param user     Passed to the callback
+*/
+void kv_rt_set_guard_callback (lua_State* L, kv_rt_guard_callback_t callback, void* user);
+
 //=============================================================================
 /** Open all libraries
     @param L    The Lua state
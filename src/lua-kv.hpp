@@ -8,6 +8,19 @@
  #define LKV_JUCE_HEADER "JuceHeader.h"
 #endif
 
+/** Compiles a function once per instruction set and picks one at load time.
+    Used on the block kernels so a single binary uses AVX2 or AVX-512 where
+    the host has it. Needs GCC or Clang on x86-64 ELF, where the loader
+    resolves the variants; elsewhere it expands to nothing.
+*/
+#ifndef LKV_TARGET_CLONES
+ #if LKV_CPU_DISPATCH && defined (__x86_64__) && defined (__ELF__) && (defined (__GNUC__) || defined (__clang__))
+  #define LKV_TARGET_CLONES __attribute__ ((target_clones ("avx512f", "avx2", "default")))
+ #else
+  #define LKV_TARGET_CLONES
+ #endif
+#endif
+
 namespace kv {
 namespace lua {
     /** Removes a field from the table then clears it.
@@ -1,4 +1,6 @@
 local AudioBuffer       = require ('kv.AudioBuffer')
+local AudioBuffer32     = require ('kv.AudioBuffer32')
+local AudioBuffer64     = require ('kv.AudioBuffer64')
 local round             = require ('kv.round')
 
 TestAudioBuffer = {
@@ -38,6 +40,50 @@ TestAudioBuffer = {
         luaunit.assertTrue (buf:cleared())
     end,
 
+    testShare = function()
+        local writer = AudioBuffer.new32 (2, 16)
+        writer:set (1, 1, 0.5)
+        local handle = writer:share()
+        luaunit.assertError (writer.share, writer)
+
+        local reader = AudioBuffer32.import (handle)
+        luaunit.assertError (AudioBuffer32.import, handle)
+        luaunit.assertError (AudioBuffer64.import, handle)
+        luaunit.assertEquals (reader:channels(), 2)
+        luaunit.assertEquals (reader:length(), 16)
+        luaunit.assertEquals (reader:get (1, 1), 0.5)
+        luaunit.assertFalse (reader:fetch())
+
+        for block = 1, 4 do
+            writer:set (2, 16, block)
+            writer:publish()
+            luaunit.assertEquals (writer:length(), 16)
+        end
+        luaunit.assertTrue (reader:fetch())
+        luaunit.assertEquals (reader:get (2, 16), 4.0)
+        luaunit.assertFalse (reader:fetch())
+
+        -- either end may go first
+        writer = nil
+        collectgarbage()
+        luaunit.assertEquals (reader:get (2, 16), 4.0)
+        luaunit.assertFalse (reader:fetch())
+    end,
+
+    testShareHandle = function()
+        luaunit.assertError (AudioBuffer32.import, AudioBuffer.new32 (1, 1))
+        luaunit.assertError (AudioBuffer32.import, io.stdout)
+
+        -- a handle collected without import releases its reference
+        local writer = AudioBuffer.new32 (1, 4)
+        local handle = writer:share()
+        handle = nil
+        collectgarbage()
+        writer:set (1, 1, 0.25)
+        writer:publish()
+        luaunit.assertError (writer.share, writer)
+    end,
+
     tearDown = function()
         collectgarbage()
     end
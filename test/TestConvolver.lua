@@ -0,0 +1,100 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Convolver         = require ('kv.dsp.Convolver')
+
+local function noise (nchans, nframes, seed)
+    local buf = AudioBuffer.new64 (nchans, nframes)
+    local x = seed
+    for c = 1, nchans do
+        for f = 1, nframes do
+            x = (x * 1103515245 + 12345) % 2147483648
+            buf:set (c, f, x / 1073741824 - 1.0)
+        end
+    end
+    return buf
+end
+
+local function direct (input, ir, c, f)
+    local sum = 0
+    for k = 1, math.min (f, ir:length()) do
+        sum = sum + ir:get (1, k) * input:get (c, f - k + 1)
+    end
+    return sum
+end
+
+TestConvolver = {
+    testNew = function()
+        local conv = Convolver.new (noise (1, 100, 1), 2, 30)
+        luaunit.assertEquals (conv:channels(), 2)
+        luaunit.assertEquals (conv:length(), 100)
+        luaunit.assertEquals (conv:headsize(), 32)
+        luaunit.assertEquals (conv:tailsize(), 0)
+        luaunit.assertEquals (Convolver.new (noise (1, 2000, 1), 1, 16):tailsize(), 256)
+    end,
+
+    testImpulse = function()
+        local ir = noise (1, 40, 3)
+        local conv = Convolver.new (ir, 1, 16)
+        local buf = AudioBuffer.new32 (1, 64)
+        buf:clear()
+        buf:set (1, 1, 1.0)
+        conv:process (buf)
+        for f = 1, 40 do
+            luaunit.assertAlmostEquals (buf:get (1, f), ir:get (1, f), 1.0e-5)
+        end
+        for f = 41, 64 do
+            luaunit.assertAlmostEquals (buf:get (1, f), 0, 1.0e-5)
+        end
+    end,
+
+    testManyChannels = function()
+        -- more tail jobs in flight than the worker queue holds
+        local nchans = 1100
+        local ir = noise (1, 300, 5)
+        local conv = Convolver.new (ir, nchans, 8)
+        luaunit.assertEquals (conv:tailsize(), 128)
+        local buf = AudioBuffer.new32 (nchans, 300)
+        buf:clear()
+        for c = 1, nchans do buf:set (c, 1, 1.0) end
+        conv:process (buf)
+        for _, c in ipairs ({ 1, nchans }) do
+            for f = 1, 300 do
+                luaunit.assertAlmostEquals (buf:get (c, f), ir:get (1, f), 1.0e-4)
+            end
+        end
+    end,
+
+    testLongResponse = function()
+        local ir = noise (1, 1200, 7)
+        local input = noise (2, 1500, 11)
+        local buf = AudioBuffer.new64 (2, 1500)
+        for c = 1, 2 do
+            for f = 1, 1500 do buf:set (c, f, input:get (c, f)) end
+        end
+
+        -- odd block sizes cross every partition boundary
+        local conv = Convolver.new (ir, 2, 16)
+        local start = 1
+        for _, n in ipairs ({ 7, 100, 1, 256, 333, 803 }) do
+            conv:process (buf, start, n)
+            start = start + n
+        end
+
+        for c = 1, 2 do
+            for f = 1, 1500, 37 do
+                luaunit.assertAlmostEquals (buf:get (c, f), direct (input, ir, c, f), 1.0e-3)
+            end
+        end
+    end,
+
+    testReset = function()
+        local conv = Convolver.new (noise (1, 600, 5), 1, 8)
+        local buf = noise (1, 512, 9)
+        conv:process (buf)
+        conv:reset()
+        buf:clear()
+        conv:process (buf)
+        for f = 1, 512 do
+            luaunit.assertEquals (buf:get (1, f), 0)
+        end
+    end
+}
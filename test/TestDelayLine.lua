@@ -0,0 +1,124 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local DelayLine         = require ('kv.dsp.DelayLine')
+local vector            = require ('kv.vector')
+
+local function impulse (nframes)
+    local buf = AudioBuffer.new64 (1, nframes)
+    buf:clear()
+    buf:set (1, 1, 1.0)
+    return buf
+end
+
+TestDelayLine = {
+    testNew = function()
+        local delay = DelayLine.new (2, 1000)
+        luaunit.assertEquals (delay:channels(), 2)
+        luaunit.assertEquals (delay:maxdelay(), 1000)
+        luaunit.assertEquals (delay:interpolation(), DelayLine.LINEAR)
+    end,
+
+    testIntegerDelay = function()
+        local delay = DelayLine.new (1, 100, 16)
+        local input, output = impulse (16), AudioBuffer.new64 (1, 16)
+        delay:write (input)
+        delay:read (output, 5)
+        for f = 1, 16 do
+            luaunit.assertEquals (output:get (1, f), f == 6 and 1.0 or 0.0)
+        end
+
+        -- across the block boundary
+        input:clear()
+        delay:write (input)
+        delay:read (output, 20)
+        for f = 1, 16 do
+            luaunit.assertEquals (output:get (1, f), f == 5 and 1.0 or 0.0)
+        end
+    end,
+
+    testWrap = function()
+        local delay = DelayLine.new (1, 8, 4)
+        local buf = AudioBuffer.new64 (1, 4)
+        local out = AudioBuffer.new64 (1, 4)
+        local n = 0
+        for block = 1, 20 do
+            for f = 1, 4 do n = n + 1; buf:set (1, f, n) end
+            delay:write (buf)
+            delay:read (out, 7)
+            if block > 2 then
+                for f = 1, 4 do
+                    luaunit.assertEquals (out:get (1, f), buf:get (1, f) - 7)
+                end
+            end
+        end
+    end,
+
+    testMaxBlock = function()
+        local delay = DelayLine.new (1, 8, 4)
+        local buf = AudioBuffer.new64 (1, 8)
+        luaunit.assertErrorMsgContains ("maxblock", delay.write, delay, buf)
+        delay:write (buf, 5, 4)
+    end,
+
+    testFractional = function()
+        for _, mode in ipairs ({ DelayLine.LINEAR, DelayLine.CUBIC }) do
+            local delay = DelayLine.new (1, 64, 32)
+            delay:setinterpolation (mode)
+            local ramp = AudioBuffer.new32 (1, 32)
+            for f = 1, 32 do ramp:set (1, f, f) end
+            local out = AudioBuffer.new32 (1, 32)
+            delay:write (ramp)
+            delay:read (out, 2.5, 5, 8)
+            for f = 5, 12 do
+                luaunit.assertAlmostEquals (out:get (1, f), f - 2.5, 1e-5)
+            end
+        end
+    end,
+
+    testCubicShort = function()
+        -- below one frame the cubic would read frames not yet written
+        local delay = DelayLine.new (1, 64, 8)
+        delay:setinterpolation (DelayLine.CUBIC)
+        local ramp = AudioBuffer.new64 (1, 8)
+        local out = AudioBuffer.new64 (1, 8)
+        local n = 0
+        for block = 1, 4 do
+            for f = 1, 8 do n = n + 1; ramp:set (1, f, n) end
+            delay:write (ramp)
+            delay:read (out, 0.5)
+            if block > 1 then
+                for f = 1, 8 do
+                    luaunit.assertAlmostEquals (out:get (1, f), ramp:get (1, f) - 1, 1e-9)
+                end
+            end
+        end
+    end,
+
+    testAllpass = function()
+        local delay = DelayLine.new (1, 64, 64)
+        delay:setinterpolation (DelayLine.ALLPASS)
+        local input, output = impulse (64), AudioBuffer.new64 (1, 64)
+        delay:write (input)
+        delay:read (output, 3.5)
+        local energy = 0.0
+        for f = 1, 64 do energy = energy + output:get (1, f) ^ 2 end
+        luaunit.assertAlmostEquals (energy, 1.0, 1e-6)
+    end,
+
+    testModulated = function()
+        local delay = DelayLine.new (1, 64, 16)
+        local ramp = AudioBuffer.new64 (1, 16)
+        for f = 1, 16 do ramp:set (1, f, f) end
+        local delays = vector.new (16)
+        for f = 1, 16 do delays[f] = (f - 1) * 0.5 end
+        local out = AudioBuffer.new64 (1, 16)
+        delay:write (ramp)
+        delay:read (out, delays)
+        for f = 1, 16 do
+            luaunit.assertAlmostEquals (out:get (1, f), f - delays[f], 1e-9)
+        end
+    end,
+
+    tearDown = function()
+        collectgarbage()
+    end
+}
@@ -0,0 +1,97 @@
+
+local DisplayList = require ('kv.DisplayList')
+local Graphics    = require ('kv.Graphics')
+local Rectangle   = require ('kv.Rectangle')
+local Widget      = require ('kv.Widget')
+local object      = require ('kv.object')
+
+function test_displaylist_record()
+    local list = DisplayList.new()
+    luaunit.assertEquals (#list, 0)
+
+    list:savestate()
+    list:setcolor (0xff000000)
+    list:fillall()
+    list:fillrect (Rectangle.new (0, 0, 10, 10))
+    list:drawrect (0, 0, 10, 10)
+    list:drawtext ("text", 0, 0, 100, 20)
+    list:translate (4, 4)
+    list:restorestate()
+    luaunit.assertEquals (#list, 8)
+
+    list:clear()
+    luaunit.assertEquals (#list, 0)
+end
+
+function test_displaylist_path()
+    local list = DisplayList.new()
+    list:moveto (0, 0)
+    list:lineto (10, 0)
+    list:quadto (10, 10, 0, 10)
+    list:closepath()
+    list:fillpath()
+    list:strokepath (2)
+    luaunit.assertEquals (#list, 2)
+end
+
+function test_displaylist_image()
+    local list = DisplayList.new()
+    luaunit.assertFalse (list:drawimage ("does/not/exist.png", 0, 0))
+    luaunit.assertEquals (#list, 0)
+end
+
+function test_displaylist_draw()
+    local list = DisplayList.new()
+    list:fillall (0xff0000ff)
+    list:setcolor (0xffff0000)
+    list:fillrect (0, 0, 2, 2)
+
+    local g = Graphics.image (4, 4)
+    g:draw (list)
+    luaunit.assertEquals (g:pixel (0, 0), 0xffff0000)
+    luaunit.assertEquals (g:pixel (3, 3), 0xff0000ff)
+end
+
+function test_displaylist_unbalanced()
+    local list = DisplayList.new()
+    list:restorestate()
+    list:restorestate()
+    list:savestate()
+    list:setcolor (0xffff0000)
+    list:translate (2, 2)
+
+    local g = Graphics.image (4, 4)
+    g:savestate()
+    g:setcolor (0xff00ff00)
+    g:draw (list)
+    -- the caller's color and transform are untouched
+    local dot = DisplayList.new()
+    dot:fillrect (0, 0, 1, 1)
+    g:draw (dot)
+    luaunit.assertEquals (g:pixel (0, 0), 0xff00ff00)
+    g:restorestate()
+end
+
+function test_displaylist_widget()
+    local Panel = object (Widget)
+    local painted = 0
+    function Panel:init() Widget.init (self) end
+    function Panel:paint (g) painted = painted + 1 end
+
+    local panel = object.new (Panel)
+    panel:resize (4, 4)
+    luaunit.assertNil (panel.displaylist)
+
+    local list = DisplayList.new()
+    list:fillall (0xffff0000)
+    panel.displaylist = list
+    luaunit.assertEquals (panel.displaylist, list)
+
+    local g = Graphics.image (4, 4)
+    g:paintwidget (panel)
+    luaunit.assertEquals (g:pixel (2, 2), 0xffff0000)
+    luaunit.assertEquals (painted, 1)
+
+    panel.displaylist = nil
+    luaunit.assertNil (panel.displaylist)
+end
@@ -0,0 +1,227 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Engine            = require ('kv.Engine')
+local MidiBuffer        = require ('kv.MidiBuffer')
+local MidiMessage       = require ('kv.MidiMessage')
+
+-- writes a constant to every output channel
+local function constant (value)
+    return string.format ([[
+        return function (_, out)
+            for c = 1, out:channels() do
+                for f = 1, out:length() do out:set (c, f, %f) end
+            end
+        end
+    ]], value)
+end
+
+-- sums its input channels into every output channel
+local sum = [[
+    return function (ins, out)
+        for f = 1, out:length() do
+            local x = 0.0
+            for c = 1, ins:channels() do x = x + ins:get (c, f) end
+            for c = 1, out:channels() do out:set (c, f, x) end
+        end
+    end
+]]
+
+TestEngine = {
+    testGraph = function()
+        for _, threads in ipairs ({ 1, 4 }) do
+            local engine = Engine.new (threads)
+            luaunit.assertEquals (engine:threads(), threads)
+            local a = engine:add (constant (0.25), 1)
+            local b = engine:add (constant (0.5), 2)
+            local s = engine:add (sum, 1)
+            local g = engine:add ([[
+                return function (ins, out)
+                    for f = 1, out:length() do out:set (1, f, ins:get (1, f) * 2) end
+                end
+            ]], 1)
+            luaunit.assertEquals (engine:nodes(), 4)
+            luaunit.assertTrue (engine:connect (a, s))
+            luaunit.assertTrue (engine:connect (b, s))
+            luaunit.assertTrue (engine:connect (s, g))
+            luaunit.assertFalse (engine:connect (a, s))
+            luaunit.assertFalse (engine:connect (g, a))
+
+            engine:prepare (64)
+            local out = AudioBuffer.new32 (1, 64)
+            for _ = 1, 10 do
+                engine:process (64)
+                engine:output (s, out)
+                luaunit.assertAlmostEquals (out:get (1, 1), 1.25, 1.0e-6)
+                engine:output (g, out)
+                luaunit.assertAlmostEquals (out:get (1, 64), 2.5, 1.0e-6)
+            end
+        end
+    end,
+
+    testCycle = function()
+        local engine = Engine.new (1)
+        local a = engine:add (sum, 1)
+        local b = engine:add (sum, 1)
+        local c = engine:add (sum, 1)
+        luaunit.assertTrue (engine:connect (a, b))
+        luaunit.assertTrue (engine:connect (b, c))
+        luaunit.assertFalse (engine:connect (c, a))
+        luaunit.assertFalse (engine:connect (a, a))
+        luaunit.assertError (engine.connect, engine, a, 4)
+    end,
+
+    testErrors = function()
+        local engine = Engine.new (2)
+        luaunit.assertError (engine.add, engine, "return 1")
+        luaunit.assertError (engine.add, engine, "return function(")
+        local n = engine:add ([[
+            local count = 0
+            return function (_, out)
+                count = count + 1
+                if count == 2 then error ("second block") end
+                out:set (1, 1, 1.0)
+            end
+        ]], 1)
+        luaunit.assertError (engine.process, engine, 16)
+        engine:prepare (16)
+        luaunit.assertError (engine.process, engine, 32)
+
+        local out = AudioBuffer.new32 (1, 16)
+        engine:process (16)
+        luaunit.assertNil (engine:error (n))
+        engine:output (n, out)
+        luaunit.assertEquals (out:get (1, 1), 1.0)
+
+        engine:process (16)
+        luaunit.assertStrContains (engine:error (n), "second block")
+        engine:output (n, out)
+        luaunit.assertEquals (out:get (1, 1), 0.0)
+
+        engine:clearerror (n)
+        engine:process (16)
+        luaunit.assertNil (engine:error (n))
+        engine:output (n, out)
+        luaunit.assertEquals (out:get (1, 1), 1.0)
+    end,
+
+    testMidi = function()
+        local engine = Engine.new (3)
+        local source = engine:add ([[
+            local midi = require ('kv.midi')
+            return function (_, _, _, out)
+                out:insert (midi.noteon (1, 60, 100), 3)
+            end
+        ]], 0)
+        local thru = engine:add ([[
+            return function (_, _, ins, out)
+                for data, size, frame in ins:events() do out:addevent (data, size, frame) end
+            end
+        ]], 0)
+        local merge = engine:add ("return function() end", 0)
+        local count = engine:add ([[
+            return function (_, _, ins, out)
+                out:insert (require ('kv.midi').noteoff (1, ins:size(), 0), 1)
+            end
+        ]], 0)
+        engine:connect (source, thru)
+        engine:connect (thru, count)
+        engine:connect (source, merge)
+        engine:prepare (32)
+
+        for _ = 1, 3 do
+            engine:process (32)
+            -- copied to two inputs, so the source keeps its output
+            local buf = MidiBuffer.new()
+            engine:midi (source, buf)
+            luaunit.assertEquals (buf:size(), 1)
+            for msg, frame in buf:messages() do
+                luaunit.assertEquals (msg:note(), 60)
+                luaunit.assertEquals (frame, 3)
+            end
+
+            -- handed on to its only consumer
+            buf:clear()
+            engine:midi (thru, buf)
+            luaunit.assertEquals (buf:size(), 0)
+
+            engine:midi (count, buf)
+            luaunit.assertEquals (buf:size(), 1)
+            for msg in buf:messages() do
+                luaunit.assertEquals (msg:note(), 1)
+            end
+        end
+        luaunit.assertNil (engine:error (thru))
+        luaunit.assertNil (engine:error (count))
+    end,
+
+    testParallel = function()
+        -- a wide graph gives the same result on any number of threads
+        local function run (threads)
+            local engine = Engine.new (threads)
+            local mix = engine:add (sum, 1)
+            for i = 1, 16 do
+                local n = engine:add (constant (i / 16), 1)
+                engine:connect (n, mix)
+            end
+            engine:prepare (128)
+            local out = AudioBuffer.new32 (1, 128)
+            for _ = 1, 20 do engine:process (128) end
+            engine:output (mix, out)
+            return out:get (1, 128)
+        end
+        luaunit.assertAlmostEquals (run (1), 8.5, 1.0e-5)
+        luaunit.assertAlmostEquals (run (8), 8.5, 1.0e-5)
+    end,
+
+    testPool = function()
+        -- counts blocks, negated if the state ran the script before
+        local counter = [[
+            local fresh = ran == nil
+            ran = true
+            local count = 0
+            return function (_, out)
+                count = count + 1
+                out:set (1, 1, fresh and count or -count)
+            end
+        ]]
+
+        local engine = Engine.new (1)
+        engine:warm (counter, 4)
+        local stats = engine:poolstats()
+        luaunit.assertEquals (stats.size, 4)
+        luaunit.assertEquals (stats.available, 4)
+        luaunit.assertEquals (stats.hitrate, 0.0)
+
+        for _ = 1, 6 do engine:add (counter, 1) end
+        stats = engine:poolstats()
+        luaunit.assertEquals (stats.hits, 4)
+        luaunit.assertEquals (stats.misses, 2)
+        luaunit.assertEquals (stats.size, 6)
+        luaunit.assertEquals (stats.available, 0)
+
+        engine:prepare (8)
+        for _ = 1, 3 do engine:process (8) end
+        local out = AudioBuffer.new32 (1, 8)
+        engine:output (1, out)
+        luaunit.assertEquals (out:get (1, 1), 3.0)
+
+        -- states come back with the script run afresh
+        engine:clear()
+        luaunit.assertEquals (engine:nodes(), 0)
+        luaunit.assertEquals (engine:poolstats().available, 6)
+        local n = engine:add (counter, 1)
+        engine:prepare (8)
+        engine:process (8)
+        engine:output (n, out)
+        luaunit.assertEquals (out:get (1, 1), 1.0)
+
+        stats = engine:poolstats()
+        luaunit.assertEquals (stats.hits, 5)
+        luaunit.assertEquals (stats.misses, 2)
+        luaunit.assertEquals (stats.available, 5)
+        luaunit.assertAlmostEquals (stats.hitrate, 5 / 7, 1.0e-9)
+
+        -- a script that fails doesn't make a pool
+        luaunit.assertError (engine.warm, engine, "return function(", 2)
+        luaunit.assertEquals (engine:poolstats().size, 6)
+    end
+}
@@ -0,0 +1,97 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local EnvelopeBank      = require ('kv.dsp.EnvelopeBank')
+local MidiBuffer        = require ('kv.MidiBuffer')
+local VoiceAllocator    = require ('kv.VoiceAllocator')
+local midi              = require ('kv.midi')
+local vector            = require ('kv.vector')
+
+TestEnvelopeBank = {
+    testNew = function()
+        local envs = EnvelopeBank.new (4, 48000)
+        luaunit.assertEquals (envs:size(), 4)
+        luaunit.assertEquals (envs:samplerate(), 48000)
+        luaunit.assertEquals (envs:active(), 0)
+        luaunit.assertEquals (envs:stage (1), EnvelopeBank.IDLE)
+    end,
+
+    testStages = function()
+        local envs = EnvelopeBank.new (1, 1000)
+        envs:setadsr (0.01, 0.01, 0.5, 0.01)
+        local a, d, s, r = envs:adsr (1)
+        luaunit.assertEquals (s, 0.5)
+
+        envs:trigger (1)
+        luaunit.assertEquals (envs:stage (1), EnvelopeBank.ATTACK)
+        envs:tick (5)
+        luaunit.assertAlmostEquals (envs:level (1), 0.5, 1e-9)
+        envs:tick (5)
+        luaunit.assertEquals (envs:stage (1), EnvelopeBank.DECAY)
+        envs:tick (20)
+        luaunit.assertEquals (envs:stage (1), EnvelopeBank.SUSTAIN)
+        luaunit.assertEquals (envs:level (1), 0.5)
+
+        envs:release (1)
+        envs:tick (20)
+        luaunit.assertEquals (envs:stage (1), EnvelopeBank.IDLE)
+        luaunit.assertEquals (envs:level (1), 0.0)
+    end,
+
+    testRenderApply = function()
+        local envs = EnvelopeBank.new (2, 1000)
+        envs:setadsr (1, 0.004, 0.0, 1.0, 0.0)
+        envs:trigger (1)
+        local buf = AudioBuffer.new64 (2, 8)
+        envs:render (1, buf, 2)
+        local expected = { 0.25, 0.5, 0.75, 1, 1, 1, 1, 1 }
+        for f = 1, 8 do
+            luaunit.assertAlmostEquals (buf:get (2, f), expected[f], 1e-9)
+        end
+
+        for c = 1, 2 do for f = 1, 8 do buf:set (c, f, 2.0) end end
+        envs:trigger (2, 0.5)
+        envs:setadsr (2, 0.0, 0.0, 1.0, 0.0)
+        envs:apply (2, buf, nil, 3, 4)
+        luaunit.assertEquals (buf:get (1, 2), 2.0)
+        luaunit.assertEquals (buf:get (1, 3), 1.0)
+        luaunit.assertEquals (buf:get (2, 6), 1.0)
+        luaunit.assertEquals (buf:get (2, 7), 2.0)
+    end,
+
+    testScheduleMidi = function()
+        local envs = EnvelopeBank.new (128, 1000)
+        envs:setadsr (0.0, 0.0, 1.0, 0.0)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 127), 5)
+        buf:insert (midi.noteoff (1, 60, 0), 9)
+        luaunit.assertEquals (envs:schedule (buf), 2)
+
+        local audio = AudioBuffer.new64 (1, 16)
+        envs:render (61, audio)
+        for f = 1, 16 do
+            luaunit.assertEquals (audio:get (1, f), (f >= 5 and f < 9) and 1.0 or 0.0)
+        end
+    end,
+
+    testScheduleAllocator = function()
+        local alloc = VoiceAllocator.new (4)
+        local envs = EnvelopeBank.new (alloc:polyphony(), 1000)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 127), 1)
+        buf:insert (midi.noteon (1, 64, 127), 3)
+        alloc:process (buf)
+        luaunit.assertEquals (envs:schedule (alloc), 2)
+        envs:tick (4)
+        luaunit.assertEquals (envs:active(), 2)
+        luaunit.assertTrue (envs:active (2))
+
+        local levels = vector.new()
+        envs:levels (levels)
+        luaunit.assertEquals (#levels, 4)
+        luaunit.assertTrue (levels[1] > levels[2])
+        luaunit.assertEquals (levels[3], 0.0)
+    end,
+
+    tearDown = function()
+        collectgarbage()
+    end
+}
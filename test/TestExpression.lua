@@ -0,0 +1,84 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Expression        = require ('kv.dsp.Expression')
+local dsp               = require ('kv.dsp')
+local vector            = require ('kv.vector')
+
+TestExpression = {
+    testCompile = function()
+        local expr = dsp.compile ("t = a * 2 -- doubled\ny = t + b; z = -t ^ 2")
+        luaunit.assertEquals (expr:inputs(), { "a", "b" })
+        luaunit.assertEquals (expr:outputs(), { "t", "y", "z" })
+        luaunit.assertError (Expression.compile, "y = ")
+        luaunit.assertError (Expression.compile, "y = x +* 2")
+        luaunit.assertError (Expression.compile, "y = nope (x)")
+        luaunit.assertError (Expression.compile, "y = min (x)")
+        luaunit.assertError (Expression.compile, "")
+    end,
+
+    testNesting = function()
+        local ok = Expression.compile ("y = " .. string.rep ("(", 50) .. "x" .. string.rep (")", 50))
+        luaunit.assertEquals (ok:inputs(), { "x" })
+        for _, src in ipairs ({
+            "y = " .. string.rep ("+", 100000) .. "x",
+            "y = " .. string.rep ("- ", 100000) .. "x",
+            "y = " .. string.rep ("(", 100000) .. "x" .. string.rep (")", 100000),
+            "y = " .. string.rep ("sin (", 100000) .. "x" .. string.rep (")", 100000)
+        }) do
+            luaunit.assertErrorMsgContains ("too deeply nested", Expression.compile, src)
+        end
+    end,
+
+    testBuffer = function()
+        for _, new in ipairs ({ AudioBuffer.new32, AudioBuffer.new64 }) do
+            local buffer = new (2, 300)
+            for f = 1, 300 do buffer:set (1, f, f / 300) end
+
+            local expr = Expression.compile ("y = clamp (x * g, -0.5, 0.5) + sin (pi * x) ^ 2")
+            expr:bind ("x", buffer, 1)
+            expr:bind ("y", buffer, 2)
+            expr:bind ("g", 0.75)
+            luaunit.assertEquals (expr:run(), 300)
+            for _, f in ipairs ({ 1, 100, 129, 257, 300 }) do
+                local x = f / 300
+                local y = math.max (-0.5, math.min (0.5, x * 0.75)) + math.sin (math.pi * x) ^ 2
+                luaunit.assertAlmostEquals (buffer:get (2, f), y, 1.0e-5)
+            end
+        end
+    end,
+
+    testRange = function()
+        local a, y = vector.new (8), vector.new (8)
+        for i = 1, 8 do a[i] = i end
+        local expr = Expression.compile ("y = a + 1")
+        expr:bind ("a", a)
+        expr:bind ("y", y)
+        luaunit.assertEquals (expr:run (3, 2), 2)
+        luaunit.assertEquals ({ y[2], y[3], y[4], y[5] }, { 0, 4, 5, 0 })
+        luaunit.assertError (expr.run, expr, 6, 4)
+        luaunit.assertEquals (expr:run (6), 3)
+        luaunit.assertEquals (y[8], 9)
+    end,
+
+    testLocals = function()
+        local x, y = vector.new (4), vector.new (4)
+        for i = 1, 4 do x[i] = i end
+        local expr = Expression.compile ("x = x * 2\ny = max (x, 5) - pow (2, 3)")
+        expr:bind ("x", x)
+        expr:bind ("y", y)
+        expr:run()
+        luaunit.assertEquals ({ x[1], x[2], x[3], x[4] }, { 2, 4, 6, 8 })
+        luaunit.assertEquals ({ y[1], y[2], y[3], y[4] }, { -3, -3, -2, 0 })
+
+        -- unbound inputs read zero
+        expr:bind ("x", nil)
+        expr:run()
+        luaunit.assertEquals (y[1], -3)
+    end,
+
+    testBindErrors = function()
+        local expr = Expression.compile ("y = x")
+        luaunit.assertError (expr.bind, expr, "missing", 1)
+        luaunit.assertError (expr.bind, expr, "x", {})
+        luaunit.assertError (expr.bind, expr, "x", AudioBuffer.new (1, 4), 2)
+    end
+}
@@ -0,0 +1,132 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local FFT               = require ('kv.dsp.FFT')
+local STFT              = require ('kv.dsp.STFT')
+local vector            = require ('kv.vector')
+
+local function sine (nframes, cycles)
+    local buf = AudioBuffer.new64 (1, nframes)
+    for f = 1, nframes do
+        buf:set (1, f, math.sin (2 * math.pi * cycles * (f - 1) / nframes))
+    end
+    return buf
+end
+
+TestFFT = {
+    testNew = function()
+        local fft = FFT (6)
+        luaunit.assertEquals (fft:order(), 6)
+        luaunit.assertEquals (fft:size(), 64)
+        luaunit.assertEquals (fft:bins(), 33)
+        luaunit.assertEquals (fft:window(), FFT.RECTANGULAR)
+        luaunit.assertEquals (FFT.new (4, FFT.HANN):window(), FFT.HANN)
+    end,
+
+    testSinePeak = function()
+        local fft = FFT.new (6)
+        fft:forward (sine (64, 5))
+        local mags = fft:magnitudes()
+        luaunit.assertEquals (#mags, 33)
+        for k = 1, #mags do
+            if k == 6 then
+                luaunit.assertAlmostEquals (mags[k], 32, 1.0e-3)
+            else
+                luaunit.assertAlmostEquals (mags[k], 0, 1.0e-3)
+            end
+        end
+
+        local re, im = fft:bin (6)
+        luaunit.assertAlmostEquals (re, 0, 1.0e-3)
+        luaunit.assertAlmostEquals (im, -32, 1.0e-3)
+        luaunit.assertAlmostEquals (fft:phases()[6], -math.pi / 2, 1.0e-3)
+        luaunit.assertNil (fft:bin (34))
+    end,
+
+    testRoundTrip = function()
+        local fft = FFT.new (5)
+        local input, output = sine (32, 3), AudioBuffer.new32 (1, 32)
+        input:set (1, 7, 0.25)
+        fft:forward (input)
+        fft:inverse (output)
+        for f = 1, 32 do
+            luaunit.assertAlmostEquals (output:get (1, f), input:get (1, f), 1.0e-4)
+        end
+
+        -- bins survive the inverse
+        local vec = fft:inverse()
+        luaunit.assertEquals (#vec, 32)
+        luaunit.assertAlmostEquals (vec[7], input:get (1, 7), 1.0e-4)
+    end,
+
+    testVectorInput = function()
+        local fft = FFT.new (3)
+        fft:forward ({ 1, 1, 1, 1 })
+        local re, im = fft:bin (1)
+        luaunit.assertAlmostEquals (re, 4, 1.0e-5)
+        luaunit.assertAlmostEquals (im, 0, 1.0e-5)
+
+        local vec = vector.new (8)
+        for i = 1, 8 do vec[i] = 0.5 end
+        fft:forward (vec)
+        luaunit.assertAlmostEquals (fft:bin (1), 4, 1.0e-5)
+    end,
+
+    testSetBin = function()
+        local fft = FFT.new (4)
+        fft:forward ({ 0 })
+        fft:setbin (1, 16, 0)
+        local out = fft:inverse()
+        for i = 1, 16 do
+            luaunit.assertAlmostEquals (out[i], 1, 1.0e-5)
+        end
+    end,
+
+    testWindows = function()
+        local vec = FFT.fillwindow (vector.new (8), FFT.HANN)
+        luaunit.assertAlmostEquals (vec[1], 0, 1.0e-6)
+        luaunit.assertAlmostEquals (vec[5], 1, 1.0e-6)
+        luaunit.assertAlmostEquals (vec[3], 0.5, 1.0e-6)
+
+        FFT.fillwindow (vec, FFT.BLACKMAN_HARRIS)
+        luaunit.assertAlmostEquals (vec[1], 0.00006, 1.0e-5)
+        luaunit.assertAlmostEquals (vec[5], 1, 1.0e-5)
+
+        FFT.fillwindow (vec, FFT.RECTANGULAR)
+        for i = 1, 8 do luaunit.assertEquals (vec[i], 1) end
+    end
+}
+
+TestSTFT = {
+    testIdentity = function()
+        local stft = STFT.new (5, 8)
+        luaunit.assertEquals (stft:hop(), 8)
+        luaunit.assertEquals (stft:latency(), 32)
+        luaunit.assertEquals (stft:fft():size(), 32)
+
+        local nframes = 160
+        local input = sine (nframes, 7)
+        local buf = AudioBuffer.new64 (1, nframes)
+        for f = 1, nframes do buf:set (1, f, input:get (1, f)) end
+
+        -- odd block sizes carry state between calls
+        local frames = 0
+        local count = function() frames = frames + 1 end
+        stft:process (buf, 1, 1, 50, count)
+        stft:process (buf, 1, 51, 110, count)
+        luaunit.assertEquals (frames, nframes // 8)
+
+        for f = 64 + 1, nframes do
+            luaunit.assertAlmostEquals (buf:get (1, f), input:get (1, f - 32), 1.0e-4)
+        end
+    end,
+
+    testSilence = function()
+        local stft = STFT.new (4, 4)
+        local buf = sine (64, 2)
+        stft:process (buf, function (fft)
+            for k = 1, fft:bins() do fft:setbin (k, 0, 0) end
+        end)
+        for f = 1, 64 do
+            luaunit.assertEquals (buf:get (1, f), 0)
+        end
+    end
+}
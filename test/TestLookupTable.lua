@@ -0,0 +1,73 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local LookupTable       = require ('kv.dsp.LookupTable')
+local vector            = require ('kv.vector')
+
+local function tanh (x)
+    local e = math.exp (2 * x)
+    return (e - 1) / (e + 1)
+end
+
+TestLookupTable = {
+    testFunction = function()
+        local lut = LookupTable.new (function (x) return tanh (3 * x) end)
+        luaunit.assertEquals (lut:size(), 1024)
+        local lo, hi = lut:range()
+        luaunit.assertEquals (lo, -1)
+        luaunit.assertEquals (hi, 1)
+        for _, x in ipairs ({ -1, -0.37, 0, 0.2, 0.999, 1 }) do
+            luaunit.assertAlmostEquals (lut:eval (x), tanh (3 * x), 1.0e-4)
+            luaunit.assertAlmostEquals (lut (x), tanh (3 * x), 1.0e-4)
+        end
+        -- clamped outside the range
+        luaunit.assertAlmostEquals (lut (5), tanh (3), 1.0e-6)
+    end,
+
+    testPoints = function()
+        local lut = LookupTable.new ({ 0, 10, 0 }, 0, 2)
+        luaunit.assertEquals (lut:size(), 3)
+        luaunit.assertAlmostEquals (lut (0.5), 5, 1.0e-6)
+        luaunit.assertAlmostEquals (lut (1.5), 5, 1.0e-6)
+        lut:setrange (0, 4)
+        luaunit.assertAlmostEquals (lut (1), 5, 1.0e-6)
+
+        local vec = vector.new (2)
+        vec[1], vec[2] = 1, 3
+        luaunit.assertAlmostEquals (LookupTable.new (vec) (0), 2, 1.0e-6)
+    end,
+
+    testCubic = function()
+        local lut = LookupTable.new (function (x) return x * x * x end, -1, 1, 64)
+        luaunit.assertEquals (lut:interpolation(), LookupTable.LINEAR)
+        lut:setinterpolation (LookupTable.CUBIC)
+        luaunit.assertEquals (lut:interpolation(), LookupTable.CUBIC)
+        local x = 0.123
+        luaunit.assertAlmostEquals (lut (x), x * x * x, 1.0e-5)
+        luaunit.assertAlmostEquals (lut (1), 1, 1.0e-6)
+        luaunit.assertAlmostEquals (lut (-1), -1, 1.0e-6)
+    end,
+
+    testApply = function()
+        local lut = LookupTable.new (function (x) return 2 * x end)
+        local buf = AudioBuffer.new32 (2, 8)
+        for c = 1, 2 do
+            for f = 1, 8 do buf:set (c, f, 0.25) end
+        end
+
+        lut:apply (buf, 2, 3, 2)
+        luaunit.assertAlmostEquals (buf:get (2, 2), 0.25, 1.0e-6)
+        luaunit.assertAlmostEquals (buf:get (2, 3), 0.5, 1.0e-6)
+        luaunit.assertAlmostEquals (buf:get (2, 4), 0.5, 1.0e-6)
+        luaunit.assertAlmostEquals (buf:get (2, 5), 0.25, 1.0e-6)
+        luaunit.assertAlmostEquals (buf:get (1, 3), 0.25, 1.0e-6)
+
+        lut:apply (buf)
+        luaunit.assertAlmostEquals (buf:get (1, 1), 0.5, 1.0e-6)
+        luaunit.assertAlmostEquals (buf:get (2, 3), 1.0, 1.0e-6)
+
+        local vec = vector.new (2)
+        vec[1], vec[2] = -0.5, 0.1
+        lut:apply (vec)
+        luaunit.assertAlmostEquals (vec[1], -1.0, 1.0e-6)
+        luaunit.assertAlmostEquals (vec[2], 0.2, 1.0e-6)
+    end
+}
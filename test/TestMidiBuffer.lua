@@ -56,6 +56,24 @@ test_MidiBuffer = {
         luaunit.assertEquals (b2:size(), 1)
     end,
 
+    testShare = function()
+        local writer = MidiBuffer.new()
+        local reader = MidiBuffer.import (writer:share())
+        luaunit.assertEquals (reader:size(), 0)
+
+        writer:addmessage (MidiMessage.new(), 0)
+        writer:publish()
+        writer:clear()
+        writer:addmessage (MidiMessage.new(), 1)
+        writer:addmessage (MidiMessage.new(), 2)
+        writer:publish()
+
+        luaunit.assertTrue (reader:fetch())
+        luaunit.assertEquals (reader:size(), 2)
+        luaunit.assertFalse (reader:fetch())
+        luaunit.assertFalse (MidiBuffer.new():fetch())
+    end,
+
     tearDown = function()
         collectgarbage()
     end
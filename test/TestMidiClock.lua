@@ -0,0 +1,84 @@
+local MidiBuffer            = require ('kv.MidiBuffer')
+local MidiClockGenerator    = require ('kv.MidiClockGenerator')
+local MidiClockFollower     = require ('kv.MidiClockFollower')
+
+TestMidiClock = {
+    testGenerate = function()
+        local clock = MidiClockGenerator.new (48000)
+        local buf = MidiBuffer.new()
+        clock:settempo (120)
+        clock:start()
+
+        -- one quarter note at 120 bpm is 24000 frames
+        for i = 1, 24000 / 500 do
+            buf:clear()
+            clock:process (buf, 500)
+            for msg, frame in buf:messages() do
+                luaunit.assertTrue (frame >= 1 and frame <= 500)
+            end
+        end
+
+        luaunit.assertTrue (clock:running())
+        luaunit.assertAlmostEquals (clock:position(), 1.0, 0.001)
+    end,
+
+    testFollow = function()
+        local clock = MidiClockGenerator.new (44100)
+        local follower = MidiClockFollower.new (44100)
+        local buf = MidiBuffer.new()
+        clock:settempo (133)
+        clock:start()
+
+        for i = 1, 400 do
+            buf:clear()
+            clock:process (buf, 256)
+            follower:process (buf, 256)
+        end
+
+        luaunit.assertTrue (follower:locked())
+        luaunit.assertTrue (follower:running())
+        luaunit.assertAlmostEquals (follower:tempo(), 133.0, 0.1)
+        luaunit.assertAlmostEquals (follower:position(), clock:position(), 1.0 / 24.0)
+
+        clock:stop()
+        buf:clear()
+        clock:process (buf, 256)
+        follower:process (buf, 256)
+        luaunit.assertFalse (follower:running())
+    end,
+
+    testLocate = function()
+        local clock = MidiClockGenerator.new (44100)
+        local follower = MidiClockFollower.new (44100)
+        local buf = MidiBuffer.new()
+        clock:locate (8)
+        clock:process (buf, 128)
+        follower:process (buf, 128)
+        luaunit.assertEquals (buf:size(), 1)
+        luaunit.assertEquals (follower:position(), 8.0)
+    end,
+
+    testTimecode = function()
+        local clock = MidiClockGenerator.new (48000)
+        local follower = MidiClockFollower.new (48000)
+        local buf = MidiBuffer.new()
+        clock:setmtc (25)
+        luaunit.assertEquals (clock:mtc(), 25)
+        clock:start()
+
+        -- two seconds
+        for i = 1, 2 * 48000 / 480 do
+            buf:clear()
+            clock:process (buf, 480)
+            follower:process (buf, 480)
+        end
+
+        local h, m, s, f, t = follower:timecode()
+        luaunit.assertEquals (t, 1)
+        luaunit.assertTrue (s * 25 + f >= 48 and s * 25 + f <= 50)
+    end,
+
+    tearDown = function()
+        collectgarbage()
+    end
+}
@@ -0,0 +1,85 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local OscillatorBank    = require ('kv.dsp.OscillatorBank')
+local vector            = require ('kv.vector')
+
+TestOscillatorBank = {
+    testNew = function()
+        local bank = OscillatorBank.new (8, 48000)
+        luaunit.assertEquals (bank:size(), 8)
+        luaunit.assertEquals (bank:samplerate(), 48000)
+        luaunit.assertEquals (bank:mode(), OscillatorBank.SINE)
+    end,
+
+    testSine = function()
+        local bank = OscillatorBank.new (1, 48000)
+        local buf = AudioBuffer.new64 (1, 480)
+        buf:clear()
+        bank:setfrequency (1, 1000)
+        bank:setgain (1, 0.5)
+        bank:render (buf)
+        for f = 1, 480 do
+            local expected = 0.5 * math.sin (2 * math.pi * 1000 * (f - 1) / 48000)
+            luaunit.assertAlmostEquals (buf:get (1, f), expected, 1e-7)
+        end
+        luaunit.assertAlmostEquals (bank:phase (1), 0.0, 1e-9)
+    end,
+
+    testFrequencies = function()
+        local bank = OscillatorBank.new (3)
+        local freqs = vector.new (3)
+        freqs[1], freqs[2], freqs[3] = 110, 220, 440
+        bank:setfrequency (freqs)
+        luaunit.assertEquals (bank:frequency (2), 220)
+        bank:setfrequency ({ 100, 200 })
+        luaunit.assertEquals (bank:frequency (1), 100)
+        luaunit.assertEquals (bank:frequency (3), 440)
+    end,
+
+    testRange = function()
+        local bank = OscillatorBank.new (2, 44100)
+        bank:setmode (OscillatorBank.SAW)
+        bank:setfrequency ({ 440, 660 })
+        bank:setgain ({ 0.25, 0.25 })
+        local buf = AudioBuffer.new32 (2, 256)
+        buf:clear()
+        bank:render (buf, 2, 65, 64)
+        luaunit.assertEquals (buf:get (2, 64), 0.0)
+        luaunit.assertEquals (buf:get (2, 129), 0.0)
+        luaunit.assertEquals (buf:get (1, 100), 0.0)
+        luaunit.assertNotEquals (buf:get (2, 100), 0.0)
+    end,
+
+    testBandLimited = function()
+        for _, mode in ipairs ({ OscillatorBank.SAW, OscillatorBank.SQUARE }) do
+            local bank = OscillatorBank.new (1, 44100)
+            bank:setmode (mode)
+            bank:setfrequency (1, 1234.5)
+            bank:setgain (1, 1.0)
+            local buf = AudioBuffer.new64 (1, 4096)
+            buf:clear()
+            bank:render (buf)
+            for f = 1, 4096 do
+                luaunit.assertTrue (math.abs (buf:get (1, f)) <= 1.1)
+            end
+        end
+    end,
+
+    testWavetable = function()
+        local bank = OscillatorBank.new (1, 8)
+        bank:setmode (OscillatorBank.WAVETABLE)
+        bank:setwavetable ({ 0, 1, 0, -1 })
+        bank:setfrequency (1, 1)
+        bank:setgain (1, 1)
+        local buf = AudioBuffer.new64 (1, 8)
+        buf:clear()
+        bank:render (buf)
+        local expected = { 0, 0.5, 1, 0.5, 0, -0.5, -1, -0.5 }
+        for f = 1, 8 do
+            luaunit.assertAlmostEquals (buf:get (1, f), expected[f], 1e-9)
+        end
+    end,
+
+    tearDown = function()
+        collectgarbage()
+    end
+}
@@ -0,0 +1,84 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Oversampler       = require ('kv.dsp.Oversampler')
+local vector            = require ('kv.vector')
+
+local function ramp (nchans, nframes)
+    local buf = AudioBuffer.new64 (nchans, nframes)
+    for c = 1, nchans do
+        for f = 1, nframes do
+            buf:set (c, f, math.sin (2 * math.pi * f / nframes) * 0.5)
+        end
+    end
+    return buf
+end
+
+TestOversampler = {
+    testNew = function()
+        local os = Oversampler.new (2, 4, 256)
+        luaunit.assertEquals (os:channels(), 2)
+        luaunit.assertEquals (os:factor(), 4)
+        luaunit.assertEquals (os:maxblock(), 256)
+        luaunit.assertEquals (os:filter(), Oversampler.IIR)
+        luaunit.assertEquals (Oversampler.new (1, 8, 64, Oversampler.FIR):filter(), Oversampler.FIR)
+        luaunit.assertTrue (os:latency() >= 0)
+        luaunit.assertTrue (os:view():isfloat())
+    end,
+
+    testViewShare = function()
+        local os = Oversampler.new (2, 4, 64)
+        local view = os:view()
+        luaunit.assertErrorMsgContains ("can't be shared", view.share, view)
+        view = nil
+        collectgarbage()
+        luaunit.assertTrue (os:view():isfloat())
+    end,
+
+    testView = function()
+        local os = Oversampler.new (2, 4, 64)
+        local buf = ramp (2, 100)
+        local calls, lengths = 0, {}
+        os:process (buf, function (view)
+            calls = calls + 1
+            lengths[calls] = view:length()
+            luaunit.assertEquals (view, os:view())
+            luaunit.assertEquals (view:channels(), 2)
+        end)
+        -- split at the maximum block
+        luaunit.assertEquals (calls, 2)
+        luaunit.assertEquals (lengths, { 256, 144 })
+    end,
+
+    testScriptGain = function()
+        for _, new in ipairs ({ AudioBuffer.new32, AudioBuffer.new64 }) do
+            local os = Oversampler.new (1, 2, 512)
+            local buf = new (1, 512)
+            buf:clear()
+            os:process (buf, function (view)
+                for f = 1, view:length() do view:set (1, f, 0.25) end
+            end)
+            luaunit.assertAlmostEquals (buf:get (1, 512), 0.25, 1.0e-3)
+        end
+    end,
+
+    testShaper = function()
+        local os = Oversampler.new (1, 2, 512)
+        os:setshaper ({ -0.5, 0.5 })
+        local buf = AudioBuffer.new64 (1, 512)
+        for f = 1, 512 do buf:set (1, f, 1.0) end
+        os:process (buf)
+        luaunit.assertAlmostEquals (buf:get (1, 512), 0.5, 1.0e-3)
+
+        -- identity curve from a vector
+        local curve = vector.new (3)
+        curve[1], curve[2], curve[3] = -1, 0, 1
+        os:setshaper (curve)
+        os:reset()
+        for f = 1, 512 do buf:set (1, f, 0.3) end
+        os:process (buf, 1, 512)
+        luaunit.assertAlmostEquals (buf:get (1, 512), 0.3, 1.0e-3)
+
+        os:setshaper (nil)
+        os:process (buf)
+        luaunit.assertAlmostEquals (buf:get (1, 512), 0.3, 1.0e-3)
+    end
+}
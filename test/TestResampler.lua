@@ -0,0 +1,90 @@
+local AudioBuffer       = require ('kv.AudioBuffer')
+local Resampler         = require ('kv.dsp.Resampler')
+
+local function sine (nchans, nframes, hz, rate)
+    local buf = AudioBuffer.new64 (nchans, nframes)
+    for c = 1, nchans do
+        for f = 1, nframes do
+            buf:set (c, f, math.sin (2 * math.pi * hz * (f - 1) / rate + c))
+        end
+    end
+    return buf
+end
+
+TestResampler = {
+    testNew = function()
+        local rs = Resampler.new (2)
+        luaunit.assertEquals (rs:channels(), 2)
+        luaunit.assertEquals (rs:quality(), Resampler.SINC)
+        luaunit.assertEquals (rs:ratio(), 1.0)
+        luaunit.assertEquals (rs:latency(), 16)
+        rs:setquality (Resampler.LAGRANGE)
+        luaunit.assertEquals (rs:latency(), 2)
+        rs:setrates (48000, 96000)
+        luaunit.assertAlmostEquals (rs:ratio(), 2.0, 1.0e-12)
+    end,
+
+    testLagrangeUnity = function()
+        local rs = Resampler.new (1, Resampler.LAGRANGE)
+        local input, output = sine (1, 64, 1000, 44100), AudioBuffer.new64 (1, 64)
+        local used, made = rs:process (input, output)
+        luaunit.assertEquals (used, 64)
+        luaunit.assertEquals (made, 64)
+        for f = 3, 64 do
+            luaunit.assertAlmostEquals (output:get (1, f), input:get (1, f - 2), 1.0e-6)
+        end
+    end,
+
+    testConvert = function()
+        for _, q in ipairs ({ Resampler.LAGRANGE, Resampler.SINC, Resampler.SINC_BEST }) do
+            local rs = Resampler.new (2, q)
+            rs:setrates (44100, 48000)
+            local input  = sine (2, 441, 1000, 44100)
+            local output = AudioBuffer.new32 (2, 1024)
+            local used, made = rs:process (input, output)
+            luaunit.assertEquals (used, 441)
+            luaunit.assertAlmostEquals (made, 480, 1)
+
+            local step, lat = 44100 / 48000, rs:latency()
+            for c = 1, 2 do
+                for m = 100, made - 1, 7 do
+                    local t = m * step - lat
+                    local want = math.sin (2 * math.pi * 1000 * t / 44100 + c)
+                    luaunit.assertAlmostEquals (output:get (c, m + 1), want, 2.0e-3)
+                end
+            end
+        end
+    end,
+
+    testStreaming = function()
+        local input = sine (1, 500, 3000, 96000)
+        local whole, parts = AudioBuffer.new64 (1, 300), AudioBuffer.new64 (1, 300)
+
+        local rs = Resampler.new (1, Resampler.SINC)
+        rs:setratio (0.5)
+        local used, made = rs:process (input, whole)
+        luaunit.assertEquals (made, 250)
+        luaunit.assertEquals (used, 500)
+
+        rs:reset()
+        local pos, out = 1, 1
+        for _, n in ipairs ({ 1, 33, 100, 7, 359 }) do
+            local u, m = rs:process (input, parts, pos, n, out)
+            luaunit.assertEquals (u, n)
+            pos, out = pos + u, out + m
+        end
+        luaunit.assertEquals (out - 1, 250)
+        for f = 1, 250 do
+            luaunit.assertEquals (parts:get (1, f), whole:get (1, f))
+        end
+    end,
+
+    testOutputLimited = function()
+        local rs = Resampler.new (1, Resampler.SINC)
+        rs:setratio (2)
+        local input, output = sine (1, 100, 100, 48000), AudioBuffer.new64 (1, 50)
+        local used, made = rs:process (input, output)
+        luaunit.assertEquals (made, 50)
+        luaunit.assertEquals (used, 25)
+    end
+}
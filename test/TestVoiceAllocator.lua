@@ -0,0 +1,110 @@
+local MidiBuffer        = require ('kv.MidiBuffer')
+local VoiceAllocator    = require ('kv.VoiceAllocator')
+local midi              = require ('kv.midi')
+
+TestVoiceAllocator = {
+    testNew = function()
+        local alloc = VoiceAllocator.new (8)
+        luaunit.assertEquals (alloc:polyphony(), 8)
+        luaunit.assertEquals (alloc:policy(), VoiceAllocator.OLDEST)
+        luaunit.assertEquals (alloc:size(), 0)
+        luaunit.assertEquals (alloc:sounding(), 0)
+    end,
+
+    testStartStop = function()
+        local alloc = VoiceAllocator.new (4)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 100), 10)
+        buf:insert (midi.noteon (1, 64, 90), 20)
+        luaunit.assertEquals (alloc:process (buf), 2)
+
+        local cmd, voice, note, velocity, frame, channel = alloc:command (1)
+        luaunit.assertEquals (cmd, VoiceAllocator.START)
+        luaunit.assertEquals (voice, 1)
+        luaunit.assertEquals (note, 60)
+        luaunit.assertEquals (velocity, 100)
+        luaunit.assertEquals (frame, 10)
+        luaunit.assertEquals (channel, 1)
+        luaunit.assertEquals (alloc:sounding(), 2)
+
+        buf:clear()
+        buf:insert (midi.noteoff (1, 60, 0), 5)
+        luaunit.assertEquals (alloc:process (buf), 1)
+        cmd, voice = alloc:command (1)
+        luaunit.assertEquals (cmd, VoiceAllocator.STOP)
+        luaunit.assertEquals (voice, 1)
+        luaunit.assertFalse (alloc:sounding (1))
+        luaunit.assertTrue (alloc:sounding (2))
+        luaunit.assertNil (alloc:command (2))
+    end,
+
+    testSteal = function()
+        local alloc = VoiceAllocator.new (2)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 100), 1)
+        buf:insert (midi.noteon (1, 48, 50), 2)
+        buf:insert (midi.noteon (1, 72, 80), 3)
+        alloc:process (buf)
+
+        local types = {}
+        for i, cmd, voice, note in alloc:commands() do
+            types[i] = cmd
+        end
+        luaunit.assertEquals (types, { VoiceAllocator.START, VoiceAllocator.START,
+                                       VoiceAllocator.STEAL, VoiceAllocator.START })
+        luaunit.assertEquals (alloc:note (1), 72)
+        luaunit.assertEquals (alloc:note (2), 48)
+
+        alloc:reset()
+        alloc:setpolicy (VoiceAllocator.LOWEST)
+        alloc:process (buf)
+        luaunit.assertEquals (alloc:note (1), 60)
+        luaunit.assertEquals (alloc:note (2), 72)
+    end,
+
+    testSustain = function()
+        local alloc = VoiceAllocator.new (4)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 100), 1)
+        buf:insert (midi.controller (1, 64, 127), 2)
+        buf:insert (midi.noteoff (1, 60, 0), 3)
+        luaunit.assertEquals (alloc:process (buf), 1)
+        luaunit.assertTrue (alloc:sounding (1))
+
+        buf:clear()
+        buf:insert (midi.controller (1, 64, 0), 7)
+        luaunit.assertEquals (alloc:process (buf), 1)
+        local cmd, voice, _, _, frame = alloc:command (1)
+        luaunit.assertEquals (cmd, VoiceAllocator.STOP)
+        luaunit.assertEquals (frame, 7)
+        luaunit.assertEquals (alloc:sounding(), 0)
+    end,
+
+    testSostenuto = function()
+        local alloc = VoiceAllocator.new (4)
+        local buf = MidiBuffer.new()
+        buf:insert (midi.noteon (1, 60, 100), 1)
+        buf:insert (midi.controller (1, 66, 127), 2)
+        buf:insert (midi.noteon (1, 64, 100), 3)
+        buf:insert (midi.noteoff (1, 60, 0), 4)
+        buf:insert (midi.noteoff (1, 64, 0), 5)
+        alloc:process (buf)
+        luaunit.assertTrue (alloc:sounding (1))
+        luaunit.assertFalse (alloc:sounding (2))
+
+        buf:clear()
+        buf:insert (midi.controller (1, 66, 0), 1)
+        alloc:process (buf)
+        luaunit.assertEquals (alloc:sounding(), 0)
+    end,
+
+    testReleaseAll = function()
+        local alloc = VoiceAllocator.new()
+        local buf = MidiBuffer.new()
+        for n = 60, 63 do buf:insert (midi.noteon (1, n, 100), 1) end
+        alloc:process (buf)
+        alloc:releaseall (32)
+        luaunit.assertEquals (alloc:size(), 8)
+        luaunit.assertEquals (alloc:sounding(), 0)
+    end
+}
@@ -7,11 +7,26 @@ local tests = {
     'test_bytes',
     'test_midi',
     'test_object',
+    'test_profile',
+    'test_rt',
     'TestAudioBuffer',
     'TestBounds',
+    'TestConvolver',
+    'TestDelayLine',
+    'TestDisplayList',
+    'TestEngine',
+    'TestEnvelopeBank',
+    'TestExpression',
+    'TestFFT',
+    'TestLookupTable',
     'TestMidiBuffer',
+    'TestMidiClock',
     'TestMidiMessage',
-    'TestPoint'
+    'TestOscillatorBank',
+    'TestOversampler',
+    'TestPoint',
+    'TestResampler',
+    'TestVoiceAllocator'
 }
 for _,t in ipairs (tests) do 
     require (t)
@@ -23,3 +23,35 @@ function test_midi_noteoff()
                 midi.noteoff (channel, 55, 127))
     end
 end
+
+function test_midi_clamp()
+    equals (midi.clamp (-1), 0)
+    equals (midi.clamp (64), 64)
+    equals (midi.clamp (128), 127)
+end
+
+function test_midi_tohertz()
+    local vector = require ('kv.vector')
+    luaunit.assertAlmostEquals (midi.tohertz (69), 440.0, 0.0001)
+    luaunit.assertAlmostEquals (midi.tohertz (57), 220.0, 0.0001)
+    luaunit.assertAlmostEquals (midi.tohertz (60.5), 440 * 2 ^ ((60.5 - 69) / 12), 0.001)
+    luaunit.assertAlmostEquals (midi.tohertz (67, 8192 + 4096, 4), 440.0, 0.0001)
+
+    local notes, freqs = vector.new (128), vector.new()
+    for i = 1, #notes do notes[i] = i - 1 end
+    midi.tohertz (notes, freqs)
+    equals (#freqs, 128)
+    for i = 1, #notes do
+        luaunit.assertAlmostEquals (freqs[i], 440 * 2 ^ ((notes[i] - 69) / 12), 0.0001)
+    end
+end
+
+function test_midi_tuning()
+    midi.settuning ({ 0, 0, 0, 0, 0, 0, 0, 0, 0, -100, 0, 0 })
+    luaunit.assertAlmostEquals (midi.tohertz (69), midi.tohertz (68), 0.0001)
+    midi.setreference (432)
+    luaunit.assertAlmostEquals (midi.tohertz (69), 432.0, 0.0001)
+    luaunit.assertAlmostEquals (midi.tonote (432), 69.0, 0.0001)
+    midi.setreference()
+    equals (midi.reference(), 440.0)
+end
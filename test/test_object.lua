@@ -65,6 +65,83 @@ assert (br:get() == 100)
 br:set (200)
 assert (br:get() == 200)
 
+-- every instance of a plain type shares one metatable
+assert (getmetatable (object.new (Bare)) == getmetatable (br))
+br.extra = 1
+assert (rawget (br, "extra") == 1)
+
+-- a type backed by userdata
+local AudioBuffer = require ('kv.AudioBuffer')
+local Buffer = object.define()
+local Buffer_mt = getmetatable (Buffer)
+Buffer_mt.__newuserdata = function() return AudioBuffer.new (2, 64) end
+Buffer_mt.__methods = { "channels", "length" }
+Buffer_mt.__props = { "clear" }
+
+local Track = object (Buffer, {
+    frames = { get = function (self) return self:length() end },
+    label  = {
+        get = function (self) return self._label end,
+        set = function (self, v) self._label = v end
+    }
+})
+function Track:init (label) self.label = label end
+function Track:length() return 32 end
+
+local track = object.new (Track, "drums")
+assert (type (getmetatable (track).__impl) == 'userdata')
+luaunit.assertEquals (track.label, "drums")
+luaunit.assertEquals (track:channels(), 2)
+-- the derived type's fields come before the userdata's methods
+luaunit.assertEquals (track:length(), 32)
+luaunit.assertEquals (track.frames, 32)
+luaunit.assertEquals (type (track.clear), 'function')
+luaunit.assertError (function() track.frames = 1 end)
+track.notes = "none"
+luaunit.assertEquals (rawget (track, "notes"), "none")
+luaunit.assertNotEquals (getmetatable (object.new (Track)), getmetatable (track))
+
+-- functions set on an instance can be replaced and removed
+track.clicked = function() return 1 end
+luaunit.assertEquals (track:clicked(), 1)
+track.clicked = function() return 2 end
+luaunit.assertEquals (track:clicked(), 2)
+track.clicked = nil
+luaunit.assertNil (track.clicked)
+luaunit.assertEquals (track:channels(), 2)
+
+-- a function can replace a value set before it, and the other way round
+track.pressed = false
+track.pressed = function() return 3 end
+luaunit.assertEquals (track:pressed(), 3)
+track.pressed = 4
+luaunit.assertEquals (track.pressed, 4)
+
+-- changing a type updates instances that already exist
+function Track:channels() return 99 end
+luaunit.assertEquals (track:channels(), 99)
+Track.channels = nil
+luaunit.assertEquals (track:channels(), 2)
+function Animal:size() return "any" end
+luaunit.assertEquals (obj:size(), "any")
+luaunit.assertEquals (dog:size(), "varies")
+
+-- attributes need the type finalized again
+getmetatable (Track).__atts.kind = { get = function() return "audio" end }
+luaunit.assertNil (track.kind)
+luaunit.assertIs (object.finalize (Track), Track)
+luaunit.assertEquals (track.kind, "audio")
+luaunit.assertEquals (object.new (Track).kind, "audio")
+
+local names = {}
+for k in pairs (BlackLab) do names[k] = true end
+assert (names.init and names.size)
+
+local buf = object.new (Buffer)
+luaunit.assertEquals (buf:length(), 64)
+luaunit.assertEquals (object.ref (Buffer, AudioBuffer.new (1, 8)):length(), 8)
+luaunit.assertError (object.ref, Buffer, {})
+
 end
 
 return test_object
@@ -0,0 +1,86 @@
+local profile       = require ('kv.profile')
+
+local equals        = luaunit.assertEquals
+
+local function spin (n)
+    local x = 0
+    for i = 1, n do x = x + math.sin (i) end
+    return x
+end
+
+function test_profile_zones()
+    profile.reset()
+    for _ = 1, 50 do
+        profile.begin ("outer")
+        profile.begin ("inner")
+        spin (200)
+        profile.finish ("inner")
+        spin (200)
+        profile.finish()
+    end
+
+    local zones = profile.report().zones
+    equals (#zones, 2)
+    equals (zones[1].name, "outer")
+    equals (zones[2].name, "inner")
+    for _, z in ipairs (zones) do
+        equals (z.count, 50)
+        luaunit.assertTrue (z.total > 0)
+        luaunit.assertTrue (z.p50 <= z.p99)
+        luaunit.assertTrue (z.p99 <= z.max)
+        luaunit.assertAlmostEquals (z.mean, z.total / 50, 1.0e-9)
+    end
+    luaunit.assertTrue (zones[1].total > zones[2].total)
+end
+
+function test_profile_errors()
+    luaunit.assertError (profile.finish)
+    profile.begin ("a")
+    luaunit.assertError (profile.finish, "b")
+    profile.finish ("a")
+end
+
+function test_profile_now()
+    local t0 = profile.now()
+    spin (1000)
+    luaunit.assertTrue (profile.now() > t0)
+end
+
+function test_profile_trace()
+    profile.reset()
+    equals (profile.trace (true), false)
+    for _ = 1, 3 do
+        profile.begin ("block \"one\"")
+        profile.finish()
+    end
+    equals (profile.trace (false), true)
+    local json = profile.tojson()
+    local _, n = json:gsub ('"ph":"X"', '')
+    equals (n, 3)
+    luaunit.assertStrContains (json, '"name":"block \\"one\\""')
+
+    local path = os.tmpname()
+    luaunit.assertTrue (profile.dump (path))
+    local f = io.open (path)
+    equals (f:read ('a'), json)
+    f:close()
+    os.remove (path)
+end
+
+function test_profile_sampling()
+    profile.reset()
+    profile.start (100)
+    spin (20000)
+    profile.stop()
+    local report = profile.report()
+    luaunit.assertTrue (report.nsamples > 0)
+    equals (report.dropped, 0)
+    local top = report.samples[1]
+    luaunit.assertStrContains (top.source, 'test_profile.lua')
+    luaunit.assertTrue (top.count > 0)
+
+    -- stopped sampler records nothing
+    local count = report.nsamples
+    spin (20000)
+    equals (profile.report().nsamples, count)
+end
@@ -0,0 +1,118 @@
+local rt            = require ('kv.rt')
+
+local equals        = luaunit.assertEquals
+
+local function litter (n)
+    for i = 1, n do local t = { i, tostring (i) } end
+end
+
+function test_rt_setgc()
+    equals (rt.gcmode(), 'incremental')
+    equals (rt.setgc ('manual'), 'incremental')
+    equals (rt.gcmode(), 'manual')
+    equals (collectgarbage ('isrunning'), false)
+    equals (rt.setgc ('generational'), 'manual')
+    equals (collectgarbage ('isrunning'), true)
+    rt.setgc ('incremental')
+    luaunit.assertError (rt.setgc, 'sometimes')
+end
+
+function test_rt_idle()
+    rt.setgc ('manual')
+    rt.resetstats()
+    collectgarbage ('collect')
+    litter (20000)
+    local reclaimed = 0
+    for _ = 1, 1000 do
+        local time, bytes = rt.idle (1000, 64)
+        luaunit.assertTrue (time >= 0)
+        reclaimed = reclaimed + bytes
+        if rt.stats().cycles > 0 then break end
+    end
+    luaunit.assertTrue (reclaimed > 0)
+
+    local stats = rt.stats()
+    equals (stats.totalreclaimed, reclaimed)
+    luaunit.assertTrue (stats.blocks > 0)
+    luaunit.assertTrue (stats.cycles > 0)
+    equals (rt.stats (stats), stats)
+
+    equals ({ rt.idle (0) }, { 0, 0 })
+    rt.resetstats()
+    equals (rt.stats().blocks, 0)
+    rt.setgc ('incremental')
+end
+
+function test_rt_wrap()
+    rt.setgc ('manual')
+    rt.resetstats()
+    local process = rt.wrap (function (a, b)
+        litter (100)
+        return a + b, 'ok'
+    end, 100)
+    local sum, status = process (2, 3)
+    equals (sum, 5)
+    equals (status, 'ok')
+    equals (rt.stats().blocks, 1)
+    rt.setgc ('incremental')
+end
+
+function test_rt_guard()
+    rt.resetguard()
+    local process = rt.guard (function (n)
+        local t = {}
+        for i = 1, n do t[i] = { i } end
+        return #t
+    end, 1.0e9)
+    equals (process (100), 100)
+
+    local stats = rt.guardstats()
+    equals (stats.blocks, 1)
+    luaunit.assertTrue (stats.allocs >= 100)
+    equals (stats.lastallocs, stats.allocs)
+    equals (stats.blocking, 0)
+    equals (stats.overruns, 0)
+    equals (stats.lastoverrun, false)
+    luaunit.assertNil (stats.blockingname)
+
+    -- nothing is counted outside the guarded call
+    local t = {}
+    for i = 1, 100 do t[i] = { i } end
+    equals (rt.guardstats().allocs, stats.allocs)
+    rt.resetguard()
+    equals (rt.guardstats().blocks, 0)
+end
+
+function test_rt_guard_blocking()
+    rt.resetguard()
+    local process = rt.guard (function()
+        local x = 0
+        for i = 1, 3 do x = x + math.abs (-i) end
+        io.type (x)
+        return x
+    end, 0)
+    equals (process(), 6)
+
+    local stats = rt.guardstats()
+    equals (stats.blocking, 1)
+    equals (stats.blockingname, 'io.type')
+    equals (stats.overruns, 1)
+    equals (stats.lastoverrun, true)
+
+    local native = math.floor
+    rt.block (native, 'math.floor')
+    process = rt.guard (function (x) return native (x) end, 1.0e9)
+    equals (process (1.5), 1)
+    equals (rt.guardstats().lastblocking, 1)
+    rt.resetguard()
+end
+
+function test_rt_guard_error()
+    local failing = rt.guard (function() error ('failed') end, 1.0e9)
+    luaunit.assertErrorMsgContains ('failed', failing)
+    -- allocator and hooks are restored after an error
+    equals (debug.gethook(), nil)
+    local ok = pcall (failing)
+    equals (ok, false)
+    equals (rt.guardstats().lastallocs >= 0, true)
+end